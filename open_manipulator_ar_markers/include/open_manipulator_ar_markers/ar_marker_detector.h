@@ -0,0 +1,116 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+
+#ifndef OPEN_MANIPULATOR_AR_MARKERS_AR_MARKER_DETECTOR_H
+#define OPEN_MANIPULATOR_AR_MARKERS_AR_MARKER_DETECTOR_H
+
+#include <ros/ros.h>
+#include <boost/shared_ptr.hpp>
+#include <tf2_ros/buffer.h>
+#include <tf2_ros/transform_listener.h>
+
+#include "sensor_msgs/CompressedImage.h"
+#include "sensor_msgs/CameraInfo.h"
+#include "std_msgs/UInt8.h"
+#include "ar_track_alvar_msgs/AlvarMarkers.h"
+
+#include "open_manipulator_ar_markers/detection_gate.h"
+#include "open_manipulator_ar_markers/marker_dictionary.h"
+#include "open_manipulator_ar_markers/marker_detector.h"
+#include "open_manipulator_ar_markers/marker_pose_estimator.h"
+#include "open_manipulator_ar_markers/marker_tracker.h"
+
+namespace open_manipulator_ar_markers
+{
+
+typedef struct _RunningTime
+{
+  double sum;
+  double max;
+
+  _RunningTime() : sum(0.0), max(0.0) {}
+  void add(double value)
+  {
+    sum += value;
+    if (value > max) max = value;
+  }
+} RunningTime;
+
+// Decodes the compressed camera stream, detects markers and publishes their
+// poses as ar_track_alvar_msgs/AlvarMarkers, replacing republish + ar_track_alvar.
+class ArMarkerDetector
+{
+ private:
+  // ROS NodeHandle
+  ros::NodeHandle node_handle_;
+  ros::NodeHandle priv_node_handle_;
+
+  ros::Subscriber compressed_image_sub_;
+  ros::Subscriber camera_info_sub_;
+  ros::Subscriber perception_demand_sub_;
+  ros::Publisher ar_pose_marker_pub_;
+
+  boost::shared_ptr<tf2_ros::Buffer> tf_buffer_;
+  boost::shared_ptr<tf2_ros::TransformListener> tf_listener_;
+
+  std::string output_frame_;
+  std::string camera_frame_;
+  int statistics_period_;
+  bool use_tracking_;
+
+  MarkerDictionary dictionary_;
+  MarkerDetector detector_;
+  MarkerTracker tracker_;
+  DetectionGate gate_;
+  MarkerPoseEstimator pose_estimator_;
+
+  cv::Mat gray_;
+  std::vector<MarkerDetection> detections_;
+  std::vector<MarkerPose> poses_;
+
+  // Per frame cost [s], reported every statistics_period_ frames
+  uint32_t num_of_frame_;
+  uint32_t num_of_marker_;
+  uint32_t num_of_full_scan_;
+  RunningTime decode_time_;
+  RunningTime detect_time_;
+  RunningTime pose_time_;
+  RunningTime cpu_time_;
+  RunningTime latency_;
+
+ public:
+  ArMarkerDetector(ros::NodeHandle node_handle, ros::NodeHandle priv_node_handle);
+
+  void initCameraModel();
+  void initSubscribe();
+  void initPublisher();
+
+  void compressedImageCallback(const sensor_msgs::CompressedImage::ConstPtr &msg);
+  void cameraInfoCallback(const sensor_msgs::CameraInfo::ConstPtr &msg);
+  void perceptionDemandCallback(const std_msgs::UInt8::ConstPtr &msg);
+
+  static MarkerDetectorParams loadDetectorParams(const ros::NodeHandle &priv_node_handle);
+  static MarkerTrackerParams loadTrackerParams(const ros::NodeHandle &priv_node_handle);
+
+ private:
+  void setCameraModel(const sensor_msgs::CameraInfo &camera_info);
+  void reportStatistics();
+};
+
+}  // namespace open_manipulator_ar_markers
+
+#endif  // OPEN_MANIPULATOR_AR_MARKERS_AR_MARKER_DETECTOR_H
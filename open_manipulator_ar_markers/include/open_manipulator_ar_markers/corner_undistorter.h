@@ -0,0 +1,68 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+
+#ifndef OPEN_MANIPULATOR_AR_MARKERS_CORNER_UNDISTORTER_H
+#define OPEN_MANIPULATOR_AR_MARKERS_CORNER_UNDISTORTER_H
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+namespace open_manipulator_ar_markers
+{
+
+// Removes plumb_bob lens distortion from sparse image points (marker corners)
+// instead of rectifying whole frames. The inverse distortion is sampled once
+// on a coarse pixel grid and bilinearly interpolated per point.
+class CornerUndistorter
+{
+ public:
+  static const int DEFAULT_GRID_STEP = 8;  // [pixel]
+  static const int NUM_OF_ITERATION = 20;  // fixed point iterations of the exact inversion
+
+  CornerUndistorter();
+
+  // camera_matrix is the row major 3x3 K and distortion the plumb_bob D
+  // (k1, k2, p1, p2[, k3]) of a sensor_msgs/CameraInfo.
+  void init(const double camera_matrix[9], const std::vector<double> &distortion,
+            int image_width, int image_height, int grid_step = DEFAULT_GRID_STEP);
+
+  bool isReady() const { return !table_.empty(); }
+
+  // Distorted pixels to ideal (distortion free) pixels of the same camera
+  // matrix, like cv::undistortPoints(..., K, D, noArray(), K). Points may be
+  // undistorted in place.
+  void undistort(const cv::Point2f *distorted, cv::Point2f *ideal, size_t num_of_point) const;
+
+  // Reference inversion used to build the table and for points off the table
+  cv::Point2f undistortExact(const cv::Point2f &distorted) const;
+
+  size_t tableBytes() const { return table_.size() * sizeof(float); }
+
+ private:
+  double fx_, fy_, cx_, cy_;
+  double k1_, k2_, p1_, p2_, k3_;
+
+  int grid_step_;
+  int grid_cols_;
+  int grid_rows_;
+  float inverse_step_;
+  std::vector<float> table_;  // ideal (x, y) per grid node, row major
+};
+
+}  // namespace open_manipulator_ar_markers
+
+#endif  // OPEN_MANIPULATOR_AR_MARKERS_CORNER_UNDISTORTER_H
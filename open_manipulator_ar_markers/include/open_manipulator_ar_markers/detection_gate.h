@@ -0,0 +1,100 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+
+#ifndef OPEN_MANIPULATOR_AR_MARKERS_DETECTION_GATE_H
+#define OPEN_MANIPULATOR_AR_MARKERS_DETECTION_GATE_H
+
+#include <ros/ros.h>
+
+// Values of std_msgs/UInt8 perception_demand, published by the pick and place nodes
+#define PERCEPTION_DEMAND_NONE  0  // marker poses are not used, skip every frame
+#define PERCEPTION_DEMAND_LOW   1  // monitoring only, a few frames per second
+#define PERCEPTION_DEMAND_FULL  2  // marker acquisition, every frame
+
+namespace open_manipulator_ar_markers
+{
+
+// Decides which camera frames are worth detecting markers in. Until a demand
+// is received every frame passes, so the detector works without the nodes.
+class DetectionGate
+{
+ public:
+  explicit DetectionGate(double low_rate = 2.0)
+  : demand_(PERCEPTION_DEMAND_FULL),
+    low_rate_period_(low_rate > 0.0 ? 1.0 / low_rate : 0.0),
+    num_of_pass_(0),
+    num_of_drop_(0)
+  {}
+
+  // Returns true when the demand changed
+  bool setDemand(uint8_t demand)
+  {
+    if (demand > PERCEPTION_DEMAND_FULL) demand = PERCEPTION_DEMAND_FULL;
+    if (demand == demand_) return false;
+
+    demand_ = demand;
+    last_pass_ = ros::Time();
+    return true;
+  }
+
+  uint8_t demand() const { return demand_; }
+
+  bool pass(const ros::Time &stamp)
+  {
+    bool pass = false;
+    if (demand_ == PERCEPTION_DEMAND_FULL)
+    {
+      pass = true;
+    }
+    else if (demand_ == PERCEPTION_DEMAND_LOW)
+    {
+      // A stamp going backwards (bag restart, sim time reset) opens the gate again
+      pass = last_pass_.isZero() || stamp < last_pass_ || (stamp - last_pass_).toSec() >= low_rate_period_;
+      if (pass) last_pass_ = stamp;
+    }
+
+    if (pass) num_of_pass_++;
+    else num_of_drop_++;
+    return pass;
+  }
+
+  uint32_t numOfPass() const { return num_of_pass_; }
+  uint32_t numOfDrop() const { return num_of_drop_; }
+  void resetCount() { num_of_pass_ = num_of_drop_ = 0; }
+
+  static const char *demandName(uint8_t demand)
+  {
+    switch (demand)
+    {
+      case PERCEPTION_DEMAND_NONE: return "none";
+      case PERCEPTION_DEMAND_LOW:  return "low";
+      default:                     return "full";
+    }
+  }
+
+ private:
+  uint8_t demand_;
+  double low_rate_period_;  // [s]
+  ros::Time last_pass_;
+
+  uint32_t num_of_pass_;
+  uint32_t num_of_drop_;
+};
+
+}  // namespace open_manipulator_ar_markers
+
+#endif  // OPEN_MANIPULATOR_AR_MARKERS_DETECTION_GATE_H
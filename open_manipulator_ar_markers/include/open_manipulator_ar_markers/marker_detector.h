@@ -0,0 +1,93 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+
+#ifndef OPEN_MANIPULATOR_AR_MARKERS_MARKER_DETECTOR_H
+#define OPEN_MANIPULATOR_AR_MARKERS_MARKER_DETECTOR_H
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "open_manipulator_ar_markers/marker_dictionary.h"
+
+namespace open_manipulator_ar_markers
+{
+
+typedef struct _MarkerDetection
+{
+  int id;
+  int num_of_error;
+  cv::Point2f corners[4];  // clockwise from the marker's top left corner [pixel]
+} MarkerDetection;
+
+typedef struct _MarkerDetectorParams
+{
+  int threshold_window;              // adaptive threshold block size [pixel], odd
+  double threshold_offset;           // subtracted from the local mean
+  double min_perimeter_ratio;        // candidate perimeter relative to the larger image side
+  double max_perimeter_ratio;
+  double polygon_epsilon_ratio;      // approxPolyDP tolerance relative to the contour length
+  double min_corner_distance_ratio;  // shortest quad side relative to its perimeter
+  int min_contrast;                  // minimum black/white difference of the cell grid
+  int max_border_error;              // white cells tolerated in the black border
+  int corner_refine_window;          // cornerSubPix half window [pixel], 0 disables refinement
+
+  _MarkerDetectorParams()
+  : threshold_window(15),
+    threshold_offset(7.0),
+    min_perimeter_ratio(0.1),
+    max_perimeter_ratio(4.0),
+    polygon_epsilon_ratio(0.05),
+    min_corner_distance_ratio(0.05),
+    min_contrast(30),
+    max_border_error(3),
+    corner_refine_window(4)
+  {}
+} MarkerDetectorParams;
+
+// Finds square fiducials of a MarkerDictionary in 8 bit grayscale images.
+// Buffers are kept between calls so steady state detection does not allocate.
+class MarkerDetector
+{
+ public:
+  MarkerDetector(const MarkerDictionary &dictionary, const MarkerDetectorParams &params = MarkerDetectorParams());
+
+  void detect(const cv::Mat &gray, std::vector<MarkerDetection> &detections);
+
+  // Reads the cell grid spanned by four clockwise corners. Returns false when
+  // the quad is not a marker of the dictionary.
+  bool decode(const cv::Mat &gray, const cv::Point2f quad[4], MarkerDetection *detection) const;
+
+  void refineCorners(const cv::Mat &gray, std::vector<MarkerDetection> &detections) const;
+
+  const MarkerDetectorParams &params() const { return params_; }
+
+ private:
+  void findQuads(const cv::Mat &gray);
+  void removeDuplicates(std::vector<MarkerDetection> &detections) const;
+
+  const MarkerDictionary &dictionary_;
+  MarkerDetectorParams params_;
+
+  cv::Mat binary_;
+  std::vector<std::vector<cv::Point> > contours_;
+  std::vector<cv::Point> polygon_;
+  std::vector<cv::Point2f> quads_;  // four clockwise corners per candidate
+};
+
+}  // namespace open_manipulator_ar_markers
+
+#endif  // OPEN_MANIPULATOR_AR_MARKERS_MARKER_DETECTOR_H
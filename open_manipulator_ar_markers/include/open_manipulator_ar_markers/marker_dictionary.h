@@ -0,0 +1,60 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+
+#ifndef OPEN_MANIPULATOR_AR_MARKERS_MARKER_DICTIONARY_H
+#define OPEN_MANIPULATOR_AR_MARKERS_MARKER_DICTIONARY_H
+
+#include <stdint.h>
+#include <vector>
+
+namespace open_manipulator_ar_markers
+{
+
+// Square markers with a 5x5 bit payload inside a one cell black border
+// (7x7 cells in total). Bit (row * 5 + col) is set for a white cell.
+//
+// The codes are generated deterministically at construction, so every build
+// and the marker_generator tool agree on the same dictionary. Any two codes
+// differ in at least MIN_DISTANCE bits under all four rotations.
+class MarkerDictionary
+{
+ public:
+  static const int MARKER_BITS  = 5;
+  static const int MARKER_CELLS = MARKER_BITS + 2;
+  static const int MIN_DISTANCE = 8;
+
+  explicit MarkerDictionary(int num_of_marker = 50);
+
+  int size() const { return (int)codes_[0].size(); }
+  uint32_t code(int id) const { return codes_[0].at(id); }
+  int maxCorrection() const { return (MIN_DISTANCE - 1) / 2; }
+
+  // Returns the marker id, or -1 when no code is within maxCorrection() bits.
+  // rotation is the number of 90 degree clockwise turns that map the
+  // canonical code onto the observed one.
+  int identify(uint32_t observed, int *rotation, int *num_of_error) const;
+
+  // Rotates a code by 90 degrees clockwise (image coordinates, y down).
+  static uint32_t rotate(uint32_t code);
+
+ private:
+  std::vector<uint32_t> codes_[4];
+};
+
+}  // namespace open_manipulator_ar_markers
+
+#endif  // OPEN_MANIPULATOR_AR_MARKERS_MARKER_DICTIONARY_H
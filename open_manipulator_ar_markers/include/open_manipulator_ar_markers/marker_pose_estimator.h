@@ -0,0 +1,80 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+
+#ifndef OPEN_MANIPULATOR_AR_MARKERS_MARKER_POSE_ESTIMATOR_H
+#define OPEN_MANIPULATOR_AR_MARKERS_MARKER_POSE_ESTIMATOR_H
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "open_manipulator_ar_markers/corner_undistorter.h"
+#include "open_manipulator_ar_markers/marker_detector.h"
+
+namespace open_manipulator_ar_markers
+{
+
+typedef struct _MarkerPose
+{
+  int id;
+  int num_of_error;
+  double position[3];     // [m]
+  double orientation[4];  // quaternion (w, x, y, z)
+} MarkerPose;
+
+// Solves the marker pose in the camera optical frame from its four corners.
+// The marker frame has x to the right, y up and z out of the printed face.
+class MarkerPoseEstimator
+{
+ public:
+  MarkerPoseEstimator();
+
+  // camera_matrix is the row major 3x3 K of a sensor_msgs/CameraInfo and
+  // distortion its plumb_bob D. With the image size the corner undistortion
+  // table is built, otherwise every corner is inverted iteratively.
+  void setCameraModel(const double camera_matrix[9], const std::vector<double> &distortion,
+                      int image_width = 0, int image_height = 0);
+  void setMarkerSize(double marker_size);  // edge of the black square [m]
+
+  bool isReady() const { return has_camera_model_ && marker_size_ > 0.0; }
+
+  // position [m], orientation quaternion (w, x, y, z)
+  bool estimate(const MarkerDetection &detection, double position[3], double orientation[4]);
+
+  // Undistorts the corners of all detections in one pass, then solves each
+  // marker. Markers whose pose cannot be solved are left out.
+  void estimate(const std::vector<MarkerDetection> &detections, std::vector<MarkerPose> &poses);
+
+  const CornerUndistorter &undistorter() const { return undistorter_; }
+
+ private:
+  bool solve(const cv::Point2f ideal_corners[4], double position[3], double orientation[4]);
+
+  bool has_camera_model_;
+  double marker_size_;
+  cv::Matx33d camera_matrix_;
+  std::vector<double> no_distortion_;
+  CornerUndistorter undistorter_;
+
+  std::vector<cv::Point3f> object_points_;
+  std::vector<cv::Point2f> image_points_;
+  std::vector<cv::Point2f> distorted_corners_;
+  std::vector<cv::Point2f> ideal_corners_;
+};
+
+}  // namespace open_manipulator_ar_markers
+
+#endif  // OPEN_MANIPULATOR_AR_MARKERS_MARKER_POSE_ESTIMATOR_H
@@ -0,0 +1,83 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+
+#ifndef OPEN_MANIPULATOR_AR_MARKERS_MARKER_TRACKER_H
+#define OPEN_MANIPULATOR_AR_MARKERS_MARKER_TRACKER_H
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "open_manipulator_ar_markers/marker_detector.h"
+
+namespace open_manipulator_ar_markers
+{
+
+typedef struct _MarkerTrackerParams
+{
+  int pyramid_levels;     // the full frame search runs on the image halved this many times
+  double roi_margin;      // search window margin around the predicted marker, relative to its side
+  int max_missed_frames;  // a track missed for more frames than this is lost and triggers a full search
+  int rescan_period;      // full search every N tracked frames to pick up new markers, 0 only on loss
+
+  _MarkerTrackerParams()
+  : pyramid_levels(1),
+    roi_margin(0.5),
+    max_missed_frames(2),
+    rescan_period(15)
+  {}
+} MarkerTrackerParams;
+
+// Detection front-end that searches the whole frame at reduced resolution and,
+// once markers are found, only looks inside windows predicted from their last
+// corners and image velocity. Corners are always refined at full resolution.
+class MarkerTracker
+{
+ public:
+  MarkerTracker(MarkerDetector &detector, const MarkerTrackerParams &params = MarkerTrackerParams());
+
+  void track(const cv::Mat &gray, std::vector<MarkerDetection> &detections);
+  void reset();
+
+  bool lastFrameWasFullScan() const { return full_scan_; }
+  const MarkerTrackerParams &params() const { return params_; }
+
+ private:
+  typedef struct _Track
+  {
+    MarkerDetection detection;
+    cv::Point2f velocity;  // corner displacement per frame [pixel]
+    int missed;
+  } Track;
+
+  void fullScan(const cv::Mat &gray, std::vector<MarkerDetection> &detections);
+  bool trackMarker(const cv::Mat &gray, Track &track);
+
+  MarkerDetector &detector_;
+  MarkerTrackerParams params_;
+
+  std::vector<Track> tracks_;
+  std::vector<Track> next_tracks_;
+  int frames_since_scan_;
+  bool full_scan_;
+
+  std::vector<cv::Mat> pyramid_;
+  std::vector<MarkerDetection> candidates_;
+};
+
+}  // namespace open_manipulator_ar_markers
+
+#endif  // OPEN_MANIPULATOR_AR_MARKERS_MARKER_TRACKER_H
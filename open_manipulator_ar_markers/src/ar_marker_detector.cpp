@@ -0,0 +1,265 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+
+#include <time.h>
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+#include <camera_calibration_parsers/parse.h>
+#include <tf2_geometry_msgs/tf2_geometry_msgs.h>
+
+#include "open_manipulator_ar_markers/ar_marker_detector.h"
+
+namespace open_manipulator_ar_markers
+{
+
+namespace
+{
+double threadCpuTime()
+{
+  timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+}  // namespace
+
+ArMarkerDetector::ArMarkerDetector(ros::NodeHandle node_handle, ros::NodeHandle priv_node_handle)
+: node_handle_(node_handle),
+  priv_node_handle_(priv_node_handle),
+  statistics_period_(300),
+  use_tracking_(true),
+  detector_(dictionary_, loadDetectorParams(priv_node_handle)),
+  tracker_(detector_, loadTrackerParams(priv_node_handle)),
+  gate_(priv_node_handle.param<double>("low_rate", 2.0)),
+  num_of_frame_(0),
+  num_of_marker_(0),
+  num_of_full_scan_(0)
+{
+  double marker_size = priv_node_handle_.param<double>("marker_size", 3.0);  // [cm], same unit as ar_track_alvar
+  output_frame_      = priv_node_handle_.param<std::string>("output_frame", "");
+  camera_frame_      = priv_node_handle_.param<std::string>("camera_frame", "");
+  statistics_period_ = priv_node_handle_.param<int>("statistics_period", 300);
+  use_tracking_      = priv_node_handle_.param<bool>("use_tracking", true);
+
+  pose_estimator_.setMarkerSize(marker_size * 0.01);
+
+  if (!output_frame_.empty())
+  {
+    tf_buffer_.reset(new tf2_ros::Buffer);
+    tf_listener_.reset(new tf2_ros::TransformListener(*tf_buffer_, node_handle_));
+  }
+
+  initCameraModel();
+  initPublisher();
+  initSubscribe();
+}
+
+MarkerDetectorParams ArMarkerDetector::loadDetectorParams(const ros::NodeHandle &priv_node_handle)
+{
+  MarkerDetectorParams params;
+  priv_node_handle.param<int>("threshold_window", params.threshold_window, params.threshold_window);
+  priv_node_handle.param<double>("threshold_offset", params.threshold_offset, params.threshold_offset);
+  priv_node_handle.param<double>("min_perimeter_ratio", params.min_perimeter_ratio, params.min_perimeter_ratio);
+  priv_node_handle.param<double>("max_perimeter_ratio", params.max_perimeter_ratio, params.max_perimeter_ratio);
+  priv_node_handle.param<int>("min_contrast", params.min_contrast, params.min_contrast);
+  priv_node_handle.param<int>("corner_refine_window", params.corner_refine_window, params.corner_refine_window);
+  return params;
+}
+
+MarkerTrackerParams ArMarkerDetector::loadTrackerParams(const ros::NodeHandle &priv_node_handle)
+{
+  MarkerTrackerParams params;
+  priv_node_handle.param<int>("pyramid_levels", params.pyramid_levels, params.pyramid_levels);
+  priv_node_handle.param<double>("roi_margin", params.roi_margin, params.roi_margin);
+  priv_node_handle.param<int>("max_missed_frames", params.max_missed_frames, params.max_missed_frames);
+  priv_node_handle.param<int>("rescan_period", params.rescan_period, params.rescan_period);
+  return params;
+}
+
+void ArMarkerDetector::initCameraModel()
+{
+  // camera_info_file (e.g. raspicam.yaml) avoids waiting for the driver's camera_info
+  std::string camera_info_file = priv_node_handle_.param<std::string>("camera_info_file", "");
+  if (camera_info_file.empty()) return;
+
+  std::string camera_name;
+  sensor_msgs::CameraInfo camera_info;
+  if (camera_calibration_parsers::readCalibration(camera_info_file, camera_name, camera_info))
+    setCameraModel(camera_info);
+  else
+    ROS_ERROR("[ArMarkerDetector] Failed to read %s, waiting for camera_info", camera_info_file.c_str());
+}
+
+void ArMarkerDetector::initSubscribe()
+{
+  // Queue of one: a late frame is dropped rather than processed stale
+  compressed_image_sub_ = node_handle_.subscribe("image/compressed", 1, &ArMarkerDetector::compressedImageCallback, this,
+                                                 ros::TransportHints().tcpNoDelay());
+  if (!pose_estimator_.isReady())
+    camera_info_sub_ = node_handle_.subscribe("camera_info", 1, &ArMarkerDetector::cameraInfoCallback, this);
+  perception_demand_sub_ = node_handle_.subscribe("perception_demand", 1, &ArMarkerDetector::perceptionDemandCallback, this);
+}
+
+void ArMarkerDetector::initPublisher()
+{
+  ar_pose_marker_pub_ = node_handle_.advertise<ar_track_alvar_msgs::AlvarMarkers>("ar_pose_marker", 10);
+}
+
+void ArMarkerDetector::setCameraModel(const sensor_msgs::CameraInfo &camera_info)
+{
+  double camera_matrix[9];
+  for (int i = 0; i < 9; i++)
+    camera_matrix[i] = camera_info.K[i];
+  pose_estimator_.setCameraModel(camera_matrix, camera_info.D, camera_info.width, camera_info.height);
+}
+
+void ArMarkerDetector::cameraInfoCallback(const sensor_msgs::CameraInfo::ConstPtr &msg)
+{
+  setCameraModel(*msg);
+  camera_info_sub_.shutdown();
+}
+
+void ArMarkerDetector::perceptionDemandCallback(const std_msgs::UInt8::ConstPtr &msg)
+{
+  if (!gate_.setDemand(msg->data)) return;
+
+  // Tracks from before a pause are stale
+  if (gate_.demand() == PERCEPTION_DEMAND_NONE) tracker_.reset();
+  ROS_INFO("[ArMarkerDetector] Perception demand: %s", DetectionGate::demandName(gate_.demand()));
+}
+
+void ArMarkerDetector::compressedImageCallback(const sensor_msgs::CompressedImage::ConstPtr &msg)
+{
+  if (!pose_estimator_.isReady())
+  {
+    ROS_WARN_THROTTLE(5.0, "[ArMarkerDetector] Waiting for camera_info");
+    return;
+  }
+
+  // Dropped before decoding, which is most of the per frame cost
+  if (!gate_.pass(msg->header.stamp)) return;
+
+  double cpu_start = threadCpuTime();
+  ros::WallTime start = ros::WallTime::now();
+
+  // Decoding straight to grayscale skips chroma upsampling and color conversion
+  const cv::Mat compressed(1, (int)msg->data.size(), CV_8UC1, const_cast<uint8_t *>(msg->data.data()));
+  cv::imdecode(compressed, cv::IMREAD_GRAYSCALE, &gray_);
+  if (gray_.empty())
+  {
+    ROS_WARN_THROTTLE(5.0, "[ArMarkerDetector] Failed to decode %s image", msg->format.c_str());
+    return;
+  }
+  ros::WallTime decoded = ros::WallTime::now();
+
+  if (use_tracking_)
+  {
+    tracker_.track(gray_, detections_);
+    if (tracker_.lastFrameWasFullScan()) num_of_full_scan_++;
+  }
+  else
+  {
+    detector_.detect(gray_, detections_);
+    num_of_full_scan_++;
+  }
+  ros::WallTime detected = ros::WallTime::now();
+
+  const std::string &camera_frame = camera_frame_.empty() ? msg->header.frame_id : camera_frame_;
+  bool use_transform = !output_frame_.empty() && output_frame_ != camera_frame;
+
+  geometry_msgs::TransformStamped camera_to_output;
+  if (use_transform)
+  {
+    try
+    {
+      camera_to_output = tf_buffer_->lookupTransform(output_frame_, camera_frame, msg->header.stamp, ros::Duration(0.1));
+    }
+    catch (tf2::TransformException &ex)
+    {
+      ROS_WARN_THROTTLE(5.0, "[ArMarkerDetector] %s", ex.what());
+      return;
+    }
+  }
+
+  ar_track_alvar_msgs::AlvarMarkers::Ptr markers(new ar_track_alvar_msgs::AlvarMarkers);
+  markers->header.stamp = msg->header.stamp;
+  markers->header.frame_id = use_transform ? output_frame_ : camera_frame;
+  pose_estimator_.estimate(detections_, poses_);
+  markers->markers.reserve(poses_.size());
+
+  for (size_t i = 0; i < poses_.size(); i++)
+  {
+    const MarkerPose &pose = poses_[i];
+
+    geometry_msgs::PoseStamped camera_pose;
+    camera_pose.header.stamp = msg->header.stamp;
+    camera_pose.header.frame_id = camera_frame;
+    camera_pose.pose.position.x = pose.position[0];
+    camera_pose.pose.position.y = pose.position[1];
+    camera_pose.pose.position.z = pose.position[2];
+    camera_pose.pose.orientation.w = pose.orientation[0];
+    camera_pose.pose.orientation.x = pose.orientation[1];
+    camera_pose.pose.orientation.y = pose.orientation[2];
+    camera_pose.pose.orientation.z = pose.orientation[3];
+
+    ar_track_alvar_msgs::AlvarMarker marker;
+    marker.header = markers->header;
+    marker.id = pose.id;
+    // confidence stays 0 as with ar_track_alvar; corrected bit errors are not a confidence
+    if (use_transform)
+      tf2::doTransform(camera_pose, marker.pose, camera_to_output);
+    else
+      marker.pose = camera_pose;
+    marker.pose.header = markers->header;
+
+    markers->markers.push_back(marker);
+  }
+  ros::WallTime solved = ros::WallTime::now();
+
+  // Published as a shared pointer: subscribers in the same nodelet manager get it without a copy
+  num_of_marker_ += markers->markers.size();
+  ar_pose_marker_pub_.publish(markers);
+
+  decode_time_.add((decoded - start).toSec());
+  detect_time_.add((detected - decoded).toSec());
+  pose_time_.add((solved - detected).toSec());
+  cpu_time_.add(threadCpuTime() - cpu_start);
+  latency_.add((ros::Time::now() - msg->header.stamp).toSec());
+
+  if (++num_of_frame_ >= (uint32_t)statistics_period_) reportStatistics();
+}
+
+void ArMarkerDetector::reportStatistics()
+{
+  double n = num_of_frame_;
+  ROS_INFO("[ArMarkerDetector] %u frames (%u full scans, %u gated), %.2f markers/frame | decode %.2f detect %.2f pose %.2f ms/frame | "
+           "cpu %.2f ms/frame (max %.2f) | frame to pose latency %.1f ms (max %.1f)",
+           num_of_frame_, num_of_full_scan_, gate_.numOfDrop(), num_of_marker_ / n,
+           decode_time_.sum / n * 1e3, detect_time_.sum / n * 1e3, pose_time_.sum / n * 1e3,
+           cpu_time_.sum / n * 1e3, cpu_time_.max * 1e3,
+           latency_.sum / n * 1e3, latency_.max * 1e3);
+
+  num_of_frame_ = 0;
+  num_of_marker_ = 0;
+  num_of_full_scan_ = 0;
+  gate_.resetCount();
+  decode_time_ = RunningTime();
+  detect_time_ = RunningTime();
+  pose_time_ = RunningTime();
+  cpu_time_ = RunningTime();
+  latency_ = RunningTime();
+}
+
+}  // namespace open_manipulator_ar_markers
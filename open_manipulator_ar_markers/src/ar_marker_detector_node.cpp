@@ -0,0 +1,29 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+
+#include "open_manipulator_ar_markers/ar_marker_detector.h"
+
+int main(int argc, char **argv)
+{
+  // Init ROS node
+  ros::init(argc, argv, "ar_marker_detector");
+
+  open_manipulator_ar_markers::ArMarkerDetector ar_marker_detector(ros::NodeHandle(""), ros::NodeHandle("~"));
+
+  ros::spin();
+  return 0;
+}
@@ -0,0 +1,42 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <boost/shared_ptr.hpp>
+
+#include "open_manipulator_ar_markers/ar_marker_detector.h"
+
+namespace open_manipulator_ar_markers
+{
+
+// Loaded into the same manager as open_manipulator_pick_and_place, marker
+// tables reach the node's arPoseMarkerCallback without serialisation.
+class ArMarkerDetectorNodelet : public nodelet::Nodelet
+{
+ private:
+  boost::shared_ptr<ArMarkerDetector> ar_marker_detector_;
+
+  virtual void onInit()
+  {
+    ar_marker_detector_.reset(new ArMarkerDetector(getNodeHandle(), getPrivateNodeHandle()));
+  }
+};
+
+}  // namespace open_manipulator_ar_markers
+
+PLUGINLIB_EXPORT_CLASS(open_manipulator_ar_markers::ArMarkerDetectorNodelet, nodelet::Nodelet)
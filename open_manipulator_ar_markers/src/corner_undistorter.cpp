@@ -0,0 +1,131 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+
+#include <cmath>
+
+#include "open_manipulator_ar_markers/corner_undistorter.h"
+
+namespace open_manipulator_ar_markers
+{
+
+CornerUndistorter::CornerUndistorter()
+: fx_(1.0), fy_(1.0), cx_(0.0), cy_(0.0),
+  k1_(0.0), k2_(0.0), p1_(0.0), p2_(0.0), k3_(0.0),
+  grid_step_(DEFAULT_GRID_STEP),
+  grid_cols_(0),
+  grid_rows_(0),
+  inverse_step_(1.0f / DEFAULT_GRID_STEP)
+{
+}
+
+void CornerUndistorter::init(const double camera_matrix[9], const std::vector<double> &distortion,
+                             int image_width, int image_height, int grid_step)
+{
+  fx_ = camera_matrix[0];
+  fy_ = camera_matrix[4];
+  cx_ = camera_matrix[2];
+  cy_ = camera_matrix[5];
+
+  k1_ = distortion.size() > 0 ? distortion[0] : 0.0;
+  k2_ = distortion.size() > 1 ? distortion[1] : 0.0;
+  p1_ = distortion.size() > 2 ? distortion[2] : 0.0;
+  p2_ = distortion.size() > 3 ? distortion[3] : 0.0;
+  k3_ = distortion.size() > 4 ? distortion[4] : 0.0;
+
+  table_.clear();
+  if (image_width <= 0 || image_height <= 0 || grid_step <= 0) return;
+
+  // One node past the last pixel on each side, so every pixel has four neighbours
+  grid_step_ = grid_step;
+  inverse_step_ = 1.0f / grid_step;
+  grid_cols_ = (image_width - 1) / grid_step + 2;
+  grid_rows_ = (image_height - 1) / grid_step + 2;
+
+  table_.resize(grid_cols_ * grid_rows_ * 2);
+  for (int row = 0; row < grid_rows_; row++)
+  {
+    for (int col = 0; col < grid_cols_; col++)
+    {
+      cv::Point2f ideal = undistortExact(cv::Point2f((float)(col * grid_step), (float)(row * grid_step)));
+      table_[(row * grid_cols_ + col) * 2]     = ideal.x;
+      table_[(row * grid_cols_ + col) * 2 + 1] = ideal.y;
+    }
+  }
+}
+
+cv::Point2f CornerUndistorter::undistortExact(const cv::Point2f &distorted) const
+{
+  const double x0 = (distorted.x - cx_) / fx_;
+  const double y0 = (distorted.y - cy_) / fy_;
+
+  // Same fixed point scheme as cv::undistortPoints, run to convergence
+  double x = x0;
+  double y = y0;
+  for (int i = 0; i < NUM_OF_ITERATION; i++)
+  {
+    double r2 = x * x + y * y;
+    double inverse_radial = 1.0 / (1.0 + ((k3_ * r2 + k2_) * r2 + k1_) * r2);
+    double delta_x = 2.0 * p1_ * x * y + p2_ * (r2 + 2.0 * x * x);
+    double delta_y = p1_ * (r2 + 2.0 * y * y) + 2.0 * p2_ * x * y;
+    x = (x0 - delta_x) * inverse_radial;
+    y = (y0 - delta_y) * inverse_radial;
+  }
+
+  return cv::Point2f((float)(x * fx_ + cx_), (float)(y * fy_ + cy_));
+}
+
+void CornerUndistorter::undistort(const cv::Point2f *distorted, cv::Point2f *ideal, size_t num_of_point) const
+{
+  if (table_.empty())
+  {
+    for (size_t i = 0; i < num_of_point; i++)
+      ideal[i] = undistortExact(distorted[i]);
+    return;
+  }
+
+  const float max_u = (float)(grid_cols_ - 1) - 1e-3f;
+  const float max_v = (float)(grid_rows_ - 1) - 1e-3f;
+  const float *table = &table_[0];
+
+  for (size_t i = 0; i < num_of_point; i++)
+  {
+    float u = distorted[i].x * inverse_step_;
+    float v = distorted[i].y * inverse_step_;
+    if (!(u >= 0.0f && v >= 0.0f && u < max_u && v < max_v))
+    {
+      ideal[i] = undistortExact(distorted[i]);
+      continue;
+    }
+
+    int col = (int)u;
+    int row = (int)v;
+    float a = u - col;
+    float b = v - row;
+
+    const float *top    = table + (row * grid_cols_ + col) * 2;
+    const float *bottom = top + grid_cols_ * 2;
+    float w00 = (1.0f - a) * (1.0f - b);
+    float w01 = a * (1.0f - b);
+    float w10 = (1.0f - a) * b;
+    float w11 = a * b;
+
+    ideal[i].x = w00 * top[0] + w01 * top[2] + w10 * bottom[0] + w11 * bottom[2];
+    ideal[i].y = w00 * top[1] + w01 * top[3] + w10 * bottom[1] + w11 * bottom[3];
+  }
+}
+
+}  // namespace open_manipulator_ar_markers
@@ -0,0 +1,207 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+
+#include <time.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <camera_calibration_parsers/parse.h>
+
+#include "open_manipulator_ar_markers/corner_undistorter.h"
+
+using open_manipulator_ar_markers::CornerUndistorter;
+
+namespace
+{
+double monotonicTime()
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+void printError(const char *name, std::vector<double> error)
+{
+  double sum = 0.0;
+  for (size_t i = 0; i < error.size(); i++)
+    sum += error[i];
+  std::sort(error.begin(), error.end());
+
+  printf("%-28s mean %.5f  p99 %.5f  max %.5f [pixel]\n", name,
+         sum / error.size(), error[(size_t)(error.size() * 0.99)], error.back());
+}
+
+// Runs function repeatedly for about a second and returns the time per call
+template <typename Function>
+double timePerCall(Function function)
+{
+  int repeat = 1;
+  while (true)
+  {
+    double start = monotonicTime();
+    for (int i = 0; i < repeat; i++)
+      function();
+    double elapsed = monotonicTime() - start;
+    if (elapsed > 1.0) return elapsed / repeat;
+    repeat *= 2;
+  }
+}
+
+struct TableUndistortion
+{
+  const CornerUndistorter *undistorter;
+  const std::vector<cv::Point2f> *corners;
+  std::vector<cv::Point2f> *ideal;
+  void operator()() const { undistorter->undistort(&(*corners)[0], &(*ideal)[0], corners->size()); }
+};
+
+struct ExactUndistortion
+{
+  const CornerUndistorter *undistorter;
+  const std::vector<cv::Point2f> *corners;
+  std::vector<cv::Point2f> *ideal;
+  void operator()() const
+  {
+    for (size_t i = 0; i < corners->size(); i++)
+      (*ideal)[i] = undistorter->undistortExact((*corners)[i]);
+  }
+};
+
+struct OpenCVUndistortPoints
+{
+  const cv::Mat *camera_matrix;
+  const cv::Mat *distortion;
+  const std::vector<cv::Point2f> *corners;
+  std::vector<cv::Point2f> *ideal;
+  void operator()() const { cv::undistortPoints(*corners, *ideal, *camera_matrix, *distortion, cv::noArray(), *camera_matrix); }
+};
+
+struct ImageRemap
+{
+  const cv::Mat *image;
+  const cv::Mat *map1;
+  const cv::Mat *map2;
+  cv::Mat *rectified;
+  void operator()() const { cv::remap(*image, *rectified, *map1, *map2, cv::INTER_LINEAR); }
+};
+}  // namespace
+
+// Validates CornerUndistorter against cv::undistortPoints on every pixel of
+// the image and compares its cost with full image rectification.
+// usage: corner_undistortion_benchmark <camera_info yaml> [grid step]
+// e.g. $(rospack find open_manipulator_camera)/camera_info/raspicam.yaml
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    printf("usage: %s <camera_info yaml> [grid step]\n", argv[0]);
+    return 1;
+  }
+  int grid_step = argc > 2 ? atoi(argv[2]) : CornerUndistorter::DEFAULT_GRID_STEP;
+
+  std::string camera_name;
+  sensor_msgs::CameraInfo camera_info;
+  if (!camera_calibration_parsers::readCalibration(argv[1], camera_name, camera_info))
+  {
+    printf("failed to read %s\n", argv[1]);
+    return 1;
+  }
+  const int width = camera_info.width;
+  const int height = camera_info.height;
+
+  double K[9];
+  for (int i = 0; i < 9; i++)
+    K[i] = camera_info.K[i];
+
+  double start = monotonicTime();
+  CornerUndistorter undistorter;
+  undistorter.init(K, camera_info.D, width, height, grid_step);
+  printf("%s %dx%d, grid step %d: table %zu bytes built in %.2f ms\n", camera_name.c_str(), width, height,
+         grid_step, undistorter.tableBytes(), (monotonicTime() - start) * 1e3);
+
+  cv::Mat camera_matrix(3, 3, CV_64FC1);
+  for (int i = 0; i < 9; i++)
+    camera_matrix.at<double>(i / 3, i % 3) = K[i];
+  cv::Mat distortion(1, (int)camera_info.D.size(), CV_64FC1);
+  for (size_t i = 0; i < camera_info.D.size(); i++)
+    distortion.at<double>(0, (int)i) = camera_info.D[i];
+
+  // Accuracy on every pixel center, and inside the central 80 % where markers are picked
+  std::vector<cv::Point2f> pixels;
+  pixels.reserve(width * height);
+  for (int y = 0; y < height; y++)
+    for (int x = 0; x < width; x++)
+      pixels.push_back(cv::Point2f((float)x, (float)y));
+
+  std::vector<cv::Point2f> reference, table(pixels.size());
+  cv::undistortPoints(pixels, reference, camera_matrix, distortion, cv::noArray(), camera_matrix);
+  undistorter.undistort(&pixels[0], &table[0], pixels.size());
+
+  std::vector<double> table_error, table_center_error, exact_error;
+  table_error.reserve(pixels.size());
+  exact_error.reserve(pixels.size());
+  for (size_t i = 0; i < pixels.size(); i++)
+  {
+    cv::Point2f exact = undistorter.undistortExact(pixels[i]);
+    double error = std::sqrt((table[i].x - reference[i].x) * (table[i].x - reference[i].x) +
+                             (table[i].y - reference[i].y) * (table[i].y - reference[i].y));
+    table_error.push_back(error);
+    exact_error.push_back(std::sqrt((exact.x - reference[i].x) * (exact.x - reference[i].x) +
+                                    (exact.y - reference[i].y) * (exact.y - reference[i].y)));
+
+    if (std::fabs(pixels[i].x - width * 0.5) < width * 0.4 && std::fabs(pixels[i].y - height * 0.5) < height * 0.4)
+      table_center_error.push_back(error);
+  }
+  printf("-- against cv::undistortPoints\n");
+  printError("table, whole image", table_error);
+  printError("table, central 80 %", table_center_error);
+  printError("exact inversion", exact_error);
+
+  // Cost per frame for 1 to 4 markers of four corners
+  printf("-- time per frame\n");
+  std::vector<cv::Point2f> corners, ideal;
+  for (int num_of_marker = 1; num_of_marker <= 4; num_of_marker++)
+  {
+    corners.clear();
+    for (int i = 0; i < num_of_marker * 4; i++)
+      corners.push_back(cv::Point2f((float)(37 * i % width), (float)(53 * i % height)));
+    ideal.resize(corners.size());
+
+    TableUndistortion table_function = {&undistorter, &corners, &ideal};
+    ExactUndistortion exact_function = {&undistorter, &corners, &ideal};
+    OpenCVUndistortPoints opencv_function = {&camera_matrix, &distortion, &corners, &ideal};
+    printf("%d marker(s): table %.3f us, exact %.3f us, cv::undistortPoints %.3f us\n", num_of_marker,
+           timePerCall(table_function) * 1e6, timePerCall(exact_function) * 1e6, timePerCall(opencv_function) * 1e6);
+  }
+
+  cv::Mat image(height, width, CV_8UC1);
+  for (int y = 0; y < height; y++)
+    for (int x = 0; x < width; x++)
+      image.at<uchar>(y, x) = (uchar)((x * 7 + y * 13) & 0xff);
+
+  cv::Mat map1, map2, rectified;
+  cv::initUndistortRectifyMap(camera_matrix, distortion, cv::Mat(), camera_matrix, cv::Size(width, height),
+                              CV_16SC2, map1, map2);
+  ImageRemap remap_function = {&image, &map1, &map2, &rectified};
+  printf("full image cv::remap (precomputed maps, gray) %.3f us\n", timePerCall(remap_function) * 1e6);
+  return 0;
+}
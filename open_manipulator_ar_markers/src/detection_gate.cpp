@@ -0,0 +1,87 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+
+#include <ros/ros.h>
+#include <topic_tools/shape_shifter.h>
+
+#include "std_msgs/UInt8.h"
+
+#include "open_manipulator_ar_markers/detection_gate.h"
+
+namespace open_manipulator_ar_markers
+{
+
+// Relays image_in to image_out according to perception_demand, so that an
+// external detector (ar_track_alvar) only sees the frames the task needs.
+// Messages are forwarded without deserialization, so any image type works.
+class DetectionGateRelay
+{
+ private:
+  // ROS NodeHandle
+  ros::NodeHandle node_handle_;
+  ros::NodeHandle priv_node_handle_;
+
+  ros::Subscriber image_sub_;
+  ros::Subscriber perception_demand_sub_;
+  ros::Publisher image_pub_;
+  bool is_advertised_;
+
+  DetectionGate gate_;
+
+ public:
+  DetectionGateRelay()
+  : node_handle_(""),
+    priv_node_handle_("~"),
+    is_advertised_(false),
+    gate_(priv_node_handle_.param<double>("low_rate", 2.0))
+  {
+    image_sub_ = node_handle_.subscribe("image_in", 1, &DetectionGateRelay::imageCallback, this,
+                                        ros::TransportHints().tcpNoDelay());
+    perception_demand_sub_ = node_handle_.subscribe("perception_demand", 1, &DetectionGateRelay::perceptionDemandCallback, this);
+  }
+
+  void perceptionDemandCallback(const std_msgs::UInt8::ConstPtr &msg)
+  {
+    if (gate_.setDemand(msg->data))
+      ROS_INFO("[DetectionGate] Perception demand: %s", DetectionGate::demandName(gate_.demand()));
+  }
+
+  void imageCallback(const topic_tools::ShapeShifter::ConstPtr &msg)
+  {
+    // The output type is only known once the first message arrives
+    if (!is_advertised_)
+    {
+      image_pub_ = msg->advertise(node_handle_, "image_out", 1);
+      is_advertised_ = true;
+    }
+
+    // Receive time: the header is not deserialized
+    if (gate_.pass(ros::Time::now())) image_pub_.publish(msg);
+  }
+};
+
+}  // namespace open_manipulator_ar_markers
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "detection_gate");
+
+  open_manipulator_ar_markers::DetectionGateRelay detection_gate;
+
+  ros::spin();
+  return 0;
+}
@@ -0,0 +1,238 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+
+#include <algorithm>
+#include <cmath>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "open_manipulator_ar_markers/marker_detector.h"
+
+namespace open_manipulator_ar_markers
+{
+
+namespace
+{
+inline double squaredDistance(const cv::Point2f &a, const cv::Point2f &b)
+{
+  double dx = a.x - b.x;
+  double dy = a.y - b.y;
+  return dx * dx + dy * dy;
+}
+
+inline double quadPerimeter(const cv::Point2f corners[4])
+{
+  double perimeter = 0.0;
+  for (int i = 0; i < 4; i++)
+    perimeter += std::sqrt(squaredDistance(corners[i], corners[(i + 1) % 4]));
+  return perimeter;
+}
+
+inline cv::Point2f quadCenter(const cv::Point2f corners[4])
+{
+  return cv::Point2f((corners[0].x + corners[1].x + corners[2].x + corners[3].x) * 0.25f,
+                     (corners[0].y + corners[1].y + corners[2].y + corners[3].y) * 0.25f);
+}
+}  // namespace
+
+MarkerDetector::MarkerDetector(const MarkerDictionary &dictionary, const MarkerDetectorParams &params)
+: dictionary_(dictionary),
+  params_(params)
+{
+  if (params_.threshold_window % 2 == 0) params_.threshold_window++;
+  if (params_.threshold_window < 3) params_.threshold_window = 3;
+}
+
+void MarkerDetector::detect(const cv::Mat &gray, std::vector<MarkerDetection> &detections)
+{
+  detections.clear();
+  findQuads(gray);
+
+  MarkerDetection detection;
+  for (size_t i = 0; i + 3 < quads_.size(); i += 4)
+  {
+    if (decode(gray, &quads_[i], &detection))
+      detections.push_back(detection);
+  }
+
+  removeDuplicates(detections);
+  refineCorners(gray, detections);
+}
+
+void MarkerDetector::findQuads(const cv::Mat &gray)
+{
+  quads_.clear();
+
+  // Dark pixels become foreground, so every marker border is one closed blob
+  cv::adaptiveThreshold(gray, binary_, 255, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY_INV,
+                        params_.threshold_window, params_.threshold_offset);
+  cv::findContours(binary_, contours_, cv::RETR_LIST, cv::CHAIN_APPROX_NONE);
+
+  // CHAIN_APPROX_NONE keeps every boundary pixel, so the point count is the perimeter
+  int max_side = std::max(gray.cols, gray.rows);
+  size_t min_perimeter = (size_t)(params_.min_perimeter_ratio * max_side);
+  size_t max_perimeter = (size_t)(params_.max_perimeter_ratio * max_side);
+
+  for (size_t i = 0; i < contours_.size(); i++)
+  {
+    const std::vector<cv::Point> &contour = contours_[i];
+    if (contour.size() < min_perimeter || contour.size() > max_perimeter) continue;
+
+    cv::approxPolyDP(contour, polygon_, contour.size() * params_.polygon_epsilon_ratio, true);
+    if (polygon_.size() != 4 || !cv::isContourConvex(polygon_)) continue;
+
+    cv::Point2f corners[4];
+    for (int j = 0; j < 4; j++)
+      corners[j] = cv::Point2f((float)polygon_[j].x, (float)polygon_[j].y);
+
+    double min_distance = params_.min_corner_distance_ratio * contour.size();
+    bool too_small = false;
+    for (int j = 0; j < 4; j++)
+      too_small |= squaredDistance(corners[j], corners[(j + 1) % 4]) < min_distance * min_distance;
+    if (too_small) continue;
+
+    // Image y points down, so a positive cross product means clockwise
+    double cross = (corners[1].x - corners[0].x) * (corners[2].y - corners[0].y) -
+                   (corners[1].y - corners[0].y) * (corners[2].x - corners[0].x);
+    if (cross < 0.0) std::swap(corners[1], corners[3]);
+
+    for (int j = 0; j < 4; j++)
+      quads_.push_back(corners[j]);
+  }
+}
+
+bool MarkerDetector::decode(const cv::Mat &gray, const cv::Point2f quad[4], MarkerDetection *detection) const
+{
+  const int cells = MarkerDictionary::MARKER_CELLS;
+  const int bits  = MarkerDictionary::MARKER_BITS;
+
+  const cv::Point2f canonical[4] = {cv::Point2f(0.0f, 0.0f),
+                                    cv::Point2f((float)cells, 0.0f),
+                                    cv::Point2f((float)cells, (float)cells),
+                                    cv::Point2f(0.0f, (float)cells)};
+  cv::Mat homography = cv::getPerspectiveTransform(canonical, quad);
+  const double *h = homography.ptr<double>(0);
+
+  // Five samples per cell (center and diagonal neighbours) averaged
+  static const double offset[5][2] = {{0.0, 0.0}, {-0.2, -0.2}, {0.2, -0.2}, {0.2, 0.2}, {-0.2, 0.2}};
+
+  int cell_value[cells][cells];
+  int min_value = 255;
+  int max_value = 0;
+
+  for (int row = 0; row < cells; row++)
+  {
+    for (int col = 0; col < cells; col++)
+    {
+      int sum = 0;
+      for (int k = 0; k < 5; k++)
+      {
+        double u = col + 0.5 + offset[k][0];
+        double v = row + 0.5 + offset[k][1];
+        double w = h[6] * u + h[7] * v + h[8];
+        int x = (int)std::floor((h[0] * u + h[1] * v + h[2]) / w + 0.5);
+        int y = (int)std::floor((h[3] * u + h[4] * v + h[5]) / w + 0.5);
+        if (x < 0 || y < 0 || x >= gray.cols || y >= gray.rows) return false;
+        sum += gray.ptr<uchar>(y)[x];
+      }
+      cell_value[row][col] = sum / 5;
+      min_value = std::min(min_value, cell_value[row][col]);
+      max_value = std::max(max_value, cell_value[row][col]);
+    }
+  }
+
+  if (max_value - min_value < params_.min_contrast) return false;
+  int threshold = (min_value + max_value) / 2;
+
+  int border_error = 0;
+  uint32_t code = 0;
+  for (int row = 0; row < cells; row++)
+  {
+    for (int col = 0; col < cells; col++)
+    {
+      bool white = cell_value[row][col] > threshold;
+      if (row == 0 || col == 0 || row == cells - 1 || col == cells - 1)
+      {
+        if (white) border_error++;
+      }
+      else if (white)
+      {
+        code |= 1u << ((row - 1) * bits + (col - 1));
+      }
+    }
+  }
+  if (border_error > params_.max_border_error) return false;
+
+  int rotation = 0;
+  int num_of_error = 0;
+  int id = dictionary_.identify(code, &rotation, &num_of_error);
+  if (id < 0) return false;
+
+  // The canonical top left corner was turned onto quad[rotation]
+  detection->id = id;
+  detection->num_of_error = num_of_error;
+  for (int k = 0; k < 4; k++)
+    detection->corners[k] = quad[(k + rotation) % 4];
+  return true;
+}
+
+void MarkerDetector::removeDuplicates(std::vector<MarkerDetection> &detections) const
+{
+  // The inner edge of a border can decode as well; keep the outer (larger) quad
+  for (size_t i = 0; i < detections.size(); i++)
+  {
+    for (size_t j = i + 1; j < detections.size();)
+    {
+      double perimeter_i = quadPerimeter(detections[i].corners);
+      double perimeter_j = quadPerimeter(detections[j].corners);
+      double max_distance = std::max(perimeter_i, perimeter_j) / 8.0;
+
+      if (detections[i].id == detections[j].id &&
+          squaredDistance(quadCenter(detections[i].corners), quadCenter(detections[j].corners)) < max_distance * max_distance)
+      {
+        if (perimeter_j > perimeter_i) detections[i] = detections[j];
+        detections.erase(detections.begin() + j);
+      }
+      else
+      {
+        j++;
+      }
+    }
+  }
+}
+
+void MarkerDetector::refineCorners(const cv::Mat &gray, std::vector<MarkerDetection> &detections) const
+{
+  if (params_.corner_refine_window <= 0) return;
+
+  const cv::TermCriteria criteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 10, 0.01);
+  std::vector<cv::Point2f> corners(4);
+
+  for (size_t i = 0; i < detections.size(); i++)
+  {
+    // Keep the window inside the border cell so the corner stays unambiguous
+    double cell_size = quadPerimeter(detections[i].corners) / (4.0 * MarkerDictionary::MARKER_CELLS);
+    int window = std::min(params_.corner_refine_window, (int)(cell_size * 0.5));
+    if (window < 1) continue;
+
+    corners.assign(detections[i].corners, detections[i].corners + 4);
+    cv::cornerSubPix(gray, corners, cv::Size(window, window), cv::Size(-1, -1), criteria);
+    for (int k = 0; k < 4; k++)
+      detections[i].corners[k] = corners[k];
+  }
+}
+
+}  // namespace open_manipulator_ar_markers
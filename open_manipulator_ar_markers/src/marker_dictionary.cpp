@@ -0,0 +1,117 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+
+#include <cstddef>
+
+#include "open_manipulator_ar_markers/marker_dictionary.h"
+
+namespace open_manipulator_ar_markers
+{
+
+namespace
+{
+const uint32_t CODE_MASK = (1u << (MarkerDictionary::MARKER_BITS * MarkerDictionary::MARKER_BITS)) - 1;
+
+inline int popcount(uint32_t value)
+{
+  return __builtin_popcount(value);
+}
+}  // namespace
+
+MarkerDictionary::MarkerDictionary(int num_of_marker)
+{
+  for (int r = 0; r < 4; r++)
+    codes_[r].reserve(num_of_marker);
+
+  // xorshift32 with a fixed seed: the dictionary must never change between builds
+  uint32_t state = 0x2545F491u;
+  for (int attempt = 0; attempt < 10000000 && size() < num_of_marker; attempt++)
+  {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+
+    uint32_t candidate = state & CODE_MASK;
+
+    // Reject nearly uniform payloads, they look like plain black squares
+    int num_of_white = popcount(candidate);
+    if (num_of_white < 8 || num_of_white > 17) continue;
+
+    uint32_t rotated[4];
+    rotated[0] = candidate;
+    for (int r = 1; r < 4; r++)
+      rotated[r] = rotate(rotated[r - 1]);
+
+    bool accepted = true;
+    for (int r = 1; r < 4 && accepted; r++)
+      accepted = popcount(candidate ^ rotated[r]) >= MIN_DISTANCE;
+
+    for (int id = 0; id < size() && accepted; id++)
+      for (int r = 0; r < 4 && accepted; r++)
+        accepted = popcount(codes_[0][id] ^ rotated[r]) >= MIN_DISTANCE;
+
+    if (!accepted) continue;
+
+    for (int r = 0; r < 4; r++)
+      codes_[r].push_back(rotated[r]);
+  }
+}
+
+int MarkerDictionary::identify(uint32_t observed, int *rotation, int *num_of_error) const
+{
+  int best_id = -1;
+  int best_rotation = 0;
+  int best_error = maxCorrection() + 1;
+
+  for (int r = 0; r < 4; r++)
+  {
+    const std::vector<uint32_t> &codes = codes_[r];
+    for (int id = 0; id < (int)codes.size(); id++)
+    {
+      int error = popcount(codes[id] ^ observed);
+      if (error < best_error)
+      {
+        best_id = id;
+        best_rotation = r;
+        best_error = error;
+      }
+    }
+  }
+
+  if (rotation != NULL) *rotation = best_rotation;
+  if (num_of_error != NULL) *num_of_error = best_error;
+  return best_id;
+}
+
+uint32_t MarkerDictionary::rotate(uint32_t code)
+{
+  uint32_t rotated = 0;
+  for (int row = 0; row < MARKER_BITS; row++)
+  {
+    for (int col = 0; col < MARKER_BITS; col++)
+    {
+      if (code & (1u << (row * MARKER_BITS + col)))
+      {
+        // (col, row) -> (MARKER_BITS - 1 - row, col)
+        rotated |= 1u << (col * MARKER_BITS + (MARKER_BITS - 1 - row));
+      }
+    }
+  }
+  return rotated;
+}
+
+}  // namespace open_manipulator_ar_markers
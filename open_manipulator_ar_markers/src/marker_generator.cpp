@@ -0,0 +1,74 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+
+#include "open_manipulator_ar_markers/marker_dictionary.h"
+
+// Writes a printable marker of the ar_marker_detector dictionary.
+// usage: marker_generator <id> [pixels per cell] [output file]
+int main(int argc, char **argv)
+{
+  using open_manipulator_ar_markers::MarkerDictionary;
+
+  if (argc < 2)
+  {
+    printf("usage: %s <id> [pixels per cell] [output file]\n", argv[0]);
+    return 1;
+  }
+
+  MarkerDictionary dictionary;
+  int id = atoi(argv[1]);
+  int cell = argc > 2 ? atoi(argv[2]) : 40;
+  std::string file = argc > 3 ? argv[3] : "marker_" + std::string(argv[1]) + ".png";
+
+  if (id < 0 || id >= dictionary.size() || cell <= 0)
+  {
+    printf("id must be in [0, %d) and pixels per cell positive\n", dictionary.size());
+    return 1;
+  }
+
+  // One white cell of quiet zone around the black border
+  const int cells = MarkerDictionary::MARKER_CELLS;
+  const int bits  = MarkerDictionary::MARKER_BITS;
+  cv::Mat image((cells + 2) * cell, (cells + 2) * cell, CV_8UC1, cv::Scalar(255));
+
+  uint32_t code = dictionary.code(id);
+  for (int row = 0; row < cells; row++)
+  {
+    for (int col = 0; col < cells; col++)
+    {
+      bool border = row == 0 || col == 0 || row == cells - 1 || col == cells - 1;
+      bool white = !border && (code & (1u << ((row - 1) * bits + (col - 1))));
+      if (white) continue;
+
+      image(cv::Rect((col + 1) * cell, (row + 1) * cell, cell, cell)).setTo(cv::Scalar(0));
+    }
+  }
+
+  if (!cv::imwrite(file, image))
+  {
+    printf("failed to write %s\n", file.c_str());
+    return 1;
+  }
+  printf("marker %d written to %s (print the black square at the detector's marker_size)\n", id, file.c_str());
+  return 0;
+}
@@ -0,0 +1,182 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+
+#include <dirent.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <ros/ros.h>
+
+#include "ar_track_alvar_msgs/AlvarMarkers.h"
+
+// Measures a marker pipeline from the outside so that ar_track_alvar and
+// ar_marker_detector can be compared on the same terms: frame to pose latency
+// on /ar_pose_marker and CPU time per frame of the named processes.
+class MarkerLatencyMonitor
+{
+ private:
+  ros::NodeHandle node_handle_;
+  ros::NodeHandle priv_node_handle_;
+  ros::Subscriber ar_pose_marker_sub_;
+  ros::Timer report_timer_;
+
+  std::vector<std::string> process_names_;
+  std::vector<int> pids_;
+
+  uint32_t num_of_frame_;
+  double latency_sum_;
+  double latency_max_;
+  double last_cpu_time_;
+  ros::WallTime last_report_;
+
+ public:
+  MarkerLatencyMonitor()
+  : node_handle_(""),
+    priv_node_handle_("~"),
+    num_of_frame_(0),
+    latency_sum_(0.0),
+    latency_max_(0.0),
+    last_cpu_time_(-1.0)
+  {
+    // e.g. ["republish", "individualMarkersNoKinect"] or ["ar_marker_detector"] or ["nodelet"]
+    priv_node_handle_.getParam("process_names", process_names_);
+    double report_period = priv_node_handle_.param<double>("report_period", 5.0);
+
+    ar_pose_marker_sub_ = node_handle_.subscribe("ar_pose_marker", 10, &MarkerLatencyMonitor::arPoseMarkerCallback, this);
+    report_timer_ = node_handle_.createTimer(ros::Duration(report_period), &MarkerLatencyMonitor::reportCallback, this);
+    last_report_ = ros::WallTime::now();
+  }
+
+  void arPoseMarkerCallback(const ar_track_alvar_msgs::AlvarMarkers::ConstPtr &msg)
+  {
+    ros::Time stamp = msg->header.stamp;
+    if (stamp.isZero() && !msg->markers.empty()) stamp = msg->markers.front().header.stamp;
+    if (stamp.isZero()) return;
+
+    double latency = (ros::Time::now() - stamp).toSec();
+    latency_sum_ += latency;
+    if (latency > latency_max_) latency_max_ = latency;
+    num_of_frame_++;
+  }
+
+  void reportCallback(const ros::TimerEvent&)
+  {
+    if (pids_.empty()) findProcesses();
+
+    ros::WallTime now = ros::WallTime::now();
+    double period = (now - last_report_).toSec();
+    double cpu_time = processCpuTime();
+
+    double cpu_per_frame = 0.0;
+    double cpu_load = 0.0;
+    if (last_cpu_time_ >= 0.0 && cpu_time >= 0.0)
+    {
+      cpu_load = (cpu_time - last_cpu_time_) / period * 100.0;
+      if (num_of_frame_ > 0) cpu_per_frame = (cpu_time - last_cpu_time_) / num_of_frame_;
+    }
+
+    if (num_of_frame_ > 0)
+    {
+      ROS_INFO("%.1f Hz | frame to pose latency %.1f ms (max %.1f) | cpu %.2f ms/frame, %.1f %% (%lu processes)",
+               num_of_frame_ / period,
+               latency_sum_ / num_of_frame_ * 1e3, latency_max_ * 1e3,
+               cpu_per_frame * 1e3, cpu_load, (unsigned long)pids_.size());
+    }
+    else
+    {
+      ROS_WARN("No marker message for %.1f s", period);
+    }
+
+    num_of_frame_ = 0;
+    latency_sum_ = 0.0;
+    latency_max_ = 0.0;
+    last_cpu_time_ = cpu_time;
+    last_report_ = now;
+  }
+
+ private:
+  void findProcesses()
+  {
+    DIR *proc = opendir("/proc");
+    if (proc == NULL) return;
+
+    struct dirent *entry;
+    while ((entry = readdir(proc)) != NULL)
+    {
+      int pid = atoi(entry->d_name);
+      if (pid <= 0) continue;
+
+      std::ifstream comm_file(("/proc/" + std::string(entry->d_name) + "/comm").c_str());
+      std::string comm;
+      if (!std::getline(comm_file, comm)) continue;
+
+      // comm is truncated to 15 characters
+      for (size_t i = 0; i < process_names_.size(); i++)
+      {
+        if (process_names_[i].compare(0, 15, comm) == 0)
+        {
+          pids_.push_back(pid);
+          break;
+        }
+      }
+    }
+    closedir(proc);
+  }
+
+  // utime + stime of all monitored processes [s], -1 if none is running
+  double processCpuTime()
+  {
+    if (pids_.empty()) return -1.0;
+
+    static const double ticks_per_second = sysconf(_SC_CLK_TCK);
+    unsigned long long ticks = 0;
+    for (size_t i = 0; i < pids_.size(); i++)
+    {
+      char path[64];
+      snprintf(path, sizeof(path), "/proc/%d/stat", pids_[i]);
+      std::ifstream stat_file(path);
+      std::string stat;
+      if (!std::getline(stat_file, stat))
+      {
+        pids_.clear();  // a process restarted, look it up again next period
+        return -1.0;
+      }
+
+      // Fields after the parenthesised command name; utime and stime are 14th and 15th
+      const char *fields = strrchr(stat.c_str(), ')');
+      unsigned long long utime = 0, stime = 0;
+      if (fields == NULL ||
+          sscanf(fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2)
+        continue;
+      ticks += utime + stime;
+    }
+    return ticks / ticks_per_second;
+  }
+};
+
+int main(int argc, char **argv)
+{
+  // Init ROS node
+  ros::init(argc, argv, "marker_latency_monitor");
+
+  MarkerLatencyMonitor marker_latency_monitor;
+
+  ros::spin();
+  return 0;
+}
@@ -0,0 +1,147 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+
+#include <algorithm>
+#include <cmath>
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include "open_manipulator_ar_markers/marker_pose_estimator.h"
+
+namespace open_manipulator_ar_markers
+{
+
+namespace
+{
+void rotationToQuaternion(const cv::Matx33d &r, double q[4])
+{
+  double trace = r(0, 0) + r(1, 1) + r(2, 2);
+  if (trace > 0.0)
+  {
+    double s = std::sqrt(trace + 1.0) * 2.0;
+    q[0] = 0.25 * s;
+    q[1] = (r(2, 1) - r(1, 2)) / s;
+    q[2] = (r(0, 2) - r(2, 0)) / s;
+    q[3] = (r(1, 0) - r(0, 1)) / s;
+  }
+  else if (r(0, 0) > r(1, 1) && r(0, 0) > r(2, 2))
+  {
+    double s = std::sqrt(1.0 + r(0, 0) - r(1, 1) - r(2, 2)) * 2.0;
+    q[0] = (r(2, 1) - r(1, 2)) / s;
+    q[1] = 0.25 * s;
+    q[2] = (r(0, 1) + r(1, 0)) / s;
+    q[3] = (r(0, 2) + r(2, 0)) / s;
+  }
+  else if (r(1, 1) > r(2, 2))
+  {
+    double s = std::sqrt(1.0 + r(1, 1) - r(0, 0) - r(2, 2)) * 2.0;
+    q[0] = (r(0, 2) - r(2, 0)) / s;
+    q[1] = (r(0, 1) + r(1, 0)) / s;
+    q[2] = 0.25 * s;
+    q[3] = (r(1, 2) + r(2, 1)) / s;
+  }
+  else
+  {
+    double s = std::sqrt(1.0 + r(2, 2) - r(0, 0) - r(1, 1)) * 2.0;
+    q[0] = (r(1, 0) - r(0, 1)) / s;
+    q[1] = (r(0, 2) + r(2, 0)) / s;
+    q[2] = (r(1, 2) + r(2, 1)) / s;
+    q[3] = 0.25 * s;
+  }
+}
+}  // namespace
+
+MarkerPoseEstimator::MarkerPoseEstimator()
+: has_camera_model_(false),
+  marker_size_(0.0),
+  camera_matrix_(cv::Matx33d::eye())
+{
+  image_points_.resize(4);
+}
+
+void MarkerPoseEstimator::setCameraModel(const double camera_matrix[9], const std::vector<double> &distortion,
+                                         int image_width, int image_height)
+{
+  for (int i = 0; i < 9; i++)
+    camera_matrix_(i / 3, i % 3) = camera_matrix[i];
+
+  // Corners are undistorted here, so solvePnP always sees an ideal camera
+  undistorter_.init(camera_matrix, distortion, image_width, image_height);
+  has_camera_model_ = true;
+}
+
+void MarkerPoseEstimator::setMarkerSize(double marker_size)
+{
+  double half = marker_size * 0.5;
+  marker_size_ = marker_size;
+
+  object_points_.clear();
+  object_points_.push_back(cv::Point3f(-half,  half, 0.0f));  // top left
+  object_points_.push_back(cv::Point3f( half,  half, 0.0f));  // top right
+  object_points_.push_back(cv::Point3f( half, -half, 0.0f));  // bottom right
+  object_points_.push_back(cv::Point3f(-half, -half, 0.0f));  // bottom left
+}
+
+bool MarkerPoseEstimator::estimate(const MarkerDetection &detection, double position[3], double orientation[4])
+{
+  if (!isReady()) return false;
+
+  cv::Point2f ideal_corners[4];
+  undistorter_.undistort(detection.corners, ideal_corners, 4);
+  return solve(ideal_corners, position, orientation);
+}
+
+void MarkerPoseEstimator::estimate(const std::vector<MarkerDetection> &detections, std::vector<MarkerPose> &poses)
+{
+  poses.clear();
+  if (!isReady() || detections.empty()) return;
+
+  distorted_corners_.resize(detections.size() * 4);
+  ideal_corners_.resize(detections.size() * 4);
+  for (size_t i = 0; i < detections.size(); i++)
+    std::copy(detections[i].corners, detections[i].corners + 4, &distorted_corners_[i * 4]);
+
+  undistorter_.undistort(&distorted_corners_[0], &ideal_corners_[0], distorted_corners_.size());
+
+  MarkerPose pose;
+  for (size_t i = 0; i < detections.size(); i++)
+  {
+    if (!solve(&ideal_corners_[i * 4], pose.position, pose.orientation)) continue;
+
+    pose.id = detections[i].id;
+    pose.num_of_error = detections[i].num_of_error;
+    poses.push_back(pose);
+  }
+}
+
+bool MarkerPoseEstimator::solve(const cv::Point2f ideal_corners[4], double position[3], double orientation[4])
+{
+  image_points_.assign(ideal_corners, ideal_corners + 4);
+
+  cv::Vec3d rvec, tvec;
+  if (!cv::solvePnP(object_points_, image_points_, camera_matrix_, no_distortion_, rvec, tvec, false, cv::SOLVEPNP_ITERATIVE))
+    return false;
+
+  cv::Matx33d rotation;
+  cv::Rodrigues(rvec, rotation);
+
+  for (int i = 0; i < 3; i++)
+    position[i] = tvec[i];
+  rotationToQuaternion(rotation, orientation);
+  return true;
+}
+
+}  // namespace open_manipulator_ar_markers
@@ -0,0 +1,212 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "open_manipulator_ar_markers/marker_tracker.h"
+
+namespace open_manipulator_ar_markers
+{
+
+namespace
+{
+inline cv::Point2f quadCenter(const cv::Point2f corners[4])
+{
+  return cv::Point2f((corners[0].x + corners[1].x + corners[2].x + corners[3].x) * 0.25f,
+                     (corners[0].y + corners[1].y + corners[2].y + corners[3].y) * 0.25f);
+}
+
+inline float squaredDistance(const cv::Point2f &a, const cv::Point2f &b)
+{
+  float dx = a.x - b.x;
+  float dy = a.y - b.y;
+  return dx * dx + dy * dy;
+}
+}  // namespace
+
+MarkerTracker::MarkerTracker(MarkerDetector &detector, const MarkerTrackerParams &params)
+: detector_(detector),
+  params_(params),
+  frames_since_scan_(0),
+  full_scan_(false)
+{
+  if (params_.pyramid_levels < 0) params_.pyramid_levels = 0;
+  pyramid_.resize(params_.pyramid_levels);
+}
+
+void MarkerTracker::reset()
+{
+  tracks_.clear();
+  frames_since_scan_ = 0;
+}
+
+void MarkerTracker::track(const cv::Mat &gray, std::vector<MarkerDetection> &detections)
+{
+  detections.clear();
+  full_scan_ = tracks_.empty() ||
+               (params_.rescan_period > 0 && frames_since_scan_ >= params_.rescan_period);
+
+  if (!full_scan_)
+  {
+    next_tracks_.clear();
+    for (size_t i = 0; i < tracks_.size(); i++)
+    {
+      Track &track = tracks_[i];
+      if (trackMarker(gray, track))
+      {
+        track.missed = 0;
+        detections.push_back(track.detection);
+      }
+      else if (++track.missed > params_.max_missed_frames)
+      {
+        full_scan_ = true;
+        continue;
+      }
+      next_tracks_.push_back(track);
+    }
+    tracks_.swap(next_tracks_);
+    frames_since_scan_++;
+  }
+
+  if (full_scan_) fullScan(gray, detections);
+}
+
+void MarkerTracker::fullScan(const cv::Mat &gray, std::vector<MarkerDetection> &detections)
+{
+  const cv::Mat *level = &gray;
+  for (int i = 0; i < params_.pyramid_levels; i++)
+  {
+    cv::pyrDown(*level, pyramid_[i]);
+    level = &pyramid_[i];
+  }
+  detector_.detect(*level, candidates_);
+
+  // Pixel centers of level n map back as (p + 0.5) * 2^n - 0.5. The quads are
+  // re-read at full resolution, which also rejects codes misread when small.
+  const float scale = (float)(1 << params_.pyramid_levels);
+  detections.clear();
+  MarkerDetection detection;
+  for (size_t i = 0; i < candidates_.size(); i++)
+  {
+    cv::Point2f quad[4];
+    for (int k = 0; k < 4; k++)
+      quad[k] = cv::Point2f((candidates_[i].corners[k].x + 0.5f) * scale - 0.5f,
+                            (candidates_[i].corners[k].y + 0.5f) * scale - 0.5f);
+
+    if (detector_.decode(gray, quad, &detection) && detection.id == candidates_[i].id)
+      detections.push_back(detection);
+  }
+  detector_.refineCorners(gray, detections);
+
+  // Keep the velocity of markers that were already tracked
+  next_tracks_.clear();
+  for (size_t i = 0; i < detections.size(); i++)
+  {
+    Track track;
+    track.detection = detections[i];
+    track.velocity = cv::Point2f(0.0f, 0.0f);
+    track.missed = 0;
+
+    cv::Point2f center = quadCenter(detections[i].corners);
+    float nearest = std::numeric_limits<float>::max();
+    for (size_t j = 0; j < tracks_.size(); j++)
+    {
+      if (tracks_[j].detection.id != detections[i].id) continue;
+
+      cv::Point2f previous = quadCenter(tracks_[j].detection.corners);
+      float distance = squaredDistance(center, previous);
+      if (distance < nearest)
+      {
+        nearest = distance;
+        track.velocity = cv::Point2f((center.x - previous.x) / (tracks_[j].missed + 1),
+                                     (center.y - previous.y) / (tracks_[j].missed + 1));
+      }
+    }
+    next_tracks_.push_back(track);
+  }
+  tracks_.swap(next_tracks_);
+  frames_since_scan_ = 0;
+}
+
+bool MarkerTracker::trackMarker(const cv::Mat &gray, Track &track)
+{
+  // Constant velocity prediction; the window grows with every missed frame
+  const int steps = track.missed + 1;
+  cv::Point2f predicted[4];
+  float min_x = std::numeric_limits<float>::max();
+  float min_y = std::numeric_limits<float>::max();
+  float max_x = -std::numeric_limits<float>::max();
+  float max_y = -std::numeric_limits<float>::max();
+  for (int k = 0; k < 4; k++)
+  {
+    predicted[k] = cv::Point2f(track.detection.corners[k].x + track.velocity.x * steps,
+                               track.detection.corners[k].y + track.velocity.y * steps);
+    min_x = std::min(min_x, predicted[k].x);
+    min_y = std::min(min_y, predicted[k].y);
+    max_x = std::max(max_x, predicted[k].x);
+    max_y = std::max(max_y, predicted[k].y);
+  }
+
+  float side = std::max(max_x - min_x, max_y - min_y);
+  float margin = side * (float)params_.roi_margin * steps +
+                 (std::fabs(track.velocity.x) + std::fabs(track.velocity.y)) * steps;
+
+  int left   = std::max(0, (int)std::floor(min_x - margin));
+  int top    = std::max(0, (int)std::floor(min_y - margin));
+  int right  = std::min(gray.cols, (int)std::ceil(max_x + margin) + 1);
+  int bottom = std::min(gray.rows, (int)std::ceil(max_y + margin) + 1);
+  if (right - left < MarkerDictionary::MARKER_CELLS * 2 || bottom - top < MarkerDictionary::MARKER_CELLS * 2)
+    return false;
+
+  const cv::Rect roi(left, top, right - left, bottom - top);
+  detector_.detect(gray(roi), candidates_);
+
+  const cv::Point2f offset((float)left, (float)top);
+  const cv::Point2f predicted_center = quadCenter(predicted);
+  int best = -1;
+  float nearest = std::numeric_limits<float>::max();
+  for (size_t i = 0; i < candidates_.size(); i++)
+  {
+    if (candidates_[i].id != track.detection.id) continue;
+
+    cv::Point2f center = quadCenter(candidates_[i].corners);
+    float distance = squaredDistance(cv::Point2f(center.x + offset.x, center.y + offset.y), predicted_center);
+    if (distance < nearest)
+    {
+      nearest = distance;
+      best = (int)i;
+    }
+  }
+  if (best < 0) return false;
+
+  const cv::Point2f previous_center = quadCenter(track.detection.corners);
+  track.detection = candidates_[best];
+  for (int k = 0; k < 4; k++)
+  {
+    track.detection.corners[k].x += offset.x;
+    track.detection.corners[k].y += offset.y;
+  }
+
+  cv::Point2f center = quadCenter(track.detection.corners);
+  track.velocity = cv::Point2f((center.x - previous_center.x) / steps, (center.y - previous_center.y) / steps);
+  return true;
+}
+
+}  // namespace open_manipulator_ar_markers
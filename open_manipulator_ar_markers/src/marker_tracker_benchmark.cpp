@@ -0,0 +1,176 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+
+#include <time.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+
+#include "sensor_msgs/CompressedImage.h"
+
+#include "open_manipulator_ar_markers/marker_dictionary.h"
+#include "open_manipulator_ar_markers/marker_detector.h"
+#include "open_manipulator_ar_markers/marker_tracker.h"
+
+using namespace open_manipulator_ar_markers;
+
+namespace
+{
+double monotonicTime()
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+void printTimes(const char *name, std::vector<double> times)
+{
+  if (times.empty()) return;
+
+  double sum = 0.0;
+  for (size_t i = 0; i < times.size(); i++)
+    sum += times[i];
+  std::sort(times.begin(), times.end());
+
+  printf("%-12s mean %7.3f  p50 %7.3f  p95 %7.3f  max %7.3f [ms/frame]\n", name,
+         sum / times.size() * 1e3,
+         times[times.size() / 2] * 1e3,
+         times[std::min(times.size() - 1, (size_t)(times.size() * 0.95))] * 1e3,
+         times.back() * 1e3);
+}
+
+double meanCornerError(const MarkerDetection &a, const MarkerDetection &b)
+{
+  double error = 0.0;
+  for (int k = 0; k < 4; k++)
+    error += std::sqrt((a.corners[k].x - b.corners[k].x) * (a.corners[k].x - b.corners[k].x) +
+                       (a.corners[k].y - b.corners[k].y) * (a.corners[k].y - b.corners[k].y));
+  return error / 4.0;
+}
+}  // namespace
+
+// Replays a recorded compressed image stream through the full frame detector
+// and the tracking front-end, and compares their cost and detections.
+// usage: marker_tracker_benchmark <bag> [topic] [max frames]
+// e.g. a bag of `rosbag record /camera/image/compressed` taken during the demo
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    printf("usage: %s <bag> [topic] [max frames]\n", argv[0]);
+    return 1;
+  }
+  std::string topic = argc > 2 ? argv[2] : "/camera/image/compressed";
+  size_t max_frames = argc > 3 ? (size_t)atoi(argv[3]) : 900;
+
+  // Decode everything first so only detection is timed
+  std::vector<cv::Mat> frames;
+  try
+  {
+    rosbag::Bag bag(argv[1], rosbag::bagmode::Read);
+    rosbag::View view(bag, rosbag::TopicQuery(topic));
+    for (rosbag::View::iterator it = view.begin(); it != view.end() && frames.size() < max_frames; ++it)
+    {
+      sensor_msgs::CompressedImage::ConstPtr msg = it->instantiate<sensor_msgs::CompressedImage>();
+      if (!msg) continue;
+
+      const cv::Mat compressed(1, (int)msg->data.size(), CV_8UC1, const_cast<uint8_t *>(msg->data.data()));
+      cv::Mat gray = cv::imdecode(compressed, cv::IMREAD_GRAYSCALE);
+      if (!gray.empty()) frames.push_back(gray);
+    }
+    bag.close();
+  }
+  catch (rosbag::BagException &ex)
+  {
+    printf("failed to read %s: %s\n", argv[1], ex.what());
+    return 1;
+  }
+
+  if (frames.empty())
+  {
+    printf("no %s frames in %s\n", topic.c_str(), argv[1]);
+    return 1;
+  }
+  printf("%zu frames of %dx%d from %s\n", frames.size(), frames[0].cols, frames[0].rows, topic.c_str());
+
+  MarkerDictionary dictionary;
+  MarkerDetector detector(dictionary);
+  MarkerTracker tracker(detector);
+
+  std::vector<std::vector<MarkerDetection> > reference(frames.size());
+  std::vector<double> full_frame_times;
+  for (size_t i = 0; i < frames.size(); i++)
+  {
+    double start = monotonicTime();
+    detector.detect(frames[i], reference[i]);
+    full_frame_times.push_back(monotonicTime() - start);
+  }
+
+  std::vector<MarkerDetection> detections;
+  std::vector<double> tracking_times;
+  size_t num_of_full_scan = 0;
+  size_t num_of_reference = 0;
+  size_t num_of_found = 0;
+  double corner_error = 0.0;
+  for (size_t i = 0; i < frames.size(); i++)
+  {
+    double start = monotonicTime();
+    tracker.track(frames[i], detections);
+    tracking_times.push_back(monotonicTime() - start);
+    if (tracker.lastFrameWasFullScan()) num_of_full_scan++;
+
+    // A reference marker counts as found when the tracker reports the same id within 2 pixels
+    for (size_t j = 0; j < reference[i].size(); j++)
+    {
+      num_of_reference++;
+      for (size_t k = 0; k < detections.size(); k++)
+      {
+        if (detections[k].id != reference[i][j].id) continue;
+
+        double error = meanCornerError(detections[k], reference[i][j]);
+        if (error < 2.0)
+        {
+          num_of_found++;
+          corner_error += error;
+          break;
+        }
+      }
+    }
+  }
+
+  printTimes("full frame", full_frame_times);
+  printTimes("tracking", tracking_times);
+
+  double full_frame_sum = 0.0, tracking_sum = 0.0;
+  for (size_t i = 0; i < frames.size(); i++)
+  {
+    full_frame_sum += full_frame_times[i];
+    tracking_sum += tracking_times[i];
+  }
+  printf("speedup %.2fx, full scans %zu/%zu frames\n",
+         tracking_sum > 0.0 ? full_frame_sum / tracking_sum : 0.0, num_of_full_scan, frames.size());
+  printf("found %zu/%zu reference markers, mean corner difference %.3f pixel\n",
+         num_of_found, num_of_reference, num_of_found ? corner_error / num_of_found : 0.0);
+  return 0;
+}
@@ -0,0 +1,269 @@
+﻿#ifndef OPEN_MANIPULATOR_FINAL_H
+#define OPEN_MANIPULATOR_FINAL_H
+
+#include <ros/ros.h>
+#include <ros/callback_queue.h>
+#include <ros/file_log.h>
+#include <map>
+#include <mutex>
+#include <termios.h>
+#include <sys/ioctl.h>
+
+#include "open_manipulator_msgs/OpenManipulatorState.h"
+#include "open_manipulator_msgs/KinematicsPose.h"
+#include "open_manipulator_msgs/SetJointPosition.h"
+#include "open_manipulator_msgs/SetKinematicsPose.h"
+
+#include "ar_track_alvar_msgs/AlvarMarkers.h"
+#include "sensor_msgs/CameraInfo.h"
+#include "sensor_msgs/Image.h"
+#include "sensor_msgs/image_encodings.h"
+#include "sensor_msgs/JointState.h"
+#include "std_msgs/UInt8.h"
+
+#include "open_manipulator_pick_and_place/arm_kinematics.h"
+#include "open_manipulator_pick_and_place/camera_transform_monitor.h"
+#include "open_manipulator_pick_and_place/depth_roi_sampler.h"
+#include "open_manipulator_pick_and_place/event_log.h"
+#include "open_manipulator_pick_and_place/flight_recorder.h"
+#include "open_manipulator_pick_and_place/joint_state_buffer.h"
+#include "open_manipulator_pick_and_place/keyboard_reader.h"
+#include "open_manipulator_pick_and_place/latency_statistics.h"
+#include "open_manipulator_pick_and_place/marker_fusion.h"
+#include "open_manipulator_pick_and_place/path_timing.h"
+#include "open_manipulator_pick_and_place/pose_library.h"
+#include "open_manipulator_pick_and_place/sequence_checkpoint.h"
+#include "open_manipulator_pick_and_place/step_wait.h"
+#include "open_manipulator_pick_and_place/stop_controller.h"
+#include "open_manipulator_pick_and_place/trace_writer.h"
+#include "open_manipulator_pick_and_place/trajectory_client.h"
+#include "open_manipulator_pick_and_place/voxel_grid.h"
+
+#define NUM_OF_JOINT_AND_TOOL 5
+#define HOME_POSE   'q'
+#define DEMO_START  'w'
+#define DEMO_STOP   'e'
+
+// perception_demand values, see open_manipulator_ar_markers/detection_gate.h
+#define PERCEPTION_DEMAND_NONE  0
+#define PERCEPTION_DEMAND_LOW   1
+#define PERCEPTION_DEMAND_FULL  2
+
+#define MAX_SEARCH_ATTEMPTS  8
+#define SEARCH_PATH_TIME     2.0  // base joint sweep per attempt [s]
+#define SEARCH_SETTLE_TIME   1.0  // extra wait without motion compensation [s]
+
+#define SEARCH_IN_PROGRESS  0
+#define SEARCH_FOUND        1
+#define SEARCH_FAILED       2
+
+// 포즈 라이브러리 키 (소스의 기본값 순서), config/poses.yaml 참고
+#define POSE_HOME              0   // q 키의 joint1..joint4
+#define POSE_HOME_GRIPPER      1
+#define POSE_DEMO_HOME         2   // 데모 처음과 끝
+#define POSE_INITIAL           3   // 마커 탐색 자세, joint2..joint4는 탐색에도 사용
+#define POSE_GRIPPER_OPEN      4
+#define POSE_GRIPPER_CLOSE     5
+#define POSE_GRIP_ORIENTATION  6   // w x y z
+#define POSE_PICK              7   // 집을 마커 기준 x y 오프셋, z (depth_topic이 없을 때)
+#define POSE_PLACE             8   // 놓을 마커 기준 x y 오프셋, z (depth_topic이 없을 때)
+#define POSE_LIFT              9   // 놓은 뒤 상승, 놓을 마커 기준 x y 오프셋, z
+#define POSE_MOVE_TIME         10  // [s]
+#define POSE_APPROACH_TIME     11  // 마커로 접근하는 task space 경로 [s]
+#define POSE_GRIP_TIME         12  // 잡거나 놓기 전 대기 [s]
+#define POSE_OPEN_TIME         13  // 초기 자세에서 그리퍼를 열기 전 대기 [s]
+#define POSE_HOME_RETURN_TIME  14  // 글자 쓰기 끝의 demo_home [s]
+#define POSE_LETTER_MOVE_TIME  15  // [s]
+#define POSE_LETTER_LIFT_TIME  16  // R과 A 사이 demo_home [s]
+#define POSE_LETTER_I          17  // 글자별 joint1..joint4
+#define POSE_LETTER_R          18
+#define POSE_LETTER_A          19
+#define POSE_LETTER_S          20
+#define POSE_LETTER_C          21
+#define NUM_OF_POSE            22
+
+typedef struct _ArMarker
+{
+  uint32_t id;
+  double position[3];
+  ros::Time stamp;
+} ArMarker;
+
+class OpenManipulatorPickandPlace
+{
+ private:
+  // ROS NodeHandle
+  ros::NodeHandle node_handle_;
+  ros::NodeHandle priv_node_handle_;
+  // realtime이면 마커/깊이 콜백은 이 큐에서 일반 우선순위 스피너 스레드가 처리 (제어 스레드 밖).
+  // 구독자보다 먼저 선언해 구독자보다 나중에 소멸
+  ros::CallbackQueue perception_queue_;
+  boost::shared_ptr<ros::AsyncSpinner> perception_spinner_;
+  // 그 콜백과 tick이 함께 쓰는 marker_fusion_, fused_marker_pose_, depth_image_, depth_sampler_, voxel_grid_ 보호.
+  // 복사와 조회 동안만 잡고 격자 삽입 중에는 잡지 않음
+  std::mutex perception_mutex_;
+  open_manipulator_pick_and_place::TrajectoryClient trajectory_;  // goal_* services as goals
+  ros::Publisher perception_demand_pub_;
+
+  ros::Subscriber open_manipulator_states_sub_;
+  ros::Subscriber open_manipulator_joint_states_sub_;
+  ros::Subscriber open_manipulator_kinematics_pose_sub_;
+  std::vector<ros::Subscriber> ar_pose_marker_sub_;  // 마커 소스마다 하나
+
+  std::vector<double> present_joint_angle_;
+  std::vector<double> present_kinematic_position_;
+  std::vector<std::string> joint_name_;
+  bool open_manipulator_is_moving_;
+  std::vector<ArMarker> ar_marker_pose;     // 이번 tick 시점의 fused_marker_pose_
+  std::vector<ArMarker> fused_marker_pose_;  // arPoseMarkerCallback이 마지막으로 합친 마커
+
+  uint8_t mode_state_;
+  uint8_t demo_count_;
+  uint8_t pick_ar_id_;
+  uint8_t pick_marker_id_;   // 집을 마커 ID
+  uint8_t place_marker_id_;  // 놓을 마커 ID
+  uint8_t perception_demand_;
+
+  // Image capture to task space command issued from a marker pose
+  open_manipulator_pick_and_place::LatencyStatistics frame_to_command_latency_;
+
+  // Markers reported in camera_frame_ are moved to the world frame with the
+  // joint positions at their capture time, so they stay valid while moving
+  open_manipulator_pick_and_place::JointStateBuffer joint_state_buffer_;
+  open_manipulator_pick_and_place::ArmKinematics arm_kinematics_;
+  // 관절 거리와 속도/가속도 한계로 정한 path_time
+  open_manipulator_pick_and_place::PathTiming path_timing_;
+  std::string camera_frame_;
+  bool use_motion_compensation_;
+  boost::shared_ptr<open_manipulator_pick_and_place::CameraTransformMonitor> camera_transform_monitor_;
+
+  // 모든 카메라(marker_sources)의 마커를 하나의 표로 합침
+  open_manipulator_pick_and_place::MarkerFusion marker_fusion_;
+
+  // 정렬된 깊이 영상(depth_topic)에서 마커 아래 높이를 읽어 집기/놓기 z로 사용
+  ros::Subscriber depth_image_sub_;
+  ros::Subscriber depth_info_sub_;
+  sensor_msgs::Image::ConstPtr depth_image_;
+  open_manipulator_pick_and_place::DepthRoiSampler depth_sampler_;
+  double depth_roi_half_size_;
+  double depth_scale_;
+  double depth_max_age_;
+  double grasp_below_top_;
+  double grasp_min_height_;
+  double place_clearance_;
+  double held_height_;  // 잡은 지점의 상자 바닥으로부터 높이, 음수면 모름
+
+  // 같은 깊이 영상으로 만든 작업 공간 점유 격자, 경로가 막히면 명령을 보내지 않고 다음 주기에 재시도
+  open_manipulator_pick_and_place::VoxelGrid voxel_grid_;
+  open_manipulator_pick_and_place::VoxelGrid perception_voxel_grid_;  // 여기에 삽입한 뒤 voxel_grid_로 복사
+  bool use_voxel_grid_;
+  int voxel_inflation_;         // [셀]
+  double voxel_ignore_radius_;  // 도구의 시작/목표 주변에서 무시할 반경 [m]
+  bool is_path_blocked_;
+  uint32_t num_of_blocked_path_;
+  double blocked_since_;         // [s], 경로가 비어 있으면 0
+  double blocked_path_timeout_;  // [s], 0이면 계속 기다림
+
+  // 단계가 바뀔 때마다 진행 상태를 매핑된 파일에 저장, 재시작하면 관절 상태를 다시 읽은 뒤 이어서 진행
+  open_manipulator_pick_and_place::SequenceCheckpoint checkpoint_;
+  open_manipulator_pick_and_place::SequenceState saved_state_;   // 마지막 저장 또는 이어서 할 상태
+  bool is_resume_pending_;
+  bool is_holding_;         // 마지막 그리퍼 명령이 닫기였음
+  double gripper_command_;  // [m]
+
+  // 잡기/놓기/마커 대기는 현재 자세 유지 명령 대신 이 노드의 주기에서 처리
+  open_manipulator_pick_and_place::StepWait step_wait_;
+  open_manipulator_pick_and_place::SettleDetector gripper_settle_;
+  open_manipulator_pick_and_place::SettleDetector marker_settle_;
+  int wait_marker_id_;
+
+  // 컨트롤러 호출은 제한 시간이 있음, 명령이 실패/시간 초과/계획 실패한 단계는 몇 번 다시 보내고 그래도 안 되면 데모 정지
+  uint32_t num_of_failed_command_;
+  int command_retries_;         // 재시도 중인 단계의 횟수
+  int max_command_retries_;
+  double command_retry_delay_;  // [s]
+  uint32_t num_of_aborted_demo_;
+
+  // Control path messages go through the event log instead of printf, and
+  // together with state, markers and commands into the flight recorder
+  open_manipulator_pick_and_place::EventLog event_log_;
+  open_manipulator_pick_and_place::FlightRecorder flight_recorder_;
+  open_manipulator_pick_and_place::TraceWriter trace_;
+  int16_t logged_demo_count_;
+  bool is_realtime_;  // SCHED_FIFO 제어 스레드에서 실행: 상태 화면 없음, 짧은 호출 제한 시간
+
+  // 마커 탐색 (case 3, 6): ID별 마지막 관측과 탐색 상태
+  std::map<uint32_t, ArMarker> last_seen_marker_;
+  bool is_searching_;
+  int search_attempts_;
+  ros::Time search_look_time_;  // 이 시각 이후의 관측만 사용
+  ros::Time search_deadline_;   // 다음 탐색 동작 시각
+
+  // 포즈와 경로 시간, pose_file이 바뀌면 데모 사이클 사이에 다시 적용
+  open_manipulator_pick_and_place::PoseLibrary poses_;
+
+  // 정지 키와 stop 토픽은 타이머를 기다리지 않고 각자의 스레드에서 팔을 멈춤
+  open_manipulator_pick_and_place::StopController stop_;
+  open_manipulator_pick_and_place::KeyboardReader keyboard_;
+
+ public:
+  OpenManipulatorPickandPlace();
+  OpenManipulatorPickandPlace(ros::NodeHandle node_handle, ros::NodeHandle priv_node_handle);
+  ~OpenManipulatorPickandPlace();
+
+  void initServiceClient();
+  void initSubscribe();
+  void initPublisher();
+  void initCameraModel();
+  void initEventLog();
+  void initPoseLibrary();
+  void initStop();
+  void initCheckpoint();
+
+  void manipulatorStatesCallback(const open_manipulator_msgs::OpenManipulatorState::ConstPtr &msg);
+  void kinematicsPoseCallback(const open_manipulator_msgs::KinematicsPose::ConstPtr &msg);
+  void jointStatesCallback(const sensor_msgs::JointState::ConstPtr &msg);
+  void arPoseMarkerCallback(const ar_track_alvar_msgs::AlvarMarkers::ConstPtr &msg, size_t source);
+  void depthImageCallback(const sensor_msgs::Image::ConstPtr &msg);
+  void depthInfoCallback(const sensor_msgs::CameraInfo::ConstPtr &msg);
+  void trajectoryDoneCallback(uint8_t state, const open_manipulator_pick_and_place::TrajectoryFeedback &feedback);
+  void processDigitInput(char first_input);
+  void moveHomePose();
+
+
+  bool setJointSpacePath(std::vector<std::string> joint_name, std::vector<double> joint_angle, double path_time);
+  bool setToolControl(std::vector<double> joint_angle);
+  bool setTaskSpacePath(std::vector<double> kinematics_pose, std::vector<double> kinematics_orientation, double path_time);
+  void recordFrameToCommandLatency(const ArMarker &marker);
+  bool cameraToWorld(const ros::Time &stamp, const double camera_position[3], double world_position[3]);
+  bool depthHeight(const double world_position[3], double *top_z, double *support_z);
+  double pickHeight(const ArMarker &marker);
+  double placeHeight(const std::vector<double> &place_position);
+  bool isJointPathClear(const std::vector<double> &joint_angle);
+  bool isTaskPathClear(const std::vector<double> &kinematics_pose);
+  void updatePathBlocked(bool is_clear, uint8_t service, double blocked_at);
+  void logEvent(uint32_t event, double a0 = 0.0, double a1 = 0.0);
+  void saveCheckpoint();
+  void resumeSequence();
+  int resumeStep(int step, bool is_holding);
+  void startWait(uint8_t condition, double time, int marker_id = -1);
+  bool isStepWaiting();
+  void updateCommandResult(uint8_t state, uint8_t service, double deadline);
+  void retryStep(uint8_t step);
+  void holdBlockedStep(uint8_t step);
+  void abortDemo();
+  int searchMarker(uint8_t marker_id, uint32_t search_event, ArMarker *marker);
+  uint8_t perceptionDemand();
+  void updatePerceptionDemand();
+
+
+  void publishCallback(const ros::TimerEvent&);
+  void setModeState(char ch);
+  void demoSequence();
+
+
+  void printText();
+  bool kbhit();
+};
+
+#endif //OPEN_MANIPULATOR_final_H
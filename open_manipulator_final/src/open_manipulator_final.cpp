@@ -2,14 +2,66 @@
 
 #define INPUT_WAIT_TIME 2  // 두 번째 입력 대기 시간 (초)
 
+// 기본 포즈 라이브러리 (POSE_* 순서), pose_file 값이 우선
+static const open_manipulator_pick_and_place::PoseEntry DEFAULT_POSES[NUM_OF_POSE] =
+{
+    {"home",             4, { 0.01, -0.80,  0.00, 1.90}},
+    {"home_gripper",     1, { 0.0}},
+    {"demo_home",        4, { 0.00, -1.05,  0.35, 0.70}},
+    {"initial",          4, { 0.01, -0.80,  0.00, 1.90}},
+    {"gripper_open",     1, { 0.010}},
+    {"gripper_close",    1, {-0.008}},
+    {"grip_orientation", 4, { 0.74,  0.00,  0.66, 0.00}},
+    {"pick",             3, { 0.005, 0.000, 0.033}},
+    {"place",            3, { 0.005, 0.000, 0.069}},
+    {"lift",             3, { 0.030, 0.030, 0.170}},
+    {"move_time",        1, { 2.0}},
+    {"approach_time",    1, { 3.0}},
+    {"grip_time",        1, { 1.0}},
+    {"open_time",        1, { 3.0}},
+    {"home_return_time", 1, { 0.01}},
+    {"letter_move_time", 1, { 1.0}},
+    {"letter_lift_time", 1, { 0.1}},
+    {"letter_i",         4, {-0.063,  0.061, -1.488, -0.012}},
+    {"letter_r",         4, {-0.015,  0.030,  0.779,  1.759}},
+    {"letter_a",         4, {-0.032,  0.078,  0.894,  0.021}},
+    {"letter_s",         4, { 0.000, -1.085,  0.508, -0.341}},
+    {"letter_c",         4, {-0.031, -1.235,  0.032,  1.119}},
+};
+
 OpenManipulatorPickandPlace::OpenManipulatorPickandPlace()
-    : node_handle_(""),
-      priv_node_handle_("~"),
+    : OpenManipulatorPickandPlace(ros::NodeHandle(""), ros::NodeHandle("~"))
+{
+}
+
+OpenManipulatorPickandPlace::OpenManipulatorPickandPlace(ros::NodeHandle node_handle, ros::NodeHandle priv_node_handle)
+    : node_handle_(node_handle),
+      priv_node_handle_(priv_node_handle),
       mode_state_(0),
       demo_count_(0),
       pick_ar_id_(0),
       pick_marker_id_(-1),   // 초기값: 유효하지 않은 ID
-      place_marker_id_(-1)   // 초기값: 유효하지 않은 ID
+      place_marker_id_(-1),  // 초기값: 유효하지 않은 ID
+      perception_demand_(PERCEPTION_DEMAND_LOW),
+      held_height_(-1.0),
+      use_voxel_grid_(false),
+      is_path_blocked_(false),
+      num_of_blocked_path_(0),
+      blocked_since_(0.0),
+      blocked_path_timeout_(10.0),
+      is_resume_pending_(false),
+      is_holding_(false),
+      gripper_command_(0.0),
+      wait_marker_id_(-1),
+      num_of_failed_command_(0),
+      command_retries_(0),
+      max_command_retries_(2),
+      command_retry_delay_(0.5),
+      num_of_aborted_demo_(0),
+      logged_demo_count_(-1),
+      is_searching_(false),
+      search_attempts_(0),
+      poses_(DEFAULT_POSES, NUM_OF_POSE)
 {
     present_joint_angle_.resize(NUM_OF_JOINT_AND_TOOL, 0.0);
     present_kinematic_position_.resize(3, 0.0);
@@ -19,24 +71,242 @@ OpenManipulatorPickandPlace::OpenManipulatorPickandPlace()
     joint_name_.push_back("joint3");
     joint_name_.push_back("joint4");
 
+    // SCHED_FIFO 제어 스레드(control_loop.h)에서는 printText()(clear용 셸 실행과 화면 전체 출력)를 건너뛰고,
+    // 컨트롤러 호출이 주기를 막는 시간도 주기의 일부로 제한
+    is_realtime_ = priv_node_handle_.param<bool>("realtime", false);
+
+    initEventLog();
+    initPoseLibrary();
+    initCameraModel();
     initServiceClient();
     initSubscribe();
+    initPublisher();
+    initStop();
+    initCheckpoint();
+
+    // 콜백이 위의 모든 것을 쓰므로 마지막에 시작
+    if (is_realtime_)
+    {
+        perception_spinner_.reset(new ros::AsyncSpinner(1, &perception_queue_));
+        perception_spinner_->start();
+    }
 }
 
 OpenManipulatorPickandPlace::~OpenManipulatorPickandPlace()
 {
-    if (ros::isStarted())
+    if (perception_spinner_) perception_spinner_->stop();
+
+    // ROS is shut down by the owner (main() or the nodelet manager), not here,
+    // so that unloading the nodelet does not take the whole manager down.
+}
+
+void OpenManipulatorPickandPlace::initEventLog()
+{
+    // 터미널 출력은 기록 스레드가 담당하므로 제어 루프가 터미널 속도에 묶이지 않음
+    // 기본 파일 이름은 노드 이름 (매니저 안에서는 nodelet 이름)
+    std::string name = open_manipulator_pick_and_place::nodeFileName(priv_node_handle_.getNamespace());
+    std::string file = priv_node_handle_.param<std::string>("event_log_file",
+                                                           ros::file_log::getLogDirectory() + "/" + name + "_events.bin");
+    // 상태 화면이 없을 때만 터미널에 출력, 상태 화면은 최근 이벤트를 직접 표시
+    bool echo = priv_node_handle_.param<bool>("event_log_echo", is_realtime_);
+    if (!event_log_.open(file, echo))
+    {
+        ROS_ERROR("Cannot open the event log %s, events are only printed", file.c_str());
+        event_log_.open("", echo);
+    }
+
+    // 최근 기록을 고정 크기 링에 유지, 실패나 치명적 시그널 시 같은 폴더에 덤프
+    if (priv_node_handle_.param<bool>("flight_recorder", true))
+    {
+        std::string directory = priv_node_handle_.param<std::string>("flight_recorder_directory", ros::file_log::getLogDirectory());
+        int records = priv_node_handle_.param<int>("flight_recorder_records", open_manipulator_pick_and_place::FlightRecorder::DEFAULT_CAPACITY);
+        double seconds = priv_node_handle_.param<double>("flight_recorder_seconds", 30.0);
+        if (flight_recorder_.open(directory, name + "_flight", records, seconds))
+            flight_recorder_.installSignalHandlers();
+        else
+            ROS_ERROR("Cannot create the flight recorder %s/%s_flight.ring, or another instance uses it", directory.c_str(), name.c_str());
+    }
+
+    // 데모 실행마다 Chrome trace event JSON 기록, 기본은 꺼짐
+    if (priv_node_handle_.param<bool>("trace", false))
+    {
+        trace_.enable(priv_node_handle_.param<std::string>("trace_directory", ros::file_log::getLogDirectory()),
+                      name + "_trace");
+    }
+}
+
+void OpenManipulatorPickandPlace::initPoseLibrary()
+{
+    // 파일이 없으면 기본 포즈 사용
+    std::string file = priv_node_handle_.param<std::string>("pose_file", "");
+    if (file.empty()) return;
+
+    std::string error;
+    if (poses_.load(file, &error))
+        poses_.update();
+    else
+        ROS_ERROR("Cannot load the pose library, using the built-in poses: %s", error.c_str());
+
+    if (priv_node_handle_.param<bool>("pose_file_watch", true) && !poses_.watch(file))
+        ROS_ERROR("Cannot watch %s for changes, poses are not reloaded", file.c_str());
+}
+
+void OpenManipulatorPickandPlace::logEvent(uint32_t event, double a0, double a1)
+{
+    event_log_.log(event, a0, a1);
+    flight_recorder_.record(event, a0, a1);
+}
+
+void OpenManipulatorPickandPlace::initCameraModel()
+{
+    camera_frame_            = priv_node_handle_.param<std::string>("camera_frame", "camera");
+    use_motion_compensation_ = priv_node_handle_.param<bool>("motion_compensation", true);
+
+    // link5 -> camera (x y z yaw pitch roll), static_transform_publisher 인자와 같은 순서
+    std::vector<double> extrinsic;
+    if (priv_node_handle_.getParam("camera_extrinsic", extrinsic))
+    {
+        if (extrinsic.size() == 6)
+            arm_kinematics_.setCameraExtrinsic(extrinsic[0], extrinsic[1], extrinsic[2], extrinsic[3], extrinsic[4], extrinsic[5]);
+        else
+            ROS_ERROR("camera_extrinsic needs 6 values (x y z yaw pitch roll), using the raspicam mount");
+    }
+
+    // TF는 이 비교에만 사용, 0이면 비활성화
+    double tf_comparison_period = priv_node_handle_.param<double>("tf_comparison_period", 1.0);
+    if (tf_comparison_period > 0.0)
+    {
+        camera_transform_monitor_.reset(new open_manipulator_pick_and_place::CameraTransformMonitor(
+            node_handle_, joint_state_buffer_, arm_kinematics_,
+            priv_node_handle_.param<std::string>("world_frame", "world"), camera_frame_, tf_comparison_period));
+    }
+
+    // 마커 토픽별 오차(새 관측), 나이에 따른 오차 증가, 최대 나이; 고정 카메라는 팔과 같이 움직이지 않음
+    std::vector<std::string> topic;
+    std::vector<double> sigma, drift, max_age;
+    std::vector<bool> is_fixed;
+    priv_node_handle_.param("marker_sources", topic, std::vector<std::string>(1, "/ar_pose_marker"));
+    priv_node_handle_.getParam("marker_source_sigma", sigma);
+    priv_node_handle_.getParam("marker_source_drift", drift);
+    priv_node_handle_.getParam("marker_source_max_age", max_age);
+    priv_node_handle_.getParam("marker_source_fixed", is_fixed);
+    for (size_t i = 0; i < topic.size(); i++)
     {
-        ros::shutdown();
-        ros::waitForShutdown();
+        open_manipulator_pick_and_place::MarkerSource source;
+        source.topic = topic[i];
+        source.sigma = i < sigma.size() && sigma[i] > 0.0 ? sigma[i] : 0.01;
+        source.drift = i < drift.size() ? drift[i] : 0.05;
+        source.max_age = i < max_age.size() ? max_age[i] : 1.0;
+        source.is_fixed = i < is_fixed.size() ? is_fixed[i] : false;
+        marker_fusion_.addSource(source);
     }
+
+    // 마커 아래에서 읽을 영역과 집기/놓기 높이 계산
+    depth_roi_half_size_ = priv_node_handle_.param<double>("depth_roi_half_size", 0.012);
+    depth_scale_         = priv_node_handle_.param<double>("depth_scale", 0.001);
+    depth_max_age_       = priv_node_handle_.param<double>("depth_max_age", 0.5);
+    grasp_below_top_     = priv_node_handle_.param<double>("grasp_below_top", 0.020);
+    grasp_min_height_    = priv_node_handle_.param<double>("grasp_min_height", 0.010);
+    place_clearance_     = priv_node_handle_.param<double>("place_clearance", 0.005);
+
+    // 깊이 영상으로 만드는 작업 공간 점유 격자, 기본은 꺼짐
+    use_voxel_grid_ = priv_node_handle_.param<bool>("voxel_grid", false);
+    if (use_voxel_grid_)
+    {
+        open_manipulator_pick_and_place::VoxelGridConfig config = open_manipulator_pick_and_place::defaultVoxelGridConfig();
+        double resolution = priv_node_handle_.param<double>("voxel_resolution", config.resolution);
+        for (int i = 0; i < 3; i++)
+            config.size[i] = (int)ceil(config.size[i] * config.resolution / resolution);  // 같은 작업 공간
+        config.resolution = resolution;
+        config.decay_time = priv_node_handle_.param<double>("voxel_decay_time", config.decay_time);
+        config.stride     = priv_node_handle_.param<int>("voxel_stride", config.stride);
+        voxel_grid_.configure(config);
+        perception_voxel_grid_.configure(config);
+    }
+    voxel_inflation_     = (int)ceil(priv_node_handle_.param<double>("voxel_inflation", 0.01) / voxel_grid_.config().resolution);
+    voxel_ignore_radius_ = priv_node_handle_.param<double>("voxel_ignore_radius", 0.05);
+    blocked_path_timeout_ = priv_node_handle_.param<double>("blocked_path_timeout", 10.0);
 }
 
 void OpenManipulatorPickandPlace::initServiceClient()
 {
-    goal_joint_space_path_client_ = node_handle_.serviceClient<open_manipulator_msgs::SetJointPosition>("goal_joint_space_path");
-    goal_tool_control_client_ = node_handle_.serviceClient<open_manipulator_msgs::SetJointPosition>("goal_tool_control");
-    goal_task_space_path_client_ = node_handle_.serviceClient<open_manipulator_msgs::SetKinematicsPose>("goal_task_space_path");
+    trajectory_.init(node_handle_, joint_name_,
+                     priv_node_handle_.param<double>("trajectory_timeout_margin", 2.0),
+                     priv_node_handle_.param<double>("hold_time", 0.1));
+    trajectory_.registerCallbacks(boost::bind(&OpenManipulatorPickandPlace::trajectoryDoneCallback, this, _1, _2),
+                                  open_manipulator_pick_and_place::TrajectoryClient::FeedbackCallback());
+
+    // 손으로 정한 path_time 대신 관절 한계가 허용하는 가장 짧은 시간을 사용
+    path_timing_.init(priv_node_handle_.param<bool>("auto_path_time", true),
+                      priv_node_handle_.param<std::vector<double> >("joint_velocity_limit", std::vector<double>(1, 2.0)),
+                      priv_node_handle_.param<std::vector<double> >("joint_acceleration_limit", std::vector<double>(1, 4.0)),
+                      priv_node_handle_.param<double>("path_time_safety_factor", 1.2),
+                      priv_node_handle_.param<double>("min_path_time", 0.2));
+
+    // 잡기/놓기 대기는 그리퍼가 멈추면, 집기 전 대기는 마커가 흔들리지 않으면 끝남 (시간은 최대값)
+    gripper_settle_.setLimits(priv_node_handle_.param<double>("gripper_settle_tolerance", 0.0005),
+                              priv_node_handle_.param<double>("gripper_settle_time", 0.3));
+    marker_settle_.setLimits(priv_node_handle_.param<double>("marker_settle_tolerance", 0.003),
+                             priv_node_handle_.param<double>("marker_settle_time", 0.5));
+
+    // 응답하지 않는 컨트롤러 호출은 service_call_timeout 후 실패
+    trajectory_.setCallTimeout(priv_node_handle_.param<double>("service_call_timeout", is_realtime_ ? 0.05 : 1.0));
+    max_command_retries_ = priv_node_handle_.param<int>("max_command_retries", 2);
+    command_retry_delay_ = priv_node_handle_.param<double>("command_retry_delay", 0.5);
+
+    // 컨트롤러가 뜨기 전에 보낸 명령이 조용히 실패하지 않도록 서비스를 기다림
+    double timeout = priv_node_handle_.param<double>("service_wait_timeout", 10.0);
+    if (!trajectory_.waitForServer(timeout))
+        ROS_WARN("Controller services not available after %.1f s, commands connect once they are", timeout);
+}
+
+void OpenManipulatorPickandPlace::trajectoryDoneCallback(uint8_t state, const open_manipulator_pick_and_place::TrajectoryFeedback &feedback)
+{
+    trace_.instant("goal done", "arm", TRACE_TRACK_ARM, "state", state);
+    if (state == TRAJECTORY_ABORTED)
+        logEvent(EVENT_TRAJECTORY_ABORTED, feedback.elapsed, trajectory_.pathTime());
+    else if (state == TRAJECTORY_PREEMPTED)
+        logEvent(EVENT_TRAJECTORY_PREEMPTED, feedback.progress * 100.0);
+}
+
+void OpenManipulatorPickandPlace::initStop()
+{
+    stop_.init(node_handle_, joint_name_, &joint_state_buffer_,
+               priv_node_handle_.param<double>("hold_time", 0.1),
+               priv_node_handle_.param<double>("stop_latency_budget", 0.009),
+               boost::bind(&OpenManipulatorPickandPlace::logEvent, this, _1, _2, _3));
+    stop_.setCallTimeout(priv_node_handle_.param<double>("service_call_timeout", 1.0));
+
+    // 'e'는 입력되는 즉시 키보드 스레드에서 처리 (9단계 입력 대기 중에도)
+    keyboard_.start("e", boost::bind(&open_manipulator_pick_and_place::StopController::request, &stop_, STOP_SOURCE_KEY));
+}
+
+void OpenManipulatorPickandPlace::initCheckpoint()
+{
+    memset(&saved_state_, 0, sizeof(saved_state_));
+    saved_state_.mode_state = -1;  // 첫 주기에 저장
+    if (!priv_node_handle_.param<bool>("checkpoint", true)) return;
+
+    std::string file = priv_node_handle_.param<std::string>("checkpoint_file",
+                                                           open_manipulator_pick_and_place::checkpointDirectory() + "/" +
+                                                           open_manipulator_pick_and_place::nodeFileName(priv_node_handle_.getNamespace()) +
+                                                           "_checkpoint.bin");
+    if (!checkpoint_.open(file))
+    {
+        ROS_ERROR("Cannot open the checkpoint %s, the demo is not resumed after a restart", file.c_str());
+        return;
+    }
+
+    // 실행 중이던 데모이고 오래되지 않았을 때만 (그 사이 작업대가 바뀌었을 수 있음)
+    open_manipulator_pick_and_place::SequenceState state;
+    double max_age = priv_node_handle_.param<double>("resume_max_age", 600.0);
+    if (priv_node_handle_.param<bool>("resume", true) && checkpoint_.load(&state) && state.mode_state == DEMO_START &&
+        (open_manipulator_pick_and_place::EventLog::now() - state.stamp) * 1e-9 < max_age)
+    {
+        saved_state_ = state;
+        is_resume_pending_ = true;
+        ROS_INFO("Resuming the demo from step %d once the joint states are read", state.demo_count);
+    }
 }
 
 void OpenManipulatorPickandPlace::initSubscribe()
@@ -44,63 +314,394 @@ void OpenManipulatorPickandPlace::initSubscribe()
     open_manipulator_states_sub_ = node_handle_.subscribe("states", 10, &OpenManipulatorPickandPlace::manipulatorStatesCallback, this);
     open_manipulator_joint_states_sub_ = node_handle_.subscribe("joint_states", 10, &OpenManipulatorPickandPlace::jointStatesCallback, this);
     open_manipulator_kinematics_pose_sub_ = node_handle_.subscribe("gripper/kinematics_pose", 10, &OpenManipulatorPickandPlace::kinematicsPoseCallback, this);
-    ar_pose_marker_sub_ = node_handle_.subscribe("/ar_pose_marker", 10, &OpenManipulatorPickandPlace::arPoseMarkerCallback, this);
+
+    // realtime이면 마커와 깊이 영상은 별도 스레드에서 받아, 전체 프레임 격자 삽입이 tick을 막지 않음
+    ros::NodeHandle perception_node_handle(node_handle_);
+    if (is_realtime_) perception_node_handle.setCallbackQueue(&perception_queue_);
+
+    for (size_t i = 0; i < marker_fusion_.numOfSource(); i++)
+    {
+        ar_pose_marker_sub_.push_back(perception_node_handle.subscribe<ar_track_alvar_msgs::AlvarMarkers>(
+            marker_fusion_.source(i).topic, 10, boost::bind(&OpenManipulatorPickandPlace::arPoseMarkerCallback, this, _1, i)));
+    }
+
+    // D435의 정렬된 깊이 영상 (예: /camera/aligned_depth_to_color/image_raw)과 같은 곳의 camera_info
+    std::string depth_topic = priv_node_handle_.param<std::string>("depth_topic", "");
+    if (!depth_topic.empty())
+    {
+        depth_image_sub_ = perception_node_handle.subscribe(depth_topic, 1, &OpenManipulatorPickandPlace::depthImageCallback, this);
+        depth_info_sub_ = perception_node_handle.subscribe(depth_topic.substr(0, depth_topic.rfind('/') + 1) + "camera_info", 1,
+                                                           &OpenManipulatorPickandPlace::depthInfoCallback, this);
+    }
+}
+
+void OpenManipulatorPickandPlace::initPublisher()
+{
+    // Latched, so a detector started after the node still gets the current demand
+    perception_demand_pub_ = node_handle_.advertise<std_msgs::UInt8>("perception_demand", 1, true);
+
+    std_msgs::UInt8 msg;
+    msg.data = perception_demand_ = perceptionDemand();
+    perception_demand_pub_.publish(msg);
 }
 
 bool OpenManipulatorPickandPlace::setJointSpacePath(std::vector<std::string> joint_name, std::vector<double> joint_angle, double path_time)
 {
-    open_manipulator_msgs::SetJointPosition srv;
-    srv.request.joint_position.joint_name = joint_name;
-    srv.request.joint_position.position = joint_angle;
-    srv.request.path_time = path_time;
+    if (!isJointPathClear(joint_angle)) return false;  // 격자에 막힌 경로는 보내지 않음
+    if (!stop_.beginCommand()) return false;  // 정지 중에는 보내지 않음
+
+    path_time = path_timing_.jointPathTime(&present_joint_angle_[0], &joint_angle[0], path_time);
+    open_manipulator_pick_and_place::TraceSpan span(trace_, "goal_joint_space_path", "rpc", TRACE_TRACK_CONTROL, "path_time", path_time);
+    flight_recorder_.record(EVENT_JOINT_COMMAND, joint_angle.at(0), joint_angle.at(1), joint_angle.at(2), joint_angle.at(3), path_time);
+    uint8_t state = trajectory_.sendJointGoal(joint_name, joint_angle, path_time, ros::Time::now().toSec());
+    stop_.endCommand();
+    updateCommandResult(state, EVENT_SERVICE_JOINT_SPACE_PATH, trajectory_.jointSpacePath().deadline());
+    return state == TRAJECTORY_PENDING;
+}
+
+bool OpenManipulatorPickandPlace::setToolControl(std::vector<double> joint_angle)
+{
+    if (!stop_.beginCommand()) return false;
+
+    open_manipulator_pick_and_place::TraceSpan span(trace_, "goal_tool_control", "rpc", TRACE_TRACK_CONTROL);
+    flight_recorder_.record(EVENT_TOOL_COMMAND, joint_angle.at(0));
+    uint8_t state = trajectory_.sendToolGoal(joint_angle);
+    stop_.endCommand();
+    gripper_command_ = joint_angle.at(0);
+    is_holding_ = gripper_command_ <= poses_.value(POSE_GRIPPER_CLOSE);
+    updateCommandResult(state, EVENT_SERVICE_TOOL_CONTROL, trajectory_.toolControl().deadline());
+    return state == TRAJECTORY_SUCCEEDED;
+}
+
+bool OpenManipulatorPickandPlace::setTaskSpacePath(std::vector<double> kinematics_pose, std::vector<double> kinematics_orientation, double path_time)
+{
+    if (!isTaskPathClear(kinematics_pose)) return false;
+    if (!stop_.beginCommand()) return false;
+
+    path_time = path_timing_.taskPathTime(arm_kinematics_, &present_joint_angle_[0], &kinematics_pose[0], &kinematics_orientation[0], path_time);
+    open_manipulator_pick_and_place::TraceSpan span(trace_, "goal_task_space_path", "rpc", TRACE_TRACK_CONTROL, "path_time", path_time);
+    flight_recorder_.record(EVENT_TASK_COMMAND, kinematics_pose.at(0), kinematics_pose.at(1), kinematics_pose.at(2), path_time);
+    uint8_t state = trajectory_.sendTaskGoal("gripper", kinematics_pose, kinematics_orientation, path_time, ros::Time::now().toSec());
+    stop_.endCommand();
+    updateCommandResult(state, EVENT_SERVICE_TASK_SPACE_PATH, trajectory_.taskSpacePath().deadline());
+    return state == TRAJECTORY_PENDING;
+}
 
-    if (goal_joint_space_path_client_.call(srv))
+void OpenManipulatorPickandPlace::recordFrameToCommandLatency(const ArMarker &marker)
+{
+    if (marker.stamp.isZero()) return;
+    frame_to_command_latency_.addSample((ros::Time::now() - marker.stamp).toSec());
+}
+
+bool OpenManipulatorPickandPlace::cameraToWorld(const ros::Time &stamp, const double camera_position[3], double world_position[3])
+{
+    double joint_angle[open_manipulator_pick_and_place::JointStateBuffer::NUM_OF_JOINT];
+    if (!joint_state_buffer_.interpolate(stamp.toSec(), joint_angle))
     {
-        return srv.response.is_planned;
+        ROS_WARN_THROTTLE(5.0, "No joint state at the marker capture time, marker ignored");
+        return false;
     }
-    return false;
+
+    open_manipulator_pick_and_place::transformPoint(arm_kinematics_.cameraToWorld(joint_angle), camera_position, world_position);
+    return true;
 }
 
-bool OpenManipulatorPickandPlace::setToolControl(std::vector<double> joint_angle)
+// world_position 아래 물체 윗면과 그 물체가 놓인 면의 높이 (주변이 안 보이면 NAN),
+// 마지막 깊이 영상과 그 촬영 시각의 관절 각도로 계산
+bool OpenManipulatorPickandPlace::depthHeight(const double world_position[3], double *top_z, double *support_z)
 {
-    open_manipulator_msgs::SetJointPosition srv;
-    srv.request.joint_position.joint_name.push_back("gripper");
-    srv.request.joint_position.position = joint_angle;
+    std::lock_guard<std::mutex> lock(perception_mutex_);
+    if (!depth_image_ || !depth_sampler_.hasIntrinsics()) return false;
 
-    if (goal_tool_control_client_.call(srv))
+    const sensor_msgs::Image &image = *depth_image_;
+    if ((ros::Time::now() - image.header.stamp).toSec() > depth_max_age_)
     {
-        return srv.response.is_planned;
+        ROS_WARN_THROTTLE(5.0, "Depth image older than %.1f s, using the pose library's heights", depth_max_age_);
+        return false;
     }
-    return false;
+    if (image.data.size() < (size_t)image.step * image.height) return false;
+
+    double joint_angle[open_manipulator_pick_and_place::JointStateBuffer::NUM_OF_JOINT];
+    if (!joint_state_buffer_.interpolate(image.header.stamp.toSec(), joint_angle)) return false;
+    open_manipulator_pick_and_place::RigidTransform camera_to_world = arm_kinematics_.cameraToWorld(joint_angle);
+
+    double center[3];
+    open_manipulator_pick_and_place::transformPoint(open_manipulator_pick_and_place::inverse(camera_to_world), world_position, center);
+
+    open_manipulator_pick_and_place::DepthRoiResult result;
+    bool is_sampled = false;
+    if (image.encoding == sensor_msgs::image_encodings::TYPE_16UC1 || image.encoding == sensor_msgs::image_encodings::MONO16)
+        is_sampled = depth_sampler_.sample((const uint16_t *)&image.data[0], image.width, image.height, image.step,
+                                           depth_scale_, center, depth_roi_half_size_, &result);
+    else if (image.encoding == sensor_msgs::image_encodings::TYPE_32FC1)
+        is_sampled = depth_sampler_.sample((const float *)&image.data[0], image.width, image.height, image.step,
+                                           1.0, center, depth_roi_half_size_, &result);
+    if (!is_sampled) return false;
+
+    double point[3], world_point[3];
+    open_manipulator_pick_and_place::DepthRoiSampler::alongRay(center, result.top_depth, point);
+    open_manipulator_pick_and_place::transformPoint(camera_to_world, point, world_point);
+    *top_z = world_point[2];
+
+    *support_z = NAN;
+    if (result.support_pixels > 0)
+    {
+        open_manipulator_pick_and_place::DepthRoiSampler::alongRay(center, result.support_depth, point);
+        open_manipulator_pick_and_place::transformPoint(camera_to_world, point, world_point);
+        *support_z = world_point[2];
+    }
+
+    logEvent(EVENT_DEPTH_HEIGHT, *top_z, *support_z);
+    return true;
 }
 
-bool OpenManipulatorPickandPlace::setTaskSpacePath(std::vector<double> kinematics_pose, std::vector<double> kinematics_orientation, double path_time)
+// 상자 윗면에서 grasp_below_top 아래, 단 놓인 면에서 grasp_min_height 이상; 깊이 영상이 없으면 포즈의 z
+double OpenManipulatorPickandPlace::pickHeight(const ArMarker &marker)
+{
+    held_height_ = -1.0;
+
+    double top_z, support_z;
+    if (!depthHeight(marker.position, &top_z, &support_z)) return poses_.value(POSE_PICK, 2);
+
+    return open_manipulator_pick_and_place::pickGraspHeight(top_z, support_z, grasp_below_top_, grasp_min_height_, &held_height_);
+}
+
+// 잡은 상자의 바닥이 놓을 자리(바닥 또는 쌓인 상자)보다 place_clearance 위에 오도록
+double OpenManipulatorPickandPlace::placeHeight(const std::vector<double> &place_position)
+{
+    double top_z, support_z;
+    if (held_height_ < 0.0 || !depthHeight(&place_position[0], &top_z, &support_z)) return place_position.at(2);
+
+    return open_manipulator_pick_and_place::placeGraspHeight(top_z, held_height_, place_clearance_);
+}
+
+bool OpenManipulatorPickandPlace::isJointPathClear(const std::vector<double> &joint_angle)
+{
+    if (!use_voxel_grid_) return true;
+
+    double blocked_at = 0.0;
+    bool is_clear;
+    {
+        std::lock_guard<std::mutex> lock(perception_mutex_);
+        is_clear = open_manipulator_pick_and_place::isJointPathFree(voxel_grid_, arm_kinematics_, &present_joint_angle_[0], &joint_angle[0],
+                                                                    8, voxel_inflation_, voxel_ignore_radius_, &blocked_at);
+    }
+    updatePathBlocked(is_clear, EVENT_SERVICE_JOINT_SPACE_PATH, blocked_at);
+    return is_clear;
+}
+
+bool OpenManipulatorPickandPlace::isTaskPathClear(const std::vector<double> &kinematics_pose)
+{
+    if (!use_voxel_grid_) return true;
+
+    double blocked_at = 0.0;
+    bool is_clear;
+    {
+        std::lock_guard<std::mutex> lock(perception_mutex_);
+        is_clear = open_manipulator_pick_and_place::isTaskPathFree(voxel_grid_, arm_kinematics_, &present_joint_angle_[0], &kinematics_pose[0],
+                                                                   voxel_inflation_, voxel_ignore_radius_, &blocked_at);
+    }
+    updatePathBlocked(is_clear, EVENT_SERVICE_TASK_SPACE_PATH, blocked_at);
+    return is_clear;
+}
+
+// 막히기 시작할 때 한 번만 기록, 재시도마다 기록하지 않음
+void OpenManipulatorPickandPlace::updatePathBlocked(bool is_clear, uint8_t service, double blocked_at)
+{
+    if (!is_clear)
+    {
+        if (!is_path_blocked_) logEvent(EVENT_PATH_BLOCKED, service, blocked_at * 100.0);
+        num_of_blocked_path_++;
+    }
+    is_path_blocked_ = !is_clear;
+}
+
+// 실패, 시간 초과, 계획 실패한 명령을 세어 retryStep()에서 사용, deadline은 호출한 서비스의 제한 시간
+void OpenManipulatorPickandPlace::updateCommandResult(uint8_t state, uint8_t service, double deadline)
+{
+    if (state == TRAJECTORY_REJECTED) logEvent(EVENT_PATH_NOT_PLANNED, service);
+    else if (state == TRAJECTORY_LOST) logEvent(EVENT_SERVICE_CALL_FAILED, service);
+    else if (state == TRAJECTORY_TIMED_OUT) logEvent(EVENT_SERVICE_CALL_TIMED_OUT, service, deadline);
+    else return;
+    num_of_failed_command_++;
+}
+
+// command_retry_delay 후 같은 단계를 다시 보냄 (목표는 절대값), max_command_retries를 넘으면 팔을 세우고 데모 정지
+void OpenManipulatorPickandPlace::retryStep(uint8_t step)
+{
+    demo_count_ = step;
+    if (command_retries_ < max_command_retries_)
+    {
+        command_retries_++;
+        logEvent(EVENT_STEP_RETRIED, step, command_retries_);
+        startWait(STEP_WAIT_TIME, command_retry_delay_);
+        return;
+    }
+
+    logEvent(EVENT_DEMO_ABORTED, step, command_retries_);
+    abortDemo();
+}
+
+// 경로가 막힌 단계는 빌 때까지 매 주기 다시 시도, blocked_path_timeout이 지나면 명령 실패처럼 데모 정지
+void OpenManipulatorPickandPlace::holdBlockedStep(uint8_t step)
+{
+    demo_count_ = step;
+    double now = ros::Time::now().toSec();
+    if (blocked_since_ == 0.0) blocked_since_ = now;
+    if (blocked_path_timeout_ <= 0.0 || now - blocked_since_ < blocked_path_timeout_) return;
+
+    logEvent(EVENT_PATH_BLOCKED_ABORTED, step, now - blocked_since_);
+    abortDemo();
+}
+
+// 팔을 현재 자세로 세우고 데모 정지
+void OpenManipulatorPickandPlace::abortDemo()
+{
+    num_of_aborted_demo_++;
+    command_retries_ = 0;
+    blocked_since_ = 0.0;
+    step_wait_.cancel();
+    trajectory_.cancelGoal(ros::Time::now().toSec());
+    mode_state_ = DEMO_STOP;
+}
+
+// 모드, 단계, 그리퍼, 마커 번호가 바뀔 때마다 매핑된 파일에 저장
+void OpenManipulatorPickandPlace::saveCheckpoint()
+{
+    if (is_resume_pending_) return;  // 이어서 할 상태는 유지
+    if (saved_state_.mode_state == mode_state_ && saved_state_.demo_count == demo_count_ &&
+        saved_state_.is_holding == (uint32_t)is_holding_ &&
+        saved_state_.pick_marker_id == pick_marker_id_ && saved_state_.place_marker_id == place_marker_id_)
+        return;
+
+    saved_state_.mode_state = mode_state_;
+    saved_state_.demo_count = demo_count_;
+    saved_state_.pick_marker_id = pick_marker_id_;
+    saved_state_.place_marker_id = place_marker_id_;
+    saved_state_.is_holding = is_holding_;
+    saved_state_.gripper = gripper_command_;
+    saved_state_.held_height = held_height_;
+    checkpoint_.save(saved_state_);
+}
+
+// 관절 상태를 받은 뒤, 지금 팔과 그리퍼 상태에서 안전한 단계(resumeStep)부터 저장된 데모를 이어서 진행
+void OpenManipulatorPickandPlace::resumeSequence()
 {
-    open_manipulator_msgs::SetKinematicsPose srv;
+    open_manipulator_pick_and_place::JointSample sample;
+    if (!joint_state_buffer_.latest(&sample)) return;
 
-    srv.request.end_effector_name = "gripper";
+    is_resume_pending_ = false;
+    if (stop_.isStopped()) return;
 
-    srv.request.kinematics_pose.pose.position.x = kinematics_pose.at(0);
-    srv.request.kinematics_pose.pose.position.y = kinematics_pose.at(1);
-    srv.request.kinematics_pose.pose.position.z = kinematics_pose.at(2);
+    bool is_holding = open_manipulator_pick_and_place::isHoldingBox(saved_state_, present_joint_angle_.at(4), poses_.value(POSE_GRIPPER_CLOSE));
+    mode_state_ = DEMO_START;
+    demo_count_ = resumeStep(saved_state_.demo_count, is_holding);
+    pick_marker_id_ = saved_state_.pick_marker_id;
+    place_marker_id_ = saved_state_.place_marker_id;
+    held_height_ = is_holding ? saved_state_.held_height : -1.0;
+    logged_demo_count_ = -1;
+    is_searching_ = false;
+    trace_.beginRun();
+    logEvent(EVENT_SEQUENCE_RESUMED, saved_state_.demo_count, demo_count_);
+
+    // 컨트롤러도 재시작되었을 수 있으므로 다시 잡음
+    if (is_holding)
+    {
+        std::vector<double> gripper_value = {poses_.value(POSE_GRIPPER_CLOSE)};
+        setToolControl(gripper_value);
+    }
+}
 
-    srv.request.kinematics_pose.pose.orientation.w = kinematics_orientation.at(0);
-    srv.request.kinematics_pose.pose.orientation.x = kinematics_orientation.at(1);
-    srv.request.kinematics_pose.pose.orientation.y = kinematics_orientation.at(2);
-    srv.request.kinematics_pose.pose.orientation.z = kinematics_orientation.at(3);
+// 팔은 마지막 경로의 어디에서든 멈췄을 수 있으므로 그 구간을 시작하는 관절 공간 이동부터 다시 진행:
+// 상자를 잡고 있으면 잡은 뒤의 초기 자세부터, 잡기 전이거나 떨어뜨렸으면 초기 자세부터,
+// 놓은 뒤면 그리퍼 열기부터. 다음 동작 선택과 마무리 단계는 고정 관절 이동과 대기라서 그 단계부터
+int OpenManipulatorPickandPlace::resumeStep(int step, bool is_holding)
+{
+    if (step <= 0 || step >= 9) return std::max(step, 0);
 
-    srv.request.path_time = path_time;
+    if (is_holding) return 5;
+    if (step >= 7) return 7;
+    return 1;
+}
 
-    if (goal_task_space_path_client_.call(srv))
+void OpenManipulatorPickandPlace::startWait(uint8_t condition, double time, int marker_id)
+{
+    wait_marker_id_ = marker_id;
+    gripper_settle_.reset();
+    marker_settle_.reset();
+    step_wait_.start(condition, time, ros::Time::now().toSec());
+}
+
+// 최신 그리퍼 위치와 합친 마커로 대기 조건 확인, 대기 중에는 컨트롤러에 요청하지 않음
+bool OpenManipulatorPickandPlace::isStepWaiting()
+{
+    if (!step_wait_.isWaiting()) return false;
+
+    double now = ros::Time::now().toSec();
+    bool is_met = false;
+    if (step_wait_.condition() == STEP_WAIT_GRIPPER)
     {
-        return srv.response.is_planned;
+        gripper_settle_.update(now, &present_joint_angle_.at(4), 1);
+        is_met = gripper_settle_.isSettled(now);
+    }
+    else if (step_wait_.condition() == STEP_WAIT_MARKER)
+    {
+        open_manipulator_pick_and_place::FusedMarker marker;
+        bool is_found;
+        {
+            std::lock_guard<std::mutex> lock(perception_mutex_);
+            is_found = wait_marker_id_ >= 0 && marker_fusion_.find(wait_marker_id_, now, &marker);
+        }
+        if (is_found)
+            marker_settle_.update(now, marker.position, 3);
+        else
+            marker_settle_.reset();
+        is_met = marker_settle_.isSettled(now);
     }
+
+    if (step_wait_.update(now, is_met)) return true;
+    if (step_wait_.isTimedOut()) logEvent(EVENT_STEP_WAIT_TIMED_OUT, logged_demo_count_, step_wait_.elapsed(now));
     return false;
 }
 
+uint8_t OpenManipulatorPickandPlace::perceptionDemand()
+{
+    if (mode_state_ == DEMO_STOP) return PERCEPTION_DEMAND_NONE;
+    if (mode_state_ != DEMO_START) return PERCEPTION_DEMAND_LOW;  // 화면에 마커 표시
+
+    switch (demo_count_)
+    {
+        // pick/place 마커를 읽는 단계와 그 직전 대기 단계
+        case 2:
+        case 3:
+        case 5:
+        case 6:
+            return PERCEPTION_DEMAND_FULL;
+        default:
+            return PERCEPTION_DEMAND_NONE;
+    }
+}
+
+void OpenManipulatorPickandPlace::updatePerceptionDemand()
+{
+    uint8_t demand = perceptionDemand();
+    if (demand == perception_demand_) return;
+
+    std_msgs::UInt8 msg;
+    msg.data = perception_demand_ = demand;
+    perception_demand_pub_.publish(msg);
+}
+
 void OpenManipulatorPickandPlace::manipulatorStatesCallback(const open_manipulator_msgs::OpenManipulatorState::ConstPtr &msg)
 {
-    open_manipulator_is_moving_ = (msg->open_manipulator_moving_state == msg->IS_MOVING);
+    bool is_moving = (msg->open_manipulator_moving_state == msg->IS_MOVING);
+    if (is_moving != open_manipulator_is_moving_)
+    {
+        if (is_moving) trace_.begin("moving", "arm", TRACE_TRACK_ARM);
+        else trace_.end("moving", "arm", TRACE_TRACK_ARM);
+    }
+    open_manipulator_is_moving_ = is_moving;
+    trajectory_.movingState(is_moving, ros::Time::now().toSec());
 }
 
 void OpenManipulatorPickandPlace::jointStatesCallback(const sensor_msgs::JointState::ConstPtr &msg)
@@ -115,6 +716,10 @@ void OpenManipulatorPickandPlace::jointStatesCallback(const sensor_msgs::JointSt
         else if (msg->name.at(i) == "gripper") temp_angle[4] = msg->position[i];
     }
     present_joint_angle_ = temp_angle;
+
+    ros::Time stamp = msg->header.stamp.isZero() ? ros::Time::now() : msg->header.stamp;
+    joint_state_buffer_.push(stamp.toSec(), temp_angle.data());
+    trajectory_.jointState(temp_angle.data(), ros::Time::now().toSec());
 }
 
 void OpenManipulatorPickandPlace::kinematicsPoseCallback(const open_manipulator_msgs::KinematicsPose::ConstPtr &msg)
@@ -122,22 +727,123 @@ void OpenManipulatorPickandPlace::kinematicsPoseCallback(const open_manipulator_
     present_kinematic_position_ = {msg->pose.position.x, msg->pose.position.y, msg->pose.position.z};
 }
 
-void OpenManipulatorPickandPlace::arPoseMarkerCallback(const ar_track_alvar_msgs::AlvarMarkers::ConstPtr &msg)
+void OpenManipulatorPickandPlace::arPoseMarkerCallback(const ar_track_alvar_msgs::AlvarMarkers::ConstPtr &msg, size_t source)
 {
-    ar_marker_pose.clear();
+    trace_.instant("markers", "perception", TRACE_TRACK_MARKER, "count", msg->markers.size());
+
+    ros::Time now = ros::Time::now();
+    std::vector<ArMarker> seen;
     for (const auto &marker : msg->markers)
     {
-        ar_marker_pose.push_back({marker.id, {marker.pose.pose.position.x, marker.pose.pose.position.y, marker.pose.pose.position.z}});
+        ArMarker temp = {marker.id,
+                         {marker.pose.pose.position.x, marker.pose.pose.position.y, marker.pose.pose.position.z},
+                         marker.header.stamp.isZero() ? msg->header.stamp : marker.header.stamp};
+
+        const std::string &frame_id = marker.header.frame_id.empty() ? msg->header.frame_id : marker.header.frame_id;
+        if (use_motion_compensation_ && frame_id == camera_frame_)
+        {
+            double camera_position[3] = {temp.position[0], temp.position[1], temp.position[2]};
+            if (!cameraToWorld(temp.stamp, camera_position, temp.position)) continue;
+        }
+
+        flight_recorder_.record(EVENT_MARKER_SEEN, temp.id, temp.position[0], temp.position[1], temp.position[2],
+                                temp.stamp.isZero() ? 0.0 : (now - temp.stamp).toSec());
+        seen.push_back(temp);
+    }
+
+    std::lock_guard<std::mutex> lock(perception_mutex_);
+    marker_fusion_.beginView(source);
+    for (const auto &temp : seen)
+        marker_fusion_.add(source, temp.id, temp.position, temp.stamp.isZero() ? now.toSec() : temp.stamp.toSec());
+
+    // 합친 위치: 가까운 손목 카메라가 보면 그쪽 비중이 커짐
+    std::vector<open_manipulator_pick_and_place::FusedMarker> fused;
+    marker_fusion_.fuse(now.toSec(), &fused);
+
+    fused_marker_pose_.clear();
+    for (size_t i = 0; i < fused.size(); i++)
+    {
+        ArMarker temp = {fused[i].id, {fused[i].position[0], fused[i].position[1], fused[i].position[2]}, ros::Time(fused[i].stamp)};
+        fused_marker_pose_.push_back(temp);
     }
 }
 
+void OpenManipulatorPickandPlace::depthImageCallback(const sensor_msgs::Image::ConstPtr &msg)
+{
+    double fx, fy, cx, cy;
+    {
+        // 집기/놓기 단계에서 필요한 픽셀만 읽도록 보관
+        std::lock_guard<std::mutex> lock(perception_mutex_);
+        depth_image_ = msg;
+        if (!use_voxel_grid_ || !depth_sampler_.hasIntrinsics()) return;
+        fx = depth_sampler_.fx();
+        fy = depth_sampler_.fy();
+        cx = depth_sampler_.cx();
+        cy = depth_sampler_.cy();
+    }
+    if (msg->data.size() < (size_t)msg->step * msg->height) return;
+
+    double joint_angle[open_manipulator_pick_and_place::JointStateBuffer::NUM_OF_JOINT];
+    if (!joint_state_buffer_.interpolate(msg->header.stamp.toSec(), joint_angle)) return;
+
+    open_manipulator_pick_and_place::TraceSpan span(trace_, "voxel_insert", "perception", TRACE_TRACK_MARKER);
+    open_manipulator_pick_and_place::RigidTransform camera_to_world = arm_kinematics_.cameraToWorld(joint_angle);
+    if (msg->encoding == sensor_msgs::image_encodings::TYPE_16UC1 || msg->encoding == sensor_msgs::image_encodings::MONO16)
+        perception_voxel_grid_.insert((const uint16_t *)&msg->data[0], msg->width, msg->height, msg->step, depth_scale_,
+                                      fx, fy, cx, cy, camera_to_world, msg->header.stamp.toSec());
+    else if (msg->encoding == sensor_msgs::image_encodings::TYPE_32FC1)
+        perception_voxel_grid_.insert((const float *)&msg->data[0], msg->width, msg->height, msg->step, 1.0,
+                                      fx, fy, cx, cy, camera_to_world, msg->header.stamp.toSec());
+    else
+        return;
+
+    // tick은 위의 삽입이 아니라 이 복사만 기다림
+    std::lock_guard<std::mutex> lock(perception_mutex_);
+    voxel_grid_.copyCells(perception_voxel_grid_);
+}
+
+void OpenManipulatorPickandPlace::depthInfoCallback(const sensor_msgs::CameraInfo::ConstPtr &msg)
+{
+    std::lock_guard<std::mutex> lock(perception_mutex_);
+    depth_sampler_.setIntrinsics(msg->K[0], msg->K[4], msg->K[2], msg->K[5]);
+}
+
 void OpenManipulatorPickandPlace::publishCallback(const ros::TimerEvent&)
 {
-    printText();
+    flight_recorder_.record(EVENT_STATE_SNAPSHOT, present_joint_angle_.at(0), present_joint_angle_.at(1), present_joint_angle_.at(2),
+                            present_joint_angle_.at(3), present_joint_angle_.at(4), open_manipulator_is_moving_);
+    open_manipulator_pick_and_place::TraceSpan tick_span(trace_, "tick", "control", TRACE_TRACK_CONTROL);
+    trajectory_.update(ros::Time::now().toSec());
+
+    // 지금까지 합친 마커, 이번 tick 동안 그대로 사용
+    {
+        std::lock_guard<std::mutex> lock(perception_mutex_);
+        ar_marker_pose = fused_marker_pose_;
+    }
+    for (size_t i = 0; i < ar_marker_pose.size(); i++)
+        last_seen_marker_[ar_marker_pose[i].id] = ar_marker_pose[i];
+
+    // 팔은 이미 멈췄고 여기서는 데모만 종료
+    if (stop_.consume())
+    {
+        is_resume_pending_ = false;
+        step_wait_.cancel();
+        mode_state_ = DEMO_STOP;
+        is_searching_ = false;
+        trajectory_.preemptGoal(ros::Time::now().toSec());
+        trace_.instant("stop", "control", TRACE_TRACK_CONTROL);
+        logEvent(EVENT_DEMO_STOPPED);
+    }
+    if (mode_state_ != DEMO_START && !open_manipulator_is_moving_ && !trajectory_.isBusy()) stop_.warmUp();
+
+    // 다시 읽은 포즈는 데모 밖이나 집기 전 초기 자세 단계에서만 적용
+    if ((mode_state_ != DEMO_START || demo_count_ <= 1) && poses_.update())
+        logEvent(EVENT_POSES_RELOADED, poses_.generation());
+    if (!is_realtime_) printText();
 
     if (kbhit()) // 키 입력이 있는 경우
     {
-        char input = std::getchar();
+        char input = keyboard_.get();
         if (isdigit(input))
         {
             processDigitInput(input);
@@ -147,6 +853,7 @@ void OpenManipulatorPickandPlace::publishCallback(const ros::TimerEvent&)
             setModeState(input);
         }
     }
+    if (is_resume_pending_) resumeSequence();
 
     if (mode_state_ == HOME_POSE)
     {
@@ -154,13 +861,31 @@ void OpenManipulatorPickandPlace::publishCallback(const ros::TimerEvent&)
     }
     else if (mode_state_ == DEMO_START)
     {
-        if (!open_manipulator_is_moving_)
+        // 이전 목표나 대기가 실제로 끝난 뒤에 다음 단계 진행
+        if (!open_manipulator_is_moving_ && !trajectory_.isBusy() && !isStepWaiting())
+        {
+            if (demo_count_ != logged_demo_count_)
+            {
+                logEvent(EVENT_STEP_STARTED, demo_count_);
+                if (logged_demo_count_ >= 0) trace_.end("step", "demo", TRACE_TRACK_STEP);
+                trace_.begin("step", "demo", TRACE_TRACK_STEP, "step", demo_count_);
+                logged_demo_count_ = demo_count_;
+            }
             demoSequence();
+        }
     }
-    else if (mode_state_ == DEMO_STOP)
+
+    // 데모가 끝나거나 멈추면 이번 실행의 트레이스를 기록
+    if (trace_.active() && mode_state_ != DEMO_START)
     {
-        printf("[INFO] Demo stopped.\n");
+        trace_.end("step", "demo", TRACE_TRACK_STEP);
+        std::string path = trace_.endRun();
+        if (!path.empty()) ROS_INFO("Writing the demo trace to %s", path.c_str());
+        else ROS_WARN("Demo trace dropped, the one before is still being written");
     }
+
+    saveCheckpoint();
+    updatePerceptionDemand();
 }
 
 void OpenManipulatorPickandPlace::processDigitInput(char first_input)
@@ -168,11 +893,11 @@ void OpenManipulatorPickandPlace::processDigitInput(char first_input)
     clock_t start_time = clock();
     char second_input = '\0';
 
-    while ((clock() - start_time) / CLOCKS_PER_SEC < INPUT_WAIT_TIME)
+    while ((clock() - start_time) / CLOCKS_PER_SEC < INPUT_WAIT_TIME && !stop_.isStopped())
     {
         if (kbhit())
         {
-            second_input = std::getchar();
+            second_input = keyboard_.get();
             break;
         }
     }
@@ -181,7 +906,7 @@ void OpenManipulatorPickandPlace::processDigitInput(char first_input)
 
     if (marker_id < 0 || marker_id > 17)
     {
-        printf("[WARNING] Invalid marker ID. Enter a number between 0 and 17.\n");
+        logEvent(EVENT_INVALID_MARKER_ID, marker_id);
         return;
     }
 
@@ -190,22 +915,22 @@ void OpenManipulatorPickandPlace::processDigitInput(char first_input)
         if (demo_count_ <= 3)
         {
             pick_marker_id_ = marker_id;
-            printf("[INFO] Pick Marker ID set to: %d\n", pick_marker_id_);
+            logEvent(EVENT_PICK_MARKER_SET, pick_marker_id_);
         }
         else if (demo_count_ >= 5)
         {
             place_marker_id_ = marker_id;
-            printf("[INFO] Place Marker ID set to: %d\n", place_marker_id_);
+            logEvent(EVENT_PLACE_MARKER_SET, place_marker_id_);
         }
     }
 }
 
 void OpenManipulatorPickandPlace::moveHomePose()
 {
-    std::vector<double> joint_angle = {0.01, -0.80, 0.00, 1.90};
-    setJointSpacePath(joint_name_, joint_angle, 2.0);
+    std::vector<double> joint_angle = poses_.vector(POSE_HOME);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_MOVE_TIME));
 
-    std::vector<double> gripper_value = {0.0};
+    std::vector<double> gripper_value = {poses_.value(POSE_HOME_GRIPPER)};
     setToolControl(gripper_value);
 
     mode_state_ = 0;
@@ -214,15 +939,101 @@ void OpenManipulatorPickandPlace::moveHomePose()
 
 void OpenManipulatorPickandPlace::setModeState(char ch)
 {
+  // 'e'는 여기로 오지 않음, initStop() 참고
+  is_resume_pending_ = false;  // 운영자가 직접 조작
   if (ch == 'q')
+  {
+    stop_.clear();
     mode_state_ = HOME_POSE;
+    logEvent(EVENT_MODE_CHANGED, ch);
+  }
   else if (ch == 'w')
   {
+    stop_.clear();
     mode_state_ = DEMO_START;
     demo_count_ = 0;
+    logged_demo_count_ = -1;
+    is_searching_ = false;
+    step_wait_.cancel();
+    command_retries_ = 0;
+    blocked_since_ = 0.0;
+    trace_.beginRun();
+    logEvent(EVENT_MODE_CHANGED, ch);
   }
-  else if (ch == 'e')
-    mode_state_ = DEMO_STOP;
+}
+
+int OpenManipulatorPickandPlace::searchMarker(uint8_t marker_id, uint32_t search_event, ArMarker *marker)
+{
+    ros::Time now = ros::Time::now();
+    if (!is_searching_)
+    {
+        // 정지 상태에서 단계 시작: 최근 관측이면 그대로 사용
+        is_searching_ = true;
+        search_attempts_ = 0;
+        trace_.begin("marker search", "perception", TRACE_TRACK_STEP, "id", marker_id);
+        search_look_time_ = now - ros::Duration(0.5);
+        search_deadline_ = now;
+    }
+
+    // 고정 카메라가 보고 있으면 팔 자세와 관계없으므로 탐색 동작 없이 바로 사용
+    open_manipulator_pick_and_place::FusedMarker fused;
+    bool is_found;
+    {
+        std::lock_guard<std::mutex> lock(perception_mutex_);
+        is_found = marker_fusion_.find(marker_id, now.toSec(), &fused);
+    }
+    if (is_found && fused.is_fixed_view)
+    {
+        ArMarker found = {fused.id, {fused.position[0], fused.position[1], fused.position[2]}, ros::Time(fused.stamp)};
+        *marker = found;
+        is_searching_ = false;
+        trace_.end("marker search", "perception", TRACE_TRACK_STEP);
+        return SEARCH_FOUND;
+    }
+
+    std::map<uint32_t, ArMarker>::const_iterator seen = last_seen_marker_.find(marker_id);
+    if (seen != last_seen_marker_.end() && seen->second.stamp >= search_look_time_)
+    {
+        *marker = seen->second;
+        is_searching_ = false;
+        trace_.end("marker search", "perception", TRACE_TRACK_STEP);
+        return SEARCH_FOUND;
+    }
+
+    if (now < search_deadline_) return SEARCH_IN_PROGRESS;
+
+    if (search_attempts_ >= MAX_SEARCH_ATTEMPTS)
+    {
+        is_searching_ = false;
+        trace_.end("marker search", "perception", TRACE_TRACK_STEP);
+        return SEARCH_FAILED;
+    }
+
+    // 마커를 찾지 못했을 경우 Base joint 변경
+    logEvent(search_event, marker_id, search_attempts_ + 1);
+    trace_.instant("search attempt", "perception", TRACE_TRACK_STEP, "attempt", search_attempts_ + 1);
+
+    // Base joint (joint1) 값을 회전하며 탐색
+    std::vector<double> search_joint_angle;
+    search_joint_angle.push_back(-1.60 + 0.4 * search_attempts_); // Base joint 좌우로 회전
+    search_joint_angle.push_back(poses_.value(POSE_INITIAL, 1)); // Shoulder joint
+    search_joint_angle.push_back(poses_.value(POSE_INITIAL, 2)); // Elbow joint
+    search_joint_angle.push_back(poses_.value(POSE_INITIAL, 3)); // Wrist joint
+    setJointSpacePath(joint_name_, search_joint_angle, SEARCH_PATH_TIME);   // 카메라 위치 조정
+
+    // 움직임 보정이 있으면 이동 중 관측도 유효하므로 정지 대기 없이 다음 시도
+    if (use_motion_compensation_)
+    {
+        search_look_time_ = now;
+        search_deadline_ = now + ros::Duration(SEARCH_PATH_TIME);
+    }
+    else
+    {
+        search_look_time_ = now + ros::Duration(SEARCH_PATH_TIME);
+        search_deadline_ = now + ros::Duration(SEARCH_PATH_TIME + SEARCH_SETTLE_TIME);
+    }
+    search_attempts_++;
+    return SEARCH_IN_PROGRESS;
 }
 
 void OpenManipulatorPickandPlace::demoSequence()
@@ -232,84 +1043,54 @@ void OpenManipulatorPickandPlace::demoSequence()
   std::vector<double> kinematics_orientation;
   std::vector<double> gripper_value;
 
+  // 경로가 막힌 단계는 다음 주기에, 명령이 실패한 단계는 잠시 후 다시 시도 (둘 다 한도까지)
+  uint8_t step = demo_count_;
+  uint32_t num_of_blocked_path = num_of_blocked_path_;
+  uint32_t num_of_failed_command = num_of_failed_command_;
+
   switch (demo_count_)
   {
     case 0: // home pose
-    joint_angle.push_back( 0.00);
-    joint_angle.push_back(-1.05);
-    joint_angle.push_back( 0.35);
-    joint_angle.push_back( 0.70);
-    setJointSpacePath(joint_name_, joint_angle, 2.0);
+    joint_angle = poses_.vector(POSE_DEMO_HOME);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_MOVE_TIME));
     demo_count_ ++;
     break;
 
     case 1: // initial pose
-      joint_angle.push_back( 0.01);
-    joint_angle.push_back(-0.80);
-    joint_angle.push_back( 0.00);
-    joint_angle.push_back( 1.90);
-    setJointSpacePath(joint_name_, joint_angle, 2.0);
+      joint_angle = poses_.vector(POSE_INITIAL);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_MOVE_TIME));
     demo_count_ ++;
     break;
 
     case 2: // wait & open the gripper
-      setJointSpacePath(joint_name_, present_joint_angle_, 3.0);
-    gripper_value.push_back(0.010);
+    gripper_value.push_back(poses_.value(POSE_GRIPPER_OPEN));
     setToolControl(gripper_value);
+    startWait(STEP_WAIT_MARKER, poses_.value(POSE_OPEN_TIME), pick_marker_id_);
     demo_count_ ++;
     break;
 
     case 3: // pick the box 사용자가 입력한 번호의 마커를 집음
 {
-  bool marker_found = false;
-  int search_attempts = 0; // 검색 시도 횟수
-
-  while (!marker_found && search_attempts < 8) // 최대 8번 시도
+  // 타이머 주기마다 한 번씩 확인하므로 마커 콜백이 막히지 않음
+  ArMarker marker;
+  int search_result = searchMarker(pick_marker_id_, EVENT_PICK_MARKER_SEARCH, &marker);
+  if (search_result == SEARCH_FOUND)
   {
-    for (int i = 0; i < ar_marker_pose.size(); i++)
-    {
-      if (ar_marker_pose.at(i).id == pick_marker_id_) // 사용자가 설정한 pick_marker_id_
-      {
-        marker_found = true;
-
-        // X, Y, Z 값 설정
-        kinematics_position.push_back(ar_marker_pose.at(i).position[0] + 0.005); // X 좌표
-        kinematics_position.push_back(ar_marker_pose.at(i).position[1]);        // Y 좌표
-        kinematics_position.push_back(0.033);                                  // Z 좌표 고정
-
-        // 오리엔테이션 설정
-        kinematics_orientation.push_back(0.74); // w 값
-        kinematics_orientation.push_back(0.00); // x 값
-        kinematics_orientation.push_back(0.66); // y 값
-        kinematics_orientation.push_back(0.00); // z 값
-
-        setTaskSpacePath(kinematics_position, kinematics_orientation, 3.0);
-        demo_count_++; // 다음 단계로 진행
-        break;
-      }
-    }
-
-    if (!marker_found)
-    {
-      // 마커를 찾지 못했을 경우 Base joint 변경
-      printf("Pick Marker ID %d not detected. Adjusting base joint... (Attempt %d)\n", pick_marker_id_, search_attempts + 1);
+    // X, Y, Z 값 설정
+    kinematics_position.push_back(marker.position[0] + poses_.value(POSE_PICK, 0)); // X 좌표
+    kinematics_position.push_back(marker.position[1] + poses_.value(POSE_PICK, 1)); // Y 좌표
+    kinematics_position.push_back(pickHeight(marker));                             // Z 좌표, 깊이 영상 또는 고정
 
-      // Base joint (joint1) 값을 회전하며 탐색
-      std::vector<double> search_joint_angle;
-      search_joint_angle.push_back(-1.60 + 0.4 * search_attempts); // Base joint 좌우로 회전
-      search_joint_angle.push_back(-0.80);                        // Shoulder joint
-      search_joint_angle.push_back(0.00);                         // Elbow joint
-      search_joint_angle.push_back(1.90);                         // Wrist joint
-      setJointSpacePath(joint_name_, search_joint_angle, 2.0);   // 카메라 위치 조정
+    // 오리엔테이션 설정
+    kinematics_orientation = poses_.vector(POSE_GRIP_ORIENTATION);
 
-      ros::Duration(3.0).sleep(); // 3초 대기
-      search_attempts++;          // 시도 횟수 증가
-    }
+    recordFrameToCommandLatency(marker);
+    setTaskSpacePath(kinematics_position, kinematics_orientation, poses_.value(POSE_APPROACH_TIME));
+    demo_count_++; // 다음 단계로 진행
   }
-
-  if (!marker_found) // 최대 시도 후에도 찾지 못했을 경우
+  else if (search_result == SEARCH_FAILED) // 최대 시도 후에도 찾지 못했을 경우
   {
-    printf("Pick Marker ID %d could not be found after multiple attempts.\n", pick_marker_id_);
+    logEvent(EVENT_PICK_MARKER_NOT_FOUND, pick_marker_id_);
     demo_count_ = 1; // 초기 단계로 돌아감
   }
 }
@@ -317,74 +1098,41 @@ break;
 
 
   case 4: // wait & grip
-    setJointSpacePath(joint_name_, present_joint_angle_, 1.0);
     gripper_value.clear();
-    gripper_value.push_back(-0.008);
+    gripper_value.push_back(poses_.value(POSE_GRIPPER_CLOSE));
     setToolControl(gripper_value);
+    startWait(STEP_WAIT_GRIPPER, poses_.value(POSE_GRIP_TIME));
     demo_count_++;
     break;
 
   case 5: // initial pose
-    joint_angle.clear();
-    joint_angle.push_back( 0.01);
-    joint_angle.push_back(-0.80);
-    joint_angle.push_back( 0.00);
-    joint_angle.push_back( 1.90);
-    setJointSpacePath(joint_name_, joint_angle, 2.0);
+    joint_angle = poses_.vector(POSE_INITIAL);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_MOVE_TIME));
     demo_count_++;
     break;
 
     case 6: // place the box 사용자가 입력한 마커가 있는 곳에 놓음
 {
-  bool marker_found = false;
-  int search_attempts = 0; // 검색 시도 횟수
-
-  while (!marker_found && search_attempts < 8) // 최대 8번 시도
+  ArMarker marker;
+  int search_result = searchMarker(place_marker_id_, EVENT_PLACE_MARKER_SEARCH, &marker);
+  if (search_result == SEARCH_FOUND)
   {
-    for (int i = 0; i < ar_marker_pose.size(); i++)
-    {
-      if (ar_marker_pose.at(i).id == place_marker_id_) // 사용자가 설정한 place_marker_id_
-      {
-        marker_found = true;
-
-        // X, Y, Z 값 설정
-        kinematics_position.push_back(ar_marker_pose.at(i).position[0] + 0.005); // X 좌표
-        kinematics_position.push_back(ar_marker_pose.at(i).position[1]);        // Y 좌표
-        kinematics_position.push_back(0.069);                                  // Z 좌표 고정
-
-        // 오리엔테이션 설정
-        kinematics_orientation.push_back(0.74); // w 값
-        kinematics_orientation.push_back(0.00); // x 값
-        kinematics_orientation.push_back(0.66); // y 값
-        kinematics_orientation.push_back(0.00); // z 값
-
-        setTaskSpacePath(kinematics_position, kinematics_orientation, 3.0);
-        demo_count_++; // 다음 단계로 진행
-        break;
-      }
-    }
-
-    if (!marker_found)
-    {
-      // 마커를 찾지 못했을 경우 Base joint 변경
-      printf("Place Marker ID %d not detected. Adjusting base joint... (Attempt %d)\n", place_marker_id_, search_attempts + 1);
-
-      // Base joint (joint1) 값을 회전하며 탐색
-      std::vector<double> search_joint_angle;
-      search_joint_angle.push_back(-1.60 + 0.4 * search_attempts); // Base joint 좌우로 회전
-      search_joint_angle.push_back(-0.80);                        // Shoulder joint
-      search_joint_angle.push_back(0.00);                         // Elbow joint
-      search_joint_angle.push_back(1.90);                         // Wrist joint
-      setJointSpacePath(joint_name_, search_joint_angle, 2.0);   // 카메라 위치 조정
-
-      ros::Duration(3.0).sleep(); // 1초 대기
-      search_attempts++;          // 시도 횟수 증가
-    }
+    // X, Y, Z 값 설정
+    kinematics_position.push_back(marker.position[0] + poses_.value(POSE_PLACE, 0)); // X 좌표
+    kinematics_position.push_back(marker.position[1] + poses_.value(POSE_PLACE, 1)); // Y 좌표
+    kinematics_position.push_back(poses_.value(POSE_PLACE, 2));                     // Z 좌표 고정
+    kinematics_position.at(2) = placeHeight(kinematics_position);                   // 깊이 영상이 있으면 쌓인 높이에 맞춤
+
+    // 오리엔테이션 설정
+    kinematics_orientation = poses_.vector(POSE_GRIP_ORIENTATION);
+
+    recordFrameToCommandLatency(marker);
+    setTaskSpacePath(kinematics_position, kinematics_orientation, poses_.value(POSE_APPROACH_TIME));
+    demo_count_++; // 다음 단계로 진행
   }
-
-  if (!marker_found) // 최대 시도 후에도 찾지 못했을 경우
+  else if (search_result == SEARCH_FAILED) // 최대 시도 후에도 찾지 못했을 경우
   {
-    printf("Place Marker ID %d could not be found after multiple attempts.\n", place_marker_id_);
+    logEvent(EVENT_PLACE_MARKER_NOT_FOUND, place_marker_id_);
     demo_count_ = 6; // 놓기 단계로 돌아감
   }
 }
@@ -393,10 +1141,10 @@ break;
 
 
   case 7: // wait & place
-    setJointSpacePath(joint_name_, present_joint_angle_, 1.0);
     gripper_value.clear();
-    gripper_value.push_back(0.010);
+    gripper_value.push_back(poses_.value(POSE_GRIPPER_OPEN));
     setToolControl(gripper_value);
+    startWait(STEP_WAIT_GRIPPER, poses_.value(POSE_GRIP_TIME));
     demo_count_++;
     break;
 
@@ -406,161 +1154,130 @@ break;
     kinematics_orientation.clear();
 
 
-    kinematics_position.push_back(ar_marker_pose.at(place_marker_id_).position[0] + 0.030); // X 좌표
-    kinematics_position.push_back(ar_marker_pose.at(place_marker_id_).position[1] + 0.030);        // Y 좌표
-    kinematics_position.push_back(0.170);                                                 // Z 좌표 (상승)
+    kinematics_position.push_back(ar_marker_pose.at(place_marker_id_).position[0] + poses_.value(POSE_LIFT, 0)); // X 좌표
+    kinematics_position.push_back(ar_marker_pose.at(place_marker_id_).position[1] + poses_.value(POSE_LIFT, 1)); // Y 좌표
+    kinematics_position.push_back(poses_.value(POSE_LIFT, 2));                                                 // Z 좌표 (상승)
 
     // 기존 오리엔테이션 유지
-    kinematics_orientation.push_back(0.74); // w 값
-    kinematics_orientation.push_back(0.00); // x 값
-    kinematics_orientation.push_back(0.66); // y 값
-    kinematics_orientation.push_back(0.00); // z 값
+    kinematics_orientation = poses_.vector(POSE_GRIP_ORIENTATION);
 
-    setTaskSpacePath(kinematics_position, kinematics_orientation, 2.0); // 위치로 이동
+    setTaskSpacePath(kinematics_position, kinematics_orientation, poses_.value(POSE_MOVE_TIME)); // 위치로 이동
     demo_count_++;
 	break;
 
 case 9: // Prompt user to decide next action
 {
-    printf("\nWhat would you like to do next?\n");
-    printf("Press 'p' to pick another object, or 'd' to proceed to demo termination.\n");
+    logEvent(EVENT_NEXT_ACTION_PROMPT);
 
     char user_input = '\0';  // 초기화
-    while (true) // 유효한 입력을 받을 때까지 무한 루프
+    while (!stop_.isStopped()) // 유효한 입력을 받거나 정지될 때까지 반복
     {
         if (kbhit()) // 키 입력 대기
         {
-            user_input = std::getchar();
+            user_input = keyboard_.get();
             if (user_input == 'p') // Pick another object
             {
                 demo_count_ = 1; // Case 1로 설정하여 pick 과정으로 돌아감
-                printf("[INFO] Returning to pick another object.\n");
+                logEvent(EVENT_NEXT_ACTION_PICK);
                 break; // 루프 종료
             }
             else if (user_input == 'd') // Enter demo termination process
             {
                 demo_count_++; // 다음 단계(종료 과정)로 진행
-                printf("[INFO] Proceeding to demo termination process.\n");
+                logEvent(EVENT_NEXT_ACTION_END);
                 break; // 루프 종료
             }
             else
             {
-                printf("[WARNING] Invalid input. Please press 'p' or 'd'.\n");
+                logEvent(EVENT_NEXT_ACTION_INVALID);
             }
         }
         ros::Duration(0.1).sleep(); // ROS 노드가 응답을 유지하도록 100ms 대기
+        if (!is_realtime_) printText(); // 기다리는 동안에도 안내와 최근 이벤트를 상태 화면에 표시
     }
     break;
 }
 
 
     case 10: //I
-    joint_angle.clear();
-    joint_angle.push_back( -0.063);
-    joint_angle.push_back( 0.061);
-    joint_angle.push_back( -1.488);
-    joint_angle.push_back( -0.012);
-    setJointSpacePath(joint_name_, joint_angle, 1);
+    joint_angle = poses_.vector(POSE_LETTER_I);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_LETTER_MOVE_TIME));
     demo_count_++;
     break;
 
     case 11: // wait & place
-    setJointSpacePath(joint_name_, present_joint_angle_, 1.0);
     gripper_value.clear();
-    gripper_value.push_back(0.010);
+    gripper_value.push_back(poses_.value(POSE_GRIPPER_OPEN));
     setToolControl(gripper_value);
+    startWait(STEP_WAIT_TIME, poses_.value(POSE_GRIP_TIME));
     demo_count_++;
     break;
 
     case 12: //R
-    joint_angle.clear();
-    joint_angle.push_back( -0.015);
-    joint_angle.push_back( 0.030);
-    joint_angle.push_back( 0.779);
-    joint_angle.push_back( 1.759);
-    setJointSpacePath(joint_name_, joint_angle, 1);
+    joint_angle = poses_.vector(POSE_LETTER_R);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_LETTER_MOVE_TIME));
     demo_count_++;
     break;
 
     case 13: // wait & place
-    setJointSpacePath(joint_name_, present_joint_angle_, 1.0);
     gripper_value.clear();
-    gripper_value.push_back(0.010);
+    gripper_value.push_back(poses_.value(POSE_GRIPPER_OPEN));
     setToolControl(gripper_value);
+    startWait(STEP_WAIT_TIME, poses_.value(POSE_GRIP_TIME));
     demo_count_++;
     break;
 
     case 14: //임시
-    joint_angle.clear();
-    joint_angle.push_back( 0.00);
-    joint_angle.push_back(-1.05);
-    joint_angle.push_back( 0.35);
-    joint_angle.push_back( 0.70);
-    setJointSpacePath(joint_name_, joint_angle, 0.1);
+    joint_angle = poses_.vector(POSE_DEMO_HOME);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_LETTER_LIFT_TIME));
     demo_count_++;
     break;
 
     case 15: //A
-    joint_angle.clear();
-    joint_angle.push_back( -0.032);
-    joint_angle.push_back( 0.078);
-    joint_angle.push_back( 0.894);
-    joint_angle.push_back( 0.021);
-    setJointSpacePath(joint_name_, joint_angle, 1);
+    joint_angle = poses_.vector(POSE_LETTER_A);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_LETTER_MOVE_TIME));
     demo_count_++;
     break;
 
     case 16: // wait & place
-    setJointSpacePath(joint_name_, present_joint_angle_, 1.0);
     gripper_value.clear();
-    gripper_value.push_back(0.010);
+    gripper_value.push_back(poses_.value(POSE_GRIPPER_OPEN));
     setToolControl(gripper_value);
+    startWait(STEP_WAIT_TIME, poses_.value(POSE_GRIP_TIME));
     demo_count_++;
     break;
 
     case 17: //S
-    joint_angle.clear();
-    joint_angle.push_back( 0.000);
-    joint_angle.push_back( -1.085);
-    joint_angle.push_back( 0.508);
-    joint_angle.push_back( -0.341);
-    setJointSpacePath(joint_name_, joint_angle, 1);
+    joint_angle = poses_.vector(POSE_LETTER_S);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_LETTER_MOVE_TIME));
     demo_count_++;
     break;
 
     case 18: // wait & place
-    setJointSpacePath(joint_name_, present_joint_angle_, 1.0);
     gripper_value.clear();
-    gripper_value.push_back(0.010);
+    gripper_value.push_back(poses_.value(POSE_GRIPPER_OPEN));
     setToolControl(gripper_value);
+    startWait(STEP_WAIT_TIME, poses_.value(POSE_GRIP_TIME));
     demo_count_++;
     break;
 
     case 19: //C
-    joint_angle.clear();
-    joint_angle.push_back( -0.031);
-    joint_angle.push_back( -1.235);
-    joint_angle.push_back( 0.032);
-    joint_angle.push_back( 1.119);
-    setJointSpacePath(joint_name_, joint_angle, 1);
+    joint_angle = poses_.vector(POSE_LETTER_C);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_LETTER_MOVE_TIME));
     demo_count_++;
     break;
 
     case 20: // wait & place
-    setJointSpacePath(joint_name_, present_joint_angle_, 1.0);
     gripper_value.clear();
-    gripper_value.push_back(0.010);
+    gripper_value.push_back(poses_.value(POSE_GRIPPER_OPEN));
     setToolControl(gripper_value);
+    startWait(STEP_WAIT_TIME, poses_.value(POSE_GRIP_TIME));
     demo_count_++;
     break;
 
     case 21: // home pose
-    joint_angle.clear();
-    joint_angle.push_back( 0.00);
-    joint_angle.push_back(-1.05);
-    joint_angle.push_back( 0.35);
-    joint_angle.push_back( 0.70);
-    setJointSpacePath(joint_name_, joint_angle, 0.01);
+    joint_angle = poses_.vector(POSE_DEMO_HOME);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_HOME_RETURN_TIME));
     demo_count_ = 1;
     mode_state_ = DEMO_STOP;
     break;
@@ -570,6 +1287,11 @@ case 9: // Prompt user to decide next action
     demo_count_++;
     break;
   }
+
+  if (num_of_blocked_path_ != num_of_blocked_path) holdBlockedStep(step);
+  else blocked_since_ = 0.0;
+  if (num_of_failed_command_ != num_of_failed_command) retryStep(step);
+  else if (demo_count_ != step) command_retries_ = 0;
 }
 
 
@@ -675,6 +1397,28 @@ void OpenManipulatorPickandPlace::printText()
          present_kinematic_position_.at(1),
          present_kinematic_position_.at(2));
 
+  if (frame_to_command_latency_.count() > 0)
+  {
+    printf("Frame to command latency [ms] last: %.1lf mean: %.1lf max: %.1lf (n=%lu)\n",
+           frame_to_command_latency_.last() * 1e3,
+           frame_to_command_latency_.mean() * 1e3,
+           frame_to_command_latency_.max() * 1e3,
+           (unsigned long)frame_to_command_latency_.count());
+  }
+  if (trajectory_.state() != TRAJECTORY_IDLE)
+  {
+    const open_manipulator_pick_and_place::TrajectoryFeedback &feedback = trajectory_.feedback();
+    printf("Goal: %s %.0lf%% (%.1lf of %.1lf s) joint error: %.3lf\n",
+           open_manipulator_pick_and_place::trajectoryStateName(trajectory_.state()),
+           feedback.progress * 100.0, feedback.elapsed, trajectory_.pathTime(), feedback.joint_error);
+  }
+  trajectory_.jointSpacePath().printStatistics();
+  trajectory_.toolControl().printStatistics();
+  trajectory_.taskSpacePath().printStatistics();
+  stop_.printStatistics();
+  if (num_of_failed_command_ > 0)
+    printf("Failed commands: %u demos aborted: %u\n", num_of_failed_command_, num_of_aborted_demo_);
+
   if (!ar_marker_pose.empty())
   {
     printf("AR marker detected.\n");
@@ -691,38 +1435,22 @@ void OpenManipulatorPickandPlace::printText()
   {
     printf("No AR marker detected. Waiting for marker input...\n");
   }
+
+  // 상태 화면이 있으면 이벤트 로그를 터미널에 출력하지 않으므로 최근 이벤트를 여기에 표시
+  open_manipulator_pick_and_place::EventRecord recent[open_manipulator_pick_and_place::EventLog::NUM_OF_RECENT];
+  uint32_t num_of_recent = event_log_.recent(recent, open_manipulator_pick_and_place::EventLog::NUM_OF_RECENT);
+  if (num_of_recent > 0) printf("-----------------------------\n");
+  for (uint32_t i = 0; i < num_of_recent; i++)
+  {
+    char text[256];
+    open_manipulator_pick_and_place::formatEvent(recent[i], text, sizeof(text));
+    printf("[%s] %s\n", open_manipulator_pick_and_place::eventLevelName(open_manipulator_pick_and_place::eventInfo(recent[i].event).level), text);
+  }
 }
 
 
 
 bool OpenManipulatorPickandPlace::kbhit()
 {
-  termios term;
-  tcgetattr(0, &term);
-
-  termios term2 = term;
-  term2.c_lflag &= ~ICANON;
-  tcsetattr(0, TCSANOW, &term2);
-
-  int byteswaiting;
-  ioctl(0, FIONREAD, &byteswaiting);
-  tcsetattr(0, TCSANOW, &term);
-  return byteswaiting > 0;
+  return keyboard_.hit();
 }
-
-int main(int argc, char **argv)
-{
-  // Init ROS node
-  ros::init(argc, argv, "open_manipulator_pick_and_place");
-  ros::NodeHandle node_handle("");
-
-  OpenManipulatorPickandPlace open_manipulator_pick_and_place;
-
-  ros::Timer publish_timer = node_handle.createTimer(ros::Duration(0.100)/*100ms*/, &OpenManipulatorPickandPlace::publishCallback, &open_manipulator_pick_and_place);
-
-  while (ros::ok())
-  {
-    ros::spinOnce();
-  }
-  return 0;
-}
\ No newline at end of file
@@ -0,0 +1,61 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#include "open_manipulator_final/open_manipulator_final.h"
+#include "open_manipulator_pick_and_place/control_loop.h"
+
+int main(int argc, char **argv)
+{
+  // Init ROS node
+  ros::init(argc, argv, "open_manipulator_pick_and_place");
+  ros::NodeHandle node_handle("");
+  ros::NodeHandle priv_node_handle("~");
+
+  open_manipulator_pick_and_place::ControlLoopConfig control_loop_config =
+      open_manipulator_pick_and_place::loadControlLoopConfig(priv_node_handle, 0.100/*100ms*/);
+  if (!control_loop_config.is_realtime)
+  {
+    OpenManipulatorPickandPlace open_manipulator_pick_and_place;
+
+    ros::Timer publish_timer = node_handle.createTimer(ros::Duration(0.100)/*100ms*/, &OpenManipulatorPickandPlace::publishCallback, &open_manipulator_pick_and_place);
+
+    while (ros::ok())
+    {
+      ros::spinOnce();
+    }
+    return 0;
+  }
+
+  // The node's state callbacks go on the control thread's queue, its
+  // marker and depth callbacks on a spinner it starts itself; the global
+  // queue only carries the control loop's report
+  ros::CallbackQueue control_queue;
+  ros::NodeHandle control_node_handle("");
+  ros::NodeHandle control_priv_node_handle("~");
+  control_node_handle.setCallbackQueue(&control_queue);
+  control_priv_node_handle.setCallbackQueue(&control_queue);
+
+  OpenManipulatorPickandPlace open_manipulator_pick_and_place(control_node_handle, control_priv_node_handle);
+
+  open_manipulator_pick_and_place::ControlLoop control_loop;
+  control_loop.start(control_loop_config, &control_queue,
+                     boost::bind(&OpenManipulatorPickandPlace::publishCallback, &open_manipulator_pick_and_place, _1),
+                     node_handle);
+
+  ros::spin();
+  control_loop.stop();
+  return 0;
+}
@@ -0,0 +1,78 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "open_manipulator_final/open_manipulator_final.h"
+#include "open_manipulator_pick_and_place/control_loop.h"
+
+namespace open_manipulator_final
+{
+
+// Runs OpenManipulatorPickandPlace inside a nodelet manager so that marker and
+// state messages from nodelets in the same manager arrive as shared pointers.
+class OpenManipulatorFinalNodelet : public nodelet::Nodelet
+{
+ private:
+  // With realtime set the node runs on a control thread of its own, off
+  // the manager's worker threads. Declared before the node, so it is
+  // destroyed after the node's handles on it are shut down
+  ros::CallbackQueue control_queue_;
+
+  boost::shared_ptr<OpenManipulatorPickandPlace> open_manipulator_pick_and_place_;
+  ros::Timer publish_timer_;
+  open_manipulator_pick_and_place::ControlLoop control_loop_;
+
+  virtual void onInit()
+  {
+    open_manipulator_pick_and_place::ControlLoopConfig control_loop_config =
+        open_manipulator_pick_and_place::loadControlLoopConfig(getPrivateNodeHandle(), 0.100/*100ms*/);
+    if (!control_loop_config.is_realtime)
+    {
+      open_manipulator_pick_and_place_.reset(new OpenManipulatorPickandPlace(getNodeHandle(), getPrivateNodeHandle()));
+
+      publish_timer_ = getNodeHandle().createTimer(ros::Duration(0.100)/*100ms*/,
+                                                   &OpenManipulatorPickandPlace::publishCallback,
+                                                   open_manipulator_pick_and_place_.get());
+      return;
+    }
+
+    ros::NodeHandle control_node_handle(getNodeHandle());
+    ros::NodeHandle control_priv_node_handle(getPrivateNodeHandle());
+    control_node_handle.setCallbackQueue(&control_queue_);
+    control_priv_node_handle.setCallbackQueue(&control_queue_);
+    open_manipulator_pick_and_place_.reset(new OpenManipulatorPickandPlace(control_node_handle, control_priv_node_handle));
+
+    control_loop_.start(control_loop_config, &control_queue_,
+                        boost::bind(&OpenManipulatorPickandPlace::publishCallback, open_manipulator_pick_and_place_.get(), _1),
+                        getNodeHandle());
+  }
+
+ public:
+  virtual ~OpenManipulatorFinalNodelet()
+  {
+    // Before the node it ticks goes away, and the node before its queue
+    control_loop_.stop();
+    open_manipulator_pick_and_place_.reset();
+  }
+};
+
+}  // namespace open_manipulator_final
+
+PLUGINLIB_EXPORT_CLASS(open_manipulator_final::OpenManipulatorFinalNodelet, nodelet::Nodelet)
@@ -0,0 +1,426 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef OPEN_MANIPULATOR_PICK_AND_PLACE_ARM_EXECUTOR_H
+#define OPEN_MANIPULATOR_PICK_AND_PLACE_ARM_EXECUTOR_H
+
+#include <ros/ros.h>
+#include <ros/callback_queue.h>
+#include <stdint.h>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/bind.hpp>
+
+#include "open_manipulator_msgs/OpenManipulatorState.h"
+#include "sensor_msgs/JointState.h"
+
+#include "open_manipulator_pick_and_place/job_queue.h"
+#include "open_manipulator_pick_and_place/latency_statistics.h"
+#include "open_manipulator_pick_and_place/marker_map.h"
+#include "open_manipulator_pick_and_place/step_wait.h"
+#include "open_manipulator_pick_and_place/trajectory_client.h"
+
+// Steps of one pick and place job
+#define ARM_STEP_IDLE      0
+#define ARM_STEP_APPROACH  1  // open the gripper, move over the pick marker
+#define ARM_STEP_GRIP      2
+#define ARM_STEP_LIFT      3
+#define ARM_STEP_PLACE     4  // move over the place marker
+#define ARM_STEP_RELEASE   5
+#define ARM_STEP_RETREAT   6  // back to the initial pose
+
+namespace open_manipulator_pick_and_place
+{
+
+// Where an arm stands in the cell frame and what it can reach
+typedef struct _ArmBase
+{
+  double x;          // [m]
+  double y;          // [m]
+  double yaw;        // [rad]
+  double reach_min;  // horizontal distance from the base [m]
+  double reach_max;
+} ArmBase;
+
+inline double armDistance(const ArmBase &base, const double position[3])
+{
+  return std::hypot(position[0] - base.x, position[1] - base.y);
+}
+
+inline bool armCanReach(const ArmBase &base, const double position[3])
+{
+  double distance = armDistance(base, position);
+  return distance >= base.reach_min && distance <= base.reach_max;
+}
+
+inline void cellToArm(const ArmBase &base, const double cell[3], double arm[3])
+{
+  double dx = cell[0] - base.x, dy = cell[1] - base.y;
+  double c = std::cos(base.yaw), s = std::sin(base.yaw);
+  arm[0] =  c * dx + s * dy;
+  arm[1] = -s * dx + c * dy;
+  arm[2] = cell[2];
+}
+
+// Poses and path times shared by all arms, in the arm frame
+typedef struct _ArmMotion
+{
+  double initial[TRAJECTORY_NUM_OF_JOINT];
+  double gripper_open;
+  double gripper_close;
+  double grip_orientation[4];  // w x y z
+  double pick[3];              // x y offset from the marker, z
+  double lift_height;          // [m]
+  double place_height;         // above the place marker [m]
+  double move_time;            // [s]
+  double approach_time;        // [s]
+  double grip_time;            // most the gripper is waited for [s]
+  double gripper_settle_tolerance;  // [m]
+  double gripper_settle_time;       // [s]
+} ArmMotion;
+
+typedef struct _ArmReport
+{
+  uint64_t done;
+  uint64_t failed;
+  uint64_t stolen;     // jobs taken from another arm's deque
+  double busy;         // time spent on jobs [s]
+  double job_mean;     // [s]
+  double job_max;      // [s]
+  double wait_mean;    // job creation to start [s]
+} ArmReport;
+
+// Runs pick and place jobs on one arm whose controller lives in the
+// namespace of node_handle. Each executor has its own thread and callback
+// queue for its states and joint states, so arms never wait on each other;
+// the job queue and the marker map are the only shared state. An idle arm
+// takes the next job from its own deque, then steals one it can reach.
+class ArmExecutor
+{
+ public:
+  ArmExecutor(size_t index, ros::NodeHandle node_handle, const ArmBase &base, const ArmMotion &motion,
+              JobQueue *job_queue, MarkerMap *marker_map)
+  : index_(index),
+    node_handle_(node_handle),
+    base_(base),
+    motion_(motion),
+    job_queue_(job_queue),
+    marker_map_(marker_map),
+    present_gripper_(0.0),
+    step_(ARM_STEP_IDLE),
+    job_start_(0.0),
+    has_joint_state_(false),
+    is_failing_(false),
+    running_(false),
+    is_idle_(true),
+    done_(0),
+    failed_(0),
+    stolen_(0),
+    busy_(0.0)
+  {
+    joint_name_.push_back("joint1");
+    joint_name_.push_back("joint2");
+    joint_name_.push_back("joint3");
+    joint_name_.push_back("joint4");
+    for (int i = 0; i < TRAJECTORY_NUM_OF_JOINT; i++)
+      present_joint_angle_[i] = 0.0;
+    gripper_settle_.setLimits(motion.gripper_settle_tolerance, motion.gripper_settle_time);
+  }
+
+  ~ArmExecutor()
+  {
+    stop();
+  }
+
+  bool start(double timeout_margin, double hold_time, double service_wait_timeout, double call_timeout)
+  {
+    ros::NodeHandle queue_node_handle(node_handle_);
+    queue_node_handle.setCallbackQueue(&queue_);
+    states_sub_ = queue_node_handle.subscribe("states", 10, &ArmExecutor::statesCallback, this);
+    joint_states_sub_ = queue_node_handle.subscribe("joint_states", 10, &ArmExecutor::jointStatesCallback, this);
+
+    trajectory_.init(node_handle_, joint_name_, timeout_margin, hold_time);
+    trajectory_.setCallTimeout(call_timeout);
+    bool is_ready = trajectory_.waitForServer(service_wait_timeout);
+
+    running_.store(true);
+    worker_ = std::thread(&ArmExecutor::run, this);
+    return is_ready;
+  }
+
+  void stop()
+  {
+    if (!worker_.joinable()) return;
+
+    running_.store(false);
+    worker_.join();
+  }
+
+  size_t index() const { return index_; }
+  const ArmBase &base() const { return base_; }
+  bool isIdle() const { return is_idle_.load(); }
+
+  bool canServe(const PickPlaceJob &job) const
+  {
+    return armCanReach(base_, job.pick) && armCanReach(base_, job.place);
+  }
+
+  ArmReport report() const
+  {
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    ArmReport report;
+    report.done = done_;
+    report.failed = failed_;
+    report.stolen = stolen_;
+    report.busy = busy_;
+    report.job_mean = job_time_.mean();
+    report.job_max = job_time_.max();
+    report.wait_mean = wait_time_.mean();
+    return report;
+  }
+
+ private:
+  void run()
+  {
+    while (running_.load() && ros::ok())
+    {
+      queue_.callAvailable(ros::WallDuration(0.005));
+      step(ros::Time::now().toSec());
+    }
+  }
+
+  void statesCallback(const open_manipulator_msgs::OpenManipulatorState::ConstPtr &msg)
+  {
+    trajectory_.movingState(msg->open_manipulator_moving_state == msg->IS_MOVING, ros::Time::now().toSec());
+  }
+
+  void jointStatesCallback(const sensor_msgs::JointState::ConstPtr &msg)
+  {
+    for (size_t i = 0; i < msg->name.size() && i < msg->position.size(); i++)
+    {
+      for (int j = 0; j < TRAJECTORY_NUM_OF_JOINT; j++)
+        if (msg->name[i] == joint_name_[j]) present_joint_angle_[j] = msg->position[i];
+      if (msg->name[i] == "gripper") present_gripper_ = msg->position[i];
+    }
+    has_joint_state_ = true;
+    trajectory_.jointState(present_joint_angle_, ros::Time::now().toSec());
+  }
+
+  void step(double now)
+  {
+    trajectory_.update(now);
+    if (trajectory_.isBusy() || isWaiting(now)) return;
+
+    if (step_ == ARM_STEP_IDLE)
+    {
+      if (!has_joint_state_ || !takeJob(now)) return;
+      step_ = ARM_STEP_APPROACH;
+    }
+    else if (trajectory_.state() != TRAJECTORY_SUCCEEDED)
+    {
+      failJob(now, trajectoryStateName(trajectory_.state()));
+      return;
+    }
+    else if (step_ == ARM_STEP_RETREAT)
+    {
+      finishJob(now, true);
+      return;
+    }
+    else
+    {
+      step_++;
+    }
+
+    if (!sendStep(now)) failJob(now, "not accepted");
+  }
+
+  bool takeJob(double now)
+  {
+    PickPlaceJob job;
+    bool is_stolen = false;
+    if (!job_queue_->pop(index_, &job))
+    {
+      if (!job_queue_->steal(index_, boost::bind(&ArmExecutor::canServe, this, _1), &job))
+      {
+        is_idle_.store(true);
+        return false;
+      }
+      is_stolen = true;
+    }
+
+    is_idle_.store(false);
+    job_ = job;
+    job_start_ = now;
+
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    if (is_stolen) stolen_++;
+    wait_time_.addSample(now - job.created);
+    return true;
+  }
+
+  // Failing during the retreat ends the job, earlier steps retreat first
+  void failJob(double now, const char *reason)
+  {
+    ROS_WARN("Arm %lu: job %u (marker %u to %u) failed at step %d: goal %s",
+             (unsigned long)index_, job_.id, job_.pick_marker_id, job_.place_marker_id, step_, reason);
+
+    if (step_ == ARM_STEP_RETREAT)
+    {
+      finishJob(now, false);
+      return;
+    }
+
+    step_ = ARM_STEP_RETREAT;
+    if (!sendStep(now)) finishJob(now, false);
+    else is_failing_ = true;
+  }
+
+  void finishJob(double now, bool is_done)
+  {
+    bool is_success = is_done && !is_failing_;
+    {
+      std::lock_guard<std::mutex> lock(report_mutex_);
+      if (is_success) done_++;
+      else failed_++;
+      busy_ += now - job_start_;
+      if (is_success) job_time_.addSample(now - job_start_);
+    }
+    step_ = ARM_STEP_IDLE;
+    is_failing_ = false;
+  }
+
+  bool sendStep(double now)
+  {
+    double position[3];
+    std::vector<double> orientation(motion_.grip_orientation, motion_.grip_orientation + 4);
+
+    switch (step_)
+    {
+      case ARM_STEP_APPROACH:
+        // The box may have moved since the job was assigned
+        marker_map_->find(job_.pick_marker_id, now, job_.pick);
+        if (!armCanReach(base_, job_.pick)) return false;
+        if (!sendTool(motion_.gripper_open)) return false;
+        cellToArm(base_, job_.pick, position);
+        return sendTask(position[0] + motion_.pick[0], position[1] + motion_.pick[1], motion_.pick[2],
+                        orientation, motion_.approach_time, now);
+
+      case ARM_STEP_GRIP:
+        if (!sendTool(motion_.gripper_close)) return false;
+        return waitGripper(motion_.grip_time, now);
+
+      case ARM_STEP_LIFT:
+        cellToArm(base_, job_.pick, position);
+        return sendTask(position[0] + motion_.pick[0], position[1] + motion_.pick[1], motion_.lift_height,
+                        orientation, motion_.move_time, now);
+
+      case ARM_STEP_PLACE:
+        marker_map_->find(job_.place_marker_id, now, job_.place);
+        if (!armCanReach(base_, job_.place)) return false;
+        cellToArm(base_, job_.place, position);
+        return sendTask(position[0], position[1], position[2] + motion_.place_height,
+                        orientation, motion_.approach_time, now);
+
+      case ARM_STEP_RELEASE:
+        if (!sendTool(motion_.gripper_open)) return false;
+        return waitGripper(motion_.grip_time, now);
+
+      case ARM_STEP_RETREAT:
+      {
+        std::vector<double> joint_angle(motion_.initial, motion_.initial + TRAJECTORY_NUM_OF_JOINT);
+        return trajectory_.sendJointGoal(joint_name_, joint_angle, motion_.move_time, now) == TRAJECTORY_PENDING;
+      }
+
+      default:
+        return false;
+    }
+  }
+
+  bool sendTask(double x, double y, double z, const std::vector<double> &orientation, double path_time, double now)
+  {
+    std::vector<double> position;
+    position.push_back(x);
+    position.push_back(y);
+    position.push_back(z);
+    return trajectory_.sendTaskGoal("gripper", position, orientation, path_time, now) == TRAJECTORY_PENDING;
+  }
+
+  bool sendTool(double value)
+  {
+    return trajectory_.sendToolGoal(std::vector<double>(1, value)) == TRAJECTORY_SUCCEEDED;
+  }
+
+  // While the gripper closes or opens the arm stays where its last goal left
+  // it; the step waits on the worker's own tick until the gripper stops, at
+  // most time, without a goal to the controller
+  bool waitGripper(double time, double now)
+  {
+    gripper_settle_.reset();
+    step_wait_.start(STEP_WAIT_GRIPPER, time, now);
+    return true;
+  }
+
+  bool isWaiting(double now)
+  {
+    if (!step_wait_.isWaiting()) return false;
+
+    gripper_settle_.update(now, &present_gripper_, 1);
+    return step_wait_.update(now, gripper_settle_.isSettled(now));
+  }
+
+  size_t index_;
+  ros::NodeHandle node_handle_;  // in the arm's namespace
+  ArmBase base_;
+  ArmMotion motion_;
+  JobQueue *job_queue_;
+  MarkerMap *marker_map_;
+
+  // Worker thread only
+  ros::CallbackQueue queue_;
+  ros::Subscriber states_sub_;
+  ros::Subscriber joint_states_sub_;
+  TrajectoryClient trajectory_;
+  std::vector<std::string> joint_name_;
+  double present_joint_angle_[TRAJECTORY_NUM_OF_JOINT];
+  double present_gripper_;
+  StepWait step_wait_;
+  SettleDetector gripper_settle_;
+  PickPlaceJob job_;
+  int step_;
+  double job_start_;  // [s]
+  bool has_joint_state_;
+  bool is_failing_;  // retreating after a failed step
+
+  std::thread worker_;
+  std::atomic<bool> running_;
+  std::atomic<bool> is_idle_;
+
+  mutable std::mutex report_mutex_;
+  uint64_t done_;
+  uint64_t failed_;
+  uint64_t stolen_;
+  double busy_;  // [s]
+  LatencyStatistics job_time_;
+  LatencyStatistics wait_time_;
+};
+
+}  // namespace open_manipulator_pick_and_place
+
+#endif  // OPEN_MANIPULATOR_PICK_AND_PLACE_ARM_EXECUTOR_H
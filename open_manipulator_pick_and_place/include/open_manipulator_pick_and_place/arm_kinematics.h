@@ -0,0 +1,174 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+
+#ifndef OPEN_MANIPULATOR_PICK_AND_PLACE_ARM_KINEMATICS_H
+#define OPEN_MANIPULATOR_PICK_AND_PLACE_ARM_KINEMATICS_H
+
+#include <cmath>
+
+#define ARM_TOOL_OFFSET  0.126  // link5 -> tool point of task space paths, along x [m]
+
+namespace open_manipulator_pick_and_place
+{
+
+// Rotation (row major) and translation, mapping child frame points to the parent frame
+typedef struct _RigidTransform
+{
+  double rotation[9];
+  double translation[3];
+} RigidTransform;
+
+inline RigidTransform makeTransform(double x, double y, double z, double yaw, double pitch, double roll)
+{
+  // Same convention as tf static_transform_publisher: R = Rz(yaw) Ry(pitch) Rx(roll)
+  double cy = std::cos(yaw),   sy = std::sin(yaw);
+  double cp = std::cos(pitch), sp = std::sin(pitch);
+  double cr = std::cos(roll),  sr = std::sin(roll);
+
+  RigidTransform t = {{cy * cp, cy * sp * sr - sy * cr, cy * sp * cr + sy * sr,
+                       sy * cp, sy * sp * sr + cy * cr, sy * sp * cr - cy * sr,
+                       -sp,     cp * sr,                cp * cr},
+                      {x, y, z}};
+  return t;
+}
+
+// a * b: frame b expressed through frame a
+inline RigidTransform compose(const RigidTransform &a, const RigidTransform &b)
+{
+  RigidTransform t;
+  for (int row = 0; row < 3; row++)
+  {
+    for (int col = 0; col < 3; col++)
+    {
+      t.rotation[row * 3 + col] = a.rotation[row * 3]     * b.rotation[col] +
+                                  a.rotation[row * 3 + 1] * b.rotation[3 + col] +
+                                  a.rotation[row * 3 + 2] * b.rotation[6 + col];
+    }
+    t.translation[row] = a.rotation[row * 3]     * b.translation[0] +
+                         a.rotation[row * 3 + 1] * b.translation[1] +
+                         a.rotation[row * 3 + 2] * b.translation[2] + a.translation[row];
+  }
+  return t;
+}
+
+inline void transformPoint(const RigidTransform &t, const double point[3], double result[3])
+{
+  for (int row = 0; row < 3; row++)
+    result[row] = t.rotation[row * 3] * point[0] + t.rotation[row * 3 + 1] * point[1] +
+                  t.rotation[row * 3 + 2] * point[2] + t.translation[row];
+}
+
+// Parent frame points to the child frame
+inline RigidTransform inverse(const RigidTransform &t)
+{
+  RigidTransform result;
+  for (int row = 0; row < 3; row++)
+  {
+    for (int col = 0; col < 3; col++)
+      result.rotation[row * 3 + col] = t.rotation[col * 3 + row];
+  }
+  for (int row = 0; row < 3; row++)
+    result.translation[row] = -(result.rotation[row * 3]     * t.translation[0] +
+                                result.rotation[row * 3 + 1] * t.translation[1] +
+                                result.rotation[row * 3 + 2] * t.translation[2]);
+  return result;
+}
+
+// Pitch of the tool (w x y z), positive pointing down like joint2 to joint4;
+// the arm cannot roll and yaw follows from the position
+inline double toolPitch(double w, double x, double y, double z)
+{
+  double sin_pitch = 2.0 * (w * y - z * x);
+  return std::asin(sin_pitch > 1.0 ? 1.0 : (sin_pitch < -1.0 ? -1.0 : sin_pitch));
+}
+
+// Forward kinematics of the OpenManipulator-X (open_manipulator_description)
+// from world to link5 and the camera mounted on it, and the inverse
+// kinematics of the tool point of the controller's task space paths.
+class ArmKinematics
+{
+ public:
+  ArmKinematics()
+  {
+    // raspicam mount of ar_pose.launch: link5 -> camera (optical frame)
+    setCameraExtrinsic(0.015, 0.0, 0.052, -1.57, 0.0, -1.57);
+  }
+
+  void setCameraExtrinsic(double x, double y, double z, double yaw, double pitch, double roll)
+  {
+    link5_to_camera_ = makeTransform(x, y, z, yaw, pitch, roll);
+  }
+
+  const RigidTransform &cameraExtrinsic() const { return link5_to_camera_; }
+
+  // joint1 to joint4 [rad]
+  RigidTransform link5ToWorld(const double joint[4]) const
+  {
+    // world = link1, joint1 about z, joint2 to joint4 about y
+    RigidTransform t = makeTransform(0.012, 0.0, 0.017, joint[0], 0.0, 0.0);
+    t = compose(t, makeTransform(0.0, 0.0, 0.0595, 0.0, joint[1], 0.0));
+    t = compose(t, makeTransform(0.024, 0.0, 0.128, 0.0, joint[2], 0.0));
+    t = compose(t, makeTransform(0.124, 0.0, 0.0, 0.0, joint[3], 0.0));
+    return t;
+  }
+
+  RigidTransform cameraToWorld(const double joint[4]) const
+  {
+    return compose(link5ToWorld(joint), link5_to_camera_);
+  }
+
+  // Elbow up joint1 to joint4 [rad] that put the tool point (ARM_TOOL_OFFSET
+  // ahead of link5) at position with the given pitch; false when out of
+  // reach or of the joint limits
+  bool toolToJoint(const double position[3], double pitch, double joint[4]) const
+  {
+    const double LINK1 = std::sqrt(0.024 * 0.024 + 0.128 * 0.128);  // joint2 -> joint3
+    const double LINK1_ELEVATION = std::atan2(0.128, 0.024);         // at joint2 = 0
+    const double LINK2 = 0.124;                                      // joint3 -> joint4
+
+    // joint2 -> joint4 in the vertical plane through joint1
+    double r = std::sqrt((position[0] - 0.012) * (position[0] - 0.012) + position[1] * position[1]);
+    double wrist_r = r - ARM_TOOL_OFFSET * std::cos(pitch);
+    double wrist_z = position[2] - 0.0765 + ARM_TOOL_OFFSET * std::sin(pitch);
+
+    double cos_elbow = (wrist_r * wrist_r + wrist_z * wrist_z - LINK1 * LINK1 - LINK2 * LINK2) / (2.0 * LINK1 * LINK2);
+    if (cos_elbow < -1.0 || cos_elbow > 1.0) return false;
+
+    // Elevation of the two links, link1 above link2
+    double elbow = std::acos(cos_elbow);
+    double elevation1 = std::atan2(wrist_z, wrist_r) + std::atan2(LINK2 * std::sin(elbow), LINK1 + LINK2 * std::cos(elbow));
+    double elevation2 = elevation1 - elbow;
+
+    joint[0] = std::atan2(position[1], position[0] - 0.012);
+    joint[1] = LINK1_ELEVATION - elevation1;
+    joint[2] = -elevation2 - joint[1];
+    joint[3] = pitch - joint[1] - joint[2];
+
+    const double lower[4] = {-2.827, -1.790, -0.942, -1.790};
+    const double upper[4] = { 2.827,  1.571,  1.382,  2.042};
+    for (int i = 0; i < 4; i++)
+      if (joint[i] < lower[i] || joint[i] > upper[i]) return false;
+    return true;
+  }
+
+ private:
+  RigidTransform link5_to_camera_;
+};
+
+}  // namespace open_manipulator_pick_and_place
+
+#endif  // OPEN_MANIPULATOR_PICK_AND_PLACE_ARM_KINEMATICS_H
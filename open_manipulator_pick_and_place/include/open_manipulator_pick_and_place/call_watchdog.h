@@ -0,0 +1,161 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef OPEN_MANIPULATOR_PICK_AND_PLACE_CALL_WATCHDOG_H
+#define OPEN_MANIPULATOR_PICK_AND_PLACE_CALL_WATCHDOG_H
+
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <boost/function.hpp>
+
+namespace open_manipulator_pick_and_place
+{
+
+// Deadlines of blocking calls, watched by one thread. A call is armed before
+// it blocks and disarmed when it returns; when its deadline passes first the
+// thread runs its expire callback, which has to make the call return (for a
+// service call: drop the connection it waits on). disarm() waits for an
+// expire callback that is running, so the caller sees the call either
+// completed or expired, never both. The thread starts with the first arm().
+class CallWatchdog
+{
+ public:
+  typedef boost::function<void()> ExpireCallback;
+
+  static const int CAPACITY = 8;  // calls armed at once
+  static const int NONE = -1;
+
+  CallWatchdog()
+  : is_running_(false),
+    expired_(0)
+  {
+    for (int i = 0; i < CAPACITY; i++)
+      watch_[i].is_armed = false;
+  }
+
+  ~CallWatchdog()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      is_running_ = false;
+    }
+    condition_.notify_one();
+    if (thread_.joinable()) thread_.join();
+  }
+
+  // Any thread; NONE when all watches are in use, the call then runs unwatched
+  int arm(double timeout, const ExpireCallback &expire)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!is_running_)
+    {
+      is_running_ = true;
+      thread_ = std::thread(&CallWatchdog::run, this);
+    }
+
+    for (int i = 0; i < CAPACITY; i++)
+    {
+      Watch &watch = watch_[i];
+      if (watch.is_armed) continue;
+
+      watch.is_armed = true;
+      watch.is_expired = false;
+      watch.deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(timeout));
+      watch.expire = expire;
+      condition_.notify_one();
+      return i;
+    }
+    return NONE;
+  }
+
+  // True when the deadline passed before the call returned
+  bool disarm(int index)
+  {
+    if (index == NONE) return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Watch &watch = watch_[index];
+    watch.is_armed = false;
+    watch.expire.clear();
+    return watch.is_expired;
+  }
+
+  uint64_t expired()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return expired_;
+  }
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  typedef struct _Watch
+  {
+    bool is_armed;
+    bool is_expired;  // expire ran, the watch stays armed until disarm()
+    Clock::time_point deadline;
+    ExpireCallback expire;
+  } Watch;
+
+  void run()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (is_running_)
+    {
+      Clock::time_point now = Clock::now();
+      Clock::time_point next = now + std::chrono::seconds(1);
+      for (int i = 0; i < CAPACITY; i++)
+      {
+        Watch &watch = watch_[i];
+        if (!watch.is_armed || watch.is_expired) continue;
+
+        if (watch.deadline <= now)
+        {
+          // Under the lock, so disarm() cannot return while it runs
+          watch.is_expired = true;
+          expired_++;
+          if (watch.expire) watch.expire();
+        }
+        else if (watch.deadline < next)
+        {
+          next = watch.deadline;
+        }
+      }
+      condition_.wait_until(lock, next);
+    }
+  }
+
+  std::mutex mutex_;  // guards everything below
+  std::condition_variable condition_;
+  std::thread thread_;
+  bool is_running_;
+  Watch watch_[CAPACITY];
+  uint64_t expired_;
+};
+
+// The one watchdog thread of the process, shared by every ServiceConnection
+inline CallWatchdog &callWatchdog()
+{
+  static CallWatchdog watchdog;
+  return watchdog;
+}
+
+}  // namespace open_manipulator_pick_and_place
+
+#endif  // OPEN_MANIPULATOR_PICK_AND_PLACE_CALL_WATCHDOG_H
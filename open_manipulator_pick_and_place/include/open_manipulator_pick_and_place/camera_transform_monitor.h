@@ -0,0 +1,164 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef OPEN_MANIPULATOR_PICK_AND_PLACE_CAMERA_TRANSFORM_MONITOR_H
+#define OPEN_MANIPULATOR_PICK_AND_PLACE_CAMERA_TRANSFORM_MONITOR_H
+
+#include <ros/ros.h>
+#include <stdio.h>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <boost/shared_ptr.hpp>
+#include <tf2_ros/buffer.h>
+#include <tf2_ros/transform_listener.h>
+
+#include "diagnostic_msgs/DiagnosticArray.h"
+
+#include "open_manipulator_pick_and_place/arm_kinematics.h"
+#include "open_manipulator_pick_and_place/diagnostic_value.h"
+#include "open_manipulator_pick_and_place/joint_state_buffer.h"
+
+namespace open_manipulator_pick_and_place
+{
+
+// Periodically checks the in-node camera -> world transform against TF at the
+// stamp of the latest joint state and publishes the difference and the cost
+// of both on /diagnostics. Only this monitor listens to TF.
+class CameraTransformMonitor
+{
+ public:
+  CameraTransformMonitor(ros::NodeHandle node_handle, const JointStateBuffer &joint_state_buffer,
+                         const ArmKinematics &arm_kinematics, const std::string &world_frame,
+                         const std::string &camera_frame, double period)
+  : node_handle_(node_handle),
+    joint_state_buffer_(joint_state_buffer),
+    arm_kinematics_(arm_kinematics),
+    world_frame_(world_frame),
+    camera_frame_(camera_frame),
+    max_translation_error_(0.0),
+    max_rotation_error_(0.0)
+  {
+    tf_buffer_.reset(new tf2_ros::Buffer);
+    tf_listener_.reset(new tf2_ros::TransformListener(*tf_buffer_, node_handle_));
+    diagnostics_pub_ = node_handle_.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+    timer_ = node_handle_.createTimer(ros::Duration(period), &CameraTransformMonitor::timerCallback, this);
+  }
+
+ private:
+  void timerCallback(const ros::TimerEvent&)
+  {
+    diagnostic_msgs::DiagnosticStatus status;
+    status.name = ros::this_node::getName() + ": camera transform";
+    status.hardware_id = camera_frame_;
+
+    JointSample sample;
+    if (!joint_state_buffer_.latest(&sample))
+    {
+      status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+      status.message = "No joint state";
+      publish(status);
+      return;
+    }
+
+    ros::WallTime start = ros::WallTime::now();
+    RigidTransform kinematics = arm_kinematics_.cameraToWorld(sample.position);
+    double kinematics_time = (ros::WallTime::now() - start).toSec();
+
+    geometry_msgs::TransformStamped tf_transform;
+    start = ros::WallTime::now();
+    try
+    {
+      tf_transform = tf_buffer_->lookupTransform(world_frame_, camera_frame_, ros::Time(sample.stamp));
+    }
+    catch (tf2::TransformException &ex)
+    {
+      status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+      status.message = std::string("TF not available: ") + ex.what();
+      publish(status);
+      return;
+    }
+    double tf_time = (ros::WallTime::now() - start).toSec();
+
+    const geometry_msgs::Vector3 &t = tf_transform.transform.translation;
+    double translation_error = std::sqrt((kinematics.translation[0] - t.x) * (kinematics.translation[0] - t.x) +
+                                         (kinematics.translation[1] - t.y) * (kinematics.translation[1] - t.y) +
+                                         (kinematics.translation[2] - t.z) * (kinematics.translation[2] - t.z));
+    double rotation_error = rotationDifference(kinematics, tf_transform.transform.rotation);
+    max_translation_error_ = std::max(max_translation_error_, translation_error);
+    max_rotation_error_ = std::max(max_rotation_error_, rotation_error);
+
+    if (translation_error < 0.005 && rotation_error < 1.0 * M_PI / 180.0)
+    {
+      status.level = diagnostic_msgs::DiagnosticStatus::OK;
+      status.message = "Forward kinematics matches TF";
+    }
+    else
+    {
+      status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+      status.message = "Forward kinematics differs from TF, check the camera extrinsic";
+    }
+
+    addDiagnosticValue(status, "Translation difference [mm]", translation_error * 1e3);
+    addDiagnosticValue(status, "Rotation difference [deg]", rotation_error * 180.0 / M_PI);
+    addDiagnosticValue(status, "Max translation difference [mm]", max_translation_error_ * 1e3);
+    addDiagnosticValue(status, "Max rotation difference [deg]", max_rotation_error_ * 180.0 / M_PI);
+    addDiagnosticValue(status, "Forward kinematics time [us]", kinematics_time * 1e6);
+    addDiagnosticValue(status, "TF lookup time [us]", tf_time * 1e6);
+    publish(status);
+  }
+
+  // Angle of the rotation between the two orientations [rad]
+  static double rotationDifference(const RigidTransform &kinematics, const geometry_msgs::Quaternion &q)
+  {
+    const double r[9] = {1.0 - 2.0 * (q.y * q.y + q.z * q.z), 2.0 * (q.x * q.y - q.z * q.w), 2.0 * (q.x * q.z + q.y * q.w),
+                         2.0 * (q.x * q.y + q.z * q.w), 1.0 - 2.0 * (q.x * q.x + q.z * q.z), 2.0 * (q.y * q.z - q.x * q.w),
+                         2.0 * (q.x * q.z - q.y * q.w), 2.0 * (q.y * q.z + q.x * q.w), 1.0 - 2.0 * (q.x * q.x + q.y * q.y)};
+
+    // trace(Rk^T R) = sum of the element-wise products
+    double trace = 0.0;
+    for (int i = 0; i < 9; i++)
+      trace += kinematics.rotation[i] * r[i];
+    return std::acos(std::max(-1.0, std::min(1.0, (trace - 1.0) * 0.5)));
+  }
+
+  void publish(const diagnostic_msgs::DiagnosticStatus &status)
+  {
+    diagnostic_msgs::DiagnosticArray diagnostics;
+    diagnostics.header.stamp = ros::Time::now();
+    diagnostics.status.push_back(status);
+    diagnostics_pub_.publish(diagnostics);
+  }
+
+  ros::NodeHandle node_handle_;
+  ros::Publisher diagnostics_pub_;
+  ros::Timer timer_;
+
+  boost::shared_ptr<tf2_ros::Buffer> tf_buffer_;
+  boost::shared_ptr<tf2_ros::TransformListener> tf_listener_;
+
+  const JointStateBuffer &joint_state_buffer_;
+  const ArmKinematics &arm_kinematics_;
+  std::string world_frame_;
+  std::string camera_frame_;
+
+  double max_translation_error_;  // [m]
+  double max_rotation_error_;     // [rad]
+};
+
+}  // namespace open_manipulator_pick_and_place
+
+#endif  // OPEN_MANIPULATOR_PICK_AND_PLACE_CAMERA_TRANSFORM_MONITOR_H
@@ -0,0 +1,337 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef OPEN_MANIPULATOR_PICK_AND_PLACE_CONTROL_LOOP_H
+#define OPEN_MANIPULATOR_PICK_AND_PLACE_CONTROL_LOOP_H
+
+#include <ros/ros.h>
+#include <ros/callback_queue.h>
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/function.hpp>
+
+#include "diagnostic_msgs/DiagnosticArray.h"
+
+#include "open_manipulator_pick_and_place/diagnostic_value.h"
+
+// Buckets of the tick lateness histogram: < 1 us, then [2^(i-1), 2^i) us,
+// the last one open ended (> 0.5 s)
+#define JITTER_NUM_OF_BUCKET  21
+
+namespace open_manipulator_pick_and_place
+{
+
+// Lateness of every tick, in power of 2 microsecond buckets like
+// cyclictest's, counted with atomics so the report can read them while
+// the control thread writes
+class JitterHistogram
+{
+ public:
+  JitterHistogram()
+  {
+    reset();
+  }
+
+  void reset()
+  {
+    for (int i = 0; i < JITTER_NUM_OF_BUCKET; i++)
+      count_[i].store(0);
+    max_.store(0);
+    sum_.store(0);
+    samples_.store(0);
+  }
+
+  void add(int64_t late_ns)
+  {
+    uint64_t late_us = late_ns > 0 ? (uint64_t)late_ns / 1000 : 0;
+    int bucket = 0;
+    while (late_us > 0 && bucket < JITTER_NUM_OF_BUCKET - 1)
+    {
+      late_us >>= 1;
+      bucket++;
+    }
+    count_[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t late = late_ns > 0 ? (uint64_t)late_ns : 0;
+    sum_.fetch_add(late, std::memory_order_relaxed);
+    samples_.fetch_add(1, std::memory_order_relaxed);
+    if (late > max_.load(std::memory_order_relaxed)) max_.store(late, std::memory_order_relaxed);
+  }
+
+  uint64_t count(int bucket) const { return count_[bucket].load(std::memory_order_relaxed); }
+  uint64_t samples() const { return samples_.load(std::memory_order_relaxed); }
+  double max() const { return max_.load(std::memory_order_relaxed) * 1e-9; }  // [s]
+  double mean() const { return samples() > 0 ? sum_.load(std::memory_order_relaxed) * 1e-9 / samples() : 0.0; }
+
+  // "< 1 us", "1-2 us", ..., "> 524288 us"
+  static std::string bucketName(int bucket)
+  {
+    char name[32];
+    if (bucket == 0) snprintf(name, sizeof(name), "< 1 us");
+    else if (bucket == JITTER_NUM_OF_BUCKET - 1) snprintf(name, sizeof(name), "> %lu us", 1UL << (bucket - 1));
+    else snprintf(name, sizeof(name), "%lu-%lu us", 1UL << (bucket - 1), 1UL << bucket);
+    return name;
+  }
+
+ private:
+  std::atomic<uint64_t> count_[JITTER_NUM_OF_BUCKET];
+  std::atomic<uint64_t> max_;      // [ns]
+  std::atomic<uint64_t> sum_;      // [ns]
+  std::atomic<uint64_t> samples_;
+};
+
+typedef struct _ControlLoopConfig
+{
+  bool is_realtime;       // off: the tick is a ros::Timer on the spinner as before
+  double period;          // [s]
+  int priority;           // SCHED_FIFO, 1 to 99
+  std::vector<int> cpu;   // affinity of the control thread, empty for any
+  bool lock_memory;       // mlockall, and malloc keeps what it got
+  int prefault_stack;     // stack touched before the loop starts [bytes]
+  double report_period;   // histogram on /diagnostics, 0 for none [s]
+} ControlLoopConfig;
+
+inline ControlLoopConfig loadControlLoopConfig(ros::NodeHandle priv_node_handle, double period)
+{
+  ControlLoopConfig config;
+  config.is_realtime     = priv_node_handle.param<bool>("realtime", false);
+  config.period          = period;
+  config.priority        = priv_node_handle.param<int>("realtime_priority", 80);
+  config.cpu             = priv_node_handle.param<std::vector<int> >("realtime_cpu", std::vector<int>());
+  config.lock_memory     = priv_node_handle.param<bool>("realtime_lock_memory", true);
+  config.prefault_stack  = priv_node_handle.param<int>("realtime_prefault_stack", 256 * 1024);
+  config.report_period   = priv_node_handle.param<double>("realtime_report_period", 10.0);
+  return config;
+}
+
+// The node's tick and its state callbacks on one dedicated thread: those
+// subscriptions and timers go on a callback queue of their own, which the
+// thread serves between ticks, so they never run concurrently with the
+// tick, as on the single threaded spinner. A callback served here delays
+// the next tick by as long as it runs, so heavy ones (the node's marker and
+// depth image callbacks) belong on another queue and thread. Ticks are on absolute
+// CLOCK_MONOTONIC deadlines (no drift); the queue is served until shortly
+// before each one and clock_nanosleep() wakes the thread for it. A tick
+// that runs past the next deadline is an overrun, the deadlines it missed
+// are skipped and the loop stays in phase. Lateness of every tick goes
+// into a histogram published on /diagnostics.
+//
+// SCHED_FIFO needs CAP_SYS_NICE or an rtprio limit (limits.conf); without
+// it the thread runs at normal priority and says so in the report.
+// mlockall() locks the whole process, not the thread: run as a nodelet, all
+// of the manager is locked, camera driver nodelets and their image buffers
+// included, which the memlock limit has to allow for.
+class ControlLoop
+{
+ public:
+  typedef boost::function<void(const ros::TimerEvent &event)> TickCallback;
+
+  ControlLoop()
+  : queue_(NULL),
+    running_(false),
+    is_realtime_(false),
+    ticks_(0),
+    overruns_(0),
+    missed_(0)
+  {
+  }
+
+  ~ControlLoop()
+  {
+    stop();
+  }
+
+  // queue holds the node's callbacks; node_handle (on another queue) carries the report
+  void start(const ControlLoopConfig &config, ros::CallbackQueue *queue, const TickCallback &tick,
+             ros::NodeHandle node_handle)
+  {
+    config_ = config;
+    queue_ = queue;
+    tick_ = tick;
+
+    if (config_.lock_memory)
+    {
+      // Freed heap stays mapped, so it is not faulted in again later
+      mallopt(M_TRIM_THRESHOLD, -1);
+      mallopt(M_MMAP_MAX, 0);
+      if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+        ROS_WARN("mlockall failed (%s), memory of the control loop may be paged", strerror(errno));
+    }
+
+    if (config_.report_period > 0.0)
+    {
+      diagnostics_pub_ = node_handle.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 10);
+      report_timer_ = node_handle.createWallTimer(ros::WallDuration(config_.report_period), &ControlLoop::report, this);
+    }
+
+    running_ = true;
+    thread_ = std::thread(&ControlLoop::run, this);
+  }
+
+  void stop()
+  {
+    if (!running_) return;
+
+    running_ = false;
+    if (thread_.joinable()) thread_.join();
+    report_timer_.stop();
+    ROS_INFO("Control loop: %llu ticks, %llu overruns, %llu missed, late mean %.3f ms max %.3f ms",
+             (unsigned long long)ticks_.load(), (unsigned long long)overruns_.load(), (unsigned long long)missed_.load(),
+             late_.mean() * 1e3, late_.max() * 1e3);
+  }
+
+  const JitterHistogram &late() const { return late_; }
+  uint64_t ticks() const { return ticks_.load(); }
+  uint64_t overruns() const { return overruns_.load(); }
+
+ private:
+  // Served until this much before a deadline, then slept to it
+  static const int64_t WAKE_UP_GUARD = 1000000;  // [ns]
+
+  static int64_t monotonic()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+  }
+
+  void setUpThread()
+  {
+    if (!config_.cpu.empty())
+    {
+      cpu_set_t cpu_set;
+      CPU_ZERO(&cpu_set);
+      for (size_t i = 0; i < config_.cpu.size(); i++)
+        CPU_SET(config_.cpu[i], &cpu_set);
+      int error = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+      if (error != 0) ROS_WARN("Cannot pin the control thread (%s)", strerror(error));
+    }
+
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = config_.priority;
+    int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    is_realtime_ = error == 0;
+    if (!is_realtime_) ROS_WARN("Cannot run the control thread SCHED_FIFO %d (%s), it runs at normal priority", config_.priority, strerror(error));
+
+    // Fault the stack in now rather than on the first deep call
+    if (config_.prefault_stack > 0)
+    {
+      volatile char *stack = (volatile char *)alloca(config_.prefault_stack);
+      for (int i = 0; i < config_.prefault_stack; i += 4096)
+        stack[i] = 0;
+    }
+  }
+
+  void run()
+  {
+    setUpThread();
+
+    const int64_t period = (int64_t)(config_.period * 1e9);
+    int64_t deadline = monotonic() + period;
+    ros::TimerEvent event;
+
+    while (running_ && ros::ok())
+    {
+      // Callbacks until shortly before the deadline
+      int64_t remaining = deadline - WAKE_UP_GUARD - monotonic();
+      if (remaining > 0)
+      {
+        queue_->callAvailable(ros::WallDuration(remaining * 1e-9));
+        continue;
+      }
+
+      struct timespec wake_up;
+      wake_up.tv_sec = deadline / 1000000000LL;
+      wake_up.tv_nsec = deadline % 1000000000LL;
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake_up, NULL) == EINTR) {}
+
+      int64_t start = monotonic();
+      int64_t late = start - deadline;
+      late_.add(late);
+      ticks_++;
+
+      event.last_expected = event.current_expected;
+      event.last_real = event.current_real;
+      event.current_real = ros::Time::now();
+      event.current_expected = event.current_real - ros::Duration(late * 1e-9);
+      tick_(event);
+
+      // Deadlines already passed are skipped, the next one keeps the phase
+      deadline += period;
+      int64_t now = monotonic();
+      if (now > deadline)
+      {
+        overruns_++;
+        int64_t missed = (now - deadline) / period + 1;
+        missed_ += missed;
+        deadline += missed * period;
+      }
+    }
+  }
+
+  void report(const ros::WallTimerEvent&)
+  {
+    diagnostic_msgs::DiagnosticStatus status;
+    status.name = ros::this_node::getName() + ": control loop";
+    status.level = !is_realtime_ || overruns_.load() > 0 ? diagnostic_msgs::DiagnosticStatus::WARN : diagnostic_msgs::DiagnosticStatus::OK;
+    status.message = !is_realtime_ ? "Not SCHED_FIFO" : (overruns_.load() > 0 ? "Ticks overran" : "OK");
+
+    addDiagnosticValue(status, "realtime", is_realtime_ ? 1.0 : 0.0);
+    addDiagnosticValue(status, "ticks", (double)ticks_.load());
+    addDiagnosticValue(status, "overruns", (double)overruns_.load());
+    addDiagnosticValue(status, "missed ticks", (double)missed_.load());
+    addDiagnosticValue(status, "late mean [ms]", late_.mean() * 1e3);
+    addDiagnosticValue(status, "late max [ms]", late_.max() * 1e3);
+    for (int i = 0; i < JITTER_NUM_OF_BUCKET; i++)
+      addDiagnosticValue(status, "late " + JitterHistogram::bucketName(i), (double)late_.count(i));
+
+    diagnostic_msgs::DiagnosticArray diagnostics;
+    diagnostics.header.stamp = ros::Time::now();
+    diagnostics.status.push_back(status);
+    diagnostics_pub_.publish(diagnostics);
+  }
+
+  ControlLoopConfig config_;
+  ros::CallbackQueue *queue_;
+  TickCallback tick_;
+  std::thread thread_;
+  std::atomic<bool> running_;
+  std::atomic<bool> is_realtime_;
+
+  std::atomic<uint64_t> ticks_;
+  std::atomic<uint64_t> overruns_;
+  std::atomic<uint64_t> missed_;
+  JitterHistogram late_;
+
+  ros::Publisher diagnostics_pub_;
+  ros::WallTimer report_timer_;
+};
+
+}  // namespace open_manipulator_pick_and_place
+
+#endif  // OPEN_MANIPULATOR_PICK_AND_PLACE_CONTROL_LOOP_H
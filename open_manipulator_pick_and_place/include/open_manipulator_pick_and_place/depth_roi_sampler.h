@@ -0,0 +1,201 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef OPEN_MANIPULATOR_PICK_AND_PLACE_DEPTH_ROI_SAMPLER_H
+#define OPEN_MANIPULATOR_PICK_AND_PLACE_DEPTH_ROI_SAMPLER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+namespace open_manipulator_pick_and_place
+{
+
+typedef struct _DepthRoiResult
+{
+  double top_depth;      // median over the footprint, optical z [m]
+  double support_depth;  // upper quartile over the ring around it, 0 when not seen [m]
+  int top_pixels;        // valid pixels behind them
+  int support_pixels;
+} DepthRoiResult;
+
+// Height of what stands under a marker, read straight from the aligned depth
+// image: the marker's square footprint is projected into the image and only
+// the pixels inside it (the top of the object) and in a ring just outside it
+// (the surface it stands on) are read. The footprint is reduced to its
+// median, so holes, edges and speckle do not move it, and the ring to its
+// upper quartile, the far side, as it also catches the object's rim when the
+// marker is smaller than the object. No point cloud is built; a footprint of
+// a few thousand pixels takes some tens of microseconds.
+//
+// Positions are in the optical frame of the depth image (x right, y down,
+// z forward); the caller moves them to and from the world frame.
+class DepthRoiSampler
+{
+ public:
+  DepthRoiSampler()
+  : fx_(0.0), fy_(0.0), cx_(0.0), cy_(0.0),
+    ring_width_(0.010),
+    min_valid_ratio_(0.3),
+    min_depth_(0.05),
+    max_depth_(2.0)
+  {
+  }
+
+  void setIntrinsics(double fx, double fy, double cx, double cy)
+  {
+    fx_ = fx; fy_ = fy; cx_ = cx; cy_ = cy;
+  }
+
+  bool hasIntrinsics() const { return fx_ > 0.0 && fy_ > 0.0; }
+  double fx() const { return fx_; }
+  double fy() const { return fy_; }
+  double cx() const { return cx_; }
+  double cy() const { return cy_; }
+
+  // ring_width [m] around the footprint; a quantile needs at least
+  // min_valid_ratio of its pixels to hold a depth in [min_depth, max_depth]
+  void setLimits(double ring_width, double min_valid_ratio, double min_depth, double max_depth)
+  {
+    ring_width_ = ring_width;
+    min_valid_ratio_ = min_valid_ratio;
+    min_depth_ = min_depth;
+    max_depth_ = max_depth;
+  }
+
+  // 16UC1 depth in units of scale [m] (1e-3 for the D435) or 32FC1 in
+  // metres (scale 1); step in bytes. center is the marker, half_size half
+  // the side of its footprint [m]. False when the footprint is behind the
+  // camera, outside the image or without enough valid pixels on top.
+  template <typename T>
+  bool sample(const T *data, int width, int height, size_t step, double scale,
+              const double center[3], double half_size, DepthRoiResult *result)
+  {
+    if (!hasIntrinsics() || center[2] <= min_depth_) return false;
+
+    double u = fx_ * center[0] / center[2] + cx_;
+    double v = fy_ * center[1] / center[2] + cy_;
+    double half_u = fx_ * half_size / center[2];
+    double half_v = fy_ * half_size / center[2];
+    double ring_u = fx_ * ring_width_ / center[2];
+    double ring_v = fy_ * ring_width_ / center[2];
+
+    Roi inner = makeRoi(u, v, half_u, half_v, width, height);
+    Roi outer = makeRoi(u, v, half_u + ring_u, half_v + ring_v, width, height);
+    if (inner.empty()) return false;
+
+    top_.clear();
+    support_.clear();
+    for (int row = outer.top; row < outer.bottom; row++)
+    {
+      const T *line = (const T *)((const uint8_t *)data + row * step);
+      bool is_inner_row = row >= inner.top && row < inner.bottom;
+      for (int col = outer.left; col < outer.right; col++)
+      {
+        float depth = (float)(line[col] * scale);
+        if (!(depth >= min_depth_ && depth <= max_depth_)) continue;  // also NaN of 32FC1
+
+        if (is_inner_row && col >= inner.left && col < inner.right) top_.push_back(depth);
+        else support_.push_back(depth);
+      }
+    }
+
+    int inner_area = inner.area();
+    int ring_area = outer.area() - inner_area;
+    if (top_.size() < (size_t)std::max(1.0, min_valid_ratio_ * inner_area)) return false;
+
+    result->top_depth = quantile(&top_, 0.5);
+    result->top_pixels = (int)top_.size();
+    bool has_support = ring_area > 0 && support_.size() >= (size_t)std::max(1.0, min_valid_ratio_ * ring_area);
+    result->support_depth = has_support ? quantile(&support_, 0.75) : 0.0;
+    result->support_pixels = has_support ? (int)support_.size() : 0;
+    return true;
+  }
+
+  // Point of the ray through center at optical depth, i.e. center moved
+  // along its line of sight onto the measured surface
+  static void alongRay(const double center[3], double depth, double point[3])
+  {
+    point[0] = center[0] * depth / center[2];
+    point[1] = center[1] * depth / center[2];
+    point[2] = depth;
+  }
+
+ private:
+  typedef struct _Roi
+  {
+    int left, top, right, bottom;  // right and bottom exclusive
+
+    bool empty() const { return right <= left || bottom <= top; }
+    int area() const { return empty() ? 0 : (right - left) * (bottom - top); }
+  } Roi;
+
+  static Roi makeRoi(double u, double v, double half_u, double half_v, int width, int height)
+  {
+    Roi roi;
+    roi.left   = std::max(0, (int)floor(u - half_u));
+    roi.top    = std::max(0, (int)floor(v - half_v));
+    roi.right  = std::min(width,  (int)ceil(u + half_u));
+    roi.bottom = std::min(height, (int)ceil(v + half_v));
+    return roi;
+  }
+
+  static double quantile(std::vector<float> *value, double q)
+  {
+    std::vector<float>::iterator nth = value->begin() + (size_t)(q * (value->size() - 1) + 0.5);
+    std::nth_element(value->begin(), nth, value->end());
+    return *nth;
+  }
+
+  double fx_, fy_, cx_, cy_;
+  double ring_width_;
+  double min_valid_ratio_;
+  double min_depth_;
+  double max_depth_;
+
+  // Kept between calls so that sampling does not allocate once warm
+  std::vector<float> top_;
+  std::vector<float> support_;
+};
+
+// Grasp height from the world heights of a box's top and of what it stands
+// on (NAN when not seen): below_top under the top, but at least min_height
+// above the support. *held_height is the grasp above the box's bottom, -1
+// when the support was not seen.
+inline double pickGraspHeight(double top_z, double support_z, double below_top, double min_height, double *held_height)
+{
+  double z = top_z - below_top;
+  *held_height = -1.0;
+  if (!isnan(support_z))
+  {
+    z = std::max(z, support_z + min_height);
+    *held_height = z - support_z;
+  }
+  return z;
+}
+
+// Grasp height that puts the bottom of a box held held_height under the
+// grasp clearance above top_z, the top of what is at the place position
+inline double placeGraspHeight(double top_z, double held_height, double clearance)
+{
+  return top_z + held_height + clearance;
+}
+
+}  // namespace open_manipulator_pick_and_place
+
+#endif  // OPEN_MANIPULATOR_PICK_AND_PLACE_DEPTH_ROI_SAMPLER_H
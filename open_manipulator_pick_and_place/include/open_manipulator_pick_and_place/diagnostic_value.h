@@ -0,0 +1,43 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef OPEN_MANIPULATOR_PICK_AND_PLACE_DIAGNOSTIC_VALUE_H
+#define OPEN_MANIPULATOR_PICK_AND_PLACE_DIAGNOSTIC_VALUE_H
+
+#include <stdio.h>
+#include <string>
+
+#include "diagnostic_msgs/DiagnosticStatus.h"
+#include "diagnostic_msgs/KeyValue.h"
+
+namespace open_manipulator_pick_and_place
+{
+
+// One number of a /diagnostics status, with three decimals
+inline void addDiagnosticValue(diagnostic_msgs::DiagnosticStatus &status, const std::string &key, double value)
+{
+  char text[32];
+  snprintf(text, sizeof(text), "%.3f", value);
+
+  diagnostic_msgs::KeyValue key_value;
+  key_value.key = key;
+  key_value.value = text;
+  status.values.push_back(key_value);
+}
+
+}  // namespace open_manipulator_pick_and_place
+
+#endif  // OPEN_MANIPULATOR_PICK_AND_PLACE_DIAGNOSTIC_VALUE_H
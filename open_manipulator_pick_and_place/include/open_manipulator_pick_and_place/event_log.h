@@ -0,0 +1,419 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef OPEN_MANIPULATOR_PICK_AND_PLACE_EVENT_LOG_H
+#define OPEN_MANIPULATOR_PICK_AND_PLACE_EVENT_LOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#define EVENT_LOG_MAGIC    "OMEVLOG"  // 8 bytes with the nul, the size of the header magic
+#define EVENT_LOG_VERSION  1
+
+#define EVENT_LEVEL_INFO     0
+#define EVENT_LEVEL_WARNING  1
+#define EVENT_LEVEL_ERROR    2
+
+// Event ids are stored in the file, only append to this list.
+// EVENT_LEVEL_ERROR events are step failures and dump the flight recorder.
+#define EVENT_LOG_STARTED             0
+#define EVENT_RECORDS_DROPPED         1
+#define EVENT_MODE_CHANGED            2
+#define EVENT_DEMO_STOPPED            3
+#define EVENT_STEP_STARTED            4
+#define EVENT_INVALID_MARKER_ID       5
+#define EVENT_PICK_MARKER_SET         6
+#define EVENT_PLACE_MARKER_SET        7
+#define EVENT_PICK_MARKER_SEARCH      8
+#define EVENT_PLACE_MARKER_SEARCH     9
+#define EVENT_PICK_MARKER_NOT_FOUND   10
+#define EVENT_PLACE_MARKER_NOT_FOUND  11
+#define EVENT_MARKER_NOT_DETECTED     12
+#define EVENT_SERVICE_CALL_FAILED     13
+#define EVENT_PATH_NOT_PLANNED        14
+#define EVENT_NEXT_ACTION_PICK        15
+#define EVENT_NEXT_ACTION_END         16
+#define EVENT_NEXT_ACTION_INVALID     17
+#define EVENT_STATE_SNAPSHOT          18
+#define EVENT_MARKER_SEEN             19
+#define EVENT_JOINT_COMMAND           20
+#define EVENT_TASK_COMMAND            21
+#define EVENT_TOOL_COMMAND            22
+#define EVENT_POSES_RELOADED          23
+#define EVENT_TRAJECTORY_ABORTED      24
+#define EVENT_TRAJECTORY_PREEMPTED    25
+#define EVENT_STOP_HELD               26
+#define EVENT_STOP_LATE               27
+#define EVENT_STOP_HOLD_FAILED        28
+#define EVENT_DEPTH_HEIGHT            29
+#define EVENT_PATH_BLOCKED            30
+#define EVENT_SEQUENCE_RESUMED        31
+#define EVENT_STEP_WAIT_TIMED_OUT     32
+#define EVENT_SERVICE_CALL_TIMED_OUT  33
+#define EVENT_STEP_RETRIED            34
+#define EVENT_DEMO_ABORTED            35
+#define EVENT_PATH_BLOCKED_ABORTED    36
+#define EVENT_NEXT_ACTION_PROMPT      37
+#define NUM_OF_EVENT                  38
+
+// Service ids for EVENT_SERVICE_CALL_FAILED, EVENT_PATH_NOT_PLANNED and EVENT_SERVICE_CALL_TIMED_OUT
+#define EVENT_SERVICE_JOINT_SPACE_PATH  0
+#define EVENT_SERVICE_TOOL_CONTROL      1
+#define EVENT_SERVICE_TASK_SPACE_PATH   2
+
+namespace open_manipulator_pick_and_place
+{
+
+typedef struct _EventInfo
+{
+  const char *name;
+  uint8_t level;
+  const char *format;  // printf format over the record's double arguments
+} EventInfo;
+
+inline const EventInfo &eventInfo(uint32_t event)
+{
+  static const EventInfo info[NUM_OF_EVENT + 1] =
+  {
+    {"log_started",            EVENT_LEVEL_INFO,    "Event log started"},
+    {"records_dropped",        EVENT_LEVEL_WARNING, "%.0f records dropped, the log ring was full"},
+    {"mode_changed",           EVENT_LEVEL_INFO,    "Mode changed to '%c'"},
+    {"demo_stopped",           EVENT_LEVEL_INFO,    "Demo stopped."},
+    {"step_started",           EVENT_LEVEL_INFO,    "Demo step %.0f started"},
+    {"invalid_marker_id",      EVENT_LEVEL_WARNING, "Invalid marker ID %.0f. Enter a number between 0 and 17."},
+    {"pick_marker_set",        EVENT_LEVEL_INFO,    "Pick Marker ID set to: %.0f"},
+    {"place_marker_set",       EVENT_LEVEL_INFO,    "Place Marker ID set to: %.0f"},
+    {"pick_marker_search",     EVENT_LEVEL_INFO,    "Pick Marker ID %.0f not detected. Adjusting base joint... (Attempt %.0f)"},
+    {"place_marker_search",    EVENT_LEVEL_INFO,    "Place Marker ID %.0f not detected. Adjusting base joint... (Attempt %.0f)"},
+    {"pick_marker_not_found",  EVENT_LEVEL_ERROR,   "Pick Marker ID %.0f could not be found after multiple attempts."},
+    {"place_marker_not_found", EVENT_LEVEL_ERROR,   "Place Marker ID %.0f could not be found after multiple attempts."},
+    {"marker_not_detected",    EVENT_LEVEL_ERROR,   "Marker %.0f not detected."},
+    {"service_call_failed",    EVENT_LEVEL_ERROR,   "Service %.0f call failed (0: joint space path, 1: tool control, 2: task space path)"},
+    {"path_not_planned",       EVENT_LEVEL_ERROR,   "Service %.0f returned is_planned false (0: joint space path, 1: tool control, 2: task space path)"},
+    {"next_action_pick",       EVENT_LEVEL_INFO,    "Returning to pick another object."},
+    {"next_action_end",        EVENT_LEVEL_INFO,    "Proceeding to demo termination process."},
+    {"next_action_invalid",    EVENT_LEVEL_WARNING, "Invalid input. Please press 'p' or 'd'."},
+    {"state_snapshot",         EVENT_LEVEL_INFO,    "Joint %.3f %.3f %.3f %.3f tool %.3f moving %.0f"},
+    {"marker_seen",            EVENT_LEVEL_INFO,    "Marker %.0f at X: %.3f Y: %.3f Z: %.3f, %.3f s after capture"},
+    {"joint_command",          EVENT_LEVEL_INFO,    "Joint space path %.3f %.3f %.3f %.3f in %.1f s"},
+    {"task_command",           EVENT_LEVEL_INFO,    "Task space path X: %.3f Y: %.3f Z: %.3f in %.1f s"},
+    {"tool_command",           EVENT_LEVEL_INFO,    "Tool control %.3f"},
+    {"poses_reloaded",         EVENT_LEVEL_INFO,    "Pose library reloaded (version %.0f)"},
+    {"trajectory_aborted",     EVENT_LEVEL_ERROR,   "Arm still moving %.1f s after a goal with path time %.1f s"},
+    {"trajectory_preempted",   EVENT_LEVEL_INFO,    "Goal preempted at %.0f%% of its path time"},
+    {"stop_held",              EVENT_LEVEL_INFO,    "Stop from source %.0f (0: key, 1: topic) held the arm in %.2f ms"},
+    {"stop_late",              EVENT_LEVEL_WARNING, "Stop took %.2f ms, over the %.2f ms budget"},
+    {"stop_hold_failed",       EVENT_LEVEL_ERROR,   "Stop from source %.0f (0: key, 1: topic) could not hold the arm, no joint state or the call failed"},
+    {"depth_height",           EVENT_LEVEL_INFO,    "Depth under the marker: top Z: %.3f support Z: %.3f"},
+    {"path_blocked",           EVENT_LEVEL_WARNING, "Service %.0f path blocked by an occupied voxel at %.0f%% of it, held until it clears"},
+    {"sequence_resumed",       EVENT_LEVEL_WARNING, "Resumed the demo from the checkpoint of step %.0f at step %.0f"},
+    {"step_wait_timed_out",    EVENT_LEVEL_INFO,    "Step %.0f waited its whole %.1f s for the gripper or the marker to settle"},
+    {"service_call_timed_out", EVENT_LEVEL_ERROR,   "Service %.0f call did not return within %.2f s (0: joint space path, 1: tool control, 2: task space path)"},
+    {"step_retried",           EVENT_LEVEL_WARNING, "Step %.0f command failed, sending it again (retry %.0f)"},
+    {"demo_aborted",           EVENT_LEVEL_ERROR,   "Step %.0f command failed after %.0f retries, demo stopped"},
+    {"path_blocked_aborted",   EVENT_LEVEL_ERROR,   "Step %.0f path stayed blocked for %.1f s, demo stopped"},
+    {"next_action_prompt",     EVENT_LEVEL_INFO,    "What would you like to do next? Press 'p' to pick another object, or 'd' to proceed to demo termination."},
+    {"unknown",                EVENT_LEVEL_ERROR,   "Unknown event"},
+  };
+  return info[event < NUM_OF_EVENT ? event : NUM_OF_EVENT];
+}
+
+inline const char *eventLevelName(uint8_t level)
+{
+  switch (level)
+  {
+    case EVENT_LEVEL_INFO:    return "INFO";
+    case EVENT_LEVEL_WARNING: return "WARNING";
+    default:                  return "ERROR";
+  }
+}
+
+#define EVENT_NUM_OF_ARG 6
+
+// One fixed size record per event, written to the file as is (64 bytes)
+typedef struct _EventRecord
+{
+  uint64_t stamp;     // CLOCK_REALTIME [ns]
+  uint32_t event;
+  uint32_t sequence;  // enqueue order, orders records with the same stamp
+  double arg[EVENT_NUM_OF_ARG];
+} EventRecord;
+
+typedef struct _EventLogHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+} EventLogHeader;
+
+// Name of a node as the start of its file names, without the leading slash
+// and with the namespaces joined by '_' (/arm1/pick: arm1_pick), so two
+// instances never default to the same files
+inline std::string nodeFileName(const std::string &node_name)
+{
+  size_t start = node_name.find_first_not_of('/');
+  std::string name = start == std::string::npos ? std::string() : node_name.substr(start);
+  std::replace(name.begin(), name.end(), '/', '_');
+  return name;
+}
+
+// Message text of a record, as the printf it replaces would have printed it
+inline void formatEvent(const EventRecord &record, char *text, size_t size)
+{
+  const EventInfo &info = eventInfo(record.event);
+  if (record.event == EVENT_MODE_CHANGED)
+    snprintf(text, size, info.format, (char)record.arg[0]);
+  else
+    snprintf(text, size, info.format, record.arg[0], record.arg[1], record.arg[2],
+             record.arg[3], record.arg[4], record.arg[5]);
+}
+
+// Asynchronous binary event log. log() copies a fixed size record into a
+// preallocated ring (bounded multi-producer queue, one CAS per record, never
+// blocks and drops when full); a background thread drains the ring into the
+// file and, if echo is set, prints the text so terminal speed no longer
+// reaches the control loop. It also keeps the last few records for a status
+// screen that clears the terminal. Decode files with event_log_decoder.
+class EventLog
+{
+ public:
+  static const uint32_t CAPACITY = 4096;  // power of 2
+  static const uint32_t WRITE_BATCH = 256;
+  static const uint32_t NUM_OF_RECENT = 8;
+
+  EventLog()
+  : file_(NULL),
+    echo_(false),
+    running_(false),
+    head_(0),
+    tail_(0),
+    dropped_(0),
+    reported_dropped_(0),
+    num_of_recent_(0)
+  {
+    for (uint32_t i = 0; i < CAPACITY; i++)
+      slot_[i].turn.store(i, std::memory_order_relaxed);
+  }
+
+  ~EventLog()
+  {
+    close();
+  }
+
+  // An empty path only echoes
+  bool open(const std::string &path, bool echo)
+  {
+    close();
+
+    if (!path.empty())
+    {
+      file_ = fopen(path.c_str(), "wb");
+      if (file_ == NULL) return false;
+
+      EventLogHeader header;
+      memset(&header, 0, sizeof(header));
+      memcpy(header.magic, EVENT_LOG_MAGIC, sizeof(header.magic));
+      header.version = EVENT_LOG_VERSION;
+      header.record_size = sizeof(EventRecord);
+      fwrite(&header, sizeof(header), 1, file_);
+    }
+
+    echo_ = echo;
+    running_.store(true, std::memory_order_release);
+    writer_ = std::thread(&EventLog::writerLoop, this);
+    log(EVENT_LOG_STARTED);
+    return true;
+  }
+
+  // Drains what is left and closes the file
+  void close()
+  {
+    if (!running_.exchange(false)) return;
+
+    writer_.join();
+    drain();
+    if (file_ != NULL)
+    {
+      fclose(file_);
+      file_ = NULL;
+    }
+  }
+
+  bool log(uint32_t event, double a0 = 0.0, double a1 = 0.0, double a2 = 0.0,
+           double a3 = 0.0, double a4 = 0.0, double a5 = 0.0)
+  {
+    if (!running_.load(std::memory_order_relaxed)) return false;
+
+    uint64_t position = head_.load(std::memory_order_relaxed);
+    Slot *slot;
+    while (true)
+    {
+      slot = &slot_[position & (CAPACITY - 1)];
+      int64_t lag = (int64_t)slot->turn.load(std::memory_order_acquire) - (int64_t)position;
+      if (lag == 0)
+      {
+        if (head_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+      }
+      else if (lag < 0)
+      {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      else
+      {
+        position = head_.load(std::memory_order_relaxed);
+      }
+    }
+
+    EventRecord &record = slot->record;
+    record.stamp = now();
+    record.event = event;
+    record.sequence = (uint32_t)position;
+    record.arg[0] = a0;
+    record.arg[1] = a1;
+    record.arg[2] = a2;
+    record.arg[3] = a3;
+    record.arg[4] = a4;
+    record.arg[5] = a5;
+    slot->turn.store(position + 1, std::memory_order_release);
+    return true;
+  }
+
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+  // Up to NUM_OF_RECENT of the last records written, oldest first
+  uint32_t recent(EventRecord *records, uint32_t size)
+  {
+    std::lock_guard<std::mutex> lock(recent_mutex_);
+    uint32_t count = size < NUM_OF_RECENT ? size : NUM_OF_RECENT;
+    if (count > num_of_recent_) count = (uint32_t)num_of_recent_;
+    for (uint32_t i = 0; i < count; i++)
+      records[i] = recent_[(num_of_recent_ - count + i) % NUM_OF_RECENT];
+    return count;
+  }
+
+  static uint64_t now()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  }
+
+ private:
+  typedef struct _Slot
+  {
+    std::atomic<uint64_t> turn;  // position + 1 once written, position + CAPACITY once read
+    EventRecord record;
+  } Slot;
+
+  void writerLoop()
+  {
+    while (running_.load(std::memory_order_acquire))
+    {
+      if (drain() == 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+
+  // Single consumer: the writer thread, or close() after it has joined
+  uint32_t drain()
+  {
+    uint32_t total = 0;
+    uint32_t count;
+    do
+    {
+      count = 0;
+      while (count < WRITE_BATCH)
+      {
+        Slot &slot = slot_[tail_ & (CAPACITY - 1)];
+        if (slot.turn.load(std::memory_order_acquire) != tail_ + 1) break;
+
+        batch_[count++] = slot.record;
+        slot.turn.store(tail_ + CAPACITY, std::memory_order_release);
+        tail_++;
+      }
+
+      uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+      if (dropped != reported_dropped_ && count < WRITE_BATCH)
+      {
+        EventRecord &record = batch_[count++];
+        memset(&record, 0, sizeof(record));
+        record.stamp = now();
+        record.event = EVENT_RECORDS_DROPPED;
+        record.arg[0] = (double)(dropped - reported_dropped_);
+        reported_dropped_ = dropped;
+      }
+
+      if (count > 0) write(count);
+      total += count;
+    } while (count == WRITE_BATCH);
+    return total;
+  }
+
+  void write(uint32_t count)
+  {
+    if (file_ != NULL)
+    {
+      fwrite(batch_, sizeof(EventRecord), count, file_);
+      fflush(file_);
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(recent_mutex_);
+      for (uint32_t i = 0; i < count; i++)
+        recent_[num_of_recent_++ % NUM_OF_RECENT] = batch_[i];
+    }
+
+    if (echo_)
+    {
+      char text[256];
+      for (uint32_t i = 0; i < count; i++)
+      {
+        formatEvent(batch_[i], text, sizeof(text));
+        printf("[%s] %s\n", eventLevelName(eventInfo(batch_[i].event).level), text);
+      }
+      fflush(stdout);
+    }
+  }
+
+  FILE *file_;
+  bool echo_;
+  std::thread writer_;
+  std::atomic<bool> running_;
+
+  Slot slot_[CAPACITY];
+  std::atomic<uint64_t> head_;
+  uint64_t tail_;
+  std::atomic<uint64_t> dropped_;
+  uint64_t reported_dropped_;
+  EventRecord batch_[WRITE_BATCH];
+
+  std::mutex recent_mutex_;
+  EventRecord recent_[NUM_OF_RECENT];
+  uint64_t num_of_recent_;  // written so far
+};
+
+}  // namespace open_manipulator_pick_and_place
+
+#endif  // OPEN_MANIPULATOR_PICK_AND_PLACE_EVENT_LOG_H
@@ -0,0 +1,311 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef OPEN_MANIPULATOR_PICK_AND_PLACE_FLIGHT_RECORDER_H
+#define OPEN_MANIPULATOR_PICK_AND_PLACE_FLIGHT_RECORDER_H
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string>
+#include <thread>
+
+#include "open_manipulator_pick_and_place/event_log.h"
+
+#define FLIGHT_RECORDER_MAGIC    "OMFLREC"
+#define FLIGHT_RECORDER_VERSION  1
+
+#define FLIGHT_RECORDER_MIN_DUMP_INTERVAL  5.0  // between automatic dumps [s]
+
+namespace open_manipulator_pick_and_place
+{
+
+// Start of the memory mapped ring file, followed by capacity EventRecords
+typedef struct _FlightRecorderHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t capacity;
+  uint32_t reserved;
+  std::atomic<uint64_t> head;  // records written so far
+} FlightRecorderHeader;
+
+// Always-on flight recorder. Every record goes into a fixed size ring in a
+// MAP_SHARED file, so the last records survive even a SIGKILL. dump() writes
+// the records of the last window_seconds in order as an event log file
+// (event_log_decoder reads both). Records of EVENT_LEVEL_ERROR events dump
+// automatically, as do fatal signals and SIGUSR1. Automatic dumps are
+// written by a background thread, record() only flags them.
+class FlightRecorder
+{
+ public:
+  static const uint32_t DEFAULT_CAPACITY = 16384;
+  static const uint32_t NO_DUMP = 0xffffffff;
+
+  FlightRecorder()
+  : header_(NULL),
+    record_(NULL),
+    mask_(0),
+    map_size_(0),
+    fd_(-1),
+    window_(0),
+    last_dump_(0),
+    pending_dump_(NO_DUMP),
+    running_(false)
+  {
+    signal_path_[0] = '\0';
+  }
+
+  ~FlightRecorder()
+  {
+    close();
+  }
+
+  // Maps <directory>/<name>.ring with capacity rounded up to a power of 2.
+  // The file stays locked while mapped; false when another running
+  // instance holds it, whose ring is then left as it is
+  bool open(const std::string &directory, const std::string &name,
+            uint32_t capacity = DEFAULT_CAPACITY, double window_seconds = 30.0)
+  {
+    close();
+
+    uint32_t size = 1;
+    while (size < capacity) size <<= 1;
+
+    std::string path = directory + "/" + name + ".ring";
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return false;
+
+    // Cleared only once it is ours
+    size_t map_size = sizeof(FlightRecorderHeader) + (size_t)size * sizeof(EventRecord);
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0 || ftruncate(fd, 0) != 0 || ftruncate(fd, map_size) != 0)
+    {
+      ::close(fd);
+      return false;
+    }
+
+    void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+    {
+      ::close(fd);
+      return false;
+    }
+    fd_ = fd;
+
+    header_ = new (map) FlightRecorderHeader;
+    memcpy(header_->magic, FLIGHT_RECORDER_MAGIC, sizeof(header_->magic));
+    header_->version = FLIGHT_RECORDER_VERSION;
+    header_->record_size = sizeof(EventRecord);
+    header_->capacity = size;
+    header_->head.store(0);
+
+    record_ = reinterpret_cast<EventRecord *>(static_cast<char *>(map) + sizeof(FlightRecorderHeader));
+    mask_ = size - 1;
+    map_size_ = map_size;
+    window_ = (uint64_t)(window_seconds * 1e9);
+    directory_ = directory;
+    name_ = name;
+    snprintf(signal_path_, sizeof(signal_path_), "%s/%s_signal.bin", directory.c_str(), name.c_str());
+
+    pending_dump_.store(NO_DUMP);
+    running_.store(true, std::memory_order_release);
+    writer_ = std::thread(&FlightRecorder::writerLoop, this);
+    return true;
+  }
+
+  void close()
+  {
+    if (header_ == NULL) return;
+
+    if (running_.exchange(false)) writer_.join();
+
+    if (instance() == this) instance() = NULL;
+    munmap(header_, map_size_);
+    ::close(fd_);  // releases the lock
+    fd_ = -1;
+    header_ = NULL;
+    record_ = NULL;
+  }
+
+  bool isOpen() const { return header_ != NULL; }
+
+  void record(uint32_t event, double a0 = 0.0, double a1 = 0.0, double a2 = 0.0,
+              double a3 = 0.0, double a4 = 0.0, double a5 = 0.0)
+  {
+    if (header_ == NULL) return;
+
+    uint64_t position = header_->head.fetch_add(1, std::memory_order_relaxed);
+    EventRecord &record = record_[position & mask_];
+    record.stamp = EventLog::now();
+    record.event = event;
+    record.sequence = (uint32_t)position;
+    record.arg[0] = a0;
+    record.arg[1] = a1;
+    record.arg[2] = a2;
+    record.arg[3] = a3;
+    record.arg[4] = a4;
+    record.arg[5] = a5;
+
+    // Only the first error of an interval claims the dump
+    if (eventInfo(event).level != EVENT_LEVEL_ERROR) return;
+    uint64_t last_dump = last_dump_.load(std::memory_order_relaxed);
+    if (record.stamp > last_dump + (uint64_t)(FLIGHT_RECORDER_MIN_DUMP_INTERVAL * 1e9) &&
+        last_dump_.compare_exchange_strong(last_dump, record.stamp, std::memory_order_relaxed))
+    {
+      pending_dump_.store(event, std::memory_order_release);
+    }
+  }
+
+  // Writes <directory>/<name>_<date>_<time>_<reason>.bin now, returns its path
+  std::string dump(const char *reason)
+  {
+    if (header_ == NULL) return std::string();
+
+    uint64_t stamp_ns = EventLog::now();
+    last_dump_.store(stamp_ns, std::memory_order_relaxed);
+    time_t sec = (time_t)(stamp_ns / 1000000000ULL);
+    struct tm local;
+    localtime_r(&sec, &local);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", &local);
+
+    std::string path = directory_ + "/" + name_ + "_" + stamp + "_" + reason + ".bin";
+    return dumpTo(path.c_str()) ? path : std::string();
+  }
+
+  // Dumps on SIGSEGV, SIGBUS, SIGFPE, SIGILL and SIGABRT (uncaught exceptions)
+  // before the default action, and on SIGUSR1 on demand. One recorder per process.
+  void installSignalHandlers()
+  {
+    instance() = this;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = &FlightRecorder::signalHandler;
+    sigemptyset(&action.sa_mask);
+
+    const int fatal[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+    action.sa_flags = SA_RESETHAND;
+    for (size_t i = 0; i < sizeof(fatal) / sizeof(fatal[0]); i++)
+      sigaction(fatal[i], &action, NULL);
+
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, NULL);
+  }
+
+ private:
+  static FlightRecorder *&instance()
+  {
+    static FlightRecorder *recorder = NULL;
+    return recorder;
+  }
+
+  void writerLoop()
+  {
+    while (running_.load(std::memory_order_acquire))
+    {
+      uint32_t event = pending_dump_.exchange(NO_DUMP, std::memory_order_acquire);
+      if (event != NO_DUMP)
+        dump(eventInfo(event).name);
+      else
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+
+  static void signalHandler(int signal_number)
+  {
+    FlightRecorder *recorder = instance();
+    if (recorder != NULL) recorder->dumpTo(recorder->signal_path_);
+
+    // SA_RESETHAND restored the default action, run it
+    if (signal_number != SIGUSR1) raise(signal_number);
+  }
+
+  // Async-signal-safe: only open, write and close on the mapped ring
+  bool dumpTo(const char *path) const
+  {
+    int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+
+    EventLogHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, EVENT_LOG_MAGIC, sizeof(header.magic));
+    header.version = EVENT_LOG_VERSION;
+    header.record_size = sizeof(EventRecord);
+    bool ok = writeAll(fd, &header, sizeof(header));
+
+    // Oldest record still in the ring, then skip what is older than the window
+    uint64_t head = header_->head.load(std::memory_order_acquire);
+    uint64_t capacity = (uint64_t)mask_ + 1;
+    uint64_t first = head > capacity ? head - capacity : 0;
+    uint64_t since = EventLog::now() - window_;
+    while (first < head && record_[first & mask_].stamp < since) first++;
+
+    // At most two contiguous pieces of the ring
+    while (ok && first < head)
+    {
+      uint64_t index = first & mask_;
+      uint64_t count = std::min<uint64_t>(head - first, capacity - index);
+      ok = writeAll(fd, &record_[index], count * sizeof(EventRecord));
+      first += count;
+    }
+
+    ::close(fd);
+    return ok;
+  }
+
+  static bool writeAll(int fd, const void *data, size_t size)
+  {
+    const char *bytes = static_cast<const char *>(data);
+    while (size > 0)
+    {
+      ssize_t written = write(fd, bytes, size);
+      if (written <= 0) return false;
+      bytes += written;
+      size -= written;
+    }
+    return true;
+  }
+
+  FlightRecorderHeader *header_;
+  EventRecord *record_;
+  uint64_t mask_;
+  size_t map_size_;
+  int fd_;                             // of the ring, locked
+  uint64_t window_;                    // [ns]
+  std::atomic<uint64_t> last_dump_;    // [ns]
+  std::atomic<uint32_t> pending_dump_; // event that asked for a dump, NO_DUMP for none
+  std::atomic<bool> running_;
+  std::thread writer_;
+  std::string directory_;
+  std::string name_;
+  char signal_path_[512];
+};
+
+}  // namespace open_manipulator_pick_and_place
+
+#endif  // OPEN_MANIPULATOR_PICK_AND_PLACE_FLIGHT_RECORDER_H
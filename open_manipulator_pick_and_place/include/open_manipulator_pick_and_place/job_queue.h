@@ -0,0 +1,123 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef OPEN_MANIPULATOR_PICK_AND_PLACE_JOB_QUEUE_H
+#define OPEN_MANIPULATOR_PICK_AND_PLACE_JOB_QUEUE_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace open_manipulator_pick_and_place
+{
+
+typedef struct _PickPlaceJob
+{
+  uint32_t id;
+  uint32_t pick_marker_id;
+  uint32_t place_marker_id;
+  double pick[3];   // cell frame, when the job was assigned [m]
+  double place[3];
+  double created;   // [s]
+  double assigned;  // [s]
+} PickPlaceJob;
+
+// One deque of jobs per arm. An arm takes its own jobs from the front, in
+// the order they were assigned; an arm with none left steals from the back
+// of the longest other deque it can serve, so a job the owner would start
+// last moves to an idle arm. Deques have their own locks: owners and
+// thieves of different deques never wait on each other.
+class JobQueue
+{
+ public:
+  typedef boost::function<bool(const PickPlaceJob &job)> JobFilter;
+
+  explicit JobQueue(size_t num_of_arm)
+  {
+    for (size_t i = 0; i < num_of_arm; i++)
+      deque_.push_back(boost::shared_ptr<ArmDeque>(new ArmDeque));
+  }
+
+  size_t numOfArm() const { return deque_.size(); }
+
+  void push(size_t arm, const PickPlaceJob &job)
+  {
+    std::lock_guard<std::mutex> lock(deque_[arm]->mutex);
+    deque_[arm]->job.push_back(job);
+  }
+
+  bool pop(size_t arm, PickPlaceJob *job)
+  {
+    std::lock_guard<std::mutex> lock(deque_[arm]->mutex);
+    if (deque_[arm]->job.empty()) return false;
+
+    *job = deque_[arm]->job.front();
+    deque_[arm]->job.pop_front();
+    return true;
+  }
+
+  // Newest job of another arm that can_serve accepts, longest deque first
+  bool steal(size_t thief, const JobFilter &can_serve, PickPlaceJob *job)
+  {
+    std::vector<std::pair<size_t, size_t> > victim;  // (length, arm)
+    for (size_t i = 0; i < deque_.size(); i++)
+    {
+      if (i == thief) continue;
+      size_t length = size(i);
+      if (length > 0) victim.push_back(std::make_pair(length, i));
+    }
+    std::sort(victim.rbegin(), victim.rend());
+
+    for (size_t v = 0; v < victim.size(); v++)
+    {
+      ArmDeque &deque = *deque_[victim[v].second];
+      std::lock_guard<std::mutex> lock(deque.mutex);
+      for (std::deque<PickPlaceJob>::reverse_iterator it = deque.job.rbegin(); it != deque.job.rend(); ++it)
+      {
+        if (!can_serve(*it)) continue;
+
+        *job = *it;
+        deque.job.erase(--it.base());
+        return true;
+      }
+    }
+    return false;
+  }
+
+  size_t size(size_t arm) const
+  {
+    std::lock_guard<std::mutex> lock(deque_[arm]->mutex);
+    return deque_[arm]->job.size();
+  }
+
+ private:
+  typedef struct _ArmDeque
+  {
+    mutable std::mutex mutex;
+    std::deque<PickPlaceJob> job;
+  } ArmDeque;
+
+  std::vector<boost::shared_ptr<ArmDeque> > deque_;
+};
+
+}  // namespace open_manipulator_pick_and_place
+
+#endif  // OPEN_MANIPULATOR_PICK_AND_PLACE_JOB_QUEUE_H
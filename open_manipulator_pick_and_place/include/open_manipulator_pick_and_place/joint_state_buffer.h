@@ -0,0 +1,145 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+
+#ifndef OPEN_MANIPULATOR_PICK_AND_PLACE_JOINT_STATE_BUFFER_H
+#define OPEN_MANIPULATOR_PICK_AND_PLACE_JOINT_STATE_BUFFER_H
+
+#include <stdint.h>
+#include <atomic>
+
+namespace open_manipulator_pick_and_place
+{
+
+typedef struct _JointSample
+{
+  double stamp;        // [s]
+  double position[4];  // joint1 to joint4 [rad]
+} JointSample;
+
+// Fixed size history of timestamped arm joint positions. One writer (the
+// joint_states callback) and any number of readers, without locks: every slot
+// is a sequence lock, so a reader retries instead of blocking the writer.
+class JointStateBuffer
+{
+ public:
+  static const uint32_t CAPACITY = 512;  // power of two, about 5 s of joint_states at 100 Hz
+  static const int NUM_OF_JOINT = 4;
+
+  JointStateBuffer() : head_(0)
+  {
+    for (uint32_t i = 0; i < CAPACITY; i++)
+      slots_[i].sequence.store(0, std::memory_order_relaxed);
+  }
+
+  // Writer only. Samples are expected in stamp order.
+  void push(double stamp, const double position[NUM_OF_JOINT])
+  {
+    uint64_t index = head_.load(std::memory_order_relaxed);
+    Slot &slot = slots_[index & (CAPACITY - 1)];
+
+    uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);  // odd while writing
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.sample.stamp = stamp;
+    for (int i = 0; i < NUM_OF_JOINT; i++)
+      slot.sample.position[i] = position[i];
+
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+    head_.store(index + 1, std::memory_order_release);
+  }
+
+  uint64_t size() const
+  {
+    uint64_t head = head_.load(std::memory_order_acquire);
+    return head < CAPACITY ? head : CAPACITY;
+  }
+
+  bool latest(JointSample *sample) const
+  {
+    uint64_t head = head_.load(std::memory_order_acquire);
+    return head > 0 && read(head - 1, sample);
+  }
+
+  // Joint positions at stamp, linearly interpolated between the bracketing
+  // samples. A stamp newer than the last sample by up to max_extrapolation is
+  // answered with the last sample; older than the history fails.
+  bool interpolate(double stamp, double position[NUM_OF_JOINT], double max_extrapolation = 0.05) const
+  {
+    uint64_t head = head_.load(std::memory_order_acquire);
+    if (head == 0) return false;
+
+    JointSample newer, older;
+    if (!read(head - 1, &newer)) return false;
+    if (stamp >= newer.stamp)
+    {
+      if (stamp - newer.stamp > max_extrapolation) return false;
+      for (int i = 0; i < NUM_OF_JOINT; i++)
+        position[i] = newer.position[i];
+      return true;
+    }
+
+    // Walk back from the newest sample; an image is rarely more than a few samples old
+    uint64_t oldest = head > CAPACITY ? head - CAPACITY + 1 : 0;  // the writer may be refilling head - CAPACITY
+    for (uint64_t index = head - 1; index > oldest; index--)
+    {
+      if (!read(index - 1, &older)) return false;
+      if (older.stamp <= stamp)
+      {
+        double span = newer.stamp - older.stamp;
+        double ratio = span > 0.0 ? (stamp - older.stamp) / span : 0.0;
+        for (int i = 0; i < NUM_OF_JOINT; i++)
+          position[i] = older.position[i] + (newer.position[i] - older.position[i]) * ratio;
+        return true;
+      }
+      newer = older;
+    }
+    return false;
+  }
+
+ private:
+  typedef struct _Slot
+  {
+    std::atomic<uint32_t> sequence;
+    JointSample sample;
+  } Slot;
+
+  // False when the slot was overwritten by a newer lap of the writer
+  bool read(uint64_t index, JointSample *sample) const
+  {
+    const Slot &slot = slots_[index & (CAPACITY - 1)];
+    const uint32_t expected = (uint32_t)(index / CAPACITY + 1) * 2;  // sequence after the write of this lap
+
+    while (true)
+    {
+      uint32_t before = slot.sequence.load(std::memory_order_acquire);
+      if (before & 1) continue;
+      if (before != expected) return false;
+
+      *sample = slot.sample;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.sequence.load(std::memory_order_relaxed) == before) return true;
+    }
+  }
+
+  Slot slots_[CAPACITY];
+  std::atomic<uint64_t> head_;  // number of samples pushed
+};
+
+}  // namespace open_manipulator_pick_and_place
+
+#endif  // OPEN_MANIPULATOR_PICK_AND_PLACE_JOINT_STATE_BUFFER_H
@@ -0,0 +1,137 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef OPEN_MANIPULATOR_PICK_AND_PLACE_KEYBOARD_READER_H
+#define OPEN_MANIPULATOR_PICK_AND_PLACE_KEYBOARD_READER_H
+
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <boost/function.hpp>
+
+namespace open_manipulator_pick_and_place
+{
+
+// Reads the terminal on its own thread, one key at a time without waiting
+// for Enter. Keys in immediate_keys go straight to the callback on that
+// thread, so they are seen even while the control thread is busy or blocked
+// in a prompt; the others are queued for hit() and get() on the control thread.
+class KeyboardReader
+{
+ public:
+  typedef boost::function<void(char key)> KeyCallback;
+
+  KeyboardReader()
+  : running_(false),
+    has_terminal_(false)
+  {
+  }
+
+  ~KeyboardReader()
+  {
+    stop();
+  }
+
+  void start(const std::string &immediate_keys, const KeyCallback &callback)
+  {
+    stop();
+    immediate_keys_ = immediate_keys;
+    callback_ = callback;
+
+    // Non-canonical input for as long as the reader runs; stdin may also be
+    // a pipe or /dev/null under roslaunch
+    has_terminal_ = tcgetattr(STDIN_FILENO, &saved_terminal_) == 0;
+    if (has_terminal_)
+    {
+      termios terminal = saved_terminal_;
+      terminal.c_lflag &= ~ICANON;
+      terminal.c_cc[VMIN] = 1;
+      terminal.c_cc[VTIME] = 0;
+      tcsetattr(STDIN_FILENO, TCSANOW, &terminal);
+    }
+
+    running_.store(true);
+    reader_ = std::thread(&KeyboardReader::readLoop, this);
+  }
+
+  void stop()
+  {
+    if (!reader_.joinable()) return;
+
+    running_.store(false);
+    reader_.join();
+    if (has_terminal_) tcsetattr(STDIN_FILENO, TCSANOW, &saved_terminal_);
+  }
+
+  bool hit()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !queue_.empty();
+  }
+
+  // Next queued key, '\0' if there is none
+  char get()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (queue_.empty()) return '\0';
+
+    char key = queue_.front();
+    queue_.pop_front();
+    return key;
+  }
+
+ private:
+  void readLoop()
+  {
+    struct pollfd descriptor = {STDIN_FILENO, POLLIN, 0};
+    while (running_.load())
+    {
+      if (poll(&descriptor, 1, 100) <= 0) continue;
+
+      char key;
+      if (read(STDIN_FILENO, &key, 1) != 1) break;  // end of input
+      if (key == '\n') continue;
+
+      if (immediate_keys_.find(key) != std::string::npos)
+      {
+        if (callback_) callback_(key);
+        continue;
+      }
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.push_back(key);
+    }
+  }
+
+  std::atomic<bool> running_;
+  std::thread reader_;
+  std::string immediate_keys_;
+  KeyCallback callback_;
+  bool has_terminal_;
+  termios saved_terminal_;
+
+  std::mutex mutex_;
+  std::deque<char> queue_;
+};
+
+}  // namespace open_manipulator_pick_and_place
+
+#endif  // OPEN_MANIPULATOR_PICK_AND_PLACE_KEYBOARD_READER_H
@@ -0,0 +1,114 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef OPEN_MANIPULATOR_PICK_AND_PLACE_LATENCY_STATISTICS_H
+#define OPEN_MANIPULATOR_PICK_AND_PLACE_LATENCY_STATISTICS_H
+
+#include <stdint.h>
+#include <cmath>
+#include <limits>
+
+namespace open_manipulator_pick_and_place
+{
+
+// Running latency statistics with a fixed log2 histogram (bucket i holds
+// samples in [2^i, 2^(i+1)) microseconds), so percentiles need no allocation.
+class LatencyStatistics
+{
+ public:
+  static const int NUM_OF_BUCKET = 32;
+
+  LatencyStatistics()
+  {
+    reset();
+  }
+
+  void reset()
+  {
+    count_ = 0;
+    last_ = 0.0;
+    sum_ = 0.0;
+    min_ = std::numeric_limits<double>::max();
+    max_ = 0.0;
+    for (int i = 0; i < NUM_OF_BUCKET; i++)
+      histogram_[i] = 0;
+  }
+
+  void addSample(double seconds)
+  {
+    if (seconds < 0.0) seconds = 0.0;
+
+    last_ = seconds;
+    sum_ += seconds;
+    if (seconds < min_) min_ = seconds;
+    if (seconds > max_) max_ = seconds;
+    histogram_[bucketOf(seconds)]++;
+    count_++;
+  }
+
+  uint64_t count() const { return count_; }
+  double last() const    { return last_; }
+  double min() const     { return count_ ? min_ : 0.0; }
+  double max() const     { return max_; }
+  double mean() const    { return count_ ? sum_ / count_ : 0.0; }
+
+  // Upper edge of the bucket holding the p-th percentile (p in [0, 1]).
+  double percentile(double p) const
+  {
+    if (count_ == 0) return 0.0;
+
+    uint64_t rank = (uint64_t)std::ceil(p * count_);
+    if (rank == 0) rank = 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < NUM_OF_BUCKET; i++)
+    {
+      seen += histogram_[i];
+      if (seen >= rank) return bucketUpperEdge(i);
+    }
+    return max_;
+  }
+
+  uint64_t bucket(int index) const { return histogram_[index]; }
+
+  static double bucketUpperEdge(int index)
+  {
+    return std::ldexp(1.0, index + 1) * 1e-6;
+  }
+
+ private:
+  static int bucketOf(double seconds)
+  {
+    double usec = seconds * 1e6;
+    if (usec < 1.0) return 0;
+
+    int exponent;
+    std::frexp(usec, &exponent);  // usec = m * 2^exponent, m in [0.5, 1)
+    int index = exponent - 1;
+    return index < NUM_OF_BUCKET ? index : NUM_OF_BUCKET - 1;
+  }
+
+  uint64_t count_;
+  double last_;
+  double sum_;
+  double min_;
+  double max_;
+  uint64_t histogram_[NUM_OF_BUCKET];
+};
+
+}  // namespace open_manipulator_pick_and_place
+
+#endif  // OPEN_MANIPULATOR_PICK_AND_PLACE_LATENCY_STATISTICS_H
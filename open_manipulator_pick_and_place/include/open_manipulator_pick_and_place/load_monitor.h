@@ -0,0 +1,134 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef OPEN_MANIPULATOR_PICK_AND_PLACE_LOAD_MONITOR_H
+#define OPEN_MANIPULATOR_PICK_AND_PLACE_LOAD_MONITOR_H
+
+#include <ros/ros.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+#include "diagnostic_msgs/DiagnosticArray.h"
+
+#include "open_manipulator_pick_and_place/diagnostic_value.h"
+#include "open_manipulator_pick_and_place/latency_statistics.h"
+
+#define LOAD_TOPIC_JOINT_STATES     0
+#define LOAD_TOPIC_STATES           1
+#define LOAD_TOPIC_KINEMATICS_POSE  2
+#define LOAD_TOPIC_AR_POSE_MARKER   3
+#define NUM_OF_LOAD_TOPIC           4
+
+namespace open_manipulator_pick_and_place
+{
+
+// What the node received and how late, and how its control tick kept up,
+// published on /diagnostics every period for load_generator. Received
+// counts are totals since start, so a sender can tell what its subscriber
+// queue dropped; latencies (publish stamp to callback) and tick times are
+// over the last period. Messages without a header only count.
+class LoadMonitor
+{
+ public:
+  LoadMonitor()
+  : is_enabled_(false),
+    ticks_(0),
+    overruns_(0)
+  {
+    for (int i = 0; i < NUM_OF_LOAD_TOPIC; i++)
+      received_[i] = 0;
+  }
+
+  // Off unless period > 0
+  void init(ros::NodeHandle node_handle, double period)
+  {
+    if (period <= 0.0) return;
+
+    is_enabled_ = true;
+    diagnostics_pub_ = node_handle.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 10);
+    timer_ = node_handle.createTimer(ros::Duration(period), &LoadMonitor::timerCallback, this);
+  }
+
+  void received(int topic, const ros::Time &stamp)
+  {
+    if (!is_enabled_) return;
+
+    received_[topic]++;
+    if (!stamp.isZero()) latency_[topic].addSample((ros::Time::now() - stamp).toSec());
+  }
+
+  // A tick overruns when it runs longer than the period or starts a whole
+  // period late, either way the next one cannot start on time
+  void tick(const ros::TimerEvent &event, double duration)
+  {
+    if (!is_enabled_) return;
+
+    ticks_++;
+    double late = (event.current_real - event.current_expected).toSec();
+    double period = (event.current_expected - event.last_expected).toSec();
+    if (!event.last_expected.isZero() && period > 0.0 && (duration > period || late > period)) overruns_++;
+
+    tick_duration_.addSample(duration);
+    tick_late_.addSample(late);
+  }
+
+ private:
+  void timerCallback(const ros::TimerEvent&)
+  {
+    static const char *topic_name[NUM_OF_LOAD_TOPIC] = {"joint_states", "states", "kinematics_pose", "ar_pose_marker"};
+
+    diagnostic_msgs::DiagnosticStatus status;
+    status.name = ros::this_node::getName() + ": load";
+    status.level = overruns_ > 0 ? diagnostic_msgs::DiagnosticStatus::WARN : diagnostic_msgs::DiagnosticStatus::OK;
+    status.message = overruns_ > 0 ? "Control tick overran" : "OK";
+
+    for (int i = 0; i < NUM_OF_LOAD_TOPIC; i++)
+    {
+      std::string name(topic_name[i]);
+      addDiagnosticValue(status, name + " received", (double)received_[i]);
+      addDiagnosticValue(status, name + " latency mean [ms]", latency_[i].mean() * 1e3);
+      addDiagnosticValue(status, name + " latency max [ms]", latency_[i].max() * 1e3);
+      latency_[i].reset();
+    }
+    addDiagnosticValue(status, "ticks", (double)ticks_);
+    addDiagnosticValue(status, "tick overruns", (double)overruns_);
+    addDiagnosticValue(status, "tick duration max [ms]", tick_duration_.max() * 1e3);
+    addDiagnosticValue(status, "tick late max [ms]", tick_late_.max() * 1e3);
+    tick_duration_.reset();
+    tick_late_.reset();
+
+    diagnostic_msgs::DiagnosticArray diagnostics;
+    diagnostics.header.stamp = ros::Time::now();
+    diagnostics.status.push_back(status);
+    diagnostics_pub_.publish(diagnostics);
+  }
+
+  bool is_enabled_;
+  ros::Publisher diagnostics_pub_;
+  ros::Timer timer_;
+
+  uint64_t received_[NUM_OF_LOAD_TOPIC];
+  LatencyStatistics latency_[NUM_OF_LOAD_TOPIC];
+  uint64_t ticks_;
+  uint64_t overruns_;
+  LatencyStatistics tick_duration_;
+  LatencyStatistics tick_late_;
+};
+
+}  // namespace open_manipulator_pick_and_place
+
+#endif  // OPEN_MANIPULATOR_PICK_AND_PLACE_LOAD_MONITOR_H
@@ -0,0 +1,165 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef OPEN_MANIPULATOR_PICK_AND_PLACE_MARKER_FUSION_H
+#define OPEN_MANIPULATOR_PICK_AND_PLACE_MARKER_FUSION_H
+
+#include <stdint.h>
+#include <math.h>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace open_manipulator_pick_and_place
+{
+
+typedef struct _MarkerSource
+{
+  std::string topic;
+  double sigma;    // position error of a fresh observation [m]
+  double drift;    // growth of that error with the age of the observation [m/s]
+  double max_age;  // older observations are dropped [s]
+  bool is_fixed;   // camera does not move with the arm
+} MarkerSource;
+
+typedef struct _FusedMarker
+{
+  uint32_t id;
+  double position[3];  // world frame [m]
+  double sigma;        // [m]
+  double stamp;        // newest observation [s]
+  uint32_t sources;    // one bit per source that contributed
+  bool is_fixed_view;  // seen by a fixed camera
+} FusedMarker;
+
+// One marker table from several cameras, e.g. a fixed overhead camera that
+// sees the whole table and a wrist camera that sees less but closer. Each
+// source keeps the observations of its last message; a marker's position is
+// the inverse variance weighted mean of them, where an observation's error
+// grows from the source's sigma with its age, so late or coarse sources
+// count less and a close wrist view takes over on the approach.
+class MarkerFusion
+{
+ public:
+  size_t addSource(const MarkerSource &source)
+  {
+    source_.push_back(source);
+    view_.push_back(std::map<uint32_t, Observation>());
+    return source_.size() - 1;
+  }
+
+  size_t numOfSource() const { return source_.size(); }
+  const MarkerSource &source(size_t index) const { return source_[index]; }
+
+  // A message is the whole view of its source: markers it no longer
+  // reports are dropped from that source
+  void beginView(size_t source) { view_[source].clear(); }
+
+  void add(size_t source, uint32_t id, const double position[3], double stamp)
+  {
+    Observation &observation = view_[source][id];
+    for (int i = 0; i < 3; i++)
+      observation.position[i] = position[i];
+    observation.stamp = stamp;
+  }
+
+  // Every marker with an observation younger than its source's max_age, by id
+  void fuse(double now, std::vector<FusedMarker> *marker) const
+  {
+    std::map<uint32_t, Sum> sum;
+    for (size_t s = 0; s < source_.size(); s++)
+    {
+      for (std::map<uint32_t, Observation>::const_iterator it = view_[s].begin(); it != view_[s].end(); ++it)
+        addObservation(s, it->second, now, &sum[it->first]);
+    }
+
+    marker->clear();
+    for (std::map<uint32_t, Sum>::const_iterator it = sum.begin(); it != sum.end(); ++it)
+    {
+      FusedMarker fused;
+      if (makeMarker(it->first, it->second, &fused)) marker->push_back(fused);
+    }
+  }
+
+  bool find(uint32_t id, double now, FusedMarker *marker) const
+  {
+    Sum sum;
+    for (size_t s = 0; s < source_.size(); s++)
+    {
+      std::map<uint32_t, Observation>::const_iterator it = view_[s].find(id);
+      if (it != view_[s].end()) addObservation(s, it->second, now, &sum);
+    }
+    return makeMarker(id, sum, marker);
+  }
+
+ private:
+  typedef struct _Observation
+  {
+    double position[3];
+    double stamp;
+  } Observation;
+
+  typedef struct _Sum
+  {
+    _Sum() : weight(0.0), stamp(0.0), sources(0), is_fixed_view(false)
+    {
+      position[0] = position[1] = position[2] = 0.0;
+    }
+
+    double position[3];  // weighted
+    double weight;
+    double stamp;
+    uint32_t sources;
+    bool is_fixed_view;
+  } Sum;
+
+  void addObservation(size_t s, const Observation &observation, double now, Sum *sum) const
+  {
+    const MarkerSource &source = source_[s];
+    double age = now > observation.stamp ? now - observation.stamp : 0.0;
+    if (age > source.max_age) return;
+
+    double sigma = source.sigma + source.drift * age;
+    double weight = 1.0 / (sigma * sigma);
+    for (int i = 0; i < 3; i++)
+      sum->position[i] += weight * observation.position[i];
+    sum->weight += weight;
+    if (observation.stamp > sum->stamp) sum->stamp = observation.stamp;
+    sum->sources |= 1u << (s % 32);
+    sum->is_fixed_view = sum->is_fixed_view || source.is_fixed;
+  }
+
+  static bool makeMarker(uint32_t id, const Sum &sum, FusedMarker *marker)
+  {
+    if (sum.weight <= 0.0) return false;
+
+    marker->id = id;
+    for (int i = 0; i < 3; i++)
+      marker->position[i] = sum.position[i] / sum.weight;
+    marker->sigma = sqrt(1.0 / sum.weight);
+    marker->stamp = sum.stamp;
+    marker->sources = sum.sources;
+    marker->is_fixed_view = sum.is_fixed_view;
+    return true;
+  }
+
+  std::vector<MarkerSource> source_;
+  std::vector<std::map<uint32_t, Observation> > view_;
+};
+
+}  // namespace open_manipulator_pick_and_place
+
+#endif  // OPEN_MANIPULATOR_PICK_AND_PLACE_MARKER_FUSION_H
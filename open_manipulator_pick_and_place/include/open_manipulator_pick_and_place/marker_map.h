@@ -0,0 +1,78 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef OPEN_MANIPULATOR_PICK_AND_PLACE_MARKER_MAP_H
+#define OPEN_MANIPULATOR_PICK_AND_PLACE_MARKER_MAP_H
+
+#include <stdint.h>
+#include <map>
+#include <mutex>
+
+namespace open_manipulator_pick_and_place
+{
+
+typedef struct _MarkerEntry
+{
+  double position[3];  // cell frame [m]
+  double stamp;        // last seen [s], 0 for fixed markers
+} MarkerEntry;
+
+// Last seen position of every marker in the shared camera view, written by
+// the marker callback and read by all arm executors. Fixed markers (place
+// spots, or every marker in a mock cell) never expire.
+class MarkerMap
+{
+ public:
+  MarkerMap() : max_age_(2.0) {}
+
+  void setMaxAge(double max_age) { max_age_ = max_age; }
+
+  void update(uint32_t id, const double position[3], double stamp)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    MarkerEntry &entry = marker_[id];
+    for (int i = 0; i < 3; i++)
+      entry.position[i] = position[i];
+    entry.stamp = stamp;
+  }
+
+  void setFixed(uint32_t id, const double position[3])
+  {
+    update(id, position, 0.0);
+  }
+
+  // False if the marker was never seen or not for max_age
+  bool find(uint32_t id, double now, double position[3]) const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<uint32_t, MarkerEntry>::const_iterator it = marker_.find(id);
+    if (it == marker_.end()) return false;
+    if (it->second.stamp > 0.0 && now - it->second.stamp > max_age_) return false;
+
+    for (int i = 0; i < 3; i++)
+      position[i] = it->second.position[i];
+    return true;
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::map<uint32_t, MarkerEntry> marker_;
+  double max_age_;  // [s]
+};
+
+}  // namespace open_manipulator_pick_and_place
+
+#endif  // OPEN_MANIPULATOR_PICK_AND_PLACE_MARKER_MAP_H
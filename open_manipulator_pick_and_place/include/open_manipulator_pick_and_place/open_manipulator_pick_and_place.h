@@ -20,6 +20,9 @@
 #define OPEN_MANIPULATOR_PICK_AND_PLACE_H
 
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
+#include <ros/file_log.h>
+#include <mutex>
 #include <termios.h>
 #include <sys/ioctl.h>
 
@@ -29,17 +32,82 @@
 #include "open_manipulator_msgs/SetKinematicsPose.h"
 
 #include "ar_track_alvar_msgs/AlvarMarkers.h"
+#include "sensor_msgs/CameraInfo.h"
+#include "sensor_msgs/Image.h"
+#include "sensor_msgs/image_encodings.h"
 #include "sensor_msgs/JointState.h"
+#include "std_msgs/UInt8.h"
+
+#include "open_manipulator_pick_and_place/arm_kinematics.h"
+#include "open_manipulator_pick_and_place/camera_transform_monitor.h"
+#include "open_manipulator_pick_and_place/depth_roi_sampler.h"
+#include "open_manipulator_pick_and_place/event_log.h"
+#include "open_manipulator_pick_and_place/flight_recorder.h"
+#include "open_manipulator_pick_and_place/joint_state_buffer.h"
+#include "open_manipulator_pick_and_place/keyboard_reader.h"
+#include "open_manipulator_pick_and_place/latency_statistics.h"
+#include "open_manipulator_pick_and_place/load_monitor.h"
+#include "open_manipulator_pick_and_place/marker_fusion.h"
+#include "open_manipulator_pick_and_place/path_timing.h"
+#include "open_manipulator_pick_and_place/pose_library.h"
+#include "open_manipulator_pick_and_place/sequence_checkpoint.h"
+#include "open_manipulator_pick_and_place/step_wait.h"
+#include "open_manipulator_pick_and_place/stop_controller.h"
+#include "open_manipulator_pick_and_place/trace_writer.h"
+#include "open_manipulator_pick_and_place/trajectory_client.h"
+#include "open_manipulator_pick_and_place/voxel_grid.h"
 
 #define NUM_OF_JOINT_AND_TOOL 5
 #define HOME_POSE   1
 #define DEMO_START  2
 #define DEMO_STOP   3
 
+// perception_demand values, see open_manipulator_ar_markers/detection_gate.h
+#define PERCEPTION_DEMAND_NONE  0
+#define PERCEPTION_DEMAND_LOW   1
+#define PERCEPTION_DEMAND_FULL  2
+
+// shortcutToPlace() results
+#define SHORTCUT_NOT_TAKEN  0  // off or blocked, go by the initial pose
+#define SHORTCUT_SENT       1
+#define SHORTCUT_FAILED     2  // sent, and the command failed or was dropped
+
+// Pose library keys, in the order of the defaults in the source, see config/poses.yaml
+#define POSE_HOME              0   // joint1..joint4 of the home key
+#define POSE_HOME_GRIPPER      1
+#define POSE_DEMO_HOME         2   // first and last demo step
+#define POSE_INITIAL           3   // camera view over the boxes
+#define POSE_PLACE             4
+#define POSE_GRIPPER_OPEN      5
+#define POSE_GRIPPER_CLOSE     6
+#define POSE_GRIP_ORIENTATION  7   // w x y z
+#define POSE_PICK              8   // x y offset from the marker, z without depth_topic
+#define POSE_PLACE_BOX_0       9   // x y z on the stack, z without depth_topic
+#define POSE_PLACE_BOX_1       10
+#define POSE_PLACE_BOX_2       11
+#define POSE_LIFT_BOX_0        12  // x y z after placing the first box
+#define POSE_LIFT_HEIGHT       13  // z after placing the second and the third box
+#define POSE_MOVE_TIME         14  // [s]
+#define POSE_APPROACH_TIME     15  // task space approach to a marker [s]
+#define POSE_GRIP_TIME         16  // wait before gripping or releasing [s]
+#define POSE_OPEN_TIME         17  // wait at the initial pose before opening [s]
+#define POSE_THIRD_GRIP_TIME   18  // grip_time of the third box [s]
+#define POSE_HOME_RETURN_TIME  19  // demo_home before and after the letters [s]
+#define POSE_LETTER_MOVE_TIME  20  // [s]
+#define POSE_LETTER_LIFT_TIME  21  // [s]
+#define POSE_LETTER_I          22  // joint1..joint4 of each letter
+#define POSE_LETTER_R          23
+#define POSE_LETTER_R_LIFT     24  // back up from R before A
+#define POSE_LETTER_A          25
+#define POSE_LETTER_S          26
+#define POSE_LETTER_C          27
+#define NUM_OF_POSE            28
+
 typedef struct _ArMarker
 {
   uint32_t id;
   double position[3];
+  ros::Time stamp;
 } ArMarker;
 
 class OpenManipulatorPickandPlace
@@ -48,42 +116,171 @@ class OpenManipulatorPickandPlace
   // ROS NodeHandle
   ros::NodeHandle node_handle_;
   ros::NodeHandle priv_node_handle_;
-  ros::ServiceClient goal_joint_space_path_client_;
-  ros::ServiceClient goal_tool_control_client_;
-  ros::ServiceClient goal_task_space_path_client_;
+  // With realtime set, the marker and depth callbacks are served from this
+  // queue by a spinner thread at normal priority, off the control thread.
+  // Declared before their subscribers, so it outlives them
+  ros::CallbackQueue perception_queue_;
+  boost::shared_ptr<ros::AsyncSpinner> perception_spinner_;
+  // What those callbacks share with the tick: marker_fusion_,
+  // fused_marker_pose_, depth_image_, depth_sampler_ and voxel_grid_. Held
+  // for copies and lookups only, never across a voxel insert
+  std::mutex perception_mutex_;
+  open_manipulator_pick_and_place::TrajectoryClient trajectory_;  // goal_* services as goals
+  ros::Publisher perception_demand_pub_;
 
   ros::Subscriber open_manipulator_states_sub_;
   ros::Subscriber open_manipulator_joint_states_sub_;
   ros::Subscriber open_manipulator_kinematics_pose_sub_;
-  ros::Subscriber ar_pose_marker_sub_;
+  std::vector<ros::Subscriber> ar_pose_marker_sub_;  // one per marker source
 
   std::vector<double> present_joint_angle_;
   std::vector<double> present_kinematic_position_;
   std::vector<std::string> joint_name_;
   bool open_manipulator_is_moving_;
-  std::vector<ArMarker> ar_marker_pose;
+  std::vector<ArMarker> ar_marker_pose;     // fused_marker_pose_ as of this tick
+  std::vector<ArMarker> fused_marker_pose_;  // last fused by arPoseMarkerCallback
 
   uint8_t mode_state_;
   uint8_t demo_count_;
   uint8_t pick_ar_id_;
+  uint8_t perception_demand_;
+
+  // Image capture to task space command issued from a marker pose
+  open_manipulator_pick_and_place::LatencyStatistics frame_to_command_latency_;
+
+  // Received messages and tick times on /diagnostics, for load_generator
+  open_manipulator_pick_and_place::LoadMonitor load_monitor_;
+
+  // Markers reported in camera_frame_ are moved to the world frame with the
+  // joint positions at their capture time, so they stay valid while moving
+  open_manipulator_pick_and_place::JointStateBuffer joint_state_buffer_;
+  open_manipulator_pick_and_place::ArmKinematics arm_kinematics_;
+  // path_time of every arm command from the distance and the joint limits
+  open_manipulator_pick_and_place::PathTiming path_timing_;
+  std::string camera_frame_;
+  bool use_motion_compensation_;
+  boost::shared_ptr<open_manipulator_pick_and_place::CameraTransformMonitor> camera_transform_monitor_;
+
+  // Markers of every camera (marker_sources), fused into ar_marker_pose
+  open_manipulator_pick_and_place::MarkerFusion marker_fusion_;
+
+  // Pick and place heights from the aligned depth image (depth_topic) under
+  // the marker or the place position, instead of the pose library's z
+  ros::Subscriber depth_image_sub_;
+  ros::Subscriber depth_info_sub_;
+  sensor_msgs::Image::ConstPtr depth_image_;
+  open_manipulator_pick_and_place::DepthRoiSampler depth_sampler_;
+  double depth_roi_half_size_;
+  double depth_scale_;
+  double depth_max_age_;
+  double grasp_below_top_;
+  double grasp_min_height_;
+  double place_clearance_;
+  double held_height_;  // grasp point above the bottom of the held box, < 0 unknown
+
+  // Occupancy of the workspace from the same depth images; arm commands
+  // whose path crosses it are held back and the demo step retried
+  open_manipulator_pick_and_place::VoxelGrid voxel_grid_;
+  open_manipulator_pick_and_place::VoxelGrid perception_voxel_grid_;  // inserted into, then copied to voxel_grid_
+  bool use_voxel_grid_;
+  int voxel_inflation_;         // [cells]
+  double voxel_ignore_radius_;  // around the tool's start and goal [m]
+  bool use_shortcut_transit_;   // grip straight to the place pose when clear
+  bool is_path_blocked_;
+  uint32_t num_of_blocked_path_;
+  double blocked_since_;         // [s], 0 while the step's path is clear
+  double blocked_path_timeout_;  // [s], 0 waits for good
+
+  // Demo progress saved to a mapped file on every step transition; a
+  // restarted node goes on from it once it has read the arm's state again
+  open_manipulator_pick_and_place::SequenceCheckpoint checkpoint_;
+  open_manipulator_pick_and_place::SequenceState saved_state_;   // last saved, or the one to resume
+  bool is_resume_pending_;
+  bool is_holding_;         // last tool command closed the gripper
+  double gripper_command_;  // [m]
+
+  // Grip, release and settle waits of the demo run on this node's tick,
+  // not as goals that hold the arm where it is
+  open_manipulator_pick_and_place::StepWait step_wait_;
+  open_manipulator_pick_and_place::SettleDetector gripper_settle_;
+  open_manipulator_pick_and_place::SettleDetector marker_settle_;
+  int wait_marker_id_;
+
+  // Controller calls carry a deadline; a demo step whose command failed,
+  // timed out or was not planned is sent again a few times, then the demo
+  // stops
+  uint32_t num_of_failed_command_;
+  int command_retries_;         // of the step being retried
+  int max_command_retries_;
+  double command_retry_delay_;  // [s]
+  uint32_t num_of_aborted_demo_;
+
+  // Control path messages go through the event log instead of printf, and
+  // together with state, markers and commands into the flight recorder
+  open_manipulator_pick_and_place::EventLog event_log_;
+  open_manipulator_pick_and_place::FlightRecorder flight_recorder_;
+  open_manipulator_pick_and_place::TraceWriter trace_;
+  int16_t logged_demo_count_;
+  bool is_realtime_;  // ticks on the SCHED_FIFO control thread: no status screen, short call deadline
+
+  // Poses and path times, retuned from pose_file between demo cycles
+  open_manipulator_pick_and_place::PoseLibrary poses_;
+
+  // The stop key and the stop topic hold the arm from their own threads
+  // instead of waiting for the timer; keys are read by keyboard_'s thread
+  open_manipulator_pick_and_place::StopController stop_;
+  open_manipulator_pick_and_place::KeyboardReader keyboard_;
 
  public:
   OpenManipulatorPickandPlace();
+  OpenManipulatorPickandPlace(ros::NodeHandle node_handle, ros::NodeHandle priv_node_handle);
   ~OpenManipulatorPickandPlace();
 
   void initServiceClient();
   void initSubscribe();
+  void initPublisher();
+  void initCameraModel();
+  void initEventLog();
+  void initPoseLibrary();
+  void initStop();
+  void initCheckpoint();
 
   void manipulatorStatesCallback(const open_manipulator_msgs::OpenManipulatorState::ConstPtr &msg);
   void kinematicsPoseCallback(const open_manipulator_msgs::KinematicsPose::ConstPtr &msg);
   void jointStatesCallback(const sensor_msgs::JointState::ConstPtr &msg);
-  void arPoseMarkerCallback(const ar_track_alvar_msgs::AlvarMarkers::ConstPtr &msg);
+  void arPoseMarkerCallback(const ar_track_alvar_msgs::AlvarMarkers::ConstPtr &msg, size_t source);
+  void depthImageCallback(const sensor_msgs::Image::ConstPtr &msg);
+  void depthInfoCallback(const sensor_msgs::CameraInfo::ConstPtr &msg);
+  void trajectoryDoneCallback(uint8_t state, const open_manipulator_pick_and_place::TrajectoryFeedback &feedback);
 
   bool setJointSpacePath(std::vector<std::string> joint_name, std::vector<double> joint_angle, double path_time);
   bool setToolControl(std::vector<double> joint_angle);
   bool setTaskSpacePath(std::vector<double> kinematics_pose, std::vector<double> kienmatics_orientation, double path_time);
+  void recordFrameToCommandLatency(const ArMarker &marker);
+  bool cameraToWorld(const ros::Time &stamp, const double camera_position[3], double world_position[3]);
+  bool depthHeight(const double world_position[3], double *top_z, double *support_z);
+  double pickHeight(const ArMarker &marker);
+  double placeHeight(const std::vector<double> &place_position);
+  bool isJointPathClear(const std::vector<double> &joint_angle);
+  bool isTaskPathClear(const std::vector<double> &kinematics_pose);
+  void updatePathBlocked(bool is_clear, uint8_t service, double blocked_at);
+  uint8_t shortcutToPlace();
+  void logEvent(uint32_t event, double a0 = 0.0, double a1 = 0.0);
+  void saveCheckpoint();
+  void resumeSequence();
+  int resumeStep(int step, bool is_holding);
+  void startWait(uint8_t condition, double time, int marker_id = -1);
+  bool isStepWaiting();
+  void updateCommandResult(uint8_t state, uint8_t service, double deadline);
+  void retryStep(uint8_t step);
+  void holdBlockedStep(uint8_t step);
+  void abortDemo();
+
+  uint8_t perceptionDemand();
+  void updatePerceptionDemand();
+  bool isCycleBoundary();
 
-  void publishCallback(const ros::TimerEvent&);
+  void publishCallback(const ros::TimerEvent &event);
   void setModeState(char ch);
   void demoSequence();
 
@@ -0,0 +1,137 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef OPEN_MANIPULATOR_PICK_AND_PLACE_PATH_TIMING_H
+#define OPEN_MANIPULATOR_PICK_AND_PLACE_PATH_TIMING_H
+
+#include <math.h>
+#include <vector>
+
+#include "open_manipulator_pick_and_place/arm_kinematics.h"
+
+// Peak velocity and acceleration of a minimum jerk move over distance d in
+// time T are these factors times d / T and d / T^2
+#define MINIMUM_JERK_VELOCITY_FACTOR      1.875
+#define MINIMUM_JERK_ACCELERATION_FACTOR  5.7735
+
+namespace open_manipulator_pick_and_place
+{
+
+// Shortest path_time the controller can follow between two arm poses. The
+// controller plays every path as a minimum jerk profile, so a joint moving
+// by d needs T >= 1.875 d / v_max and T >= sqrt(5.7735 d / a_max); the
+// slowest joint sets the time, with a safety factor on top. Paths whose
+// joints all stay put are waits (grip, open) and keep their time.
+class PathTiming
+{
+ public:
+  static const int NUM_OF_JOINT = 4;
+
+  PathTiming()
+  : is_enabled_(false),
+    safety_factor_(1.2),
+    min_path_time_(0.2),
+    hold_distance_(0.005)
+  {
+    for (int i = 0; i < NUM_OF_JOINT; i++)
+    {
+      velocity_limit_[i] = 2.0;
+      acceleration_limit_[i] = 4.0;
+    }
+  }
+
+  // velocity_limit [rad/s] and acceleration_limit [rad/s^2] per joint, a
+  // single value applies to every joint
+  void init(bool is_enabled,
+            const std::vector<double> &velocity_limit,
+            const std::vector<double> &acceleration_limit,
+            double safety_factor,
+            double min_path_time)
+  {
+    is_enabled_ = is_enabled;
+    setLimit(velocity_limit, velocity_limit_);
+    setLimit(acceleration_limit, acceleration_limit_);
+    if (safety_factor >= 1.0) safety_factor_ = safety_factor;
+    if (min_path_time > 0.0) min_path_time_ = min_path_time;
+  }
+
+  bool isEnabled() const { return is_enabled_; }
+
+  double minimumTime(const double start[4], const double goal[4]) const
+  {
+    double path_time = 0.0;
+    for (int i = 0; i < NUM_OF_JOINT; i++)
+    {
+      double distance = fabs(goal[i] - start[i]);
+      double velocity_time = MINIMUM_JERK_VELOCITY_FACTOR * distance / velocity_limit_[i];
+      double acceleration_time = sqrt(MINIMUM_JERK_ACCELERATION_FACTOR * distance / acceleration_limit_[i]);
+      path_time = fmax(path_time, fmax(velocity_time, acceleration_time));
+    }
+    return fmax(path_time * safety_factor_, min_path_time_);
+  }
+
+  double jointPathTime(const double start[4], const double goal[4], double requested_path_time) const
+  {
+    if (!is_enabled_ || isHold(start, goal)) return requested_path_time;
+    return minimumTime(start, goal);
+  }
+
+  // Goal of a task space path through the arm's own IK; one the IK cannot
+  // reach keeps its time and is left to the controller to reject
+  double taskPathTime(const ArmKinematics &kinematics,
+                      const double start[4],
+                      const double position[3],
+                      const double orientation[4],
+                      double requested_path_time) const
+  {
+    if (!is_enabled_) return requested_path_time;
+
+    double goal[NUM_OF_JOINT];
+    double pitch = toolPitch(orientation[0], orientation[1], orientation[2], orientation[3]);
+    if (!kinematics.toolToJoint(position, pitch, goal)) return requested_path_time;
+    return jointPathTime(start, goal, requested_path_time);
+  }
+
+ private:
+  bool isHold(const double start[4], const double goal[4]) const
+  {
+    for (int i = 0; i < NUM_OF_JOINT; i++)
+    {
+      if (fabs(goal[i] - start[i]) > hold_distance_) return false;
+    }
+    return true;
+  }
+
+  static void setLimit(const std::vector<double> &value, double limit[4])
+  {
+    for (int i = 0; i < NUM_OF_JOINT; i++)
+    {
+      double v = value.empty() ? 0.0 : value[(size_t)i < value.size() ? i : value.size() - 1];
+      if (v > 0.0) limit[i] = v;
+    }
+  }
+
+  bool is_enabled_;
+  double velocity_limit_[4];
+  double acceleration_limit_[4];
+  double safety_factor_;
+  double min_path_time_;
+  double hold_distance_;  // [rad]
+};
+
+}  // namespace open_manipulator_pick_and_place
+
+#endif  // OPEN_MANIPULATOR_PICK_AND_PLACE_PATH_TIMING_H
@@ -0,0 +1,250 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef OPEN_MANIPULATOR_PICK_AND_PLACE_POSE_LIBRARY_H
+#define OPEN_MANIPULATOR_PICK_AND_PLACE_POSE_LIBRARY_H
+
+#include <ros/ros.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <yaml-cpp/yaml.h>
+
+#define POSE_VALUE_MAX            8   // values of one entry (joint angles, x y z, w x y z, a time)
+#define POSE_LIBRARY_MAX_ENTRIES  32
+
+namespace open_manipulator_pick_and_place
+{
+
+typedef struct _PoseEntry
+{
+  const char *name;  // key in the YAML file, string literals only
+  uint8_t size;      // number of values, fixed by the built-in defaults
+  double value[POSE_VALUE_MAX];
+} PoseEntry;
+
+// Named poses and parameters of a demo in a flat table. The node's built-in
+// defaults fix the keys and sizes; a YAML file (key: value or key: [values])
+// overrides them and is reloaded when it changes. Files are parsed and
+// checked on a watcher thread into a staging table; the control thread picks
+// the new table up with update() where a change is safe (between demo
+// cycles), so reads are plain array accesses and a rejected file never
+// replaces the one in use.
+class PoseLibrary
+{
+ public:
+  PoseLibrary(const PoseEntry *defaults, size_t count)
+  : count_(count < POSE_LIBRARY_MAX_ENTRIES ? count : POSE_LIBRARY_MAX_ENTRIES),
+    generation_(0),
+    pending_(false),
+    watching_(false),
+    inotify_fd_(-1)
+  {
+    memcpy(default_, defaults, count_ * sizeof(PoseEntry));
+    memcpy(active_, defaults, count_ * sizeof(PoseEntry));
+    memcpy(staging_, defaults, count_ * sizeof(PoseEntry));
+  }
+
+  ~PoseLibrary()
+  {
+    stopWatching();
+  }
+
+  // Parses path into the staging table, applied by the next update()
+  bool load(const std::string &path, std::string *error)
+  {
+    PoseEntry table[POSE_LIBRARY_MAX_ENTRIES];
+    memcpy(table, default_, count_ * sizeof(PoseEntry));
+
+    try
+    {
+      YAML::Node root = YAML::LoadFile(path);
+      if (!root.IsMap())
+      {
+        *error = path + " is not a map of names to values";
+        return false;
+      }
+
+      for (YAML::const_iterator it = root.begin(); it != root.end(); ++it)
+      {
+        std::string name = it->first.as<std::string>();
+        PoseEntry *entry = find(table, name);
+        if (entry == NULL)
+        {
+          *error = "Unknown name '" + name + "' in " + path;
+          return false;
+        }
+
+        const YAML::Node &value = it->second;
+        if (value.IsScalar() && entry->size == 1)
+        {
+          entry->value[0] = value.as<double>();
+        }
+        else if (value.IsSequence() && value.size() == entry->size)
+        {
+          for (size_t i = 0; i < entry->size; i++)
+            entry->value[i] = value[i].as<double>();
+        }
+        else
+        {
+          char text[64];
+          snprintf(text, sizeof(text), "'%s' needs %d value(s)", entry->name, entry->size);
+          *error = text;
+          return false;
+        }
+
+        for (size_t i = 0; i < entry->size; i++)
+        {
+          if (!std::isfinite(entry->value[i]))
+          {
+            *error = "'" + name + "' is not a finite number";
+            return false;
+          }
+        }
+      }
+    }
+    catch (const YAML::Exception &ex)
+    {
+      *error = path + ": " + ex.what();
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    memcpy(staging_, table, count_ * sizeof(PoseEntry));
+    pending_.store(true, std::memory_order_release);
+    return true;
+  }
+
+  // Reloads path on a background thread whenever it is written or replaced.
+  // The directory is watched since editors save by renaming a new file over it.
+  bool watch(const std::string &path)
+  {
+    stopWatching();
+
+    size_t slash = path.rfind('/');
+    std::string directory = slash == std::string::npos ? "." : path.substr(0, slash);
+    file_name_ = slash == std::string::npos ? path : path.substr(slash + 1);
+    path_ = path;
+
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0) return false;
+    if (inotify_add_watch(inotify_fd_, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+      close(inotify_fd_);
+      inotify_fd_ = -1;
+      return false;
+    }
+
+    watching_.store(true);
+    watcher_ = std::thread(&PoseLibrary::watchLoop, this);
+    return true;
+  }
+
+  void stopWatching()
+  {
+    if (!watcher_.joinable()) return;
+
+    watching_.store(false);
+    watcher_.join();
+    close(inotify_fd_);
+    inotify_fd_ = -1;
+  }
+
+  // Control thread only: applies a loaded file, true if the table changed
+  bool update()
+  {
+    if (!pending_.load(std::memory_order_acquire)) return false;
+    if (!mutex_.try_lock()) return false;  // a file is being copied, next time
+
+    memcpy(active_, staging_, count_ * sizeof(PoseEntry));
+    pending_.store(false, std::memory_order_relaxed);
+    mutex_.unlock();
+    generation_++;
+    return true;
+  }
+
+  uint32_t generation() const { return generation_; }
+
+  const double *get(size_t key) const { return active_[key].value; }
+  double value(size_t key, size_t index = 0) const { return active_[key].value[index]; }
+  std::vector<double> vector(size_t key) const
+  {
+    return std::vector<double>(active_[key].value, active_[key].value + active_[key].size);
+  }
+
+ private:
+  PoseEntry *find(PoseEntry *table, const std::string &name) const
+  {
+    for (size_t i = 0; i < count_; i++)
+      if (name == table[i].name) return &table[i];
+    return NULL;
+  }
+
+  void watchLoop()
+  {
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd descriptor = {inotify_fd_, POLLIN, 0};
+
+    while (watching_.load())
+    {
+      if (poll(&descriptor, 1, 200) <= 0) continue;
+
+      bool changed = false;
+      ssize_t length;
+      while ((length = read(inotify_fd_, buffer, sizeof(buffer))) > 0)
+      {
+        for (char *p = buffer; p < buffer + length;)
+        {
+          const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(p);
+          if (event->len > 0 && file_name_ == event->name) changed = true;
+          p += sizeof(struct inotify_event) + event->len;
+        }
+      }
+      if (!changed) continue;
+
+      std::string error;
+      if (load(path_, &error))
+        ROS_INFO("Pose library %s reloaded, applied between demo cycles", path_.c_str());
+      else
+        ROS_ERROR("Pose library not reloaded, keeping the current one: %s", error.c_str());
+    }
+  }
+
+  PoseEntry default_[POSE_LIBRARY_MAX_ENTRIES];
+  PoseEntry active_[POSE_LIBRARY_MAX_ENTRIES];   // control thread
+  PoseEntry staging_[POSE_LIBRARY_MAX_ENTRIES];  // guarded by mutex_
+  size_t count_;
+  uint32_t generation_;
+
+  std::mutex mutex_;
+  std::atomic<bool> pending_;
+  std::atomic<bool> watching_;
+  std::thread watcher_;
+  int inotify_fd_;
+  std::string path_;
+  std::string file_name_;
+};
+
+}  // namespace open_manipulator_pick_and_place
+
+#endif  // OPEN_MANIPULATOR_PICK_AND_PLACE_POSE_LIBRARY_H
@@ -0,0 +1,214 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef OPEN_MANIPULATOR_PICK_AND_PLACE_SEQUENCE_CHECKPOINT_H
+#define OPEN_MANIPULATOR_PICK_AND_PLACE_SEQUENCE_CHECKPOINT_H
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+
+#include "open_manipulator_pick_and_place/event_log.h"
+
+#define SEQUENCE_CHECKPOINT_MAGIC    "OMCKPT"
+#define SEQUENCE_CHECKPOINT_VERSION  1
+
+namespace open_manipulator_pick_and_place
+{
+
+// Where the demo is, as of its last step transition
+typedef struct _SequenceState
+{
+  uint64_t stamp;           // EventLog::now() of the save [ns]
+  int32_t mode_state;
+  int32_t demo_count;       // step about to run
+  int32_t pick_marker_id;   // < 0 none
+  int32_t place_marker_id;
+  uint32_t is_holding;      // last tool command closed the gripper
+  uint32_t reserved;
+  double gripper;           // last tool command [m]
+  double held_height;       // [m], < 0 unknown
+} SequenceState;
+
+typedef struct _SequenceSlot
+{
+  uint64_t generation;      // saves so far when this one was written
+  SequenceState state;
+  uint64_t checksum;        // of generation and state
+} SequenceSlot;
+
+typedef struct _SequenceCheckpointFile
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t state_size;
+  SequenceSlot slot[2];
+} SequenceCheckpointFile;
+
+// Demo progress in a small MAP_SHARED file, saved on every step transition.
+// A save is a few stores into the page cache, so it survives a crash or
+// SIGKILL of the node; for power loss the two slots are written in turn
+// and carry a checksum, a torn save falls back to the one before it.
+class SequenceCheckpoint
+{
+ public:
+  SequenceCheckpoint()
+  : file_(NULL),
+    generation_(0)
+  {
+  }
+
+  ~SequenceCheckpoint()
+  {
+    close();
+  }
+
+  // Keeps what an earlier run of the node saved in path, a file of another
+  // layout is started over
+  bool open(const std::string &path)
+  {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return false;
+
+    struct stat status;
+    bool is_new = fstat(fd, &status) != 0 || (size_t)status.st_size != sizeof(SequenceCheckpointFile);
+    if (is_new && ftruncate(fd, sizeof(SequenceCheckpointFile)) != 0)
+    {
+      ::close(fd);
+      return false;
+    }
+
+    void *map = mmap(NULL, sizeof(SequenceCheckpointFile), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return false;
+
+    file_ = static_cast<SequenceCheckpointFile *>(map);
+    if (is_new || memcmp(file_->magic, SEQUENCE_CHECKPOINT_MAGIC, sizeof(SEQUENCE_CHECKPOINT_MAGIC)) != 0 ||
+        file_->version != SEQUENCE_CHECKPOINT_VERSION || file_->state_size != sizeof(SequenceState))
+    {
+      memset(file_, 0, sizeof(SequenceCheckpointFile));
+      memcpy(file_->magic, SEQUENCE_CHECKPOINT_MAGIC, sizeof(SEQUENCE_CHECKPOINT_MAGIC));
+      file_->version = SEQUENCE_CHECKPOINT_VERSION;
+      file_->state_size = sizeof(SequenceState);
+    }
+
+    int index = latestSlot();
+    generation_ = index < 0 ? 0 : file_->slot[index].generation;
+    return true;
+  }
+
+  void close()
+  {
+    if (file_ == NULL) return;
+
+    munmap(file_, sizeof(SequenceCheckpointFile));
+    file_ = NULL;
+  }
+
+  bool isOpen() const { return file_ != NULL; }
+
+  // Last intact save, false when there is none
+  bool load(SequenceState *state) const
+  {
+    if (file_ == NULL) return false;
+    return latest(state);
+  }
+
+  void save(const SequenceState &state)
+  {
+    if (file_ == NULL) return;
+
+    SequenceSlot &slot = file_->slot[++generation_ & 1];
+    slot.generation = generation_;
+    slot.state = state;
+    slot.state.stamp = EventLog::now();
+    slot.checksum = checksum(slot);
+
+    // Starts the write back without waiting for it
+    msync(file_, sizeof(SequenceCheckpointFile), MS_ASYNC);
+  }
+
+ private:
+  static bool isIntact(const SequenceSlot &slot)
+  {
+    return slot.generation > 0 && slot.checksum == checksum(slot);
+  }
+
+  int latestSlot() const
+  {
+    bool intact[2] = {isIntact(file_->slot[0]), isIntact(file_->slot[1])};
+    if (intact[0] && intact[1]) return file_->slot[1].generation > file_->slot[0].generation ? 1 : 0;
+    if (intact[1]) return 1;
+    if (intact[0]) return 0;
+    return -1;
+  }
+
+  bool latest(SequenceState *state) const
+  {
+    int index = latestSlot();
+    if (index < 0) return false;
+
+    *state = file_->slot[index].state;
+    return true;
+  }
+
+  // FNV-1a over the generation and the state
+  static uint64_t checksum(const SequenceSlot &slot)
+  {
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&slot);
+    size_t size = offsetof(SequenceSlot, checksum);
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++)
+    {
+      hash ^= bytes[i];
+      hash *= 1099511628211ULL;
+    }
+    return hash;
+  }
+
+  SequenceCheckpointFile *file_;
+  uint64_t generation_;
+};
+
+// $ROS_HOME, else ~/.ros: unlike the log directory of a launch, the same
+// for every run of the node
+inline std::string checkpointDirectory()
+{
+  const char *ros_home = getenv("ROS_HOME");
+  if (ros_home != NULL) return ros_home;
+
+  const char *home = getenv("HOME");
+  return std::string(home != NULL ? home : ".") + "/.ros";
+}
+
+// A box is still in the gripper when the last tool command closed it and
+// the fingers stopped short of the closed position
+inline bool isHoldingBox(const SequenceState &state, double gripper_position, double gripper_close, double margin = 0.002)
+{
+  return state.is_holding && gripper_position > gripper_close + margin;
+}
+
+}  // namespace open_manipulator_pick_and_place
+
+#endif  // OPEN_MANIPULATOR_PICK_AND_PLACE_SEQUENCE_CHECKPOINT_H
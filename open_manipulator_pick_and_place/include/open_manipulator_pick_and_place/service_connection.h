@@ -0,0 +1,199 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef OPEN_MANIPULATOR_PICK_AND_PLACE_SERVICE_CONNECTION_H
+#define OPEN_MANIPULATOR_PICK_AND_PLACE_SERVICE_CONNECTION_H
+
+#include <ros/ros.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <mutex>
+#include <string>
+#include <boost/bind.hpp>
+
+#include "open_manipulator_pick_and_place/call_watchdog.h"
+#include "open_manipulator_pick_and_place/latency_statistics.h"
+
+namespace open_manipulator_pick_and_place
+{
+
+// Persistent client of one controller service. The TCPROS connection is set
+// up once and reused by every call instead of once per call. When it breaks
+// (controller restarted) the client is recreated and the call sent once
+// more; the goal services take absolute targets, so a request that reached
+// the old controller is harmless to repeat. Round trips on an open
+// connection and calls that had to open one are timed separately.
+//
+// With a deadline, a call that has not returned by then is failed by the
+// watchdog thread, which drops the connection the call waits on; a
+// controller that hangs then costs the caller the deadline, not forever.
+// A timed out call is not sent again, the caller decides whether to retry.
+// A persistent ros::ServiceClient opens its link when it is created, or in
+// call() when the service was not up then; shutdown() from the watchdog
+// would race with the latter, so a call is only made on a client whose link
+// is already open.
+template <class Service>
+class ServiceConnection
+{
+ public:
+  ServiceConnection()
+  : is_connected_(false),
+    is_timed_out_(false),
+    deadline_(0.0),
+    reconnects_(0),
+    failures_(0),
+    timeouts_(0)
+  {
+  }
+
+  void init(ros::NodeHandle node_handle, const std::string &name)
+  {
+    node_handle_ = node_handle;
+    name_ = name;
+    client_ = node_handle_.serviceClient<Service>(name_, true);
+    is_connected_ = false;
+  }
+
+  // Calls longer than timeout seconds fail, 0 for no limit
+  void setDeadline(double timeout)
+  {
+    deadline_ = timeout;
+  }
+
+  // Blocks until the service is advertised, false after timeout seconds
+  bool waitForService(double timeout)
+  {
+    return client_.waitForExistence(ros::Duration(timeout));
+  }
+
+  // Opens the connection with a request that has no effect on the arm
+  bool warmUp(Service &srv)
+  {
+    return call(srv);
+  }
+
+  bool call(Service &srv)
+  {
+    if (!client_.isValid() && !reconnect())
+    {
+      failures_++;
+      return false;
+    }
+    if (timedCall(srv)) return true;
+    if (is_timed_out_)
+    {
+      failures_++;
+      return false;
+    }
+
+    // The connection was lost, open a new one if the service is back
+    if (!reconnect() || !timedCall(srv))
+    {
+      failures_++;
+      return false;
+    }
+    return true;
+  }
+
+  const std::string &name() const { return name_; }
+  bool isConnected() const { return is_connected_; }
+  bool isTimedOut() const { return is_timed_out_; }  // the last call failed on its deadline
+  double deadline() const { return deadline_; }
+  uint64_t reconnects() const { return reconnects_; }
+  uint64_t failures() const { return failures_; }
+  uint64_t timeouts() const { return timeouts_; }
+
+  const LatencyStatistics &roundTrip() const { return round_trip_; }
+  const LatencyStatistics &connect() const { return connect_; }
+
+  // One line of the node's status screen
+  void printStatistics() const
+  {
+    printf("%s RTT [ms] mean: %.2lf p99 < %.2lf max: %.2lf (n=%lu) connect: %.1lf reconnects: %lu failed: %lu timed out: %lu\n",
+           name_.c_str(),
+           round_trip_.mean() * 1e3,
+           round_trip_.percentile(0.99) * 1e3,
+           round_trip_.max() * 1e3,
+           (unsigned long)round_trip_.count(),
+           connect_.max() * 1e3,
+           (unsigned long)reconnects_,
+           (unsigned long)failures_,
+           (unsigned long)timeouts_);
+  }
+
+ private:
+  bool timedCall(Service &srv)
+  {
+    ros::WallTime start = ros::WallTime::now();
+    int watch = CallWatchdog::NONE;
+    if (deadline_ > 0.0) watch = callWatchdog().arm(deadline_, boost::bind(&ServiceConnection::expire, this));
+    bool is_called = client_.call(srv);
+    is_timed_out_ = callWatchdog().disarm(watch);
+    if (!is_called || is_timed_out_)
+    {
+      if (is_timed_out_) timeouts_++;
+      is_connected_ = false;
+      return false;
+    }
+
+    double seconds = (ros::WallTime::now() - start).toSec();
+    if (is_connected_)
+      round_trip_.addSample(seconds);
+    else
+      connect_.addSample(seconds);
+    is_connected_ = true;
+    return true;
+  }
+
+  // Watchdog thread, while the call blocks on the link it found open:
+  // dropping the persistent connection ends the call with false; the next
+  // call reconnects
+  void expire()
+  {
+    std::lock_guard<std::mutex> lock(client_mutex_);
+    client_.shutdown();
+  }
+
+  // Does not wait: if the service is not advertised the new client has no
+  // link, the call fails now and the next one tries again
+  bool reconnect()
+  {
+    std::lock_guard<std::mutex> lock(client_mutex_);
+    client_.shutdown();
+    client_ = node_handle_.serviceClient<Service>(name_, true);
+    is_connected_ = false;
+    reconnects_++;
+    return client_.isValid();
+  }
+
+  ros::NodeHandle node_handle_;
+  std::mutex client_mutex_;  // client_ replaced or shut down, by the caller or the watchdog
+  ros::ServiceClient client_;
+  std::string name_;
+  bool is_connected_;
+  bool is_timed_out_;
+  double deadline_;  // [s], 0 for none
+  uint64_t reconnects_;
+  uint64_t failures_;
+  uint64_t timeouts_;
+
+  LatencyStatistics round_trip_;  // calls on an open connection
+  LatencyStatistics connect_;     // first call on a new connection
+};
+
+}  // namespace open_manipulator_pick_and_place
+
+#endif  // OPEN_MANIPULATOR_PICK_AND_PLACE_SERVICE_CONNECTION_H
@@ -0,0 +1,297 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef OPEN_MANIPULATOR_PICK_AND_PLACE_STEP_WAIT_H
+#define OPEN_MANIPULATOR_PICK_AND_PLACE_STEP_WAIT_H
+
+#include <stdint.h>
+#include <math.h>
+
+#define STEP_WAIT_TIME     0  // the whole time
+#define STEP_WAIT_GRIPPER  1  // until the gripper stops, at most the time
+#define STEP_WAIT_MARKER   2  // until the marker holds still, at most the time
+
+namespace open_manipulator_pick_and_place
+{
+
+// Hashed timer wheel: a timer goes into the slot of its expiry tick with
+// the number of whole turns left, so scheduling, cancelling and expiring
+// are O(1) and advancing visits one slot per tick, however many timers
+// are pending. Timers live in a fixed pool, nothing allocates.
+class TimerWheel
+{
+ public:
+  static const uint32_t NUM_OF_SLOT = 64;  // power of 2
+  static const uint32_t CAPACITY = 32;     // timers pending at once
+  static const uint32_t INVALID = 0xffffffff;
+
+  TimerWheel()
+  : resolution_(0.01),
+    tick_(0),
+    is_started_(false)
+  {
+    clear();
+  }
+
+  void init(double resolution)
+  {
+    resolution_ = resolution;
+    clear();
+  }
+
+  void clear()
+  {
+    for (uint32_t i = 0; i < NUM_OF_SLOT; i++)
+      head_[i] = INVALID;
+    for (uint32_t i = 0; i < CAPACITY; i++)
+    {
+      timer_[i].next = i + 1 < CAPACITY ? i + 1 : INVALID;
+      timer_[i].generation = 0;
+      timer_[i].is_pending = false;
+    }
+    free_ = 0;
+    size_ = 0;
+    is_started_ = false;
+  }
+
+  // Expires on the first advance() at or after deadline, rounded up to a
+  // tick; returns the timer's id, INVALID when the pool is used up
+  uint32_t schedule(double now, double deadline, uint32_t tag)
+  {
+    if (free_ == INVALID) return INVALID;
+    start(now);
+
+    int64_t expiry = (int64_t)ceil(deadline / resolution_);
+    uint64_t delay = expiry > tick_ ? (uint64_t)(expiry - tick_) : 1;
+
+    uint32_t index = free_;
+    Timer &timer = timer_[index];
+    free_ = timer.next;
+    timer.tag = tag;
+    timer.rounds = (delay - 1) / NUM_OF_SLOT;
+    timer.is_pending = true;
+    link(index, (uint32_t)((tick_ + delay) & (NUM_OF_SLOT - 1)));
+    size_++;
+    return (timer.generation << 8) | index;
+  }
+
+  // Ids of timers that already expired or were cancelled are ignored
+  void cancel(uint32_t id)
+  {
+    uint32_t index = id & 0xff;
+    if (id == INVALID || index >= CAPACITY) return;
+
+    Timer &timer = timer_[index];
+    if (!timer.is_pending || timer.generation != (id >> 8)) return;
+    release(index);
+  }
+
+  // expired(tag) for every timer due by now, in the order of their ticks
+  template <typename Callback>
+  void advance(double now, Callback expired)
+  {
+    start(now);
+    int64_t tick = (int64_t)floor(now / resolution_);
+    while (tick_ < tick)
+    {
+      tick_++;
+      uint32_t index = head_[tick_ & (NUM_OF_SLOT - 1)];
+      while (index != INVALID)
+      {
+        Timer &timer = timer_[index];
+        uint32_t next = timer.next;
+        if (timer.rounds == 0)
+        {
+          uint32_t tag = timer.tag;
+          release(index);
+          expired(tag);
+        }
+        else
+        {
+          timer.rounds--;
+        }
+        index = next;
+      }
+    }
+  }
+
+  uint32_t size() const { return size_; }
+
+ private:
+  typedef struct _Timer
+  {
+    uint32_t next;        // in its slot, or in the free list
+    uint32_t prev;
+    uint32_t slot;
+    uint32_t tag;
+    uint64_t rounds;      // whole turns of the wheel still to go
+    uint32_t generation;  // of the pool entry, part of the id
+    bool is_pending;
+  } Timer;
+
+  void start(double now)
+  {
+    if (is_started_) return;
+    tick_ = (int64_t)floor(now / resolution_);
+    is_started_ = true;
+  }
+
+  void link(uint32_t index, uint32_t slot)
+  {
+    Timer &timer = timer_[index];
+    timer.slot = slot;
+    timer.prev = INVALID;
+    timer.next = head_[slot];
+    if (head_[slot] != INVALID) timer_[head_[slot]].prev = index;
+    head_[slot] = index;
+  }
+
+  void release(uint32_t index)
+  {
+    Timer &timer = timer_[index];
+    if (timer.prev != INVALID) timer_[timer.prev].next = timer.next;
+    else head_[timer.slot] = timer.next;
+    if (timer.next != INVALID) timer_[timer.next].prev = timer.prev;
+
+    timer.is_pending = false;
+    timer.generation = (timer.generation + 1) & 0xffffff;
+    timer.next = free_;
+    free_ = index;
+    size_--;
+  }
+
+  double resolution_;  // [s]
+  int64_t tick_;       // last tick advanced to
+  bool is_started_;
+  uint32_t head_[NUM_OF_SLOT];
+  Timer timer_[CAPACITY];
+  uint32_t free_;
+  uint32_t size_;
+};
+
+// Whether up to three values stayed within tolerance of each other for
+// settle_time: a gripper that stopped, a marker that holds still
+class SettleDetector
+{
+ public:
+  explicit SettleDetector(double tolerance = 0.001, double settle_time = 0.3)
+  : tolerance_(tolerance),
+    settle_time_(settle_time)
+  {
+    reset();
+  }
+
+  void setLimits(double tolerance, double settle_time)
+  {
+    tolerance_ = tolerance;
+    settle_time_ = settle_time;
+  }
+
+  void reset()
+  {
+    size_ = 0;
+    since_ = 0.0;
+  }
+
+  void update(double now, const double *value, int size)
+  {
+    bool is_moved = size != size_;
+    for (int i = 0; i < size && !is_moved; i++)
+      is_moved = fabs(value[i] - reference_[i]) > tolerance_;
+    if (!is_moved) return;
+
+    for (int i = 0; i < size; i++)
+      reference_[i] = value[i];
+    size_ = size;
+    since_ = now;
+  }
+
+  bool isSettled(double now) const { return size_ > 0 && now - since_ >= settle_time_; }
+
+ private:
+  double tolerance_;
+  double settle_time_;  // [s]
+  int size_;            // 0 until the first value
+  double reference_[3];
+  double since_;        // [s]
+};
+
+// A wait of the demo sequence, kept on the node's own tick instead of a
+// goal that holds the arm where it is: for a time, or until a condition
+// the caller checks holds, with the time as the limit. The limit is a
+// timer on its own TimerWheel, advanced by update().
+class StepWait
+{
+ public:
+  StepWait()
+  : timer_(TimerWheel::INVALID),
+    condition_(STEP_WAIT_TIME),
+    is_waiting_(false),
+    is_timed_out_(false),
+    started_(0.0)
+  {
+  }
+
+  void start(uint8_t condition, double time, double now)
+  {
+    cancel();
+    condition_ = condition;
+    is_waiting_ = true;
+    is_timed_out_ = false;
+    started_ = now;
+    timer_ = wheel_.schedule(now, now + time, condition);
+    if (timer_ == TimerWheel::INVALID) is_waiting_ = false;
+  }
+
+  void cancel()
+  {
+    wheel_.cancel(timer_);
+    timer_ = TimerWheel::INVALID;
+    is_waiting_ = false;
+  }
+
+  // Every tick, true while the wait goes on
+  bool update(double now, bool is_condition_met)
+  {
+    wheel_.advance(now, [this](uint32_t) { expire(); });
+    if (is_waiting_ && condition_ != STEP_WAIT_TIME && is_condition_met) cancel();
+    return is_waiting_;
+  }
+
+  bool isWaiting() const { return is_waiting_; }
+  uint8_t condition() const { return condition_; }
+  bool isTimedOut() const { return is_timed_out_; }  // the last condition wait ran to its limit
+  double elapsed(double now) const { return now - started_; }
+
+ private:
+  void expire()
+  {
+    timer_ = TimerWheel::INVALID;
+    is_timed_out_ = condition_ != STEP_WAIT_TIME;
+    is_waiting_ = false;
+  }
+
+  TimerWheel wheel_;
+  uint32_t timer_;
+  uint8_t condition_;
+  bool is_waiting_;
+  bool is_timed_out_;
+  double started_;  // [s]
+};
+
+}  // namespace open_manipulator_pick_and_place
+
+#endif  // OPEN_MANIPULATOR_PICK_AND_PLACE_STEP_WAIT_H
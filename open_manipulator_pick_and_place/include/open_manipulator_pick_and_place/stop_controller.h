@@ -0,0 +1,232 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef OPEN_MANIPULATOR_PICK_AND_PLACE_STOP_CONTROLLER_H
+#define OPEN_MANIPULATOR_PICK_AND_PLACE_STOP_CONTROLLER_H
+
+#include <ros/ros.h>
+#include <ros/callback_queue.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "open_manipulator_msgs/SetJointPosition.h"
+#include "std_msgs/Empty.h"
+
+#include "open_manipulator_pick_and_place/event_log.h"
+#include "open_manipulator_pick_and_place/joint_state_buffer.h"
+#include "open_manipulator_pick_and_place/latency_statistics.h"
+#include "open_manipulator_pick_and_place/service_connection.h"
+#include "open_manipulator_pick_and_place/trajectory_client.h"
+
+#define STOP_SOURCE_KEY    0
+#define STOP_SOURCE_TOPIC  1
+
+namespace open_manipulator_pick_and_place
+{
+
+// Stops the arm without going through the control timer. A stop key (from
+// KeyboardReader) or a message on the stop topic (served by its own spinner
+// thread) sends a hold at the latest joint state right away, on a connection
+// of its own so it never queues behind a sequencer call, and latches the
+// stop so that commands the sequencer has not sent yet are refused. The
+// control thread picks the stop up with consume() on its next tick.
+// Latency is measured from the request to the controller's reply to the hold.
+class StopController
+{
+ public:
+  typedef boost::function<void(uint32_t event, double a0, double a1)> LogCallback;
+
+  StopController()
+  : joint_state_buffer_(NULL),
+    hold_time_(0.1),
+    budget_(0.009),
+    is_warm_(false),
+    late_(0),
+    stopped_(false),
+    pending_(false),
+    commands_(0)
+  {
+  }
+
+  ~StopController()
+  {
+    if (spinner_) spinner_->stop();
+  }
+
+  void init(ros::NodeHandle node_handle, const std::vector<std::string> &joint_name,
+            const JointStateBuffer *joint_state_buffer, double hold_time, double budget, const LogCallback &log)
+  {
+    joint_name_ = joint_name;
+    joint_state_buffer_ = joint_state_buffer;
+    hold_time_ = hold_time;
+    budget_ = budget;
+    log_ = log;
+    hold_.init(node_handle, "goal_joint_space_path");
+
+    ros::NodeHandle stop_node_handle(node_handle);
+    stop_node_handle.setCallbackQueue(&queue_);
+    stop_sub_ = stop_node_handle.subscribe("stop", 1, &StopController::stopCallback, this);
+    spinner_.reset(new ros::AsyncSpinner(1, &queue_));
+    spinner_->start();
+  }
+
+  // A hold that does not return in timeout seconds fails, 0 for no limit
+  void setCallTimeout(double timeout)
+  {
+    std::lock_guard<std::mutex> lock(request_mutex_);
+    hold_.setDeadline(timeout);
+  }
+
+  // Any thread
+  void request(uint8_t source)
+  {
+    uint64_t start = monotonicNow();
+    std::lock_guard<std::mutex> lock(request_mutex_);
+
+    stopped_.store(true);
+    pending_.store(true);
+    uint64_t commands = commands_.load();
+    bool is_held = hold();
+    double latency = (monotonicNow() - start) * 1e-9;
+
+    // A command the sequencer was sending at the same time may have reached
+    // the controller after the hold; wait for it and hold once more
+    {
+      std::lock_guard<std::mutex> command_lock(command_mutex_);
+      if (commands_.load() != commands) is_held = hold();
+    }
+
+    if (!is_held)
+    {
+      if (log_) log_(EVENT_STOP_HOLD_FAILED, source, 0.0);
+      return;
+    }
+
+    latency_.addSample(latency);
+    if (log_) log_(EVENT_STOP_HELD, source, latency * 1e3);
+    if (latency > budget_)
+    {
+      late_++;
+      if (log_) log_(EVENT_STOP_LATE, latency * 1e3, budget_ * 1e3);
+    }
+  }
+
+  // Sequencer commands are sent between beginCommand() and endCommand(),
+  // beginCommand() returns false while stopped
+  bool beginCommand()
+  {
+    command_mutex_.lock();
+    if (!stopped_.load()) return true;
+
+    command_mutex_.unlock();
+    return false;
+  }
+
+  void endCommand()
+  {
+    commands_.fetch_add(1);
+    command_mutex_.unlock();
+  }
+
+  // Control thread: true once after each stop
+  bool consume() { return pending_.exchange(false); }
+
+  // Control thread: a new mode lifts the stop
+  void clear() { stopped_.store(false); }
+
+  bool isStopped() const { return stopped_.load(); }
+
+  // Control thread, with the arm at rest: opens the hold connection with a
+  // hold where the arm already is, so the first stop does not pay for it
+  void warmUp()
+  {
+    if (is_warm_) return;
+
+    std::lock_guard<std::mutex> lock(request_mutex_);
+    is_warm_ = hold();
+  }
+
+  // One line of the node's status screen
+  void printStatistics()
+  {
+    std::lock_guard<std::mutex> lock(request_mutex_);
+    if (latency_.count() == 0) return;
+
+    printf("Stop [ms] last: %.2lf mean: %.2lf max: %.2lf (n=%lu) over %.1lf ms budget: %lu\n",
+           latency_.last() * 1e3,
+           latency_.mean() * 1e3,
+           latency_.max() * 1e3,
+           (unsigned long)latency_.count(),
+           budget_ * 1e3,
+           (unsigned long)late_);
+  }
+
+ private:
+  void stopCallback(const std_msgs::Empty::ConstPtr &msg)
+  {
+    request(STOP_SOURCE_TOPIC);
+  }
+
+  bool hold()
+  {
+    JointSample sample;
+    if (joint_state_buffer_ == NULL || !joint_state_buffer_->latest(&sample)) return false;
+
+    open_manipulator_msgs::SetJointPosition srv;
+    makeHoldRequest(joint_name_, sample.position, hold_time_, &srv);
+    return hold_.call(srv) && srv.response.is_planned;
+  }
+
+  static uint64_t monotonicNow()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  }
+
+  std::vector<std::string> joint_name_;
+  const JointStateBuffer *joint_state_buffer_;
+  double hold_time_;  // [s]
+  double budget_;     // [s]
+  LogCallback log_;
+
+  ros::CallbackQueue queue_;
+  boost::shared_ptr<ros::AsyncSpinner> spinner_;
+  ros::Subscriber stop_sub_;
+
+  std::mutex request_mutex_;  // one stop at a time, guards the members below
+  ServiceConnection<open_manipulator_msgs::SetJointPosition> hold_;
+  bool is_warm_;
+  LatencyStatistics latency_;
+  uint64_t late_;
+
+  std::mutex command_mutex_;  // held by the sequencer while it sends a command
+  std::atomic<bool> stopped_;
+  std::atomic<bool> pending_;
+  std::atomic<uint64_t> commands_;
+};
+
+}  // namespace open_manipulator_pick_and_place
+
+#endif  // OPEN_MANIPULATOR_PICK_AND_PLACE_STOP_CONTROLLER_H
@@ -0,0 +1,270 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef OPEN_MANIPULATOR_PICK_AND_PLACE_TRACE_WRITER_H
+#define OPEN_MANIPULATOR_PICK_AND_PLACE_TRACE_WRITER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "open_manipulator_pick_and_place/event_log.h"
+
+// Trace tracks (tid in the trace file)
+#define TRACE_TRACK_CONTROL  1  // timer ticks and the service calls in them
+#define TRACE_TRACK_STEP     2  // demo steps and marker searches
+#define TRACE_TRACK_ARM      3  // arm moving
+#define TRACE_TRACK_MARKER   4  // marker messages
+
+namespace open_manipulator_pick_and_place
+{
+
+typedef struct _TraceEvent
+{
+  const char *name;      // string literals only, they are not copied
+  const char *category;
+  char phase;            // 'B' begin, 'E' end, 'X' complete, 'i' instant
+  uint8_t track;
+  uint64_t stamp;        // [ns]
+  uint64_t duration;     // [ns], 'X' only
+  const char *arg_name;  // NULL for no argument
+  double arg;
+} TraceEvent;
+
+// Span instrumentation of one demo run, written as Chrome trace event JSON
+// (chrome://tracing, ui.perfetto.dev) when the run ends. Events are kept in
+// a preallocated buffer during the run; at its end the buffer is swapped
+// with a second one, which a writer thread formats into the file, so the
+// caller does not wait for megabytes of fprintf. When tracing is off or no
+// run is active, every call returns after one branch and TraceSpan does not
+// even read the clock.
+class TraceWriter
+{
+ public:
+  static const size_t CAPACITY = 65536;
+
+  TraceWriter()
+  : enabled_(false),
+    active_(false),
+    dropped_(0),
+    run_start_(0),
+    is_pending_(false),
+    running_(false),
+    written_dropped_(0),
+    written_start_(0)
+  {
+  }
+
+  // A run handed over is still written, an active one is not
+  ~TraceWriter()
+  {
+    if (running_.exchange(false)) writer_.join();
+  }
+
+  // Runs are written to <directory>/<name>_<date>_<time>.json
+  void enable(const std::string &directory, const std::string &name)
+  {
+    directory_ = directory;
+    name_ = name;
+    event_.reserve(CAPACITY);
+    written_event_.reserve(CAPACITY);
+    enabled_ = true;
+
+    running_.store(true, std::memory_order_release);
+    writer_ = std::thread(&TraceWriter::writerLoop, this);
+  }
+
+  bool active() const { return active_.load(std::memory_order_relaxed); }
+
+  // A run still open (demo restarted) is written first
+  void beginRun()
+  {
+    if (!enabled_) return;
+    endRun();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    event_.clear();
+    dropped_ = 0;
+    run_start_ = EventLog::now();
+    active_.store(true);
+  }
+
+  // Hands the run to the writer thread and returns the file path it goes
+  // to, empty if there was no run or the one before is still being written
+  std::string endRun()
+  {
+    if (!active()) return std::string();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    active_.store(false);
+    if (is_pending_.load(std::memory_order_acquire)) return std::string();  // this run is lost
+
+    time_t sec = (time_t)(run_start_ / 1000000000ULL);
+    struct tm local;
+    localtime_r(&sec, &local);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", &local);
+
+    written_path_ = directory_ + "/" + name_ + "_" + stamp + ".json";
+    written_event_.swap(event_);
+    written_dropped_ = dropped_;
+    written_start_ = run_start_;
+    is_pending_.store(true, std::memory_order_release);
+    return written_path_;
+  }
+
+  void begin(const char *name, const char *category, uint8_t track, const char *arg_name = NULL, double arg = 0.0)
+  {
+    if (active()) add(name, category, 'B', track, EventLog::now(), 0, arg_name, arg);
+  }
+
+  void end(const char *name, const char *category, uint8_t track)
+  {
+    if (active()) add(name, category, 'E', track, EventLog::now(), 0, NULL, 0.0);
+  }
+
+  void instant(const char *name, const char *category, uint8_t track, const char *arg_name = NULL, double arg = 0.0)
+  {
+    if (active()) add(name, category, 'i', track, EventLog::now(), 0, arg_name, arg);
+  }
+
+  void complete(const char *name, const char *category, uint8_t track, uint64_t start,
+                const char *arg_name = NULL, double arg = 0.0)
+  {
+    if (active()) add(name, category, 'X', track, start, EventLog::now() - start, arg_name, arg);
+  }
+
+ private:
+  void writerLoop()
+  {
+    while (running_.load(std::memory_order_acquire) || is_pending_.load(std::memory_order_acquire))
+    {
+      if (!is_pending_.load(std::memory_order_acquire))
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        continue;
+      }
+      write();
+      written_event_.clear();
+      is_pending_.store(false, std::memory_order_release);
+    }
+  }
+
+  void write() const
+  {
+    FILE *file = fopen(written_path_.c_str(), "w");
+    if (file == NULL) return;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    const char *track_name[] = {"", "control", "demo steps", "arm", "markers"};
+    for (int track = TRACE_TRACK_CONTROL; track <= TRACE_TRACK_MARKER; track++)
+    {
+      fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n",
+              track, track_name[track]);
+      fprintf(file, "{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"sort_index\":%d}},\n",
+              track, track);
+    }
+
+    for (size_t i = 0; i < written_event_.size(); i++)
+    {
+      const TraceEvent &event = written_event_[i];
+      fprintf(file, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%.3f",
+              event.name, event.category, event.phase, event.track, (event.stamp - written_start_) * 1e-3);
+      if (event.phase == 'X') fprintf(file, ",\"dur\":%.3f", event.duration * 1e-3);
+      if (event.phase == 'i') fprintf(file, ",\"s\":\"t\"");
+      if (event.arg_name != NULL) fprintf(file, ",\"args\":{\"%s\":%g}", event.arg_name, event.arg);
+      fprintf(file, "},\n");
+    }
+
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"%s (%lu events dropped)\"}}\n]}\n",
+            name_.c_str(), (unsigned long)written_dropped_);
+    fclose(file);
+  }
+
+  void add(const char *name, const char *category, char phase, uint8_t track,
+           uint64_t stamp, uint64_t duration, const char *arg_name, double arg)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!active()) return;
+    if (event_.size() == CAPACITY)
+    {
+      dropped_++;
+      return;
+    }
+
+    TraceEvent event = {name, category, phase, track, stamp, duration, arg_name, arg};
+    event_.push_back(event);
+  }
+
+  bool enabled_;
+  std::atomic<bool> active_;
+  std::mutex mutex_;
+  std::vector<TraceEvent> event_;
+  uint64_t dropped_;
+  uint64_t run_start_;
+  std::string directory_;
+  std::string name_;
+
+  // Run handed to the writer thread, owned by it while is_pending_
+  std::atomic<bool> is_pending_;
+  std::atomic<bool> running_;
+  std::thread writer_;
+  std::vector<TraceEvent> written_event_;
+  uint64_t written_dropped_;
+  uint64_t written_start_;
+  std::string written_path_;
+};
+
+// Scoped 'X' span, e.g. a service call inside a timer tick
+class TraceSpan
+{
+ public:
+  TraceSpan(TraceWriter &writer, const char *name, const char *category, uint8_t track,
+            const char *arg_name = NULL, double arg = 0.0)
+  : writer_(writer.active() ? &writer : NULL),
+    name_(name),
+    category_(category),
+    track_(track),
+    arg_name_(arg_name),
+    arg_(arg),
+    start_(writer_ != NULL ? EventLog::now() : 0)
+  {
+  }
+
+  ~TraceSpan()
+  {
+    if (writer_ != NULL) writer_->complete(name_, category_, track_, start_, arg_name_, arg_);
+  }
+
+ private:
+  TraceWriter *writer_;
+  const char *name_;
+  const char *category_;
+  uint8_t track_;
+  const char *arg_name_;
+  double arg_;
+  uint64_t start_;
+};
+
+}  // namespace open_manipulator_pick_and_place
+
+#endif  // OPEN_MANIPULATOR_PICK_AND_PLACE_TRACE_WRITER_H
@@ -0,0 +1,339 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef OPEN_MANIPULATOR_PICK_AND_PLACE_TRAJECTORY_CLIENT_H
+#define OPEN_MANIPULATOR_PICK_AND_PLACE_TRAJECTORY_CLIENT_H
+
+#include <ros/ros.h>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <boost/function.hpp>
+
+#include "open_manipulator_msgs/SetJointPosition.h"
+#include "open_manipulator_msgs/SetKinematicsPose.h"
+
+#include "open_manipulator_pick_and_place/service_connection.h"
+
+// Goal states, as in actionlib's SimpleClientGoalState
+#define TRAJECTORY_IDLE       0  // no goal sent yet
+#define TRAJECTORY_PENDING    1  // planned, the controller has not reported moving yet
+#define TRAJECTORY_ACTIVE     2  // the controller reports moving
+#define TRAJECTORY_SUCCEEDED  3
+#define TRAJECTORY_ABORTED    4  // still moving timeout_margin after its path time
+#define TRAJECTORY_PREEMPTED  5  // cancelled, the arm holds where it was
+#define TRAJECTORY_REJECTED   6  // is_planned false
+#define TRAJECTORY_LOST       7  // the service call failed
+#define TRAJECTORY_TIMED_OUT  8  // the service call did not return by its deadline
+
+#define TRAJECTORY_NUM_OF_JOINT  4
+
+namespace open_manipulator_pick_and_place
+{
+
+typedef struct _TrajectoryFeedback
+{
+  double elapsed;      // since the goal was accepted [s]
+  double progress;     // elapsed / path_time, 0 to 1
+  double joint_error;  // largest |goal - present| of a joint goal [rad], 0 for task goals
+} TrajectoryFeedback;
+
+inline const char *trajectoryStateName(uint8_t state)
+{
+  static const char *name[] = {"idle", "pending", "active", "succeeded", "aborted", "preempted", "rejected", "lost", "timed out"};
+  return state <= TRAJECTORY_TIMED_OUT ? name[state] : "unknown";
+}
+
+// Joint space path to the given joint angles, which stops the arm where it
+// is when they are the present ones
+inline void makeHoldRequest(const std::vector<std::string> &joint_name, const double *position, double hold_time,
+                            open_manipulator_msgs::SetJointPosition *srv)
+{
+  srv->request.joint_position.joint_name = joint_name;
+  srv->request.joint_position.position.assign(position, position + TRAJECTORY_NUM_OF_JOINT);
+  srv->request.path_time = hold_time;
+}
+
+// Requests of the goal_* services, kept out of the client so that their cost
+// can be measured without a controller (node_benchmark)
+inline void makeJointRequest(const std::vector<std::string> &joint_name, const std::vector<double> &joint_angle,
+                             double path_time, open_manipulator_msgs::SetJointPosition *srv)
+{
+  srv->request.joint_position.joint_name = joint_name;
+  srv->request.joint_position.position = joint_angle;
+  srv->request.path_time = path_time;
+}
+
+inline void makeTaskRequest(const std::string &end_effector_name, const std::vector<double> &position,
+                            const std::vector<double> &orientation, double path_time,
+                            open_manipulator_msgs::SetKinematicsPose *srv)
+{
+  srv->request.end_effector_name = end_effector_name;
+  srv->request.kinematics_pose.pose.position.x = position.at(0);
+  srv->request.kinematics_pose.pose.position.y = position.at(1);
+  srv->request.kinematics_pose.pose.position.z = position.at(2);
+  srv->request.kinematics_pose.pose.orientation.w = orientation.at(0);
+  srv->request.kinematics_pose.pose.orientation.x = orientation.at(1);
+  srv->request.kinematics_pose.pose.orientation.y = orientation.at(2);
+  srv->request.kinematics_pose.pose.orientation.z = orientation.at(3);
+  srv->request.path_time = path_time;
+}
+
+inline void makeToolRequest(const std::vector<double> &tool_value, open_manipulator_msgs::SetJointPosition *srv)
+{
+  srv->request.joint_position.joint_name.assign(1, "gripper");
+  srv->request.joint_position.position = tool_value;
+}
+
+// Action style goals on top of the controller's goal_* services, which only
+// plan a path and return. A goal is accepted when the service plans it; it
+// becomes active when the states topic reports moving and succeeds when it
+// reports stopped (or, for a path too short to be seen moving, when its path
+// time has passed). Feedback comes with every update() and joint state.
+// cancelGoal() preempts the goal by commanding the present joint angles.
+// Tool goals only set the gripper and are not tracked; the demo paces them
+// with a joint goal. One goal at a time: a new goal preempts the old one.
+class TrajectoryClient
+{
+ public:
+  typedef boost::function<void(uint8_t state, const TrajectoryFeedback &feedback)> DoneCallback;
+  typedef boost::function<void(const TrajectoryFeedback &feedback)> FeedbackCallback;
+
+  TrajectoryClient()
+  : state_(TRAJECTORY_IDLE),
+    is_joint_goal_(false),
+    path_time_(0.0),
+    start_time_(0.0),
+    timeout_margin_(2.0),
+    hold_time_(0.1)
+  {
+    for (int i = 0; i < TRAJECTORY_NUM_OF_JOINT; i++)
+    {
+      goal_[i] = 0.0;
+      present_[i] = 0.0;
+    }
+    feedback_.elapsed = feedback_.progress = feedback_.joint_error = 0.0;
+  }
+
+  void init(ros::NodeHandle node_handle, const std::vector<std::string> &joint_name,
+            double timeout_margin, double hold_time)
+  {
+    joint_name_ = joint_name;
+    timeout_margin_ = timeout_margin;
+    hold_time_ = hold_time;
+    joint_space_path_.init(node_handle, "goal_joint_space_path");
+    tool_control_.init(node_handle, "goal_tool_control");
+    task_space_path_.init(node_handle, "goal_task_space_path");
+  }
+
+  // Service calls longer than timeout seconds fail with TRAJECTORY_TIMED_OUT,
+  // 0 for no limit
+  void setCallTimeout(double timeout)
+  {
+    joint_space_path_.setDeadline(timeout);
+    tool_control_.setDeadline(timeout);
+    task_space_path_.setDeadline(timeout);
+  }
+
+  void registerCallbacks(const DoneCallback &done, const FeedbackCallback &feedback)
+  {
+    done_callback_ = done;
+    feedback_callback_ = feedback;
+  }
+
+  // Commands sent before the controller is up would fail silently
+  bool waitForServer(double timeout)
+  {
+    if (!joint_space_path_.waitForService(timeout) ||
+        !tool_control_.waitForService(timeout) ||
+        !task_space_path_.waitForService(timeout))
+      return false;
+
+    // An empty tool command opens the connection without moving the gripper;
+    // the path services have no such request and connect on their first goal
+    open_manipulator_msgs::SetJointPosition srv;
+    return tool_control_.warmUp(srv);
+  }
+
+  // Returns TRAJECTORY_PENDING, TRAJECTORY_REJECTED, TRAJECTORY_LOST or TRAJECTORY_TIMED_OUT
+  uint8_t sendJointGoal(const std::vector<std::string> &joint_name, const std::vector<double> &joint_angle,
+                        double path_time, double now)
+  {
+    open_manipulator_msgs::SetJointPosition srv;
+    makeJointRequest(joint_name, joint_angle, path_time, &srv);
+
+    finish(TRAJECTORY_PREEMPTED, now);
+    if (!joint_space_path_.call(srv)) return failedState(joint_space_path_);
+    if (!srv.response.is_planned) return TRAJECTORY_REJECTED;
+
+    is_joint_goal_ = true;
+    for (int i = 0; i < TRAJECTORY_NUM_OF_JOINT && i < (int)joint_angle.size(); i++)
+      goal_[i] = joint_angle[i];
+    accept(path_time, now);
+    return state_;
+  }
+
+  uint8_t sendTaskGoal(const std::string &end_effector_name, const std::vector<double> &position,
+                       const std::vector<double> &orientation, double path_time, double now)
+  {
+    open_manipulator_msgs::SetKinematicsPose srv;
+    makeTaskRequest(end_effector_name, position, orientation, path_time, &srv);
+
+    finish(TRAJECTORY_PREEMPTED, now);
+    if (!task_space_path_.call(srv)) return failedState(task_space_path_);
+    if (!srv.response.is_planned) return TRAJECTORY_REJECTED;
+
+    is_joint_goal_ = false;
+    accept(path_time, now);
+    return state_;
+  }
+
+  // Not tracked, returns TRAJECTORY_SUCCEEDED, TRAJECTORY_REJECTED, TRAJECTORY_LOST or TRAJECTORY_TIMED_OUT
+  uint8_t sendToolGoal(const std::vector<double> &tool_value)
+  {
+    open_manipulator_msgs::SetJointPosition srv;
+    makeToolRequest(tool_value, &srv);
+
+    if (!tool_control_.call(srv)) return failedState(tool_control_);
+    return srv.response.is_planned ? TRAJECTORY_SUCCEEDED : TRAJECTORY_REJECTED;
+  }
+
+  // Holds the arm at the present joint angles, false if no goal was in flight
+  bool cancelGoal(double now)
+  {
+    if (!isBusy()) return false;
+
+    finish(TRAJECTORY_PREEMPTED, now);
+    open_manipulator_msgs::SetJointPosition srv;
+    makeHoldRequest(joint_name_, present_, hold_time_, &srv);
+    joint_space_path_.call(srv);
+    return true;
+  }
+
+  // Marks the goal preempted when the arm was stopped by someone else
+  // (StopController), false if no goal was in flight
+  bool preemptGoal(double now)
+  {
+    if (!isBusy()) return false;
+
+    finish(TRAJECTORY_PREEMPTED, now);
+    return true;
+  }
+
+  // From the states topic
+  void movingState(bool is_moving, double now)
+  {
+    if (is_moving && state_ == TRAJECTORY_PENDING)
+      state_ = TRAJECTORY_ACTIVE;
+    else if (!is_moving && state_ == TRAJECTORY_ACTIVE)
+      finish(TRAJECTORY_SUCCEEDED, now);
+  }
+
+  // From the joint states, joint1 to joint4
+  void jointState(const double *position, double now)
+  {
+    for (int i = 0; i < TRAJECTORY_NUM_OF_JOINT; i++)
+      present_[i] = position[i];
+    if (isBusy()) publishFeedback(now);
+  }
+
+  // Once per control tick: feedback, short paths and timeouts
+  void update(double now)
+  {
+    if (!isBusy()) return;
+
+    publishFeedback(now);
+    double elapsed = now - start_time_;
+    if (state_ == TRAJECTORY_PENDING && elapsed >= path_time_)
+      finish(TRAJECTORY_SUCCEEDED, now);
+    else if (state_ == TRAJECTORY_ACTIVE && elapsed > path_time_ + timeout_margin_)
+      finish(TRAJECTORY_ABORTED, now);
+  }
+
+  uint8_t state() const { return state_; }
+  bool isBusy() const { return state_ == TRAJECTORY_PENDING || state_ == TRAJECTORY_ACTIVE; }
+  const TrajectoryFeedback &feedback() const { return feedback_; }
+  double pathTime() const { return path_time_; }
+
+  const ServiceConnection<open_manipulator_msgs::SetJointPosition> &jointSpacePath() const { return joint_space_path_; }
+  const ServiceConnection<open_manipulator_msgs::SetJointPosition> &toolControl() const { return tool_control_; }
+  const ServiceConnection<open_manipulator_msgs::SetKinematicsPose> &taskSpacePath() const { return task_space_path_; }
+
+ private:
+  template <class Service>
+  static uint8_t failedState(const ServiceConnection<Service> &connection)
+  {
+    return connection.isTimedOut() ? TRAJECTORY_TIMED_OUT : TRAJECTORY_LOST;
+  }
+
+  void accept(double path_time, double now)
+  {
+    state_ = TRAJECTORY_PENDING;
+    path_time_ = path_time;
+    start_time_ = now;
+    publishFeedback(now);
+  }
+
+  void finish(uint8_t state, double now)
+  {
+    if (!isBusy()) return;
+
+    state_ = state;
+    updateFeedback(now);
+    if (done_callback_) done_callback_(state_, feedback_);
+  }
+
+  void updateFeedback(double now)
+  {
+    feedback_.elapsed = now - start_time_;
+    feedback_.progress = path_time_ > 0.0 ? std::min(1.0, std::max(0.0, feedback_.elapsed / path_time_)) : 1.0;
+    feedback_.joint_error = 0.0;
+    if (is_joint_goal_)
+    {
+      for (int i = 0; i < TRAJECTORY_NUM_OF_JOINT; i++)
+        feedback_.joint_error = std::max(feedback_.joint_error, std::fabs(goal_[i] - present_[i]));
+    }
+  }
+
+  void publishFeedback(double now)
+  {
+    updateFeedback(now);
+    if (feedback_callback_) feedback_callback_(feedback_);
+  }
+
+  ServiceConnection<open_manipulator_msgs::SetJointPosition> joint_space_path_;
+  ServiceConnection<open_manipulator_msgs::SetJointPosition> tool_control_;
+  ServiceConnection<open_manipulator_msgs::SetKinematicsPose> task_space_path_;
+  std::vector<std::string> joint_name_;
+
+  uint8_t state_;
+  bool is_joint_goal_;
+  double goal_[TRAJECTORY_NUM_OF_JOINT];
+  double present_[TRAJECTORY_NUM_OF_JOINT];
+  double path_time_;       // [s]
+  double start_time_;      // [s]
+  double timeout_margin_;  // [s]
+  double hold_time_;       // path time of the hold command [s]
+  TrajectoryFeedback feedback_;
+
+  DoneCallback done_callback_;
+  FeedbackCallback feedback_callback_;
+};
+
+}  // namespace open_manipulator_pick_and_place
+
+#endif  // OPEN_MANIPULATOR_PICK_AND_PLACE_TRAJECTORY_CLIENT_H
@@ -0,0 +1,306 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#ifndef OPEN_MANIPULATOR_PICK_AND_PLACE_VOXEL_GRID_H
+#define OPEN_MANIPULATOR_PICK_AND_PLACE_VOXEL_GRID_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include "open_manipulator_pick_and_place/arm_kinematics.h"
+
+namespace open_manipulator_pick_and_place
+{
+
+typedef struct _VoxelGridConfig
+{
+  double origin[3];     // world corner of cell (0, 0, 0) [m]
+  int size[3];          // cells along x y z
+  double resolution;    // cell side [m]
+  double floor_height;  // points below are the table, not obstacles [m]
+  double min_depth;     // nearer points are the gripper or the held box [m]
+  double max_depth;     // [m]
+  int stride;           // every stride-th pixel of every stride-th row
+  uint8_t hit;          // added to a cell seen occupied in a frame
+  uint8_t max_value;
+  uint8_t threshold;    // occupied from this value
+  double decay_time;    // a full cell fades out in this time unseen [s]
+} VoxelGridConfig;
+
+inline VoxelGridConfig defaultVoxelGridConfig()
+{
+  // Reach of the arm over the table, 1 cm cells: 50 x 70 x 35 cells, 120 kB
+  VoxelGridConfig config = {{-0.10, -0.35, 0.0}, {50, 70, 35}, 0.01, 0.01, 0.15, 1.0, 4, 3, 30, 6, 10.0};
+  return config;
+}
+
+// Fixed memory occupancy grid of the workspace built from depth frames, for
+// what the markers do not show: boxes stacked in earlier cycles and foreign
+// objects. A seen surface fills its column down to the floor, as things on
+// the table are solid below their tops. Cells count up when a frame sees
+// them and fade out over decay_time, so there is no ray casting to clear
+// free space and an object taken away is forgotten after a while. Frames
+// are voxelised a row at a time over plain arrays, in loops gcc vectorises on
+// x86 and ARM at -O3, at which CMakeLists.txt builds voxel_grid.cpp alone.
+class VoxelGrid
+{
+ public:
+  VoxelGrid() : frame_(0), decay_remainder_(0.0), last_decay_(0.0), ray_fx_(0.0), ray_cx_(0.0)
+  {
+    configure(defaultVoxelGridConfig());
+  }
+
+  void configure(const VoxelGridConfig &config)
+  {
+    config_ = config;
+    size_t cells = (size_t)config.size[0] * config.size[1] * config.size[2];
+    value_.assign(cells, 0);
+    seen_.assign(cells, 0);
+  }
+
+  const VoxelGridConfig &config() const { return config_; }
+
+  // Depth in the optical frame of fx fy cx cy, camera_to_world at its
+  // capture time; 16UC1 in units of scale [m] or 32FC1 with scale 1. Built
+  // for uint16_t and float in voxel_grid.cpp
+  template <typename T>
+  void insert(const T *data, int width, int height, size_t step, double scale,
+              double fx, double fy, double cx, double cy,
+              const RigidTransform &camera_to_world, double stamp);
+
+  // Below floor_height is the table, occupied as well
+  bool isOccupied(int ix, int iy, int iz) const
+  {
+    if (ix < 0 || ix >= config_.size[0] || iy < 0 || iy >= config_.size[1] || iz >= config_.size[2]) return false;
+    if (iz < floorLayer()) return true;
+    return value_[((size_t)iz * config_.size[1] + iy) * config_.size[0] + ix] >= config_.threshold;
+  }
+
+  size_t numOfOccupied() const
+  {
+    size_t count = 0;
+    for (size_t i = std::max(0, floorLayer()) * (size_t)config_.size[0] * config_.size[1]; i < value_.size(); i++)
+      count += value_[i] >= config_.threshold;
+    return count;
+  }
+
+  // Walks the cells the segment a -> b passes (3D DDA) and checks each with
+  // inflation cells around it. Cells within ignore_radius of either ignore
+  // point are not obstacles: the box being picked or placed on and the spot
+  // it left. Distance along the segment of the first occupied cell in
+  // *blocked_at.
+  bool isSegmentFree(const double a[3], const double b[3], int inflation,
+                     const double ignore[2][3], double ignore_radius, double *blocked_at = NULL) const
+  {
+    double direction[3], length = 0.0;
+    for (int i = 0; i < 3; i++)
+    {
+      direction[i] = b[i] - a[i];
+      length += direction[i] * direction[i];
+    }
+    length = sqrt(length);
+
+    int cell[3], step[3], end[3];
+    double t_max[3], t_delta[3];
+    for (int i = 0; i < 3; i++)
+    {
+      double position = (a[i] - config_.origin[i]) / config_.resolution;
+      double target = (b[i] - config_.origin[i]) / config_.resolution;
+      cell[i] = (int)floor(position);
+      end[i] = (int)floor(target);
+      double delta = target - position;
+      step[i] = delta > 0.0 ? 1 : (delta < 0.0 ? -1 : 0);
+      t_delta[i] = step[i] != 0 ? 1.0 / fabs(delta) : INFINITY;
+      double boundary = step[i] > 0 ? cell[i] + 1.0 - position : position - cell[i];
+      t_max[i] = step[i] != 0 ? boundary * t_delta[i] : INFINITY;
+    }
+
+    // Bounded by the number of cells crossed, whatever rounding does
+    int max_steps = abs(end[0] - cell[0]) + abs(end[1] - cell[1]) + abs(end[2] - cell[2]) + 1;
+    double t = 0.0;
+    for (int n = 0; n < max_steps; n++)
+    {
+      if (isBlocked(cell, inflation, ignore, ignore_radius))
+      {
+        if (blocked_at != NULL) *blocked_at = t * length;
+        return false;
+      }
+
+      int axis = t_max[0] < t_max[1] ? (t_max[0] < t_max[2] ? 0 : 2) : (t_max[1] < t_max[2] ? 1 : 2);
+      if (t_max[axis] > 1.0) break;
+      t = t_max[axis];
+      cell[axis] += step[axis];
+      t_max[axis] += t_delta[axis];
+    }
+    return true;
+  }
+
+  void clear()
+  {
+    std::fill(value_.begin(), value_.end(), 0);
+  }
+
+  // Cells of a grid filled on another thread, for readers that must not
+  // wait for its insert(); a plain copy once the sizes match
+  void copyCells(const VoxelGrid &other)
+  {
+    config_ = other.config_;
+    value_ = other.value_;
+  }
+
+ private:
+  int floorLayer() const
+  {
+    return (int)floor((config_.floor_height - config_.origin[2]) / config_.resolution);
+  }
+
+  // Fades every cell by decay_time's share of the time since the last frame
+  void decay(double stamp)
+  {
+    if (last_decay_ <= 0.0 || stamp <= last_decay_ || config_.decay_time <= 0.0)
+    {
+      if (stamp > last_decay_) last_decay_ = stamp;
+      return;
+    }
+
+    decay_remainder_ += (stamp - last_decay_) / config_.decay_time * config_.max_value;
+    last_decay_ = stamp;
+    if (decay_remainder_ < 1.0) return;
+
+    int amount = decay_remainder_ > 255.0 ? 255 : (int)decay_remainder_;
+    decay_remainder_ -= amount;
+    const uint8_t d = (uint8_t)amount;
+    uint8_t *value = &value_[0];
+    for (size_t i = 0; i < value_.size(); i++)
+      value[i] = value[i] > d ? value[i] - d : 0;  // saturating subtract, vectorised
+  }
+
+  bool isBlocked(const int cell[3], int inflation, const double ignore[2][3], double ignore_radius) const
+  {
+    for (int dz = -inflation; dz <= inflation; dz++)
+    {
+      for (int dy = -inflation; dy <= inflation; dy++)
+      {
+        for (int dx = -inflation; dx <= inflation; dx++)
+        {
+          if (!isOccupied(cell[0] + dx, cell[1] + dy, cell[2] + dz)) continue;
+
+          double center[3] = {config_.origin[0] + (cell[0] + dx + 0.5) * config_.resolution,
+                              config_.origin[1] + (cell[1] + dy + 0.5) * config_.resolution,
+                              config_.origin[2] + (cell[2] + dz + 0.5) * config_.resolution};
+          if (distance(center, ignore[0]) > ignore_radius && distance(center, ignore[1]) > ignore_radius) return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  static double distance(const double a[3], const double b[3])
+  {
+    return sqrt((a[0] - b[0]) * (a[0] - b[0]) + (a[1] - b[1]) * (a[1] - b[1]) + (a[2] - b[2]) * (a[2] - b[2]));
+  }
+
+  VoxelGridConfig config_;
+  std::vector<uint8_t> value_;
+  std::vector<uint8_t> seen_;  // frame that last counted the cell
+  uint8_t frame_;
+  double decay_remainder_;
+  double last_decay_;
+
+  // Row buffers of insert(), kept between frames
+  std::vector<float> ray_x_;
+  double ray_fx_;
+  double ray_cx_;
+  std::vector<float> depth_;
+  std::vector<int32_t> cell_;
+};
+
+inline void toolPoint(const ArmKinematics &kinematics, const double joint[4], double point[3])
+{
+  const double offset[3] = {ARM_TOOL_OFFSET, 0.0, 0.0};
+  transformPoint(kinematics.link5ToWorld(joint), offset, point);
+}
+
+// The controller moves every joint on the same time scaling, so a joint
+// space path is the straight line in joint space. The tool point and link5
+// are checked along it as segments between num_of_step poses, near the
+// tool's start and goal is not an obstacle. *blocked_at is the path's
+// progress (0 to 1) at the first blocked segment.
+inline bool isJointPathFree(const VoxelGrid &grid, const ArmKinematics &kinematics,
+                            const double start[4], const double goal[4], int num_of_step,
+                            int inflation, double ignore_radius, double *blocked_at = NULL)
+{
+  double ignore[2][3];
+  toolPoint(kinematics, start, ignore[0]);
+  toolPoint(kinematics, goal, ignore[1]);
+
+  const double origin[3] = {0.0, 0.0, 0.0};
+  double last_tool[3], last_link5[3];
+  toolPoint(kinematics, start, last_tool);
+  transformPoint(kinematics.link5ToWorld(start), origin, last_link5);
+  for (int n = 1; n <= num_of_step; n++)
+  {
+    double joint[4], tool[3], link5[3];
+    for (int i = 0; i < 4; i++)
+      joint[i] = start[i] + (goal[i] - start[i]) * n / num_of_step;
+    toolPoint(kinematics, joint, tool);
+    transformPoint(kinematics.link5ToWorld(joint), origin, link5);
+
+    if (!grid.isSegmentFree(last_tool, tool, inflation, ignore, ignore_radius) ||
+        !grid.isSegmentFree(last_link5, link5, inflation, ignore, ignore_radius))
+    {
+      if (blocked_at != NULL) *blocked_at = (n - 1.0) / num_of_step;
+      return false;
+    }
+    for (int i = 0; i < 3; i++)
+    {
+      last_tool[i] = tool[i];
+      last_link5[i] = link5[i];
+    }
+  }
+  return true;
+}
+
+// A task space path moves the tool point on the straight line
+inline bool isTaskPathFree(const VoxelGrid &grid, const ArmKinematics &kinematics,
+                           const double start[4], const double position[3],
+                           int inflation, double ignore_radius, double *blocked_at = NULL)
+{
+  double ignore[2][3];
+  toolPoint(kinematics, start, ignore[0]);
+  for (int i = 0; i < 3; i++)
+    ignore[1][i] = position[i];
+
+  double length = 0.0;
+  if (grid.isSegmentFree(ignore[0], position, inflation, ignore, ignore_radius, &length)) return true;
+
+  if (blocked_at != NULL)
+  {
+    double total = sqrt((position[0] - ignore[0][0]) * (position[0] - ignore[0][0]) +
+                        (position[1] - ignore[0][1]) * (position[1] - ignore[0][1]) +
+                        (position[2] - ignore[0][2]) * (position[2] - ignore[0][2]));
+    *blocked_at = total > 0.0 ? length / total : 0.0;
+  }
+  return false;
+}
+
+}  // namespace open_manipulator_pick_and_place
+
+#endif  // OPEN_MANIPULATOR_PICK_AND_PLACE_VOXEL_GRID_H
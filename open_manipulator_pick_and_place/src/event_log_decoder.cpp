@@ -0,0 +1,109 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include "open_manipulator_pick_and_place/event_log.h"
+#include "open_manipulator_pick_and_place/flight_recorder.h"
+
+// Prints a binary event log written by EventLog, a flight recorder dump or
+// a flight recorder ring (<name>.ring) as text.
+// usage: event_log_decoder <event log file>
+int main(int argc, char **argv)
+{
+  using namespace open_manipulator_pick_and_place;
+
+  if (argc < 2)
+  {
+    printf("usage: %s <event log file>\n", argv[0]);
+    return 1;
+  }
+
+  FILE *file = fopen(argv[1], "rb");
+  if (file == NULL)
+  {
+    printf("Cannot open %s\n", argv[1]);
+    return 1;
+  }
+
+  EventLogHeader header;
+  if (fread(&header, sizeof(header), 1, file) != 1)
+  {
+    printf("%s is not an event log\n", argv[1]);
+    fclose(file);
+    return 1;
+  }
+
+  // A flight recorder ring holds the records in a circle starting after head
+  bool is_ring = strncmp(header.magic, FLIGHT_RECORDER_MAGIC, sizeof(header.magic)) == 0;
+  uint64_t head = 0;
+  uint32_t capacity = 0;
+  if (is_ring)
+  {
+    FlightRecorderHeader ring;
+    rewind(file);
+    if (fread(&ring, sizeof(ring), 1, file) != 1 || ring.capacity == 0)
+    {
+      printf("%s is a truncated flight recorder ring\n", argv[1]);
+      fclose(file);
+      return 1;
+    }
+    head = ring.head.load();
+    capacity = ring.capacity;
+  }
+  else if (strncmp(header.magic, EVENT_LOG_MAGIC, sizeof(header.magic)) != 0)
+  {
+    printf("%s is not an event log\n", argv[1]);
+    fclose(file);
+    return 1;
+  }
+
+  if (header.version != EVENT_LOG_VERSION || header.record_size != sizeof(EventRecord))
+  {
+    printf("Unsupported event log version %u (record size %u)\n", header.version, header.record_size);
+    fclose(file);
+    return 1;
+  }
+
+  long data = ftell(file);
+  uint64_t first = (is_ring && head > capacity) ? head - capacity : 0;
+  EventRecord record;
+  char text[256];
+  unsigned long count = 0;
+  for (uint64_t position = first; !is_ring || position < head; position++)
+  {
+    if (is_ring) fseek(file, data + (long)((position % capacity) * sizeof(EventRecord)), SEEK_SET);
+    if (fread(&record, sizeof(record), 1, file) != 1) break;
+
+    time_t sec = (time_t)(record.stamp / 1000000000ULL);
+    struct tm local;
+    localtime_r(&sec, &local);
+    char clock[16];
+    strftime(clock, sizeof(clock), "%H:%M:%S", &local);
+
+    const EventInfo &info = eventInfo(record.event);
+    formatEvent(record, text, sizeof(text));
+    printf("%s.%06lu [%s] %s: %s\n", clock, (unsigned long)(record.stamp % 1000000000ULL / 1000),
+           eventLevelName(info.level), info.name, text);
+    count++;
+  }
+
+  printf("%lu records\n", count);
+  fclose(file);
+  return 0;
+}
@@ -0,0 +1,426 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#include <ros/ros.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ar_track_alvar_msgs/AlvarMarkers.h"
+#include "diagnostic_msgs/DiagnosticArray.h"
+#include "open_manipulator_msgs/KinematicsPose.h"
+#include "open_manipulator_msgs/OpenManipulatorState.h"
+#include "sensor_msgs/JointState.h"
+
+#include "open_manipulator_pick_and_place/load_monitor.h"
+
+// One row of the capacity curve
+typedef struct _LoadStep
+{
+  double scale;
+  double rate[NUM_OF_LOAD_TOPIC];        // achieved [Hz]
+  double drop[NUM_OF_LOAD_TOPIC];        // sent but never received, 0 to 1
+  double latency_max[NUM_OF_LOAD_TOPIC]; // [ms]
+  double overruns;
+  double tick_duration_max;              // [ms]
+  double tick_late_max;                  // [ms]
+  bool is_saturated;
+} LoadStep;
+
+// Stress test of the pick and place node: floods joint_states, states,
+// gripper/kinematics_pose and the marker topic at the base rates times each
+// of ~scales, and reads back from the node's load statistics (/diagnostics,
+// ~load_statistics_period) what its subscriber queues dropped, how late the
+// messages were handled and whether the control tick overran. A step is
+// saturated when a topic lost more than ~max_drop_ratio or a tick overran.
+// The curve goes to ~output as CSV; with ~required_scale the exit code is 2
+// when the node saturates below it, for the release gate.
+class LoadGenerator
+{
+ public:
+  LoadGenerator()
+  : priv_node_handle_("~"),
+    is_running_(true),
+    is_collecting_(false),
+    has_statistics_(false)
+  {
+    const char *rate_param[NUM_OF_LOAD_TOPIC] = {"joint_states_rate", "states_rate", "kinematics_pose_rate", "marker_rate"};
+    const double default_rate[NUM_OF_LOAD_TOPIC] = {100.0, 100.0, 100.0, 30.0};
+    for (int i = 0; i < NUM_OF_LOAD_TOPIC; i++)
+    {
+      base_rate_[i] = priv_node_handle_.param<double>(rate_param[i], default_rate[i]);
+      rate_[i] = 0.0;
+      sent_[i].store(0);
+    }
+
+    std::vector<double> default_scales;
+    for (double scale = 1.0; scale <= 64.0; scale *= 2.0)
+      default_scales.push_back(scale);
+    priv_node_handle_.param("scales", scales_, default_scales);
+    step_time_ = priv_node_handle_.param<double>("step_time", 5.0);
+    drain_time_ = priv_node_handle_.param<double>("drain_time", 2.0);
+    max_drop_ratio_ = priv_node_handle_.param<double>("max_drop_ratio", 0.01);
+    stop_at_saturation_ = priv_node_handle_.param<bool>("stop_at_saturation", true);
+    required_scale_ = priv_node_handle_.param<double>("required_scale", 0.0);
+    output_ = priv_node_handle_.param<std::string>("output", "");
+
+    makeMessages(priv_node_handle_.param<int>("markers_per_message", 8),
+                 priv_node_handle_.param<std::string>("marker_frame", "world"));
+
+    int queue_size = priv_node_handle_.param<int>("queue_size", 1000);  // so that the node's queues are what drops
+    pub_[LOAD_TOPIC_JOINT_STATES] = node_handle_.advertise<sensor_msgs::JointState>("joint_states", queue_size);
+    pub_[LOAD_TOPIC_STATES] = node_handle_.advertise<open_manipulator_msgs::OpenManipulatorState>("states", queue_size);
+    pub_[LOAD_TOPIC_KINEMATICS_POSE] = node_handle_.advertise<open_manipulator_msgs::KinematicsPose>("gripper/kinematics_pose", queue_size);
+    pub_[LOAD_TOPIC_AR_POSE_MARKER] = node_handle_.advertise<ar_track_alvar_msgs::AlvarMarkers>(
+        priv_node_handle_.param<std::string>("marker_topic", "/ar_pose_marker"), queue_size);
+
+    diagnostics_sub_ = node_handle_.subscribe("/diagnostics", 100, &LoadGenerator::diagnosticsCallback, this);
+    sender_ = std::thread(&LoadGenerator::sendLoop, this);
+  }
+
+  ~LoadGenerator()
+  {
+    is_running_.store(false);
+    if (sender_.joinable()) sender_.join();
+  }
+
+  // Returns the exit code
+  int run()
+  {
+    if (!waitForStatistics(10.0))
+    {
+      ROS_ERROR("No load statistics on /diagnostics, start the node with load_statistics_period > 0");
+      return 1;
+    }
+
+    printf("%8s %10s %10s %10s %10s %9s %9s %9s %9s %10s %9s %9s %9s\n",
+           "scale", "joint [Hz]", "states", "pose", "markers", "drop j %", "drop s %", "drop p %", "drop m %",
+           "lat max ms", "overruns", "tick ms", "late ms");
+
+    std::vector<LoadStep> curve;
+    for (size_t s = 0; s < scales_.size() && ros::ok(); s++)
+    {
+      LoadStep step = runStep(scales_[s]);
+      curve.push_back(step);
+
+      double latency_max = *std::max_element(step.latency_max, step.latency_max + NUM_OF_LOAD_TOPIC);
+      printf("%8.1f %10.1f %10.1f %10.1f %10.1f %9.2f %9.2f %9.2f %9.2f %10.2f %9.0f %9.2f %9.2f%s\n",
+             step.scale, step.rate[0], step.rate[1], step.rate[2], step.rate[3],
+             step.drop[0] * 100.0, step.drop[1] * 100.0, step.drop[2] * 100.0, step.drop[3] * 100.0,
+             latency_max, step.overruns, step.tick_duration_max, step.tick_late_max,
+             step.is_saturated ? "  SATURATED" : "");
+      fflush(stdout);
+
+      if (step.is_saturated && stop_at_saturation_) break;
+    }
+
+    double capacity = 0.0;  // highest scale before the first saturated step
+    for (size_t s = 0; s < curve.size() && !curve[s].is_saturated; s++)
+      capacity = curve[s].scale;
+    printf("Capacity: %.1fx the base rates (joint_states %.0f Hz, states %.0f Hz, markers %.0f Hz of %zu)\n",
+           capacity, base_rate_[LOAD_TOPIC_JOINT_STATES] * capacity, base_rate_[LOAD_TOPIC_STATES] * capacity,
+           base_rate_[LOAD_TOPIC_AR_POSE_MARKER] * capacity, markers_.markers.size());
+
+    if (!output_.empty() && !writeCurve(curve)) return 1;
+    if (required_scale_ > 0.0 && capacity < required_scale_)
+    {
+      printf("Below the required %.1fx\n", required_scale_);
+      return 2;
+    }
+    return 0;
+  }
+
+ private:
+  typedef std::map<std::string, double> Statistics;
+
+  void makeMessages(int markers_per_message, const std::string &marker_frame)
+  {
+    const char *joint_name[5] = {"joint1", "joint2", "joint3", "joint4", "gripper"};
+    joint_states_.name.assign(joint_name, joint_name + 5);
+    joint_states_.position.assign(5, 0.0);
+    joint_states_.position[1] = -0.80;
+    joint_states_.position[3] = 1.90;
+
+    states_.open_manipulator_moving_state = states_.STOPPED;
+    states_.open_manipulator_actuator_state = states_.ACTUATOR_ENABLED;
+
+    kinematics_pose_.pose.position.x = 0.2;
+    kinematics_pose_.pose.position.z = 0.2;
+
+    markers_.header.frame_id = marker_frame;
+    for (int i = 0; i < markers_per_message; i++)
+    {
+      ar_track_alvar_msgs::AlvarMarker marker;
+      marker.id = i;
+      marker.header.frame_id = marker_frame;
+      marker.pose.pose.position.x = 0.15 + 0.02 * (i % 8);
+      marker.pose.pose.position.y = -0.08 + 0.02 * (i / 8);
+      marker.pose.pose.orientation.w = 1.0;
+      markers_.markers.push_back(marker);
+    }
+  }
+
+  // Sender thread: every topic at its own rate, stamped when sent
+  void sendLoop()
+  {
+    double next[NUM_OF_LOAD_TOPIC] = {0.0, 0.0, 0.0, 0.0};
+    while (is_running_.load())
+    {
+      double now = monotonicTime();
+      double wake = now + 0.001;
+      {
+        std::lock_guard<std::mutex> lock(rate_mutex_);
+        for (int i = 0; i < NUM_OF_LOAD_TOPIC; i++)
+        {
+          if (rate_[i] <= 0.0) continue;
+          if (next[i] == 0.0 || next[i] < now - 0.1) next[i] = now;  // started, or too far behind to catch up
+          if (now >= next[i])
+          {
+            send(i);
+            next[i] += 1.0 / rate_[i];
+          }
+          wake = std::min(wake, next[i]);
+        }
+        if (rate_[0] <= 0.0 && rate_[1] <= 0.0 && rate_[2] <= 0.0 && rate_[3] <= 0.0)
+          next[0] = next[1] = next[2] = next[3] = 0.0;
+      }
+      sleepUntil(wake);
+    }
+  }
+
+  void send(int topic)
+  {
+    ros::Time stamp = ros::Time::now();
+    switch (topic)
+    {
+      case LOAD_TOPIC_JOINT_STATES:
+        joint_states_.header.stamp = stamp;
+        pub_[topic].publish(joint_states_);
+        break;
+      case LOAD_TOPIC_STATES:
+        pub_[topic].publish(states_);
+        break;
+      case LOAD_TOPIC_KINEMATICS_POSE:
+        pub_[topic].publish(kinematics_pose_);
+        break;
+      case LOAD_TOPIC_AR_POSE_MARKER:
+        markers_.header.stamp = stamp;
+        for (size_t m = 0; m < markers_.markers.size(); m++)
+          markers_.markers[m].header.stamp = stamp;
+        pub_[topic].publish(markers_);
+        break;
+    }
+    sent_[topic].fetch_add(1);
+  }
+
+  LoadStep runStep(double scale)
+  {
+    Statistics start = latestStatistics();
+    uint64_t sent_start[NUM_OF_LOAD_TOPIC];
+    for (int i = 0; i < NUM_OF_LOAD_TOPIC; i++)
+      sent_start[i] = sent_[i].load();
+
+    beginCollecting();
+    setRates(scale);
+    ros::WallDuration(step_time_).sleep();
+    setRates(0.0);
+
+    // Until the node has handled its backlog and reported it
+    ros::WallDuration(drain_time_).sleep();
+    Statistics end = latestStatistics();
+    Statistics window = endCollecting();
+
+    static const char *topic_name[NUM_OF_LOAD_TOPIC] = {"joint_states", "states", "kinematics_pose", "ar_pose_marker"};
+    LoadStep step;
+    step.scale = scale;
+    step.is_saturated = false;
+    for (int i = 0; i < NUM_OF_LOAD_TOPIC; i++)
+    {
+      std::string key = std::string(topic_name[i]) + " received";
+      double sent = (double)(sent_[i].load() - sent_start[i]);
+      double received = end[key] - start[key];
+      step.rate[i] = sent / step_time_;
+      step.drop[i] = sent > 0.0 ? std::max(0.0, sent - received) / sent : 0.0;
+      step.latency_max[i] = window[std::string(topic_name[i]) + " latency max [ms]"];
+      if (step.drop[i] > max_drop_ratio_) step.is_saturated = true;
+    }
+    step.overruns = end["tick overruns"] - start["tick overruns"];
+    step.tick_duration_max = window["tick duration max [ms]"];
+    step.tick_late_max = window["tick late max [ms]"];
+    if (step.overruns > 0.0) step.is_saturated = true;
+    return step;
+  }
+
+  void setRates(double scale)
+  {
+    std::lock_guard<std::mutex> lock(rate_mutex_);
+    for (int i = 0; i < NUM_OF_LOAD_TOPIC; i++)
+      rate_[i] = base_rate_[i] * scale;
+  }
+
+  void diagnosticsCallback(const diagnostic_msgs::DiagnosticArray::ConstPtr &msg)
+  {
+    for (size_t s = 0; s < msg->status.size(); s++)
+    {
+      const diagnostic_msgs::DiagnosticStatus &status = msg->status[s];
+      if (status.name.size() < 6 || status.name.compare(status.name.size() - 6, 6, ": load") != 0) continue;
+
+      std::lock_guard<std::mutex> lock(statistics_mutex_);
+      for (size_t v = 0; v < status.values.size(); v++)
+      {
+        double value = atof(status.values[v].value.c_str());
+        latest_[status.values[v].key] = value;
+        if (is_collecting_)
+        {
+          double &window = window_[status.values[v].key];
+          window = std::max(window, value);
+        }
+      }
+      has_statistics_ = true;
+    }
+  }
+
+  bool waitForStatistics(double timeout)
+  {
+    ros::WallTime deadline = ros::WallTime::now() + ros::WallDuration(timeout);
+    while (ros::ok() && ros::WallTime::now() < deadline)
+    {
+      {
+        std::lock_guard<std::mutex> lock(statistics_mutex_);
+        if (has_statistics_) return true;
+      }
+      ros::WallDuration(0.1).sleep();
+    }
+    return false;
+  }
+
+  Statistics latestStatistics()
+  {
+    std::lock_guard<std::mutex> lock(statistics_mutex_);
+    return latest_;
+  }
+
+  void beginCollecting()
+  {
+    std::lock_guard<std::mutex> lock(statistics_mutex_);
+    window_.clear();
+    is_collecting_ = true;
+  }
+
+  // Largest value of every statistic the node reported since beginCollecting()
+  Statistics endCollecting()
+  {
+    std::lock_guard<std::mutex> lock(statistics_mutex_);
+    is_collecting_ = false;
+    return window_;
+  }
+
+  bool writeCurve(const std::vector<LoadStep> &curve)
+  {
+    FILE *file = fopen(output_.c_str(), "w");
+    if (file == NULL)
+    {
+      printf("Cannot write %s\n", output_.c_str());
+      return false;
+    }
+
+    fprintf(file, "scale,markers_per_message,joint_states_hz,states_hz,kinematics_pose_hz,ar_pose_marker_hz,"
+                  "joint_states_drop,states_drop,kinematics_pose_drop,ar_pose_marker_drop,"
+                  "joint_states_latency_max_ms,states_latency_max_ms,kinematics_pose_latency_max_ms,ar_pose_marker_latency_max_ms,"
+                  "tick_overruns,tick_duration_max_ms,tick_late_max_ms,saturated\n");
+    for (size_t s = 0; s < curve.size(); s++)
+    {
+      const LoadStep &step = curve[s];
+      fprintf(file, "%.2f,%zu", step.scale, markers_.markers.size());
+      for (int i = 0; i < NUM_OF_LOAD_TOPIC; i++)
+        fprintf(file, ",%.2f", step.rate[i]);
+      for (int i = 0; i < NUM_OF_LOAD_TOPIC; i++)
+        fprintf(file, ",%.5f", step.drop[i]);
+      for (int i = 0; i < NUM_OF_LOAD_TOPIC; i++)
+        fprintf(file, ",%.3f", step.latency_max[i]);
+      fprintf(file, ",%.0f,%.3f,%.3f,%d\n", step.overruns, step.tick_duration_max, step.tick_late_max, step.is_saturated ? 1 : 0);
+    }
+    fclose(file);
+    return true;
+  }
+
+  static double monotonicTime()
+  {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+  }
+
+  static void sleepUntil(double time)
+  {
+    timespec wake;
+    wake.tv_sec = (time_t)time;
+    wake.tv_nsec = (long)((time - wake.tv_sec) * 1e9);
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+  }
+
+  ros::NodeHandle node_handle_;
+  ros::NodeHandle priv_node_handle_;
+  ros::Publisher pub_[NUM_OF_LOAD_TOPIC];
+  ros::Subscriber diagnostics_sub_;
+
+  double base_rate_[NUM_OF_LOAD_TOPIC];  // at scale 1 [Hz]
+  std::vector<double> scales_;
+  double step_time_;   // [s]
+  double drain_time_;  // [s]
+  double max_drop_ratio_;
+  bool stop_at_saturation_;
+  double required_scale_;
+  std::string output_;
+
+  // Sender thread only
+  sensor_msgs::JointState joint_states_;
+  open_manipulator_msgs::OpenManipulatorState states_;
+  open_manipulator_msgs::KinematicsPose kinematics_pose_;
+  ar_track_alvar_msgs::AlvarMarkers markers_;
+
+  std::thread sender_;
+  std::atomic<bool> is_running_;
+  std::mutex rate_mutex_;
+  double rate_[NUM_OF_LOAD_TOPIC];  // [Hz], 0 is off
+  std::atomic<uint64_t> sent_[NUM_OF_LOAD_TOPIC];
+
+  std::mutex statistics_mutex_;  // the spinner thread writes, run() reads
+  Statistics latest_;
+  Statistics window_;
+  bool is_collecting_;
+  bool has_statistics_;
+};
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "load_generator");
+
+  LoadGenerator generator;
+  ros::AsyncSpinner spinner(1);
+  spinner.start();
+
+  int result = generator.run();
+  ros::shutdown();
+  return result;
+}
@@ -0,0 +1,375 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#include <ros/ros.h>
+#include <stdio.h>
+#include <deque>
+#include <limits>
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+#include "ar_track_alvar_msgs/AlvarMarkers.h"
+#include "std_msgs/String.h"
+
+#include "open_manipulator_pick_and_place/arm_executor.h"
+#include "open_manipulator_pick_and_place/job_queue.h"
+#include "open_manipulator_pick_and_place/marker_map.h"
+#include "open_manipulator_pick_and_place/pose_library.h"
+
+// Pose library keys of the arm motion, see ArmMotion
+#define POSE_INITIAL           0
+#define POSE_GRIPPER_OPEN      1
+#define POSE_GRIPPER_CLOSE     2
+#define POSE_GRIP_ORIENTATION  3
+#define POSE_PICK              4
+#define POSE_LIFT_HEIGHT       5
+#define POSE_PLACE_HEIGHT      6
+#define POSE_MOVE_TIME         7
+#define POSE_APPROACH_TIME     8
+#define POSE_GRIP_TIME         9
+#define NUM_OF_POSE            10
+
+static const open_manipulator_pick_and_place::PoseEntry DEFAULT_POSES[NUM_OF_POSE] =
+{
+  {"initial",          4, { 0.01, -0.80,  0.00, 1.90}},
+  {"gripper_open",     1, { 0.010}},
+  {"gripper_close",    1, {-0.008}},
+  {"grip_orientation", 4, { 0.74,  0.00,  0.66, 0.00}},
+  {"pick",             3, { 0.005, 0.000, 0.033}},
+  {"lift_height",      1, { 0.170}},
+  {"place_height",     1, { 0.065}},
+  {"move_time",        1, { 2.0}},
+  {"approach_time",    1, { 3.0}},
+  {"grip_time",        1, { 1.0}},
+};
+
+// Hosts one ArmExecutor per arm namespace (arm0, arm1, ...) in one process.
+// Markers from the shared camera (/ar_pose_marker, in the cell frame) go
+// into one marker map; jobs (pick marker, place marker) from ~jobs or the
+// job topic ("<pick id> <place id>") are given to the nearest idle arm that
+// reaches both markers, else to the reaching arm with the fewest jobs
+// queued, and idle arms steal what others have not started.
+class MultiArmOrchestrator
+{
+ public:
+  MultiArmOrchestrator()
+  : priv_node_handle_("~"),
+    poses_(DEFAULT_POSES, NUM_OF_POSE),
+    next_job_id_(0),
+    unreachable_(0),
+    first_job_time_(0.0),
+    last_report_time_(0.0)
+  {
+    int num_of_arm = priv_node_handle_.param<int>("arms", 2);
+    std::string arm_namespace = priv_node_handle_.param<std::string>("arm_namespace", "arm");
+    report_period_ = priv_node_handle_.param<double>("report_period", 5.0);
+    exit_when_done_ = priv_node_handle_.param<bool>("exit_when_done", false);
+    marker_map_.setMaxAge(priv_node_handle_.param<double>("marker_max_age", 2.0));
+
+    std::vector<open_manipulator_pick_and_place::ArmBase> base = loadArmBases(num_of_arm);
+    open_manipulator_pick_and_place::ArmMotion motion = loadMotion();
+
+    job_queue_.reset(new open_manipulator_pick_and_place::JobQueue(num_of_arm));
+    double timeout_margin = priv_node_handle_.param<double>("trajectory_timeout_margin", 2.0);
+    double hold_time = priv_node_handle_.param<double>("hold_time", 0.1);
+    double service_wait_timeout = priv_node_handle_.param<double>("service_wait_timeout", 10.0);
+    double service_call_timeout = priv_node_handle_.param<double>("service_call_timeout", 1.0);
+    for (int i = 0; i < num_of_arm; i++)
+    {
+      char name[64];
+      snprintf(name, sizeof(name), "%s%d", arm_namespace.c_str(), i);
+      boost::shared_ptr<open_manipulator_pick_and_place::ArmExecutor> executor(
+          new open_manipulator_pick_and_place::ArmExecutor(i, ros::NodeHandle(node_handle_, name), base[i], motion,
+                                                           job_queue_.get(), &marker_map_));
+      if (!executor->start(timeout_margin, hold_time, service_wait_timeout, service_call_timeout))
+        ROS_WARN("Controller of %s not available after %.1f s, its jobs wait until it is", name, service_wait_timeout);
+      executor_.push_back(executor);
+    }
+
+    if (priv_node_handle_.param<bool>("mock_cell", false))
+      createMockCell(priv_node_handle_.param<int>("mock_jobs_per_arm", 10));
+    loadFixedMarkers();
+    loadJobs();
+
+    ar_pose_marker_sub_ = node_handle_.subscribe("/ar_pose_marker", 10, &MultiArmOrchestrator::arPoseMarkerCallback, this);
+    job_sub_ = node_handle_.subscribe("job", 10, &MultiArmOrchestrator::jobCallback, this);
+    timer_ = node_handle_.createTimer(ros::Duration(0.100)/*100ms*/, &MultiArmOrchestrator::timerCallback, this);
+  }
+
+ private:
+  // ~arm_bases: x y yaw per arm in the cell frame, by default in a row 0.4 m apart
+  std::vector<open_manipulator_pick_and_place::ArmBase> loadArmBases(int num_of_arm)
+  {
+    std::vector<double> value;
+    priv_node_handle_.getParam("arm_bases", value);
+    if (!value.empty() && value.size() < 3 * (size_t)num_of_arm)
+      ROS_ERROR("arm_bases needs x y yaw for each of the %d arms, using a row for the rest", num_of_arm);
+
+    double reach_min = priv_node_handle_.param<double>("reach_min", 0.08);
+    double reach_max = priv_node_handle_.param<double>("reach_max", 0.30);
+    std::vector<open_manipulator_pick_and_place::ArmBase> base(num_of_arm);
+    for (int i = 0; i < num_of_arm; i++)
+    {
+      bool is_given = value.size() >= 3 * (size_t)(i + 1);
+      base[i].x = is_given ? value[3 * i] : 0.0;
+      base[i].y = is_given ? value[3 * i + 1] : 0.4 * i;
+      base[i].yaw = is_given ? value[3 * i + 2] : 0.0;
+      base[i].reach_min = reach_min;
+      base[i].reach_max = reach_max;
+    }
+    return base;
+  }
+
+  open_manipulator_pick_and_place::ArmMotion loadMotion()
+  {
+    std::string file = priv_node_handle_.param<std::string>("pose_file", "");
+    std::string error;
+    if (!file.empty() && poses_.load(file, &error))
+      poses_.update();
+    else if (!file.empty())
+      ROS_ERROR("Cannot load the pose library, using the built-in poses: %s", error.c_str());
+
+    open_manipulator_pick_and_place::ArmMotion motion;
+    for (int i = 0; i < TRAJECTORY_NUM_OF_JOINT; i++)
+      motion.initial[i] = poses_.value(POSE_INITIAL, i);
+    for (int i = 0; i < 4; i++)
+      motion.grip_orientation[i] = poses_.value(POSE_GRIP_ORIENTATION, i);
+    for (int i = 0; i < 3; i++)
+      motion.pick[i] = poses_.value(POSE_PICK, i);
+    motion.gripper_open = poses_.value(POSE_GRIPPER_OPEN);
+    motion.gripper_close = poses_.value(POSE_GRIPPER_CLOSE);
+    motion.lift_height = poses_.value(POSE_LIFT_HEIGHT);
+    motion.place_height = poses_.value(POSE_PLACE_HEIGHT);
+    motion.move_time = poses_.value(POSE_MOVE_TIME);
+    motion.approach_time = poses_.value(POSE_APPROACH_TIME);
+    motion.grip_time = poses_.value(POSE_GRIP_TIME);
+    motion.gripper_settle_tolerance = priv_node_handle_.param<double>("gripper_settle_tolerance", 0.0005);
+    motion.gripper_settle_time = priv_node_handle_.param<double>("gripper_settle_time", 0.3);
+    return motion;
+  }
+
+  // ~fixed_markers: id x y z of markers that do not move (place spots)
+  void loadFixedMarkers()
+  {
+    std::vector<double> value;
+    priv_node_handle_.getParam("fixed_markers", value);
+    for (size_t i = 0; i + 3 < value.size(); i += 4)
+      marker_map_.setFixed((uint32_t)value[i], &value[i + 1]);
+  }
+
+  // ~jobs: pick and place marker id of each job, repeated ~job_repeat times
+  void loadJobs()
+  {
+    std::vector<int> value;
+    priv_node_handle_.getParam("jobs", value);
+    int repeat = priv_node_handle_.param<int>("job_repeat", 1);
+    for (int r = 0; r < repeat; r++)
+      for (size_t i = 0; i + 1 < value.size(); i += 2)
+        addJob(value[i], value[i + 1]);
+  }
+
+  // Markers and jobs for local stand-in controllers (launch/mock_arms.launch).
+  // Arm i picks from marker 10i and places on 10i+1; every other job uses
+  // markers 10i+5 and 10i+6 between arm i and i+1, which both can reach.
+  void createMockCell(int jobs_per_arm)
+  {
+    for (size_t i = 0; i < executor_.size(); i++)
+    {
+      const open_manipulator_pick_and_place::ArmBase &base = executor_[i]->base();
+      double c = std::cos(base.yaw), s = std::sin(base.yaw);
+      const double offset[4][2] = {{0.20, -0.05}, {0.15, 0.12}, {0.12, 0.20}, {0.18, 0.20}};
+      const uint32_t id[4] = {10 * i, 10 * i + 1, 10 * i + 5, 10 * i + 6};
+      for (int k = 0; k < 4; k++)
+      {
+        double position[3] = {base.x + c * offset[k][0] - s * offset[k][1],
+                              base.y + s * offset[k][0] + c * offset[k][1], 0.0};
+        marker_map_.setFixed(id[k], position);
+      }
+    }
+
+    for (int j = 0; j < jobs_per_arm; j++)
+    {
+      for (size_t i = 0; i < executor_.size(); i++)
+      {
+        bool is_shared = (j % 2 == 1) && i + 1 < executor_.size();
+        addJob(10 * i + (is_shared ? 5 : 0), 10 * i + (is_shared ? 6 : 1));
+      }
+    }
+  }
+
+  void addJob(uint32_t pick_marker_id, uint32_t place_marker_id)
+  {
+    open_manipulator_pick_and_place::PickPlaceJob job;
+    job.id = next_job_id_++;
+    job.pick_marker_id = pick_marker_id;
+    job.place_marker_id = place_marker_id;
+    job.created = ros::Time::now().toSec();
+    job.assigned = 0.0;
+    if (first_job_time_ == 0.0) first_job_time_ = job.created;
+    pending_.push_back(job);
+  }
+
+  // False while a marker of the job is not known yet
+  bool assign(open_manipulator_pick_and_place::PickPlaceJob &job, double now)
+  {
+    if (!marker_map_.find(job.pick_marker_id, now, job.pick) ||
+        !marker_map_.find(job.place_marker_id, now, job.place))
+      return false;
+
+    int best = -1;
+    double best_load = std::numeric_limits<double>::max();
+    double best_distance = std::numeric_limits<double>::max();
+    for (size_t i = 0; i < executor_.size(); i++)
+    {
+      if (!executor_[i]->canServe(job)) continue;
+
+      // An idle arm first, then the shortest deque, then the nearest
+      double load = executor_[i]->isIdle() ? 0.0 : 1.0 + job_queue_->size(i);
+      double distance = open_manipulator_pick_and_place::armDistance(executor_[i]->base(), job.pick);
+      if (load < best_load || (load == best_load && distance < best_distance))
+      {
+        best = i;
+        best_load = load;
+        best_distance = distance;
+      }
+    }
+
+    if (best < 0)
+    {
+      ROS_ERROR("Job %u: no arm reaches both marker %u and marker %u, dropped", job.id, job.pick_marker_id, job.place_marker_id);
+      unreachable_++;
+      return true;
+    }
+
+    job.assigned = now;
+    job_queue_->push(best, job);
+    return true;
+  }
+
+  void arPoseMarkerCallback(const ar_track_alvar_msgs::AlvarMarkers::ConstPtr &msg)
+  {
+    double now = ros::Time::now().toSec();
+    for (size_t i = 0; i < msg->markers.size(); i++)
+    {
+      const double position[3] = {msg->markers[i].pose.pose.position.x,
+                                  msg->markers[i].pose.pose.position.y,
+                                  msg->markers[i].pose.pose.position.z};
+      marker_map_.update(msg->markers[i].id, position, now);
+    }
+  }
+
+  void jobCallback(const std_msgs::String::ConstPtr &msg)
+  {
+    unsigned int pick_marker_id, place_marker_id;
+    if (sscanf(msg->data.c_str(), "%u %u", &pick_marker_id, &place_marker_id) != 2)
+    {
+      ROS_ERROR("Job '%s' ignored, expected '<pick marker id> <place marker id>'", msg->data.c_str());
+      return;
+    }
+    addJob(pick_marker_id, place_marker_id);
+  }
+
+  void timerCallback(const ros::TimerEvent&)
+  {
+    double now = ros::Time::now().toSec();
+    for (size_t n = pending_.size(); n > 0; n--)
+    {
+      open_manipulator_pick_and_place::PickPlaceJob job = pending_.front();
+      pending_.pop_front();
+      if (!assign(job, now)) pending_.push_back(job);
+    }
+
+    bool is_done = next_job_id_ > 0 && finished() == next_job_id_;
+    if (now - last_report_time_ >= report_period_ || (is_done && exit_when_done_))
+    {
+      printReport(now);
+      last_report_time_ = now;
+    }
+    if (is_done && exit_when_done_) ros::shutdown();
+  }
+
+  uint64_t finished()
+  {
+    uint64_t count = unreachable_;
+    for (size_t i = 0; i < executor_.size(); i++)
+    {
+      open_manipulator_pick_and_place::ArmReport report = executor_[i]->report();
+      count += report.done + report.failed;
+    }
+    return count;
+  }
+
+  // Throughput against what the arms could do if none were ever idle
+  void printReport(double now)
+  {
+    std::vector<open_manipulator_pick_and_place::ArmReport> report;
+    uint64_t done = 0, failed = 0;
+    double capacity = 0.0;  // jobs per second with every arm busy all the time
+    for (size_t i = 0; i < executor_.size(); i++)
+    {
+      report.push_back(executor_[i]->report());
+      done += report[i].done;
+      failed += report[i].failed;
+      if (report[i].job_mean > 0.0) capacity += 1.0 / report[i].job_mean;
+    }
+
+    double elapsed = first_job_time_ > 0.0 ? now - first_job_time_ : 0.0;
+    double throughput = elapsed > 0.0 ? done / elapsed : 0.0;
+    printf("-----------------------------\n");
+    printf("%lu arms: %lu/%u jobs done, %lu failed, %lu unreachable, %lu pending in %.1lf s\n",
+           (unsigned long)executor_.size(), (unsigned long)done, next_job_id_, (unsigned long)failed,
+           (unsigned long)unreachable_, (unsigned long)pending_.size(), elapsed);
+    printf("Throughput: %.2lf jobs/min (%.2lf per arm), %.0lf%% of the arms' capacity\n",
+           throughput * 60.0, throughput * 60.0 / executor_.size(),
+           capacity > 0.0 ? throughput / capacity * 100.0 : 0.0);
+    for (size_t i = 0; i < executor_.size(); i++)
+    {
+      printf("arm%lu: done %lu stolen %lu failed %lu busy %.0lf%% job [s] mean %.1lf max %.1lf wait %.1lf queued %lu\n",
+             (unsigned long)i, (unsigned long)report[i].done, (unsigned long)report[i].stolen,
+             (unsigned long)report[i].failed, elapsed > 0.0 ? report[i].busy / elapsed * 100.0 : 0.0,
+             report[i].job_mean, report[i].job_max, report[i].wait_mean, (unsigned long)job_queue_->size(i));
+    }
+  }
+
+  ros::NodeHandle node_handle_;
+  ros::NodeHandle priv_node_handle_;
+  ros::Subscriber ar_pose_marker_sub_;
+  ros::Subscriber job_sub_;
+  ros::Timer timer_;
+
+  open_manipulator_pick_and_place::PoseLibrary poses_;
+  open_manipulator_pick_and_place::MarkerMap marker_map_;
+  boost::shared_ptr<open_manipulator_pick_and_place::JobQueue> job_queue_;
+  std::vector<boost::shared_ptr<open_manipulator_pick_and_place::ArmExecutor> > executor_;
+
+  std::deque<open_manipulator_pick_and_place::PickPlaceJob> pending_;  // waiting for their markers
+  uint32_t next_job_id_;
+  uint64_t unreachable_;
+  double first_job_time_;    // [s]
+  double last_report_time_;  // [s]
+  double report_period_;     // [s]
+  bool exit_when_done_;
+};
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "multi_arm_orchestrator");
+
+  MultiArmOrchestrator orchestrator;
+  ros::spin();
+  return 0;
+}
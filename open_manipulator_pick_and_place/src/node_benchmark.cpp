@@ -0,0 +1,497 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#include <time.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <yaml-cpp/yaml.h>
+
+#include "open_manipulator_pick_and_place/open_manipulator_pick_and_place.h"
+
+namespace
+{
+double monotonicTime()
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// One measured operation; setUp() runs before every batch and is not timed
+class BenchmarkCase
+{
+ public:
+  explicit BenchmarkCase(const std::string &name) : name_(name) {}
+  virtual ~BenchmarkCase() {}
+
+  const std::string &name() const { return name_; }
+  virtual void setUp() {}
+  virtual void run() = 0;
+
+ private:
+  std::string name_;
+};
+
+typedef struct _BenchmarkResult
+{
+  std::string name;
+  uint64_t calls;  // per batch
+  double mean;     // per call over all batches [ns]
+  double min;      // per call in the fastest batch [ns]
+  double max;      // per call in the slowest batch [ns]
+} BenchmarkResult;
+
+// Runs the case in batches of about batch_time; the fastest batch is the one
+// least disturbed by the rest of the system and is what baselines compare
+BenchmarkResult measure(BenchmarkCase &benchmark_case, int batches, double batch_time)
+{
+  uint64_t calls = 1;
+  while (true)
+  {
+    benchmark_case.setUp();
+    double start = monotonicTime();
+    for (uint64_t i = 0; i < calls; i++)
+      benchmark_case.run();
+    double elapsed = monotonicTime() - start;
+    if (elapsed > batch_time * 0.1)
+    {
+      calls = std::max<uint64_t>(1, (uint64_t)(calls * batch_time / elapsed));
+      break;
+    }
+    calls *= 2;
+  }
+
+  BenchmarkResult result = {benchmark_case.name(), calls, 0.0, 0.0, 0.0};
+  for (int b = 0; b < batches; b++)
+  {
+    benchmark_case.setUp();
+    double start = monotonicTime();
+    for (uint64_t i = 0; i < calls; i++)
+      benchmark_case.run();
+    double per_call = (monotonicTime() - start) / calls * 1e9;
+
+    result.mean += per_call / batches;
+    result.min = b == 0 ? per_call : std::min(result.min, per_call);
+    result.max = std::max(result.max, per_call);
+  }
+  return result;
+}
+
+// joint_states of the arm, followed by the other joints of a bigger robot
+class JointStatesCase : public BenchmarkCase
+{
+ public:
+  JointStatesCase(OpenManipulatorPickandPlace *node, const std::string &name, int num_of_extra_joint)
+  : BenchmarkCase(name), node_(node), msg_(new sensor_msgs::JointState)
+  {
+    for (int i = 0; i < num_of_extra_joint; i++)
+    {
+      char joint_name[32];
+      snprintf(joint_name, sizeof(joint_name), "other_joint%d", i);
+      msg_->name.push_back(joint_name);
+      msg_->position.push_back(0.0);
+    }
+    const char *arm_joint[NUM_OF_JOINT_AND_TOOL] = {"joint1", "joint2", "joint3", "joint4", "gripper"};
+    for (int i = 0; i < NUM_OF_JOINT_AND_TOOL; i++)
+    {
+      msg_->name.push_back(arm_joint[i]);
+      msg_->position.push_back(0.1 * i);
+    }
+  }
+
+  // Stamped on arrival by the node, as from a driver that leaves it empty
+  void run() { node_->jointStatesCallback(msg_); }
+
+ private:
+  OpenManipulatorPickandPlace *node_;
+  sensor_msgs::JointState::Ptr msg_;
+};
+
+class KinematicsPoseCase : public BenchmarkCase
+{
+ public:
+  explicit KinematicsPoseCase(OpenManipulatorPickandPlace *node)
+  : BenchmarkCase("kinematics_pose"), node_(node), msg_(new open_manipulator_msgs::KinematicsPose)
+  {
+    msg_->pose.position.x = 0.2;
+    msg_->pose.position.z = 0.1;
+    msg_->pose.orientation.w = 1.0;
+  }
+
+  void run() { node_->kinematicsPoseCallback(msg_); }
+
+ private:
+  OpenManipulatorPickandPlace *node_;
+  open_manipulator_msgs::KinematicsPose::Ptr msg_;
+};
+
+// Markers in world (fixed camera, or ar_track_alvar transforming them) or
+// in the wrist camera frame, which the node moves to world itself
+class ArPoseMarkerCase : public BenchmarkCase
+{
+ public:
+  ArPoseMarkerCase(OpenManipulatorPickandPlace *node, const std::string &name, int num_of_marker, const std::string &frame_id)
+  : BenchmarkCase(name), node_(node), msg_(new ar_track_alvar_msgs::AlvarMarkers), joint_states_(new sensor_msgs::JointState)
+  {
+    msg_->header.frame_id = frame_id;
+    for (int i = 0; i < num_of_marker; i++)
+    {
+      ar_track_alvar_msgs::AlvarMarker marker;
+      marker.id = i;
+      marker.pose.pose.position.x = 0.02 * (i % 8) - 0.07;
+      marker.pose.pose.position.y = 0.02 * (i / 8) - 0.03;
+      marker.pose.pose.position.z = 0.25;
+      msg_->markers.push_back(marker);
+    }
+
+    const char *arm_joint[NUM_OF_JOINT_AND_TOOL] = {"joint1", "joint2", "joint3", "joint4", "gripper"};
+    joint_states_->name.assign(arm_joint, arm_joint + NUM_OF_JOINT_AND_TOOL);
+    joint_states_->position.assign(NUM_OF_JOINT_AND_TOOL, 0.0);
+  }
+
+  // Joint states on both sides of the capture time, so that every marker
+  // is moved to world, and markers that stay fresh during the batch
+  void setUp()
+  {
+    ros::Time now = ros::Time::now();
+    joint_states_->header.stamp = now - ros::Duration(0.02);
+    node_->jointStatesCallback(joint_states_);
+    joint_states_->header.stamp = now;
+    node_->jointStatesCallback(joint_states_);
+    msg_->header.stamp = now - ros::Duration(0.01);
+  }
+
+  void run() { node_->arPoseMarkerCallback(msg_, 0); }
+
+ private:
+  OpenManipulatorPickandPlace *node_;
+  ar_track_alvar_msgs::AlvarMarkers::Ptr msg_;
+  sensor_msgs::JointState::Ptr joint_states_;
+};
+
+class JointRequestCase : public BenchmarkCase
+{
+ public:
+  JointRequestCase()
+  : BenchmarkCase("request/joint_space_path"), joint_angle_(4, 0.5)
+  {
+    joint_name_.push_back("joint1");
+    joint_name_.push_back("joint2");
+    joint_name_.push_back("joint3");
+    joint_name_.push_back("joint4");
+  }
+
+  void run()
+  {
+    open_manipulator_msgs::SetJointPosition srv;
+    open_manipulator_pick_and_place::makeJointRequest(joint_name_, joint_angle_, 2.0, &srv);
+  }
+
+ private:
+  std::vector<std::string> joint_name_;
+  std::vector<double> joint_angle_;
+};
+
+class TaskRequestCase : public BenchmarkCase
+{
+ public:
+  TaskRequestCase() : BenchmarkCase("request/task_space_path"), position_(3, 0.1), orientation_(4, 0.5) {}
+
+  void run()
+  {
+    open_manipulator_msgs::SetKinematicsPose srv;
+    open_manipulator_pick_and_place::makeTaskRequest("gripper", position_, orientation_, 2.0, &srv);
+  }
+
+ private:
+  std::vector<double> position_;
+  std::vector<double> orientation_;
+};
+
+class ToolRequestCase : public BenchmarkCase
+{
+ public:
+  ToolRequestCase() : BenchmarkCase("request/tool_control"), tool_value_(1, 0.01) {}
+
+  void run()
+  {
+    open_manipulator_msgs::SetJointPosition srv;
+    open_manipulator_pick_and_place::makeToolRequest(tool_value_, &srv);
+  }
+
+ private:
+  std::vector<double> tool_value_;
+};
+
+// Pick height under a marker from a synthetic D435 frame: a 4 cm box top at
+// 0.25 m on a table at 0.30 m, with every 17th pixel a hole
+class DepthRoiCase : public BenchmarkCase
+{
+ public:
+  DepthRoiCase(const std::string &name, int width, int height)
+  : BenchmarkCase(name), width_(width), height_(height), depth_(width * height)
+  {
+    double f = 615.0 * width / 640.0;
+    sampler_.setIntrinsics(f, f, width / 2.0, height / 2.0);
+
+    for (int row = 0; row < height; row++)
+    {
+      for (int col = 0; col < width; col++)
+      {
+        double x = (col - width / 2.0) / f * 0.25, y = (row - height / 2.0) / f * 0.25;
+        bool is_box = fabs(x - 0.02) < 0.02 && fabs(y - 0.01) < 0.02;
+        depth_[row * width + col] = (row * width + col) % 17 == 0 ? 0 : (is_box ? 250 : 300);
+      }
+    }
+    center_[0] = 0.02; center_[1] = 0.01; center_[2] = 0.25;
+  }
+
+  void run()
+  {
+    open_manipulator_pick_and_place::DepthRoiResult result;
+    sampler_.sample(&depth_[0], width_, height_, width_ * sizeof(uint16_t), 0.001, center_, 0.012, &result);
+  }
+
+ private:
+  int width_;
+  int height_;
+  std::vector<uint16_t> depth_;
+  open_manipulator_pick_and_place::DepthRoiSampler sampler_;
+  double center_[3];
+};
+
+// A D435 frame into the voxel grid, camera on the arm in its initial pose
+// looking down at a table with one box on it
+class VoxelInsertCase : public BenchmarkCase
+{
+ public:
+  VoxelInsertCase(const std::string &name, int width, int height)
+  : BenchmarkCase(name), width_(width), height_(height), depth_(width * height), stamp_(0.0)
+  {
+    f_ = 615.0 * width / 640.0;
+    for (int row = 0; row < height; row++)
+    {
+      for (int col = 0; col < width; col++)
+      {
+        bool is_box = abs(col - width / 2) < width / 10 && abs(row - height / 2) < height / 10;
+        depth_[row * width + col] = (row * width + col) % 17 == 0 ? 0 : (is_box ? 250 : 300);
+      }
+    }
+
+    const double joint[4] = {0.0, -1.05, 0.35, 0.70};
+    camera_to_world_ = kinematics_.cameraToWorld(joint);
+    grid_.configure(open_manipulator_pick_and_place::defaultVoxelGridConfig());
+  }
+
+  void run()
+  {
+    stamp_ += 0.033;
+    grid_.insert(&depth_[0], width_, height_, width_ * sizeof(uint16_t), 0.001,
+                 f_, f_, width_ / 2.0, height_ / 2.0, camera_to_world_, stamp_);
+  }
+
+ private:
+  int width_;
+  int height_;
+  std::vector<uint16_t> depth_;
+  double f_;
+  double stamp_;
+  open_manipulator_pick_and_place::ArmKinematics kinematics_;
+  open_manipulator_pick_and_place::RigidTransform camera_to_world_;
+  open_manipulator_pick_and_place::VoxelGrid grid_;
+};
+
+// Check of the initial to place pose path against an empty grid, every
+// segment walked to its end
+class VoxelPathCase : public BenchmarkCase
+{
+ public:
+  VoxelPathCase() : BenchmarkCase("voxel/joint_path")
+  {
+    grid_.configure(open_manipulator_pick_and_place::defaultVoxelGridConfig());
+  }
+
+  void run()
+  {
+    const double start[4] = {0.0, -1.05, 0.35, 0.70};
+    const double goal[4] = {1.57, 0.0, 0.0, 1.0};
+    open_manipulator_pick_and_place::isJointPathFree(grid_, kinematics_, start, goal, 8, 1, 0.05);
+  }
+
+ private:
+  open_manipulator_pick_and_place::ArmKinematics kinematics_;
+  open_manipulator_pick_and_place::VoxelGrid grid_;
+};
+
+// Start of a demo run: the first step sends the home pose as a joint goal,
+// a round trip to whatever serves goal_joint_space_path
+class DemoTickCase : public BenchmarkCase
+{
+ public:
+  explicit DemoTickCase(OpenManipulatorPickandPlace *node) : BenchmarkCase("demo_tick/home_pose"), node_(node) {}
+
+  void run()
+  {
+    node_->setModeState('2');
+    node_->demoSequence();
+  }
+
+ private:
+  OpenManipulatorPickandPlace *node_;
+};
+
+void writeResults(FILE *file, const std::vector<BenchmarkResult> &result, int batches, double batch_time)
+{
+  fprintf(file, "{\n  \"benchmark\": \"open_manipulator_pick_and_place\",\n");
+  fprintf(file, "  \"batches\": %d,\n  \"batch_time\": %.3f,\n  \"unit\": \"ns\",\n  \"results\": [\n", batches, batch_time);
+  for (size_t i = 0; i < result.size(); i++)
+  {
+    fprintf(file, "    {\"name\": \"%s\", \"calls\": %llu, \"mean\": %.1f, \"min\": %.1f, \"max\": %.1f}%s\n",
+            result[i].name.c_str(), (unsigned long long)result[i].calls, result[i].mean, result[i].min, result[i].max,
+            i + 1 < result.size() ? "," : "");
+  }
+  fprintf(file, "  ]\n}\n");
+}
+
+// Fastest batch per call of every case in a file written with --out
+bool loadBaseline(const std::string &path, std::map<std::string, double> *baseline)
+{
+  try
+  {
+    YAML::Node root = YAML::LoadFile(path);
+    const YAML::Node &results = root["results"];
+    for (size_t i = 0; i < results.size(); i++)
+      (*baseline)[results[i]["name"].as<std::string>()] = results[i]["min"].as<double>();
+  }
+  catch (const YAML::Exception &ex)
+  {
+    printf("Cannot read the baseline %s: %s\n", path.c_str(), ex.what());
+    return false;
+  }
+  return true;
+}
+}  // namespace
+
+// Times the pick and place node's callbacks, the requests behind its set*
+// commands, the depth read under a marker and the voxel grid with synthetic
+// messages of the usual and the worst sizes. Needs a roscore. With
+// --demo_tick it also times the first demo step, which moves the arm to
+// its demo home pose: run it against trajectory_stand_in_server, not an arm.
+// usage: node_benchmark [--batches N] [--batch_time s] [--out results.json]
+//                       [--baseline baseline.json] [--tolerance 0.10]
+//                       [--demo_tick]
+// Returns 2 when a case is slower than the baseline by more than tolerance.
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "node_benchmark", ros::init_options::AnonymousName);
+
+  int batches = 10;
+  double batch_time = 0.1;
+  double tolerance = 0.10;
+  bool use_demo_tick = false;
+  std::string out_file, baseline_file;
+  for (int i = 1; i < argc; i++)
+  {
+    if (!strcmp(argv[i], "--batches") && i + 1 < argc) batches = std::max(1, atoi(argv[++i]));
+    else if (!strcmp(argv[i], "--batch_time") && i + 1 < argc) batch_time = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--out") && i + 1 < argc) out_file = argv[++i];
+    else if (!strcmp(argv[i], "--baseline") && i + 1 < argc) baseline_file = argv[++i];
+    else if (!strcmp(argv[i], "--tolerance") && i + 1 < argc) tolerance = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--demo_tick")) use_demo_tick = true;
+    else
+    {
+      printf("usage: %s [--batches N] [--batch_time s] [--out results.json] [--baseline baseline.json] [--tolerance 0.10] [--demo_tick]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  std::map<std::string, double> baseline;
+  if (!baseline_file.empty() && !loadBaseline(baseline_file, &baseline)) return 1;
+
+  // The node as it runs, except that it does not wait for the controller,
+  // compare TF or print every event
+  ros::param::set("~service_wait_timeout", 0.0);
+  ros::param::set("~tf_comparison_period", 0.0);
+  ros::param::set("~event_log_echo", false);
+  ros::param::set("~pose_file_watch", false);
+  OpenManipulatorPickandPlace node;
+
+  std::vector<boost::shared_ptr<BenchmarkCase> > cases;
+  cases.push_back(boost::shared_ptr<BenchmarkCase>(new JointStatesCase(&node, "joint_states/arm", 0)));
+  cases.push_back(boost::shared_ptr<BenchmarkCase>(new JointStatesCase(&node, "joint_states/arm+27", 27)));
+  cases.push_back(boost::shared_ptr<BenchmarkCase>(new KinematicsPoseCase(&node)));
+  cases.push_back(boost::shared_ptr<BenchmarkCase>(new ArPoseMarkerCase(&node, "ar_pose_marker/empty", 0, "world")));
+  cases.push_back(boost::shared_ptr<BenchmarkCase>(new ArPoseMarkerCase(&node, "ar_pose_marker/world/3", 3, "world")));
+  cases.push_back(boost::shared_ptr<BenchmarkCase>(new ArPoseMarkerCase(&node, "ar_pose_marker/world/32", 32, "world")));
+  cases.push_back(boost::shared_ptr<BenchmarkCase>(new ArPoseMarkerCase(&node, "ar_pose_marker/camera/3", 3, "camera")));
+  cases.push_back(boost::shared_ptr<BenchmarkCase>(new ArPoseMarkerCase(&node, "ar_pose_marker/camera/32", 32, "camera")));
+  cases.push_back(boost::shared_ptr<BenchmarkCase>(new JointRequestCase));
+  cases.push_back(boost::shared_ptr<BenchmarkCase>(new TaskRequestCase));
+  cases.push_back(boost::shared_ptr<BenchmarkCase>(new ToolRequestCase));
+  cases.push_back(boost::shared_ptr<BenchmarkCase>(new DepthRoiCase("depth_roi/640x480", 640, 480)));
+  cases.push_back(boost::shared_ptr<BenchmarkCase>(new DepthRoiCase("depth_roi/1280x720", 1280, 720)));
+  cases.push_back(boost::shared_ptr<BenchmarkCase>(new VoxelInsertCase("voxel/insert/640x480", 640, 480)));
+  cases.push_back(boost::shared_ptr<BenchmarkCase>(new VoxelPathCase));
+  if (use_demo_tick && ros::service::exists("goal_joint_space_path", false))
+    cases.push_back(boost::shared_ptr<BenchmarkCase>(new DemoTickCase(&node)));
+  else if (use_demo_tick)
+    printf("goal_joint_space_path is not served, demo_tick is skipped\n");
+
+  std::vector<BenchmarkResult> result;
+  int regressions = 0;
+  printf("%-28s %12s %12s %12s %10s\n", "case", "mean [ns]", "min [ns]", "max [ns]", "vs base");
+  for (size_t i = 0; i < cases.size(); i++)
+  {
+    result.push_back(measure(*cases[i], batches, batch_time));
+    const BenchmarkResult &r = result.back();
+    printf("%-28s %12.1f %12.1f %12.1f", r.name.c_str(), r.mean, r.min, r.max);
+
+    std::map<std::string, double>::const_iterator base = baseline.find(r.name);
+    if (base != baseline.end() && base->second > 0.0)
+    {
+      double change = r.min / base->second - 1.0;
+      bool is_regression = change > tolerance;
+      if (is_regression) regressions++;
+      printf(" %+9.1f%%%s", change * 100.0, is_regression ? "  SLOWER" : "");
+    }
+    printf("\n");
+  }
+
+  if (!out_file.empty())
+  {
+    FILE *file = fopen(out_file.c_str(), "w");
+    if (file == NULL)
+    {
+      printf("Cannot write %s\n", out_file.c_str());
+      return 1;
+    }
+    writeResults(file, result, batches, batch_time);
+    fclose(file);
+  }
+
+  if (regressions > 0)
+  {
+    printf("%d case(s) slower than the baseline by more than %.0f %%\n", regressions, tolerance * 100.0);
+    return 2;
+  }
+  return 0;
+}
@@ -18,12 +18,68 @@
 
 #include "open_manipulator_pick_and_place/open_manipulator_pick_and_place.h"
 
+// Built-in pose library, indexed by the POSE_* keys. pose_file overrides it.
+static const open_manipulator_pick_and_place::PoseEntry DEFAULT_POSES[NUM_OF_POSE] =
+{
+  {"home",             4, { 0.01, -0.80,  0.00, 1.90}},
+  {"home_gripper",     1, { 0.0}},
+  {"demo_home",        4, { 0.00, -1.05,  0.35, 0.70}},
+  {"initial",          4, { 0.01, -0.80,  0.00, 1.90}},
+  {"place",            4, { 1.57, -0.21, -0.15, 1.89}},
+  {"gripper_open",     1, { 0.010}},
+  {"gripper_close",    1, {-0.008}},
+  {"grip_orientation", 4, { 0.74,  0.00,  0.66, 0.00}},
+  {"pick",             3, { 0.005, 0.000, 0.033}},
+  {"place_box_0",      3, { 0.015, 0.123, 0.065}},
+  {"place_box_1",      3, { 0.015, 0.105, 0.086}},
+  {"place_box_2",      3, { 0.019, 0.095, 0.123}},
+  {"lift_box_0",       3, { 0.015, 0.102, 0.170}},
+  {"lift_height",      2, { 0.170, 0.180}},
+  {"move_time",        1, { 2.0}},
+  {"approach_time",    1, { 3.0}},
+  {"grip_time",        1, { 1.0}},
+  {"open_time",        1, { 3.0}},
+  {"third_grip_time",  1, { 2.0}},
+  {"home_return_time", 1, { 0.01}},
+  {"letter_move_time", 1, { 1.0}},
+  {"letter_lift_time", 1, { 0.1}},
+  {"letter_i",         4, {-0.063,  0.061, -1.488, -0.012}},
+  {"letter_r",         4, {-0.015,  0.030,  0.779,  1.759}},
+  {"letter_r_lift",    4, {-0.015, -0.100,  0.779,  1.759}},
+  {"letter_a",         4, {-0.032,  0.078,  0.894,  0.021}},
+  {"letter_s",         4, { 0.000, -1.085,  0.508, -0.341}},
+  {"letter_c",         4, {-0.031, -1.235,  0.032,  1.119}},
+};
+
 OpenManipulatorPickandPlace::OpenManipulatorPickandPlace()
-: node_handle_(""),
-  priv_node_handle_("~"),
+: OpenManipulatorPickandPlace(ros::NodeHandle(""), ros::NodeHandle("~"))
+{
+}
+
+OpenManipulatorPickandPlace::OpenManipulatorPickandPlace(ros::NodeHandle node_handle, ros::NodeHandle priv_node_handle)
+: node_handle_(node_handle),
+  priv_node_handle_(priv_node_handle),
   mode_state_(0),
   demo_count_(0),
-  pick_ar_id_(0)
+  pick_ar_id_(0),
+  perception_demand_(PERCEPTION_DEMAND_LOW),
+  held_height_(-1.0),
+  use_voxel_grid_(false),
+  is_path_blocked_(false),
+  num_of_blocked_path_(0),
+  blocked_since_(0.0),
+  blocked_path_timeout_(10.0),
+  is_resume_pending_(false),
+  is_holding_(false),
+  gripper_command_(0.0),
+  wait_marker_id_(-1),
+  num_of_failed_command_(0),
+  command_retries_(0),
+  max_command_retries_(2),
+  command_retry_delay_(0.5),
+  num_of_aborted_demo_(0),
+  logged_demo_count_(-1),
+  poses_(DEFAULT_POSES, NUM_OF_POSE)
 {
   present_joint_angle_.resize(NUM_OF_JOINT_AND_TOOL, 0.0);
   present_kinematic_position_.resize(3, 0.0);
@@ -33,24 +89,246 @@ OpenManipulatorPickandPlace::OpenManipulatorPickandPlace()
   joint_name_.push_back("joint3");
   joint_name_.push_back("joint4");
 
+  // On the SCHED_FIFO control thread (see control_loop.h) the tick skips
+  // printText(), which forks a shell for clear and prints a screen full,
+  // and a controller call may block it for a fraction of the period only
+  is_realtime_ = priv_node_handle_.param<bool>("realtime", false);
+
+  initEventLog();
+  initPoseLibrary();
+  initCameraModel();
   initServiceClient();
   initSubscribe();
+  initPublisher();
+  initStop();
+  initCheckpoint();
+
+  // Last, as its callbacks use all of the above
+  if (is_realtime_)
+  {
+    perception_spinner_.reset(new ros::AsyncSpinner(1, &perception_queue_));
+    perception_spinner_->start();
+  }
 }
 
 OpenManipulatorPickandPlace::~OpenManipulatorPickandPlace()
 {
-  if (ros::isStarted())
+  if (perception_spinner_) perception_spinner_->stop();
+
+  // ROS is shut down by the owner (main() or the nodelet manager), not here,
+  // so that unloading the nodelet does not take the whole manager down.
+}
+
+void OpenManipulatorPickandPlace::initEventLog()
+{
+  // Default files are named after the node, or the nodelet in a manager
+  std::string name = open_manipulator_pick_and_place::nodeFileName(priv_node_handle_.getNamespace());
+  std::string file = priv_node_handle_.param<std::string>("event_log_file",
+                                                         ros::file_log::getLogDirectory() + "/" + name + "_events.bin");
+  // Echoed only where there is no status screen to clear it, the screen
+  // shows the last events itself
+  bool echo = priv_node_handle_.param<bool>("event_log_echo", is_realtime_);
+  if (!event_log_.open(file, echo))
+  {
+    ROS_ERROR("Cannot open the event log %s, events are only printed", file.c_str());
+    event_log_.open("", echo);
+  }
+
+  // Fixed size ring of the last records, dumped next to it on failures and fatal signals
+  if (priv_node_handle_.param<bool>("flight_recorder", true))
+  {
+    std::string directory = priv_node_handle_.param<std::string>("flight_recorder_directory", ros::file_log::getLogDirectory());
+    int records = priv_node_handle_.param<int>("flight_recorder_records", open_manipulator_pick_and_place::FlightRecorder::DEFAULT_CAPACITY);
+    double seconds = priv_node_handle_.param<double>("flight_recorder_seconds", 30.0);
+    if (flight_recorder_.open(directory, name + "_flight", records, seconds))
+      flight_recorder_.installSignalHandlers();
+    else
+      ROS_ERROR("Cannot create the flight recorder %s/%s_flight.ring, or another instance uses it", directory.c_str(), name.c_str());
+  }
+
+  // Chrome trace event JSON of every demo run, off by default
+  if (priv_node_handle_.param<bool>("trace", false))
+  {
+    trace_.enable(priv_node_handle_.param<std::string>("trace_directory", ros::file_log::getLogDirectory()),
+                  name + "_trace");
+  }
+}
+
+void OpenManipulatorPickandPlace::initPoseLibrary()
+{
+  // Without a file the built-in poses are used
+  std::string file = priv_node_handle_.param<std::string>("pose_file", "");
+  if (file.empty()) return;
+
+  std::string error;
+  if (poses_.load(file, &error))
+    poses_.update();
+  else
+    ROS_ERROR("Cannot load the pose library, using the built-in poses: %s", error.c_str());
+
+  if (priv_node_handle_.param<bool>("pose_file_watch", true) && !poses_.watch(file))
+    ROS_ERROR("Cannot watch %s for changes, poses are not reloaded", file.c_str());
+}
+
+void OpenManipulatorPickandPlace::logEvent(uint32_t event, double a0, double a1)
+{
+  event_log_.log(event, a0, a1);
+  flight_recorder_.record(event, a0, a1);
+}
+
+void OpenManipulatorPickandPlace::initCameraModel()
+{
+  camera_frame_            = priv_node_handle_.param<std::string>("camera_frame", "camera");
+  use_motion_compensation_ = priv_node_handle_.param<bool>("motion_compensation", true);
+
+  // link5 -> camera as x y z yaw pitch roll, the arguments of a static_transform_publisher
+  std::vector<double> extrinsic;
+  if (priv_node_handle_.getParam("camera_extrinsic", extrinsic))
+  {
+    if (extrinsic.size() == 6)
+      arm_kinematics_.setCameraExtrinsic(extrinsic[0], extrinsic[1], extrinsic[2], extrinsic[3], extrinsic[4], extrinsic[5]);
+    else
+      ROS_ERROR("camera_extrinsic needs 6 values (x y z yaw pitch roll), using the raspicam mount");
+  }
+
+  // TF is only listened to for this check; 0 disables it
+  double tf_comparison_period = priv_node_handle_.param<double>("tf_comparison_period", 1.0);
+  if (tf_comparison_period > 0.0)
+  {
+    camera_transform_monitor_.reset(new open_manipulator_pick_and_place::CameraTransformMonitor(
+        node_handle_, joint_state_buffer_, arm_kinematics_,
+        priv_node_handle_.param<std::string>("world_frame", "world"), camera_frame_, tf_comparison_period));
+  }
+
+  // Marker topics with the error of a fresh marker, its growth with age and
+  // the age limit; fixed cameras do not move with the arm
+  std::vector<std::string> topic;
+  std::vector<double> sigma, drift, max_age;
+  std::vector<bool> is_fixed;
+  priv_node_handle_.param("marker_sources", topic, std::vector<std::string>(1, "/ar_pose_marker"));
+  priv_node_handle_.getParam("marker_source_sigma", sigma);
+  priv_node_handle_.getParam("marker_source_drift", drift);
+  priv_node_handle_.getParam("marker_source_max_age", max_age);
+  priv_node_handle_.getParam("marker_source_fixed", is_fixed);
+  for (size_t i = 0; i < topic.size(); i++)
   {
-    ros::shutdown();
-    ros::waitForShutdown();
+    open_manipulator_pick_and_place::MarkerSource source;
+    source.topic = topic[i];
+    source.sigma = i < sigma.size() && sigma[i] > 0.0 ? sigma[i] : 0.01;
+    source.drift = i < drift.size() ? drift[i] : 0.05;
+    source.max_age = i < max_age.size() ? max_age[i] : 1.0;
+    source.is_fixed = i < is_fixed.size() ? is_fixed[i] : false;
+    marker_fusion_.addSource(source);
   }
+
+  // Footprint read under a marker and what the heights are made of
+  depth_roi_half_size_ = priv_node_handle_.param<double>("depth_roi_half_size", 0.012);
+  depth_scale_         = priv_node_handle_.param<double>("depth_scale", 0.001);
+  depth_max_age_       = priv_node_handle_.param<double>("depth_max_age", 0.5);
+  grasp_below_top_     = priv_node_handle_.param<double>("grasp_below_top", 0.020);
+  grasp_min_height_    = priv_node_handle_.param<double>("grasp_min_height", 0.010);
+  place_clearance_     = priv_node_handle_.param<double>("place_clearance", 0.005);
+
+  // Voxel grid of the workspace from the depth images, off by default
+  use_voxel_grid_ = priv_node_handle_.param<bool>("voxel_grid", false);
+  if (use_voxel_grid_)
+  {
+    open_manipulator_pick_and_place::VoxelGridConfig config = open_manipulator_pick_and_place::defaultVoxelGridConfig();
+    double resolution = priv_node_handle_.param<double>("voxel_resolution", config.resolution);
+    for (int i = 0; i < 3; i++)
+      config.size[i] = (int)ceil(config.size[i] * config.resolution / resolution);  // same workspace
+    config.resolution = resolution;
+    config.decay_time = priv_node_handle_.param<double>("voxel_decay_time", config.decay_time);
+    config.stride     = priv_node_handle_.param<int>("voxel_stride", config.stride);
+    voxel_grid_.configure(config);
+    perception_voxel_grid_.configure(config);
+  }
+  voxel_inflation_      = (int)ceil(priv_node_handle_.param<double>("voxel_inflation", 0.01) / voxel_grid_.config().resolution);
+  voxel_ignore_radius_  = priv_node_handle_.param<double>("voxel_ignore_radius", 0.05);
+  blocked_path_timeout_ = priv_node_handle_.param<double>("blocked_path_timeout", 10.0);
+  use_shortcut_transit_ = priv_node_handle_.param<bool>("shortcut_transit", false);
 }
 
 void OpenManipulatorPickandPlace::initServiceClient()
 {
-  goal_joint_space_path_client_ = node_handle_.serviceClient<open_manipulator_msgs::SetJointPosition>("goal_joint_space_path");
-  goal_tool_control_client_ = node_handle_.serviceClient<open_manipulator_msgs::SetJointPosition>("goal_tool_control");
-  goal_task_space_path_client_ = node_handle_.serviceClient<open_manipulator_msgs::SetKinematicsPose>("goal_task_space_path");
+  trajectory_.init(node_handle_, joint_name_,
+                   priv_node_handle_.param<double>("trajectory_timeout_margin", 2.0),
+                   priv_node_handle_.param<double>("hold_time", 0.1));
+  trajectory_.registerCallbacks(boost::bind(&OpenManipulatorPickandPlace::trajectoryDoneCallback, this, _1, _2),
+                                open_manipulator_pick_and_place::TrajectoryClient::FeedbackCallback());
+
+  // Hand picked path times are replaced by the shortest the joint limits allow
+  path_timing_.init(priv_node_handle_.param<bool>("auto_path_time", true),
+                    priv_node_handle_.param<std::vector<double> >("joint_velocity_limit", std::vector<double>(1, 2.0)),
+                    priv_node_handle_.param<std::vector<double> >("joint_acceleration_limit", std::vector<double>(1, 4.0)),
+                    priv_node_handle_.param<double>("path_time_safety_factor", 1.2),
+                    priv_node_handle_.param<double>("min_path_time", 0.2));
+
+  // Grip and release waits end once the gripper stops, the wait before a
+  // pick once its marker holds still; their times are only the limit
+  gripper_settle_.setLimits(priv_node_handle_.param<double>("gripper_settle_tolerance", 0.0005),
+                            priv_node_handle_.param<double>("gripper_settle_time", 0.3));
+  marker_settle_.setLimits(priv_node_handle_.param<double>("marker_settle_tolerance", 0.003),
+                           priv_node_handle_.param<double>("marker_settle_time", 0.5));
+
+  // A controller that does not answer fails the call after service_call_timeout
+  trajectory_.setCallTimeout(priv_node_handle_.param<double>("service_call_timeout", is_realtime_ ? 0.05 : 1.0));
+  max_command_retries_ = priv_node_handle_.param<int>("max_command_retries", 2);
+  command_retry_delay_ = priv_node_handle_.param<double>("command_retry_delay", 0.5);
+
+  // Commands sent before the controller is up would fail silently
+  double timeout = priv_node_handle_.param<double>("service_wait_timeout", 10.0);
+  if (!trajectory_.waitForServer(timeout))
+    ROS_WARN("Controller services not available after %.1f s, commands connect once they are", timeout);
+}
+
+void OpenManipulatorPickandPlace::trajectoryDoneCallback(uint8_t state, const open_manipulator_pick_and_place::TrajectoryFeedback &feedback)
+{
+  trace_.instant("goal done", "arm", TRACE_TRACK_ARM, "state", state);
+  if (state == TRAJECTORY_ABORTED)
+    logEvent(EVENT_TRAJECTORY_ABORTED, feedback.elapsed, trajectory_.pathTime());
+  else if (state == TRAJECTORY_PREEMPTED)
+    logEvent(EVENT_TRAJECTORY_PREEMPTED, feedback.progress * 100.0);
+}
+
+void OpenManipulatorPickandPlace::initStop()
+{
+  stop_.init(node_handle_, joint_name_, &joint_state_buffer_,
+             priv_node_handle_.param<double>("hold_time", 0.1),
+             priv_node_handle_.param<double>("stop_latency_budget", 0.009),
+             boost::bind(&OpenManipulatorPickandPlace::logEvent, this, _1, _2, _3));
+  stop_.setCallTimeout(priv_node_handle_.param<double>("service_call_timeout", 1.0));
+
+  // '3' is handled on the keyboard thread as soon as it is typed
+  keyboard_.start("3", boost::bind(&open_manipulator_pick_and_place::StopController::request, &stop_, STOP_SOURCE_KEY));
+}
+
+void OpenManipulatorPickandPlace::initCheckpoint()
+{
+  memset(&saved_state_, 0, sizeof(saved_state_));
+  saved_state_.mode_state = -1;  // the first tick saves
+  if (!priv_node_handle_.param<bool>("checkpoint", true)) return;
+
+  std::string file = priv_node_handle_.param<std::string>("checkpoint_file",
+                                                         open_manipulator_pick_and_place::checkpointDirectory() + "/" +
+                                                         open_manipulator_pick_and_place::nodeFileName(priv_node_handle_.getNamespace()) +
+                                                         "_checkpoint.bin");
+  if (!checkpoint_.open(file))
+  {
+    ROS_ERROR("Cannot open the checkpoint %s, the demo is not resumed after a restart", file.c_str());
+    return;
+  }
+
+  // Only a demo that was running, and not long ago, as the cell may have changed since
+  open_manipulator_pick_and_place::SequenceState state;
+  double max_age = priv_node_handle_.param<double>("resume_max_age", 600.0);
+  if (priv_node_handle_.param<bool>("resume", true) && checkpoint_.load(&state) && state.mode_state == DEMO_START &&
+      (open_manipulator_pick_and_place::EventLog::now() - state.stamp) * 1e-9 < max_age)
+  {
+    saved_state_ = state;
+    is_resume_pending_ = true;
+    ROS_INFO("Resuming the demo from step %d once the joint states are read", state.demo_count);
+  }
 }
 
 void OpenManipulatorPickandPlace::initSubscribe()
@@ -58,70 +336,452 @@ void OpenManipulatorPickandPlace::initSubscribe()
   open_manipulator_states_sub_ = node_handle_.subscribe("states", 10, &OpenManipulatorPickandPlace::manipulatorStatesCallback, this);
   open_manipulator_joint_states_sub_ = node_handle_.subscribe("joint_states", 10, &OpenManipulatorPickandPlace::jointStatesCallback, this);
   open_manipulator_kinematics_pose_sub_ = node_handle_.subscribe("gripper/kinematics_pose", 10, &OpenManipulatorPickandPlace::kinematicsPoseCallback, this);
-  ar_pose_marker_sub_ = node_handle_.subscribe("/ar_pose_marker", 10, &OpenManipulatorPickandPlace::arPoseMarkerCallback, this);
+
+  // With realtime set markers and depth images are taken on a thread of
+  // their own, so a full frame voxelised never holds up the tick
+  ros::NodeHandle perception_node_handle(node_handle_);
+  if (is_realtime_) perception_node_handle.setCallbackQueue(&perception_queue_);
+
+  for (size_t i = 0; i < marker_fusion_.numOfSource(); i++)
+  {
+    ar_pose_marker_sub_.push_back(perception_node_handle.subscribe<ar_track_alvar_msgs::AlvarMarkers>(
+        marker_fusion_.source(i).topic, 10, boost::bind(&OpenManipulatorPickandPlace::arPoseMarkerCallback, this, _1, i)));
+  }
+
+  // Aligned depth of the D435, e.g. /camera/aligned_depth_to_color/image_raw, and its camera_info next to it
+  std::string depth_topic = priv_node_handle_.param<std::string>("depth_topic", "");
+  if (!depth_topic.empty())
+  {
+    depth_image_sub_ = perception_node_handle.subscribe(depth_topic, 1, &OpenManipulatorPickandPlace::depthImageCallback, this);
+    depth_info_sub_ = perception_node_handle.subscribe(depth_topic.substr(0, depth_topic.rfind('/') + 1) + "camera_info", 1,
+                                                       &OpenManipulatorPickandPlace::depthInfoCallback, this);
+  }
+}
+
+void OpenManipulatorPickandPlace::initPublisher()
+{
+  // Latched, so a detector started after the node still gets the current demand
+  perception_demand_pub_ = node_handle_.advertise<std_msgs::UInt8>("perception_demand", 1, true);
+
+  std_msgs::UInt8 msg;
+  msg.data = perception_demand_ = perceptionDemand();
+  perception_demand_pub_.publish(msg);
+
+  // Off by default, the stress test (launch/load_test.launch) turns it on
+  load_monitor_.init(node_handle_, priv_node_handle_.param<double>("load_statistics_period", 0.0));
 }
 
 bool OpenManipulatorPickandPlace::setJointSpacePath(std::vector<std::string> joint_name, std::vector<double> joint_angle, double path_time)
 {
-  open_manipulator_msgs::SetJointPosition srv;
-  srv.request.joint_position.joint_name = joint_name;
-  srv.request.joint_position.position = joint_angle;
-  srv.request.path_time = path_time;
+  if (!isJointPathClear(joint_angle)) return false;
+  if (!stop_.beginCommand()) return false;  // stopped, dropped
+
+  path_time = path_timing_.jointPathTime(&present_joint_angle_[0], &joint_angle[0], path_time);
+  open_manipulator_pick_and_place::TraceSpan span(trace_, "goal_joint_space_path", "rpc", TRACE_TRACK_CONTROL, "path_time", path_time);
+  flight_recorder_.record(EVENT_JOINT_COMMAND, joint_angle.at(0), joint_angle.at(1), joint_angle.at(2), joint_angle.at(3), path_time);
+  uint8_t state = trajectory_.sendJointGoal(joint_name, joint_angle, path_time, ros::Time::now().toSec());
+  stop_.endCommand();
+  updateCommandResult(state, EVENT_SERVICE_JOINT_SPACE_PATH, trajectory_.jointSpacePath().deadline());
+  return state == TRAJECTORY_PENDING;
+}
+
+bool OpenManipulatorPickandPlace::setToolControl(std::vector<double> joint_angle)
+{
+  if (!stop_.beginCommand()) return false;
+
+  open_manipulator_pick_and_place::TraceSpan span(trace_, "goal_tool_control", "rpc", TRACE_TRACK_CONTROL);
+  flight_recorder_.record(EVENT_TOOL_COMMAND, joint_angle.at(0));
+  uint8_t state = trajectory_.sendToolGoal(joint_angle);
+  stop_.endCommand();
+  gripper_command_ = joint_angle.at(0);
+  is_holding_ = gripper_command_ <= poses_.value(POSE_GRIPPER_CLOSE);
+  updateCommandResult(state, EVENT_SERVICE_TOOL_CONTROL, trajectory_.toolControl().deadline());
+  return state == TRAJECTORY_SUCCEEDED;
+}
+
+bool OpenManipulatorPickandPlace::setTaskSpacePath(std::vector<double> kinematics_pose,std::vector<double> kienmatics_orientation, double path_time)
+{
+  if (!isTaskPathClear(kinematics_pose)) return false;
+  if (!stop_.beginCommand()) return false;
+
+  path_time = path_timing_.taskPathTime(arm_kinematics_, &present_joint_angle_[0], &kinematics_pose[0], &kienmatics_orientation[0], path_time);
+  open_manipulator_pick_and_place::TraceSpan span(trace_, "goal_task_space_path", "rpc", TRACE_TRACK_CONTROL, "path_time", path_time);
+  flight_recorder_.record(EVENT_TASK_COMMAND, kinematics_pose.at(0), kinematics_pose.at(1), kinematics_pose.at(2), path_time);
+  uint8_t state = trajectory_.sendTaskGoal("gripper", kinematics_pose, kienmatics_orientation, path_time, ros::Time::now().toSec());
+  stop_.endCommand();
+  updateCommandResult(state, EVENT_SERVICE_TASK_SPACE_PATH, trajectory_.taskSpacePath().deadline());
+  return state == TRAJECTORY_PENDING;
+}
+
+void OpenManipulatorPickandPlace::recordFrameToCommandLatency(const ArMarker &marker)
+{
+  if (marker.stamp.isZero()) return;
+  frame_to_command_latency_.addSample((ros::Time::now() - marker.stamp).toSec());
+}
 
-  if (goal_joint_space_path_client_.call(srv))
+bool OpenManipulatorPickandPlace::cameraToWorld(const ros::Time &stamp, const double camera_position[3], double world_position[3])
+{
+  double joint_angle[open_manipulator_pick_and_place::JointStateBuffer::NUM_OF_JOINT];
+  if (!joint_state_buffer_.interpolate(stamp.toSec(), joint_angle))
   {
-    return srv.response.is_planned;
+    ROS_WARN_THROTTLE(5.0, "No joint state at the marker capture time, marker ignored");
+    return false;
   }
-  return false;
+
+  open_manipulator_pick_and_place::transformPoint(arm_kinematics_.cameraToWorld(joint_angle), camera_position, world_position);
+  return true;
 }
 
-bool OpenManipulatorPickandPlace::setToolControl(std::vector<double> joint_angle)
+// World heights of the top of what is under world_position and of what it
+// stands on (NAN when the ring around it is not seen), from the last depth
+// image and the joint positions at its capture time
+bool OpenManipulatorPickandPlace::depthHeight(const double world_position[3], double *top_z, double *support_z)
 {
-  open_manipulator_msgs::SetJointPosition srv;
-  srv.request.joint_position.joint_name.push_back("gripper");
-  srv.request.joint_position.position = joint_angle;
+  std::lock_guard<std::mutex> lock(perception_mutex_);
+  if (!depth_image_ || !depth_sampler_.hasIntrinsics()) return false;
 
-  if (goal_tool_control_client_.call(srv))
+  const sensor_msgs::Image &image = *depth_image_;
+  if ((ros::Time::now() - image.header.stamp).toSec() > depth_max_age_)
   {
-    return srv.response.is_planned;
+    ROS_WARN_THROTTLE(5.0, "Depth image older than %.1f s, using the pose library's heights", depth_max_age_);
+    return false;
   }
-  return false;
+  if (image.data.size() < (size_t)image.step * image.height) return false;
+
+  double joint_angle[open_manipulator_pick_and_place::JointStateBuffer::NUM_OF_JOINT];
+  if (!joint_state_buffer_.interpolate(image.header.stamp.toSec(), joint_angle)) return false;
+  open_manipulator_pick_and_place::RigidTransform camera_to_world = arm_kinematics_.cameraToWorld(joint_angle);
+
+  double center[3];
+  open_manipulator_pick_and_place::transformPoint(open_manipulator_pick_and_place::inverse(camera_to_world), world_position, center);
+
+  open_manipulator_pick_and_place::DepthRoiResult result;
+  bool is_sampled = false;
+  if (image.encoding == sensor_msgs::image_encodings::TYPE_16UC1 || image.encoding == sensor_msgs::image_encodings::MONO16)
+    is_sampled = depth_sampler_.sample((const uint16_t *)&image.data[0], image.width, image.height, image.step,
+                                       depth_scale_, center, depth_roi_half_size_, &result);
+  else if (image.encoding == sensor_msgs::image_encodings::TYPE_32FC1)
+    is_sampled = depth_sampler_.sample((const float *)&image.data[0], image.width, image.height, image.step,
+                                       1.0, center, depth_roi_half_size_, &result);
+  if (!is_sampled) return false;
+
+  double point[3], world_point[3];
+  open_manipulator_pick_and_place::DepthRoiSampler::alongRay(center, result.top_depth, point);
+  open_manipulator_pick_and_place::transformPoint(camera_to_world, point, world_point);
+  *top_z = world_point[2];
+
+  *support_z = NAN;
+  if (result.support_pixels > 0)
+  {
+    open_manipulator_pick_and_place::DepthRoiSampler::alongRay(center, result.support_depth, point);
+    open_manipulator_pick_and_place::transformPoint(camera_to_world, point, world_point);
+    *support_z = world_point[2];
+  }
+
+  logEvent(EVENT_DEPTH_HEIGHT, *top_z, *support_z);
+  return true;
 }
 
-bool OpenManipulatorPickandPlace::setTaskSpacePath(std::vector<double> kinematics_pose,std::vector<double> kienmatics_orientation, double path_time)
+// grasp_below_top under the top of the box, but at least grasp_min_height
+// above what it stands on; the pose library's z without a depth image
+double OpenManipulatorPickandPlace::pickHeight(const ArMarker &marker)
+{
+  held_height_ = -1.0;
+
+  double top_z, support_z;
+  if (!depthHeight(marker.position, &top_z, &support_z)) return poses_.value(POSE_PICK, 2);
+
+  return open_manipulator_pick_and_place::pickGraspHeight(top_z, support_z, grasp_below_top_, grasp_min_height_, &held_height_);
+}
+
+// The held box's bottom place_clearance above whatever is at the place
+// position (the table or the last box of the stack)
+double OpenManipulatorPickandPlace::placeHeight(const std::vector<double> &place_position)
+{
+  double top_z, support_z;
+  if (held_height_ < 0.0 || !depthHeight(&place_position[0], &top_z, &support_z)) return place_position.at(2);
+
+  return open_manipulator_pick_and_place::placeGraspHeight(top_z, held_height_, place_clearance_);
+}
+
+bool OpenManipulatorPickandPlace::isJointPathClear(const std::vector<double> &joint_angle)
+{
+  if (!use_voxel_grid_) return true;
+
+  double blocked_at = 0.0;
+  bool is_clear;
+  {
+    std::lock_guard<std::mutex> lock(perception_mutex_);
+    is_clear = open_manipulator_pick_and_place::isJointPathFree(voxel_grid_, arm_kinematics_, &present_joint_angle_[0], &joint_angle[0],
+                                                                8, voxel_inflation_, voxel_ignore_radius_, &blocked_at);
+  }
+  updatePathBlocked(is_clear, EVENT_SERVICE_JOINT_SPACE_PATH, blocked_at);
+  return is_clear;
+}
+
+bool OpenManipulatorPickandPlace::isTaskPathClear(const std::vector<double> &kinematics_pose)
+{
+  if (!use_voxel_grid_) return true;
+
+  double blocked_at = 0.0;
+  bool is_clear;
+  {
+    std::lock_guard<std::mutex> lock(perception_mutex_);
+    is_clear = open_manipulator_pick_and_place::isTaskPathFree(voxel_grid_, arm_kinematics_, &present_joint_angle_[0], &kinematics_pose[0],
+                                                               voxel_inflation_, voxel_ignore_radius_, &blocked_at);
+  }
+  updatePathBlocked(is_clear, EVENT_SERVICE_TASK_SPACE_PATH, blocked_at);
+  return is_clear;
+}
+
+// Logged once when a path becomes blocked, not on every retry
+void OpenManipulatorPickandPlace::updatePathBlocked(bool is_clear, uint8_t service, double blocked_at)
+{
+  if (!is_clear)
+  {
+    if (!is_path_blocked_) logEvent(EVENT_PATH_BLOCKED, service, blocked_at * 100.0);
+    num_of_blocked_path_++;
+  }
+  is_path_blocked_ = !is_clear;
+}
+
+// Failed, timed out and unplanned commands are counted for retryStep();
+// deadline is that of the service called
+void OpenManipulatorPickandPlace::updateCommandResult(uint8_t state, uint8_t service, double deadline)
 {
-  open_manipulator_msgs::SetKinematicsPose srv;
+  if (state == TRAJECTORY_REJECTED) logEvent(EVENT_PATH_NOT_PLANNED, service);
+  else if (state == TRAJECTORY_LOST) logEvent(EVENT_SERVICE_CALL_FAILED, service);
+  else if (state == TRAJECTORY_TIMED_OUT) logEvent(EVENT_SERVICE_CALL_TIMED_OUT, service, deadline);
+  else return;
+  num_of_failed_command_++;
+}
+
+// The step is sent again after command_retry_delay, the goals take absolute
+// targets; after max_command_retries the demo stops with the arm held
+void OpenManipulatorPickandPlace::retryStep(uint8_t step)
+{
+  demo_count_ = step;
+  if (command_retries_ < max_command_retries_)
+  {
+    command_retries_++;
+    logEvent(EVENT_STEP_RETRIED, step, command_retries_);
+    startWait(STEP_WAIT_TIME, command_retry_delay_);
+    return;
+  }
+
+  logEvent(EVENT_DEMO_ABORTED, step, command_retries_);
+  abortDemo();
+}
 
-  srv.request.end_effector_name = "gripper";
+// A blocked step is tried again on every tick until its path clears; after
+// blocked_path_timeout the demo stops as for a failed command
+void OpenManipulatorPickandPlace::holdBlockedStep(uint8_t step)
+{
+  demo_count_ = step;
+  double now = ros::Time::now().toSec();
+  if (blocked_since_ == 0.0) blocked_since_ = now;
+  if (blocked_path_timeout_ <= 0.0 || now - blocked_since_ < blocked_path_timeout_) return;
 
-  srv.request.kinematics_pose.pose.position.x = kinematics_pose.at(0);
-  srv.request.kinematics_pose.pose.position.y = kinematics_pose.at(1);
-  srv.request.kinematics_pose.pose.position.z = kinematics_pose.at(2);
+  logEvent(EVENT_PATH_BLOCKED_ABORTED, step, now - blocked_since_);
+  abortDemo();
+}
 
-  srv.request.kinematics_pose.pose.orientation.w = kienmatics_orientation.at(0);
-  srv.request.kinematics_pose.pose.orientation.x = kienmatics_orientation.at(1);
-  srv.request.kinematics_pose.pose.orientation.y = kienmatics_orientation.at(2);
-  srv.request.kinematics_pose.pose.orientation.z = kienmatics_orientation.at(3);
+// Stops the demo with the arm held where it is
+void OpenManipulatorPickandPlace::abortDemo()
+{
+  num_of_aborted_demo_++;
+  command_retries_ = 0;
+  blocked_since_ = 0.0;
+  step_wait_.cancel();
+  trajectory_.cancelGoal(ros::Time::now().toSec());
+  mode_state_ = DEMO_STOP;
+}
 
-  srv.request.path_time = path_time;
+// From the grip straight to the place pose, skipping the initial pose, when
+// nothing in the voxel grid is in the way
+uint8_t OpenManipulatorPickandPlace::shortcutToPlace()
+{
+  if (!use_shortcut_transit_ || !use_voxel_grid_) return SHORTCUT_NOT_TAKEN;
 
-  if (goal_task_space_path_client_.call(srv))
+  std::vector<double> joint_angle = poses_.vector(POSE_PLACE);
   {
-    return srv.response.is_planned;
+    std::lock_guard<std::mutex> lock(perception_mutex_);
+    if (!open_manipulator_pick_and_place::isJointPathFree(voxel_grid_, arm_kinematics_, &present_joint_angle_[0], &joint_angle[0],
+                                                          8, voxel_inflation_, voxel_ignore_radius_))
+      return SHORTCUT_NOT_TAKEN;
   }
+  return setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_MOVE_TIME)) ? SHORTCUT_SENT : SHORTCUT_FAILED;
+}
+
+// On every change of mode, step or grip, a few stores into the mapped file
+void OpenManipulatorPickandPlace::saveCheckpoint()
+{
+  if (is_resume_pending_) return;  // keep the one to resume
+  if (saved_state_.mode_state == mode_state_ && saved_state_.demo_count == demo_count_ &&
+      saved_state_.is_holding == (uint32_t)is_holding_)
+    return;
+
+  saved_state_.mode_state = mode_state_;
+  saved_state_.demo_count = demo_count_;
+  saved_state_.pick_marker_id = -1;  // fixed by the step in this demo
+  saved_state_.place_marker_id = -1;
+  saved_state_.is_holding = is_holding_;
+  saved_state_.gripper = gripper_command_;
+  saved_state_.held_height = held_height_;
+  checkpoint_.save(saved_state_);
+}
+
+// Waits for the joint states, then goes on with the checkpointed demo from
+// the step resumeStep() finds safe for where the arm and gripper are now
+void OpenManipulatorPickandPlace::resumeSequence()
+{
+  open_manipulator_pick_and_place::JointSample sample;
+  if (!joint_state_buffer_.latest(&sample)) return;
+
+  is_resume_pending_ = false;
+  if (stop_.isStopped()) return;
+
+  bool is_holding = open_manipulator_pick_and_place::isHoldingBox(saved_state_, present_joint_angle_.at(4), poses_.value(POSE_GRIPPER_CLOSE));
+  mode_state_ = DEMO_START;
+  demo_count_ = resumeStep(saved_state_.demo_count, is_holding);
+  held_height_ = is_holding ? saved_state_.held_height : -1.0;
+  logged_demo_count_ = -1;
+  trace_.beginRun();
+  logEvent(EVENT_SEQUENCE_RESUMED, saved_state_.demo_count, demo_count_);
+
+  // The controller may have restarted as well, grip the box again
+  if (is_holding)
+  {
+    std::vector<double> gripper_value;
+    gripper_value.push_back(poses_.value(POSE_GRIPPER_CLOSE));
+    setToolControl(gripper_value);
+  }
+}
+
+// The arm may have stopped anywhere along its last path, so a cycle (base
+// to base + 8, one per box) goes on from the joint space move that starts
+// the part it was in: with the box in the gripper from the move to the
+// initial pose after gripping, without it (not gripped yet, or dropped)
+// from the cycle's initial pose, and after the release from opening the
+// gripper again. The closing steps are fixed joint moves and waits and go
+// on where they were.
+int OpenManipulatorPickandPlace::resumeStep(int step, bool is_holding)
+{
+  if (step <= 0 || step >= 28) return std::max(step, 0);
+
+  int base = 1 + (step - 1) / 9 * 9;
+  if (is_holding) return base + 4;
+  if (step - base >= 7) return base + 7;
+  return base;
+}
+
+void OpenManipulatorPickandPlace::startWait(uint8_t condition, double time, int marker_id)
+{
+  wait_marker_id_ = marker_id;
+  gripper_settle_.reset();
+  marker_settle_.reset();
+  step_wait_.start(condition, time, ros::Time::now().toSec());
+}
+
+// Checks the wait's condition on the latest gripper position and fused
+// marker; no controller traffic while waiting
+bool OpenManipulatorPickandPlace::isStepWaiting()
+{
+  if (!step_wait_.isWaiting()) return false;
+
+  double now = ros::Time::now().toSec();
+  bool is_met = false;
+  if (step_wait_.condition() == STEP_WAIT_GRIPPER)
+  {
+    gripper_settle_.update(now, &present_joint_angle_.at(4), 1);
+    is_met = gripper_settle_.isSettled(now);
+  }
+  else if (step_wait_.condition() == STEP_WAIT_MARKER)
+  {
+    open_manipulator_pick_and_place::FusedMarker marker;
+    bool is_found;
+    {
+      std::lock_guard<std::mutex> lock(perception_mutex_);
+      is_found = wait_marker_id_ >= 0 && marker_fusion_.find(wait_marker_id_, now, &marker);
+    }
+    if (is_found)
+      marker_settle_.update(now, marker.position, 3);
+    else
+      marker_settle_.reset();
+    is_met = marker_settle_.isSettled(now);
+  }
+
+  if (step_wait_.update(now, is_met)) return true;
+  if (step_wait_.isTimedOut()) logEvent(EVENT_STEP_WAIT_TIMED_OUT, logged_demo_count_, step_wait_.elapsed(now));
   return false;
 }
 
+uint8_t OpenManipulatorPickandPlace::perceptionDemand()
+{
+  if (mode_state_ == DEMO_STOP) return PERCEPTION_DEMAND_NONE;
+  if (mode_state_ != DEMO_START) return PERCEPTION_DEMAND_LOW;  // markers are shown on screen
+
+  switch (demo_count_)
+  {
+    // Wait at the initial pose and pick steps that read ar_marker_pose
+    case 2:
+    case 3:
+    case 11:
+    case 12:
+    case 20:
+    case 21:
+      return PERCEPTION_DEMAND_FULL;
+    default:
+      return PERCEPTION_DEMAND_NONE;
+  }
+}
+
+void OpenManipulatorPickandPlace::updatePerceptionDemand()
+{
+  uint8_t demand = perceptionDemand();
+  if (demand == perception_demand_) return;
+
+  std_msgs::UInt8 msg;
+  msg.data = perception_demand_ = demand;
+  perception_demand_pub_.publish(msg);
+}
+
+// A reloaded pose library is applied outside of the demo or before the
+// initial pose of a pick, never between the steps of one pick and place
+bool OpenManipulatorPickandPlace::isCycleBoundary()
+{
+  if (mode_state_ != DEMO_START) return true;
+
+  switch (demo_count_)
+  {
+    case 0:
+    case 1:
+    case 10:
+    case 19:
+      return true;
+    default:
+      return false;
+  }
+}
+
 void OpenManipulatorPickandPlace::manipulatorStatesCallback(const open_manipulator_msgs::OpenManipulatorState::ConstPtr &msg)
 {
-  if (msg->open_manipulator_moving_state == msg->IS_MOVING)
-    open_manipulator_is_moving_ = true;
-  else
-    open_manipulator_is_moving_ = false;
+  load_monitor_.received(LOAD_TOPIC_STATES, ros::Time());
+
+  bool is_moving = (msg->open_manipulator_moving_state == msg->IS_MOVING);
+  if (is_moving != open_manipulator_is_moving_)
+  {
+    if (is_moving) trace_.begin("moving", "arm", TRACE_TRACK_ARM);
+    else trace_.end("moving", "arm", TRACE_TRACK_ARM);
+  }
+  open_manipulator_is_moving_ = is_moving;
+  trajectory_.movingState(is_moving, ros::Time::now().toSec());
 }
 
 void OpenManipulatorPickandPlace::jointStatesCallback(const sensor_msgs::JointState::ConstPtr &msg)
 {
+  load_monitor_.received(LOAD_TOPIC_JOINT_STATES, msg->header.stamp);
+
   std::vector<double> temp_angle;
   temp_angle.resize(NUM_OF_JOINT_AND_TOOL);
   for (int i = 0; i < msg->name.size(); i ++)
@@ -133,10 +793,16 @@ void OpenManipulatorPickandPlace::jointStatesCallback(const sensor_msgs::JointSt
     else if (!msg->name.at(i).compare("gripper"))  temp_angle.at(4) = (msg->position.at(i));
   }
   present_joint_angle_ = temp_angle;
+
+  ros::Time stamp = msg->header.stamp.isZero() ? ros::Time::now() : msg->header.stamp;
+  joint_state_buffer_.push(stamp.toSec(), temp_angle.data());
+  trajectory_.jointState(temp_angle.data(), ros::Time::now().toSec());
 }
 
 void OpenManipulatorPickandPlace::kinematicsPoseCallback(const open_manipulator_msgs::KinematicsPose::ConstPtr &msg)
 {
+  load_monitor_.received(LOAD_TOPIC_KINEMATICS_POSE, ros::Time());
+
   std::vector<double> temp_position;
   temp_position.push_back(msg->pose.position.x);
   temp_position.push_back(msg->pose.position.y);
@@ -145,9 +811,13 @@ void OpenManipulatorPickandPlace::kinematicsPoseCallback(const open_manipulator_
   present_kinematic_position_ = temp_position;
 }
 
-void OpenManipulatorPickandPlace::arPoseMarkerCallback(const ar_track_alvar_msgs::AlvarMarkers::ConstPtr &msg)
+void OpenManipulatorPickandPlace::arPoseMarkerCallback(const ar_track_alvar_msgs::AlvarMarkers::ConstPtr &msg, size_t source)
 {
-  std::vector<ArMarker> temp_buffer;
+  load_monitor_.received(LOAD_TOPIC_AR_POSE_MARKER, msg->header.stamp);
+  trace_.instant("markers", "perception", TRACE_TRACK_MARKER, "count", msg->markers.size());
+
+  ros::Time now = ros::Time::now();
+  std::vector<ArMarker> seen;
   for (int i = 0; i < msg->markers.size(); i ++)
   {
     ArMarker temp;
@@ -155,53 +825,171 @@ void OpenManipulatorPickandPlace::arPoseMarkerCallback(const ar_track_alvar_msgs
     temp.position[0] = msg->markers.at(i).pose.pose.position.x;
     temp.position[1] = msg->markers.at(i).pose.pose.position.y;
     temp.position[2] = msg->markers.at(i).pose.pose.position.z;
+    temp.stamp = msg->markers.at(i).header.stamp.isZero() ? msg->header.stamp : msg->markers.at(i).header.stamp;
 
+    const std::string &frame_id = msg->markers.at(i).header.frame_id.empty() ? msg->header.frame_id : msg->markers.at(i).header.frame_id;
+    if (use_motion_compensation_ && frame_id == camera_frame_)
+    {
+      double camera_position[3] = {temp.position[0], temp.position[1], temp.position[2]};
+      if (!cameraToWorld(temp.stamp, camera_position, temp.position)) continue;
+    }
+
+    flight_recorder_.record(EVENT_MARKER_SEEN, temp.id, temp.position[0], temp.position[1], temp.position[2],
+                            temp.stamp.isZero() ? 0.0 : (now - temp.stamp).toSec());
+    seen.push_back(temp);
+  }
+
+  std::lock_guard<std::mutex> lock(perception_mutex_);
+  marker_fusion_.beginView(source);
+  for (size_t i = 0; i < seen.size(); i++)
+    marker_fusion_.add(source, seen[i].id, seen[i].position, seen[i].stamp.isZero() ? now.toSec() : seen[i].stamp.toSec());
+
+  std::vector<open_manipulator_pick_and_place::FusedMarker> fused;
+  marker_fusion_.fuse(now.toSec(), &fused);
+
+  std::vector<ArMarker> temp_buffer;
+  for (size_t i = 0; i < fused.size(); i++)
+  {
+    ArMarker temp = {fused[i].id, {fused[i].position[0], fused[i].position[1], fused[i].position[2]}, ros::Time(fused[i].stamp)};
     temp_buffer.push_back(temp);
   }
+  fused_marker_pose_ = temp_buffer;
+}
+
+void OpenManipulatorPickandPlace::depthImageCallback(const sensor_msgs::Image::ConstPtr &msg)
+{
+  double fx, fy, cx, cy;
+  {
+    // Kept for the pick and place steps, which read the few pixels they need
+    std::lock_guard<std::mutex> lock(perception_mutex_);
+    depth_image_ = msg;
+    if (!use_voxel_grid_ || !depth_sampler_.hasIntrinsics()) return;
+    fx = depth_sampler_.fx();
+    fy = depth_sampler_.fy();
+    cx = depth_sampler_.cx();
+    cy = depth_sampler_.cy();
+  }
+  if (msg->data.size() < (size_t)msg->step * msg->height) return;
+
+  double joint_angle[open_manipulator_pick_and_place::JointStateBuffer::NUM_OF_JOINT];
+  if (!joint_state_buffer_.interpolate(msg->header.stamp.toSec(), joint_angle)) return;
+
+  open_manipulator_pick_and_place::TraceSpan span(trace_, "voxel_insert", "perception", TRACE_TRACK_MARKER);
+  open_manipulator_pick_and_place::RigidTransform camera_to_world = arm_kinematics_.cameraToWorld(joint_angle);
+  if (msg->encoding == sensor_msgs::image_encodings::TYPE_16UC1 || msg->encoding == sensor_msgs::image_encodings::MONO16)
+    perception_voxel_grid_.insert((const uint16_t *)&msg->data[0], msg->width, msg->height, msg->step, depth_scale_,
+                                  fx, fy, cx, cy, camera_to_world, msg->header.stamp.toSec());
+  else if (msg->encoding == sensor_msgs::image_encodings::TYPE_32FC1)
+    perception_voxel_grid_.insert((const float *)&msg->data[0], msg->width, msg->height, msg->step, 1.0,
+                                  fx, fy, cx, cy, camera_to_world, msg->header.stamp.toSec());
+  else
+    return;
+
+  // The tick only waits for this copy, not for the insert above
+  std::lock_guard<std::mutex> lock(perception_mutex_);
+  voxel_grid_.copyCells(perception_voxel_grid_);
+}
 
-  ar_marker_pose = temp_buffer;
+void OpenManipulatorPickandPlace::depthInfoCallback(const sensor_msgs::CameraInfo::ConstPtr &msg)
+{
+  std::lock_guard<std::mutex> lock(perception_mutex_);
+  depth_sampler_.setIntrinsics(msg->K[0], msg->K[4], msg->K[2], msg->K[5]);
 }
 
-void OpenManipulatorPickandPlace::publishCallback(const ros::TimerEvent&)
+void OpenManipulatorPickandPlace::publishCallback(const ros::TimerEvent &event)
 {
-  printText();
-  if (kbhit()) setModeState(std::getchar());
+  ros::WallTime tick_start = ros::WallTime::now();
+  flight_recorder_.record(EVENT_STATE_SNAPSHOT, present_joint_angle_.at(0), present_joint_angle_.at(1), present_joint_angle_.at(2),
+                          present_joint_angle_.at(3), present_joint_angle_.at(4), open_manipulator_is_moving_);
+  open_manipulator_pick_and_place::TraceSpan tick_span(trace_, "tick", "control", TRACE_TRACK_CONTROL);
+  trajectory_.update(ros::Time::now().toSec());
+
+  // The markers as fused so far, the same all through this tick
+  {
+    std::lock_guard<std::mutex> lock(perception_mutex_);
+    ar_marker_pose = fused_marker_pose_;
+  }
+
+  // The arm is already held, this only leaves the demo
+  if (stop_.consume())
+  {
+    is_resume_pending_ = false;
+    step_wait_.cancel();
+    mode_state_ = DEMO_STOP;
+    trajectory_.preemptGoal(ros::Time::now().toSec());
+    trace_.instant("stop", "control", TRACE_TRACK_CONTROL);
+    logEvent(EVENT_DEMO_STOPPED);
+  }
+  if (mode_state_ != DEMO_START && !open_manipulator_is_moving_ && !trajectory_.isBusy()) stop_.warmUp();
+
+  if (isCycleBoundary() && poses_.update()) logEvent(EVENT_POSES_RELOADED, poses_.generation());
+  if (!is_realtime_) printText();
+  if (kbhit()) setModeState(keyboard_.get());
+  if (is_resume_pending_) resumeSequence();
 
   if (mode_state_ == HOME_POSE)
   {
     std::vector<double> joint_angle;
 
-    joint_angle.push_back( 0.01);
-    joint_angle.push_back(-0.80);
-    joint_angle.push_back( 0.00);
-    joint_angle.push_back( 1.90);
-    setJointSpacePath(joint_name_, joint_angle, 2.0);
+    joint_angle = poses_.vector(POSE_HOME);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_MOVE_TIME));
 
     std::vector<double> gripper_value;
-    gripper_value.push_back(0.0);
+    gripper_value.push_back(poses_.value(POSE_HOME_GRIPPER));
     setToolControl(gripper_value);
     mode_state_ = 0;
   }
   else if (mode_state_ == DEMO_START)
   {
-    if (!open_manipulator_is_moving_) demoSequence();
+    // Steps chain on the completion of the previous goal or wait
+    if (!open_manipulator_is_moving_ && !trajectory_.isBusy() && !isStepWaiting())
+    {
+      if (demo_count_ != logged_demo_count_)
+      {
+        logEvent(EVENT_STEP_STARTED, demo_count_);
+        if (logged_demo_count_ >= 0) trace_.end("step", "demo", TRACE_TRACK_STEP);
+        trace_.begin("step", "demo", TRACE_TRACK_STEP, "step", demo_count_);
+        logged_demo_count_ = demo_count_;
+      }
+      demoSequence();
+    }
   }
-  else if (mode_state_ == DEMO_STOP)
-  {
 
+  // A run ends when the demo stops or finishes
+  if (trace_.active() && mode_state_ != DEMO_START)
+  {
+    trace_.end("step", "demo", TRACE_TRACK_STEP);
+    std::string path = trace_.endRun();
+    if (!path.empty()) ROS_INFO("Writing the demo trace to %s", path.c_str());
+    else ROS_WARN("Demo trace dropped, the one before is still being written");
   }
+
+  saveCheckpoint();
+  updatePerceptionDemand();
+  load_monitor_.tick(event, (ros::WallTime::now() - tick_start).toSec());
 }
 void OpenManipulatorPickandPlace::setModeState(char ch)
 {
+  // '3' never gets here, see initStop()
+  is_resume_pending_ = false;  // the operator takes over
   if (ch == '1')
+  {
+    stop_.clear();
     mode_state_ = HOME_POSE;
+    logEvent(EVENT_MODE_CHANGED, ch);
+  }
   else if (ch == '2')
   {
+    stop_.clear();
     mode_state_ = DEMO_START;
     demo_count_ = 0;
+    logged_demo_count_ = -1;
+    step_wait_.cancel();
+    command_retries_ = 0;
+    blocked_since_ = 0.0;
+    trace_.beginRun();
+    logEvent(EVENT_MODE_CHANGED, ch);
   }
-  else if (ch == '3')
-    mode_state_ = DEMO_STOP;
 }
 
 void OpenManipulatorPickandPlace::demoSequence()
@@ -211,28 +999,28 @@ void OpenManipulatorPickandPlace::demoSequence()
   std::vector<double> kinematics_orientation;
   std::vector<double> gripper_value;
 
+  // A step whose path is blocked is tried again on the next tick, one
+  // whose command failed after a delay; both only for so long
+  uint8_t step = demo_count_;
+  uint32_t num_of_blocked_path = num_of_blocked_path_;
+  uint32_t num_of_failed_command = num_of_failed_command_;
+
   switch (demo_count_)
   {
     case 0: // home pose
-      joint_angle.push_back( 0.00);
-    joint_angle.push_back(-1.05);
-    joint_angle.push_back( 0.35);
-    joint_angle.push_back( 0.70);
-    setJointSpacePath(joint_name_, joint_angle, 2.0);
+      joint_angle = poses_.vector(POSE_DEMO_HOME);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_MOVE_TIME));
     demo_count_ ++;
     break;
     case 1: // initial pose
-      joint_angle.push_back( 0.01);
-    joint_angle.push_back(-0.80);
-    joint_angle.push_back( 0.00);
-    joint_angle.push_back( 1.90);
-    setJointSpacePath(joint_name_, joint_angle, 2.0);
+      joint_angle = poses_.vector(POSE_INITIAL);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_MOVE_TIME));
     demo_count_ ++;
     break;
     case 2: // wait & open the gripper
-      setJointSpacePath(joint_name_, present_joint_angle_, 3.0);
-    gripper_value.push_back(0.010);
+    gripper_value.push_back(poses_.value(POSE_GRIPPER_OPEN));
     setToolControl(gripper_value);
+    startWait(STEP_WAIT_MARKER, poses_.value(POSE_OPEN_TIME), 0);
     demo_count_ ++;
     break;
 
@@ -247,17 +1035,15 @@ void OpenManipulatorPickandPlace::demoSequence()
         {
           marker_found = true;
           // X, Y, Z 값을 설정
-          kinematics_position.push_back(ar_marker_pose.at(i).position[0] + 0.005); // X 좌표
-          kinematics_position.push_back(ar_marker_pose.at(i).position[1]);        // Y 좌표
-          kinematics_position.push_back(0.033);                                  // Z 좌표 고정
+          kinematics_position.push_back(ar_marker_pose.at(i).position[0] + poses_.value(POSE_PICK, 0)); // X 좌표
+          kinematics_position.push_back(ar_marker_pose.at(i).position[1] + poses_.value(POSE_PICK, 1)); // Y 좌표
+          kinematics_position.push_back(pickHeight(ar_marker_pose.at(i)));                             // Z 좌표, 깊이 영상 또는 고정
 
           // 오리엔테이션 설정
-          kinematics_orientation.push_back(0.74); // w 값
-          kinematics_orientation.push_back(0.00); // x 값
-          kinematics_orientation.push_back(0.66); // y 값
-          kinematics_orientation.push_back(0.00); // z 값
+          kinematics_orientation = poses_.vector(POSE_GRIP_ORIENTATION);
 
-          setTaskSpacePath(kinematics_position, kinematics_orientation, 3.0);
+          recordFrameToCommandLatency(ar_marker_pose.at(i));
+          setTaskSpacePath(kinematics_position, kinematics_orientation, poses_.value(POSE_APPROACH_TIME));
           demo_count_++; // 다음 단계로 진행
           break; // 찾았으므로 반복문 종료
         }
@@ -265,37 +1051,34 @@ void OpenManipulatorPickandPlace::demoSequence()
 
       if (!marker_found)
       {
-        printf("Marker 0 not detected.\n");
+        logEvent(EVENT_MARKER_NOT_DETECTED, 0);
         demo_count_ = 1;
       }
     }
   break;
 
   case 4: // wait & grip
-    setJointSpacePath(joint_name_, present_joint_angle_, 1.0);
     gripper_value.clear();
-    gripper_value.push_back(-0.008);
+    gripper_value.push_back(poses_.value(POSE_GRIPPER_CLOSE));
     setToolControl(gripper_value);
+    startWait(STEP_WAIT_GRIPPER, poses_.value(POSE_GRIP_TIME));
     demo_count_++;
     break;
 
   case 5: // initial pose
-    joint_angle.clear();
-    joint_angle.push_back( 0.01);
-    joint_angle.push_back(-0.80);
-    joint_angle.push_back( 0.00);
-    joint_angle.push_back( 1.90);
-    setJointSpacePath(joint_name_, joint_angle, 2.0);
+    if (uint8_t shortcut = shortcutToPlace())
+    {
+      if (shortcut == SHORTCUT_SENT) demo_count_ += 2;  // already on the way to the place pose
+      break;  // failed: the step is retried, with no second goal to the initial pose
+    }
+    joint_angle = poses_.vector(POSE_INITIAL);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_MOVE_TIME));
     demo_count_++;
     break;
 
   case 6: // place pose
-    joint_angle.clear();
-    joint_angle.push_back( 1.57);
-    joint_angle.push_back(-0.21);
-    joint_angle.push_back(-0.15);
-    joint_angle.push_back( 1.89);
-    setJointSpacePath(joint_name_, joint_angle, 2.0);
+    joint_angle = poses_.vector(POSE_PLACE);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_MOVE_TIME));
     demo_count_++;
     break;
 
@@ -304,58 +1087,45 @@ void OpenManipulatorPickandPlace::demoSequence()
     kinematics_orientation.clear();
 
     // 수정된 위치 값
-    kinematics_position.push_back(0.015); // X 좌표
-    kinematics_position.push_back(0.123); // Y 좌표
-    kinematics_position.push_back(0.065); // Z 좌표
+    kinematics_position = poses_.vector(POSE_PLACE_BOX_0);
+    kinematics_position.at(2) = placeHeight(kinematics_position);  // 쌓인 높이에 맞춤
 
     // 기존 오리엔테이션 값 유지
-    kinematics_orientation.push_back(0.74); // w 값
-    kinematics_orientation.push_back(0.00); // x 값
-    kinematics_orientation.push_back(0.66); // y 값
-    kinematics_orientation.push_back(0.00); // z 값
+    kinematics_orientation = poses_.vector(POSE_GRIP_ORIENTATION);
 
-    setTaskSpacePath(kinematics_position, kinematics_orientation, 2.0);
+    setTaskSpacePath(kinematics_position, kinematics_orientation, poses_.value(POSE_MOVE_TIME));
     demo_count_++;
     break;
 
 
   case 8: // wait & place
-    setJointSpacePath(joint_name_, present_joint_angle_, 1.0);
     gripper_value.clear();
-    gripper_value.push_back(0.010);
+    gripper_value.push_back(poses_.value(POSE_GRIPPER_OPEN));
     setToolControl(gripper_value);
+    startWait(STEP_WAIT_GRIPPER, poses_.value(POSE_GRIP_TIME));
     demo_count_++;
     break;
 
   case 9: // move up after place the box
     kinematics_position.clear();
     kinematics_orientation.clear();
-    kinematics_position.push_back(0.015); // X 좌표
-    kinematics_position.push_back(0.102); // Y 좌표
-    kinematics_position.push_back(0.170);
-    kinematics_orientation.push_back(0.74);
-    kinematics_orientation.push_back(0.00);
-    kinematics_orientation.push_back(0.66);
-    kinematics_orientation.push_back(0.00);
-    setTaskSpacePath(kinematics_position, kinematics_orientation, 2.0);
+    kinematics_position = poses_.vector(POSE_LIFT_BOX_0);
+    kinematics_orientation = poses_.vector(POSE_GRIP_ORIENTATION);
+    setTaskSpacePath(kinematics_position, kinematics_orientation, poses_.value(POSE_MOVE_TIME));
     demo_count_++;
     break;
 
   case 10: // initial pose
-    joint_angle.clear();
-    joint_angle.push_back( 0.01);
-    joint_angle.push_back(-0.80);
-    joint_angle.push_back( 0.00);
-    joint_angle.push_back( 1.90);
-    setJointSpacePath(joint_name_, joint_angle, 2.0);
+    joint_angle = poses_.vector(POSE_INITIAL);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_MOVE_TIME));
     demo_count_++;
     break;
 
   case 11: // wait & open the gripper
-    setJointSpacePath(joint_name_, present_joint_angle_, 3.0);
     gripper_value.clear();
-    gripper_value.push_back(0.010);
+    gripper_value.push_back(poses_.value(POSE_GRIPPER_OPEN));
     setToolControl(gripper_value);
+    startWait(STEP_WAIT_MARKER, poses_.value(POSE_OPEN_TIME), 1);
     demo_count_++;
     break;
 
@@ -370,17 +1140,15 @@ void OpenManipulatorPickandPlace::demoSequence()
       {
         marker_found = true;
         // X, Y, Z 값을 설정
-        kinematics_position.push_back(ar_marker_pose.at(i).position[0] + 0.005); // X 좌표
-        kinematics_position.push_back(ar_marker_pose.at(i).position[1]);        // Y 좌표
-        kinematics_position.push_back(0.033);                                  // Z 좌표 고정
+        kinematics_position.push_back(ar_marker_pose.at(i).position[0] + poses_.value(POSE_PICK, 0)); // X 좌표
+        kinematics_position.push_back(ar_marker_pose.at(i).position[1] + poses_.value(POSE_PICK, 1)); // Y 좌표
+        kinematics_position.push_back(pickHeight(ar_marker_pose.at(i)));                             // Z 좌표, 깊이 영상 또는 고정
 
         // 오리엔테이션 설정
-        kinematics_orientation.push_back(0.74); // w 값
-        kinematics_orientation.push_back(0.00); // x 값
-        kinematics_orientation.push_back(0.66); // y 값
-        kinematics_orientation.push_back(0.00); // z 값
+        kinematics_orientation = poses_.vector(POSE_GRIP_ORIENTATION);
 
-        setTaskSpacePath(kinematics_position, kinematics_orientation, 3.0);
+        recordFrameToCommandLatency(ar_marker_pose.at(i));
+        setTaskSpacePath(kinematics_position, kinematics_orientation, poses_.value(POSE_APPROACH_TIME));
         demo_count_++; // 다음 단계로 진행
         break; // 찾았으므로 반복문 종료
       }
@@ -388,37 +1156,34 @@ void OpenManipulatorPickandPlace::demoSequence()
 
     if (!marker_found)
     {
-      printf("Marker 2 not detected.\n");
+      logEvent(EVENT_MARKER_NOT_DETECTED, 2);
       demo_count_ = 10;
     }
   }
   break;
 
   case 13: // wait & grip
-    setJointSpacePath(joint_name_, present_joint_angle_, 1.0);
     gripper_value.clear();
-    gripper_value.push_back(-0.008);
+    gripper_value.push_back(poses_.value(POSE_GRIPPER_CLOSE));
     setToolControl(gripper_value);
+    startWait(STEP_WAIT_GRIPPER, poses_.value(POSE_GRIP_TIME));
     demo_count_++;
     break;
 
   case 14: // initial pose
-    joint_angle.clear();
-    joint_angle.push_back( 0.01);
-    joint_angle.push_back(-0.80);
-    joint_angle.push_back( 0.00);
-    joint_angle.push_back( 1.90);
-    setJointSpacePath(joint_name_, joint_angle, 2.0);
+    if (uint8_t shortcut = shortcutToPlace())
+    {
+      if (shortcut == SHORTCUT_SENT) demo_count_ += 2;  // already on the way to the place pose
+      break;  // failed: the step is retried, with no second goal to the initial pose
+    }
+    joint_angle = poses_.vector(POSE_INITIAL);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_MOVE_TIME));
     demo_count_++;
     break;
 
   case 15: // place pose
-    joint_angle.clear();
-    joint_angle.push_back( 1.57);
-    joint_angle.push_back(-0.21);
-    joint_angle.push_back(-0.15);
-    joint_angle.push_back( 1.89);
-    setJointSpacePath(joint_name_, joint_angle, 2.0);
+    joint_angle = poses_.vector(POSE_PLACE);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_MOVE_TIME));
     demo_count_++;
     break;
 
@@ -427,26 +1192,22 @@ void OpenManipulatorPickandPlace::demoSequence()
     kinematics_orientation.clear();
 
     // 수정된 위치 값
-    kinematics_position.push_back(0.015); // X 좌표
-    kinematics_position.push_back(0.105); // Y 좌표
-    kinematics_position.push_back(0.086); // Z 좌표
+    kinematics_position = poses_.vector(POSE_PLACE_BOX_1);
+    kinematics_position.at(2) = placeHeight(kinematics_position);  // 쌓인 높이에 맞춤
 
     // 기존 오리엔테이션 값 유지
-    kinematics_orientation.push_back(0.74); // w 값
-    kinematics_orientation.push_back(0.00); // x 값
-    kinematics_orientation.push_back(0.66); // y 값
-    kinematics_orientation.push_back(0.00); // z 값
+    kinematics_orientation = poses_.vector(POSE_GRIP_ORIENTATION);
 
-    setTaskSpacePath(kinematics_position, kinematics_orientation, 2.0);
+    setTaskSpacePath(kinematics_position, kinematics_orientation, poses_.value(POSE_MOVE_TIME));
     demo_count_++;
 
     break;
 
   case 17: // wait & place
-    setJointSpacePath(joint_name_, present_joint_angle_, 1.0);
     gripper_value.clear();
-    gripper_value.push_back(0.010);
+    gripper_value.push_back(poses_.value(POSE_GRIPPER_OPEN));
     setToolControl(gripper_value);
+    startWait(STEP_WAIT_GRIPPER, poses_.value(POSE_GRIP_TIME));
     demo_count_++;
     break;
 
@@ -455,30 +1216,23 @@ void OpenManipulatorPickandPlace::demoSequence()
     kinematics_orientation.clear();
     kinematics_position.push_back(present_kinematic_position_.at(0));
     kinematics_position.push_back(present_kinematic_position_.at(1));
-    kinematics_position.push_back(0.170);
-    kinematics_orientation.push_back(0.74);
-    kinematics_orientation.push_back(0.00);
-    kinematics_orientation.push_back(0.66);
-    kinematics_orientation.push_back(0.00);
-    setTaskSpacePath(kinematics_position, kinematics_orientation, 2.0);
+    kinematics_position.push_back(poses_.value(POSE_LIFT_HEIGHT, 0));
+    kinematics_orientation = poses_.vector(POSE_GRIP_ORIENTATION);
+    setTaskSpacePath(kinematics_position, kinematics_orientation, poses_.value(POSE_MOVE_TIME));
     demo_count_++;
     break;
 
   case 19: // initial pose
-    joint_angle.clear();
-    joint_angle.push_back( 0.01);
-    joint_angle.push_back(-0.80);
-    joint_angle.push_back( 0.00);
-    joint_angle.push_back( 1.90);
-    setJointSpacePath(joint_name_, joint_angle, 2.0);
+    joint_angle = poses_.vector(POSE_INITIAL);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_MOVE_TIME));
     demo_count_++;
     break;
 
   case 20: // wait & open the gripper
-    setJointSpacePath(joint_name_, present_joint_angle_, 3.0);
     gripper_value.clear();
-    gripper_value.push_back(0.010);
+    gripper_value.push_back(poses_.value(POSE_GRIPPER_OPEN));
     setToolControl(gripper_value);
+    startWait(STEP_WAIT_MARKER, poses_.value(POSE_OPEN_TIME), 2);
     demo_count_++;
     break;
 
@@ -493,17 +1247,15 @@ void OpenManipulatorPickandPlace::demoSequence()
       {
         marker_found = true;
         // X, Y, Z 값을 설정
-        kinematics_position.push_back(ar_marker_pose.at(i).position[0] + 0.005); // X 좌표
-        kinematics_position.push_back(ar_marker_pose.at(i).position[1]);        // Y 좌표
-        kinematics_position.push_back(0.033);                                  // Z 좌표 고정
+        kinematics_position.push_back(ar_marker_pose.at(i).position[0] + poses_.value(POSE_PICK, 0)); // X 좌표
+        kinematics_position.push_back(ar_marker_pose.at(i).position[1] + poses_.value(POSE_PICK, 1)); // Y 좌표
+        kinematics_position.push_back(pickHeight(ar_marker_pose.at(i)));                             // Z 좌표, 깊이 영상 또는 고정
 
         // 오리엔테이션 설정
-        kinematics_orientation.push_back(0.74); // w 값
-        kinematics_orientation.push_back(0.00); // x 값
-        kinematics_orientation.push_back(0.66); // y 값
-        kinematics_orientation.push_back(0.00); // z 값
+        kinematics_orientation = poses_.vector(POSE_GRIP_ORIENTATION);
 
-        setTaskSpacePath(kinematics_position, kinematics_orientation, 3.0);
+        recordFrameToCommandLatency(ar_marker_pose.at(i));
+        setTaskSpacePath(kinematics_position, kinematics_orientation, poses_.value(POSE_APPROACH_TIME));
         demo_count_++; // 다음 단계로 진행
         break; // 찾았으므로 반복문 종료
       }
@@ -511,37 +1263,34 @@ void OpenManipulatorPickandPlace::demoSequence()
 
     if (!marker_found)
     {
-      printf("Marker 3 not detected.\n");
+      logEvent(EVENT_MARKER_NOT_DETECTED, 3);
       demo_count_ = 19;
     }
   }
   break;
 
   case 22: // wait & grip
-    setJointSpacePath(joint_name_, present_joint_angle_, 2.0);
     gripper_value.clear();
-    gripper_value.push_back(-0.008);
+    gripper_value.push_back(poses_.value(POSE_GRIPPER_CLOSE));
     setToolControl(gripper_value);
+    startWait(STEP_WAIT_GRIPPER, poses_.value(POSE_THIRD_GRIP_TIME));
     demo_count_++;
     break;
 
   case 23: // initial pose
-    joint_angle.clear();
-    joint_angle.push_back( 0.01);
-    joint_angle.push_back(-0.80);
-    joint_angle.push_back( 0.00);
-    joint_angle.push_back( 1.90);
-    setJointSpacePath(joint_name_, joint_angle, 2.0);
+    if (uint8_t shortcut = shortcutToPlace())
+    {
+      if (shortcut == SHORTCUT_SENT) demo_count_ += 2;  // already on the way to the place pose
+      break;  // failed: the step is retried, with no second goal to the initial pose
+    }
+    joint_angle = poses_.vector(POSE_INITIAL);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_MOVE_TIME));
     demo_count_++;
     break;
 
   case 24: // place pose
-    joint_angle.clear();
-    joint_angle.push_back( 1.57);
-    joint_angle.push_back(-0.21);
-    joint_angle.push_back(-0.15);
-    joint_angle.push_back( 1.89);
-    setJointSpacePath(joint_name_, joint_angle, 2.0);
+    joint_angle = poses_.vector(POSE_PLACE);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_MOVE_TIME));
     demo_count_++;
     break;
 
@@ -550,26 +1299,22 @@ void OpenManipulatorPickandPlace::demoSequence()
     kinematics_orientation.clear();
 
     // 수정된 위치 값
-    kinematics_position.push_back(0.019); // X 좌표
-    kinematics_position.push_back(0.095); // Y 좌표
-    kinematics_position.push_back(0.123); // Z 좌표
+    kinematics_position = poses_.vector(POSE_PLACE_BOX_2);
+    kinematics_position.at(2) = placeHeight(kinematics_position);  // 쌓인 높이에 맞춤
 
     // 기존 오리엔테이션 값 유지
-    kinematics_orientation.push_back(0.74); // w 값
-    kinematics_orientation.push_back(0.00); // x 값
-    kinematics_orientation.push_back(0.66); // y 값
-    kinematics_orientation.push_back(0.00); // z 값
+    kinematics_orientation = poses_.vector(POSE_GRIP_ORIENTATION);
 
-    setTaskSpacePath(kinematics_position, kinematics_orientation, 2.0);
+    setTaskSpacePath(kinematics_position, kinematics_orientation, poses_.value(POSE_MOVE_TIME));
     demo_count_++;
 
     break;
 
   case 26: // wait & place
-    setJointSpacePath(joint_name_, present_joint_angle_, 1.0);
     gripper_value.clear();
-    gripper_value.push_back(0.010);
+    gripper_value.push_back(poses_.value(POSE_GRIPPER_OPEN));
     setToolControl(gripper_value);
+    startWait(STEP_WAIT_GRIPPER, poses_.value(POSE_GRIP_TIME));
     demo_count_++;
     break;
 
@@ -578,132 +1323,97 @@ void OpenManipulatorPickandPlace::demoSequence()
     kinematics_orientation.clear();
     kinematics_position.push_back(present_kinematic_position_.at(0));
     kinematics_position.push_back(present_kinematic_position_.at(1));
-    kinematics_position.push_back(0.180);
-    kinematics_orientation.push_back(0.74);
-    kinematics_orientation.push_back(0.00);
-    kinematics_orientation.push_back(0.66);
-    kinematics_orientation.push_back(0.00);
-    setTaskSpacePath(kinematics_position, kinematics_orientation, 2.0);
+    kinematics_position.push_back(poses_.value(POSE_LIFT_HEIGHT, 1));
+    kinematics_orientation = poses_.vector(POSE_GRIP_ORIENTATION);
+    setTaskSpacePath(kinematics_position, kinematics_orientation, poses_.value(POSE_MOVE_TIME));
     demo_count_++;
     break;
 
   case 28: // home pose
-    joint_angle.clear();
-    joint_angle.push_back( 0.00);
-    joint_angle.push_back(-1.05);
-    joint_angle.push_back( 0.35);
-    joint_angle.push_back( 0.70);
-    setJointSpacePath(joint_name_, joint_angle, 0.01);
+    joint_angle = poses_.vector(POSE_DEMO_HOME);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_HOME_RETURN_TIME));
     demo_count_++;
     break;
 
     case 29: //I
-    joint_angle.clear();
-    joint_angle.push_back( -0.063);
-    joint_angle.push_back( 0.061);
-    joint_angle.push_back( -1.488);
-    joint_angle.push_back( -0.012);
-    setJointSpacePath(joint_name_, joint_angle, 1);
+    joint_angle = poses_.vector(POSE_LETTER_I);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_LETTER_MOVE_TIME));
     demo_count_++;
     break;
 
     case 30: // wait & place
-    setJointSpacePath(joint_name_, present_joint_angle_, 1.0);
     gripper_value.clear();
-    gripper_value.push_back(0.010);
+    gripper_value.push_back(poses_.value(POSE_GRIPPER_OPEN));
     setToolControl(gripper_value);
+    startWait(STEP_WAIT_TIME, poses_.value(POSE_GRIP_TIME));
     demo_count_++;
     break;
 
     case 31: //R
-    joint_angle.clear();
-    joint_angle.push_back( -0.015);
-    joint_angle.push_back( 0.030);
-    joint_angle.push_back( 0.779);
-    joint_angle.push_back( 1.759);
-    setJointSpacePath(joint_name_, joint_angle, 1);
+    joint_angle = poses_.vector(POSE_LETTER_R);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_LETTER_MOVE_TIME));
     demo_count_++;
     break;
 
     case 32: // wait & place
-    setJointSpacePath(joint_name_, present_joint_angle_, 1.0);
     gripper_value.clear();
-    gripper_value.push_back(0.010);
+    gripper_value.push_back(poses_.value(POSE_GRIPPER_OPEN));
     setToolControl(gripper_value);
+    startWait(STEP_WAIT_TIME, poses_.value(POSE_GRIP_TIME));
     demo_count_++;
     break;
 
     case 33: //임시
-    joint_angle.clear();
-    joint_angle.push_back( -0.015);
-    joint_angle.push_back( -0.100);
-    joint_angle.push_back( 0.779);
-    joint_angle.push_back( 1.759);
-    setJointSpacePath(joint_name_, joint_angle, 0.1);
+    joint_angle = poses_.vector(POSE_LETTER_R_LIFT);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_LETTER_LIFT_TIME));
     demo_count_++;
     break;
 
     case 34: //A
-    joint_angle.clear();
-    joint_angle.push_back( -0.032);
-    joint_angle.push_back( 0.078);
-    joint_angle.push_back( 0.894);
-    joint_angle.push_back( 0.021);
-    setJointSpacePath(joint_name_, joint_angle, 1);
+    joint_angle = poses_.vector(POSE_LETTER_A);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_LETTER_MOVE_TIME));
     demo_count_++;
     break;
 
     case 35: // wait & place
-    setJointSpacePath(joint_name_, present_joint_angle_, 1.0);
     gripper_value.clear();
-    gripper_value.push_back(0.010);
+    gripper_value.push_back(poses_.value(POSE_GRIPPER_OPEN));
     setToolControl(gripper_value);
+    startWait(STEP_WAIT_TIME, poses_.value(POSE_GRIP_TIME));
     demo_count_++;
     break;
 
     case 36: //S
-    joint_angle.clear();
-    joint_angle.push_back( 0.000);
-    joint_angle.push_back( -1.085);
-    joint_angle.push_back( 0.508);
-    joint_angle.push_back( -0.341);
-    setJointSpacePath(joint_name_, joint_angle, 1);
+    joint_angle = poses_.vector(POSE_LETTER_S);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_LETTER_MOVE_TIME));
     demo_count_++;
     break;
 
     case 37: // wait & place
-     setJointSpacePath(joint_name_, present_joint_angle_, 1.0);
     gripper_value.clear();
-    gripper_value.push_back(0.010);
+    gripper_value.push_back(poses_.value(POSE_GRIPPER_OPEN));
     setToolControl(gripper_value);
+    startWait(STEP_WAIT_TIME, poses_.value(POSE_GRIP_TIME));
     demo_count_++;
     break;
 
     case 38: //C
-    joint_angle.clear();
-    joint_angle.push_back( -0.031);
-    joint_angle.push_back( -1.235);
-    joint_angle.push_back( 0.032);
-    joint_angle.push_back( 1.119);
-    setJointSpacePath(joint_name_, joint_angle, 1);
+    joint_angle = poses_.vector(POSE_LETTER_C);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_LETTER_MOVE_TIME));
     demo_count_++;
     break;
 
     case 39: // wait & place
-    setJointSpacePath(joint_name_, present_joint_angle_, 1.0);
     gripper_value.clear();
-    gripper_value.push_back(0.010);
+    gripper_value.push_back(poses_.value(POSE_GRIPPER_OPEN));
     setToolControl(gripper_value);
+    startWait(STEP_WAIT_TIME, poses_.value(POSE_GRIP_TIME));
     demo_count_++;
     break;
 
     case 40: // home pose
-    joint_angle.clear();
-    joint_angle.push_back( 0.00);
-    joint_angle.push_back(-1.05);
-    joint_angle.push_back( 0.35);
-    joint_angle.push_back( 0.70);
-    setJointSpacePath(joint_name_, joint_angle, 0.01);
+    joint_angle = poses_.vector(POSE_DEMO_HOME);
+    setJointSpacePath(joint_name_, joint_angle, poses_.value(POSE_HOME_RETURN_TIME));
     demo_count_ = 1;
     mode_state_ = DEMO_STOP;
     break;
@@ -713,6 +1423,11 @@ void OpenManipulatorPickandPlace::demoSequence()
     demo_count_++;
     break;
   }
+
+  if (num_of_blocked_path_ != num_of_blocked_path) holdBlockedStep(step);
+  else blocked_since_ = 0.0;
+  if (num_of_failed_command_ != num_of_failed_command) retryStep(step);
+  else if (demo_count_ != step) command_retries_ = 0;
 }
 
 
@@ -874,6 +1589,28 @@ void OpenManipulatorPickandPlace::printText()
          present_kinematic_position_.at(1),
          present_kinematic_position_.at(2));
 
+  if (frame_to_command_latency_.count() > 0)
+  {
+    printf("Frame to command latency [ms] last: %.1lf mean: %.1lf max: %.1lf (n=%lu)\n",
+           frame_to_command_latency_.last() * 1e3,
+           frame_to_command_latency_.mean() * 1e3,
+           frame_to_command_latency_.max() * 1e3,
+           (unsigned long)frame_to_command_latency_.count());
+  }
+  if (trajectory_.state() != TRAJECTORY_IDLE)
+  {
+    const open_manipulator_pick_and_place::TrajectoryFeedback &feedback = trajectory_.feedback();
+    printf("Goal: %s %.0lf%% (%.1lf of %.1lf s) joint error: %.3lf\n",
+           open_manipulator_pick_and_place::trajectoryStateName(trajectory_.state()),
+           feedback.progress * 100.0, feedback.elapsed, trajectory_.pathTime(), feedback.joint_error);
+  }
+  trajectory_.jointSpacePath().printStatistics();
+  trajectory_.toolControl().printStatistics();
+  trajectory_.taskSpacePath().printStatistics();
+  stop_.printStatistics();
+  if (num_of_failed_command_ > 0)
+    printf("Failed commands: %u demos aborted: %u\n", num_of_failed_command_, num_of_aborted_demo_);
+
   if (!ar_marker_pose.empty())
   {
     printf("AR marker detected.\n");
@@ -890,38 +1627,22 @@ void OpenManipulatorPickandPlace::printText()
   {
     printf("No AR marker detected.\n");
   }
+
+  // The event log echo is off while this screen is shown, its last events are here
+  open_manipulator_pick_and_place::EventRecord recent[open_manipulator_pick_and_place::EventLog::NUM_OF_RECENT];
+  uint32_t num_of_recent = event_log_.recent(recent, open_manipulator_pick_and_place::EventLog::NUM_OF_RECENT);
+  if (num_of_recent > 0) printf("-----------------------------\n");
+  for (uint32_t i = 0; i < num_of_recent; i++)
+  {
+    char text[256];
+    open_manipulator_pick_and_place::formatEvent(recent[i], text, sizeof(text));
+    printf("[%s] %s\n", open_manipulator_pick_and_place::eventLevelName(open_manipulator_pick_and_place::eventInfo(recent[i].event).level), text);
+  }
 }
 
 
 
 bool OpenManipulatorPickandPlace::kbhit()
 {
-  termios term;
-  tcgetattr(0, &term);
-
-  termios term2 = term;
-  term2.c_lflag &= ~ICANON;
-  tcsetattr(0, TCSANOW, &term2);
-
-  int byteswaiting;
-  ioctl(0, FIONREAD, &byteswaiting);
-  tcsetattr(0, TCSANOW, &term);
-  return byteswaiting > 0;
-}
-
-int main(int argc, char **argv)
-{
-  // Init ROS node
-  ros::init(argc, argv, "open_manipulator_pick_and_place");
-  ros::NodeHandle node_handle("");
-
-  OpenManipulatorPickandPlace open_manipulator_pick_and_place;
-
-  ros::Timer publish_timer = node_handle.createTimer(ros::Duration(0.100)/*100ms*/, &OpenManipulatorPickandPlace::publishCallback, &open_manipulator_pick_and_place);
-
-  while (ros::ok())
-  {
-    ros::spinOnce();
-  }
-  return 0;
+  return keyboard_.hit();
 }
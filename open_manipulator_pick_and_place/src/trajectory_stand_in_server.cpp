@@ -0,0 +1,214 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#include <ros/ros.h>
+#include <cmath>
+#include <string>
+
+#include "open_manipulator_msgs/KinematicsPose.h"
+#include "open_manipulator_msgs/OpenManipulatorState.h"
+#include "open_manipulator_msgs/SetJointPosition.h"
+#include "open_manipulator_msgs/SetKinematicsPose.h"
+#include "sensor_msgs/JointState.h"
+
+#include "open_manipulator_pick_and_place/arm_kinematics.h"
+
+#define NUM_OF_JOINT_AND_TOOL  5
+#define TOOL_INDEX             4
+
+// Stand-in for open_manipulator_controller: serves the goal_* services and
+// publishes joint_states, states and gripper/kinematics_pose of a simulated
+// arm that follows every path in exactly its path time, so the demos and
+// TrajectoryClient (goals, feedback, preemption) run without hardware.
+// Task space goals are accepted and take their path time, but the joints
+// do not move. With ~stall_every, every so many service calls hang for
+// ~stall_time like a controller that stopped answering.
+class TrajectoryStandInServer
+{
+ public:
+  TrajectoryStandInServer()
+  : priv_node_handle_("~"),
+    moving_until_(0.0),
+    calls_(0)
+  {
+    const double initial[NUM_OF_JOINT_AND_TOOL] = {0.01, -0.80, 0.00, 1.90, 0.0};
+    for (int i = 0; i < NUM_OF_JOINT_AND_TOOL; i++)
+    {
+      start_[i] = goal_[i] = present_[i] = initial[i];
+      start_time_[i] = 0.0;
+      path_time_[i] = 0.0;
+    }
+
+    joint_name_[0] = "joint1";
+    joint_name_[1] = "joint2";
+    joint_name_[2] = "joint3";
+    joint_name_[3] = "joint4";
+    joint_name_[TOOL_INDEX] = "gripper";
+    tool_path_time_ = priv_node_handle_.param<double>("tool_path_time", 0.5);
+    stall_every_ = priv_node_handle_.param<int>("stall_every", 0);
+    stall_time_ = priv_node_handle_.param<double>("stall_time", 5.0);
+
+    joint_space_path_server_ = node_handle_.advertiseService("goal_joint_space_path", &TrajectoryStandInServer::jointSpacePathCallback, this);
+    tool_control_server_ = node_handle_.advertiseService("goal_tool_control", &TrajectoryStandInServer::toolControlCallback, this);
+    task_space_path_server_ = node_handle_.advertiseService("goal_task_space_path", &TrajectoryStandInServer::taskSpacePathCallback, this);
+
+    joint_states_pub_ = node_handle_.advertise<sensor_msgs::JointState>("joint_states", 10);
+    states_pub_ = node_handle_.advertise<open_manipulator_msgs::OpenManipulatorState>("states", 10);
+    kinematics_pose_pub_ = node_handle_.advertise<open_manipulator_msgs::KinematicsPose>("gripper/kinematics_pose", 10);
+
+    // 0 only serves the goal_* services, when load_generator sends the topics
+    double rate = priv_node_handle_.param<double>("publish_rate", 100.0);
+    if (rate > 0.0)
+      timer_ = node_handle_.createTimer(ros::Duration(1.0 / rate), &TrajectoryStandInServer::timerCallback, this);
+  }
+
+ private:
+  bool jointSpacePathCallback(open_manipulator_msgs::SetJointPosition::Request &req,
+                              open_manipulator_msgs::SetJointPosition::Response &res)
+  {
+    stall();
+    double now = ros::Time::now().toSec();
+    res.is_planned = false;
+    if (req.joint_position.position.size() < req.joint_position.joint_name.size()) return true;
+
+    for (size_t i = 0; i < req.joint_position.joint_name.size(); i++)
+    {
+      int index = jointIndex(req.joint_position.joint_name[i]);
+      if (index < 0 || index == TOOL_INDEX) return true;
+    }
+
+    for (size_t i = 0; i < req.joint_position.joint_name.size(); i++)
+      startPath(jointIndex(req.joint_position.joint_name[i]), req.joint_position.position[i], req.path_time, now);
+    moving_until_ = now + req.path_time;
+    res.is_planned = true;
+    return true;
+  }
+
+  bool toolControlCallback(open_manipulator_msgs::SetJointPosition::Request &req,
+                           open_manipulator_msgs::SetJointPosition::Response &res)
+  {
+    stall();
+
+    // An empty request plans nothing and succeeds, like the controller
+    double now = ros::Time::now().toSec();
+    for (size_t i = 0; i < req.joint_position.joint_name.size() && i < req.joint_position.position.size(); i++)
+    {
+      if (req.joint_position.joint_name[i] == joint_name_[TOOL_INDEX])
+        startPath(TOOL_INDEX, req.joint_position.position[i], tool_path_time_, now);
+    }
+    res.is_planned = true;
+    return true;
+  }
+
+  bool taskSpacePathCallback(open_manipulator_msgs::SetKinematicsPose::Request &req,
+                             open_manipulator_msgs::SetKinematicsPose::Response &res)
+  {
+    stall();
+    moving_until_ = ros::Time::now().toSec() + req.path_time;
+    res.is_planned = true;
+    return true;
+  }
+
+  void startPath(int index, double goal, double path_time, double now)
+  {
+    start_[index] = present_[index];
+    goal_[index] = goal;
+    start_time_[index] = now;
+    path_time_[index] = path_time;
+  }
+
+  void stall()
+  {
+    if (stall_every_ > 0 && ++calls_ % stall_every_ == 0) ros::WallDuration(stall_time_).sleep();
+  }
+
+  int jointIndex(const std::string &name) const
+  {
+    for (int i = 0; i < NUM_OF_JOINT_AND_TOOL; i++)
+      if (name == joint_name_[i]) return i;
+    return -1;
+  }
+
+  void timerCallback(const ros::TimerEvent&)
+  {
+    ros::Time stamp = ros::Time::now();
+    double now = stamp.toSec();
+
+    // Smooth start and stop: s = 3t^2 - 2t^3
+    for (int i = 0; i < NUM_OF_JOINT_AND_TOOL; i++)
+    {
+      double t = path_time_[i] > 0.0 ? (now - start_time_[i]) / path_time_[i] : 1.0;
+      t = t < 0.0 ? 0.0 : (t > 1.0 ? 1.0 : t);
+      present_[i] = start_[i] + (goal_[i] - start_[i]) * t * t * (3.0 - 2.0 * t);
+    }
+
+    sensor_msgs::JointState joint_state;
+    joint_state.header.stamp = stamp;
+    for (int i = 0; i < NUM_OF_JOINT_AND_TOOL; i++)
+    {
+      joint_state.name.push_back(joint_name_[i]);
+      joint_state.position.push_back(present_[i]);
+    }
+    joint_states_pub_.publish(joint_state);
+
+    open_manipulator_msgs::OpenManipulatorState state;
+    state.open_manipulator_moving_state = now < moving_until_ ? state.IS_MOVING : state.STOPPED;
+    state.open_manipulator_actuator_state = state.ACTUATOR_ENABLED;
+    states_pub_.publish(state);
+
+    const double tool_offset[3] = {ARM_TOOL_OFFSET, 0.0, 0.0};
+    double tool_position[3];
+    open_manipulator_pick_and_place::transformPoint(arm_kinematics_.link5ToWorld(present_), tool_offset, tool_position);
+
+    open_manipulator_msgs::KinematicsPose pose;
+    pose.pose.position.x = tool_position[0];
+    pose.pose.position.y = tool_position[1];
+    pose.pose.position.z = tool_position[2];
+    kinematics_pose_pub_.publish(pose);
+  }
+
+  ros::NodeHandle node_handle_;
+  ros::NodeHandle priv_node_handle_;
+  ros::ServiceServer joint_space_path_server_;
+  ros::ServiceServer tool_control_server_;
+  ros::ServiceServer task_space_path_server_;
+  ros::Publisher joint_states_pub_;
+  ros::Publisher states_pub_;
+  ros::Publisher kinematics_pose_pub_;
+  ros::Timer timer_;
+
+  open_manipulator_pick_and_place::ArmKinematics arm_kinematics_;
+  std::string joint_name_[NUM_OF_JOINT_AND_TOOL];
+  double start_[NUM_OF_JOINT_AND_TOOL];
+  double goal_[NUM_OF_JOINT_AND_TOOL];
+  double present_[NUM_OF_JOINT_AND_TOOL];
+  double start_time_[NUM_OF_JOINT_AND_TOOL];  // [s]
+  double path_time_[NUM_OF_JOINT_AND_TOOL];   // [s]
+  double tool_path_time_;                     // [s]
+  double moving_until_;                       // end of the last arm path [s]
+  int stall_every_;                           // 0 for never
+  double stall_time_;                         // [s]
+  int calls_;
+};
+
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "trajectory_stand_in_server");
+
+  TrajectoryStandInServer server;
+  ros::spin();
+  return 0;
+}
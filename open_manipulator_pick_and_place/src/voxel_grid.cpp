@@ -0,0 +1,107 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#include "open_manipulator_pick_and_place/voxel_grid.h"
+
+// The only part of the nodes built at -O3 whatever the build type (see
+// CMakeLists.txt), so that the row loops below are vectorised; check with
+// -fopt-info-vec.
+
+namespace open_manipulator_pick_and_place
+{
+
+template <typename T>
+void VoxelGrid::insert(const T *data, int width, int height, size_t step, double scale,
+                       double fx, double fy, double cx, double cy,
+                       const RigidTransform &camera_to_world, double stamp)
+{
+  decay(stamp);
+
+  int stride = config_.stride > 0 ? config_.stride : 1;
+  int columns = (width + stride - 1) / stride;
+  if ((int)ray_x_.size() != columns || ray_fx_ != fx || ray_cx_ != cx)
+  {
+    ray_x_.resize(columns);
+    for (int i = 0; i < columns; i++)
+      ray_x_[i] = (float)((i * stride - cx) / fx);
+    ray_fx_ = fx;
+    ray_cx_ = cx;
+  }
+  depth_.resize(columns);
+  cell_.resize(columns);
+
+  frame_ = frame_ == 255 ? 1 : frame_ + 1;  // 0 is never a frame, seen_ starts clear
+  float rotation[9], translation[3];
+  for (int i = 0; i < 9; i++) rotation[i] = (float)camera_to_world.rotation[i];
+  for (int i = 0; i < 3; i++) translation[i] = (float)camera_to_world.translation[i];
+
+  const float inv_resolution = (float)(1.0 / config_.resolution);
+  const float origin[3] = {(float)config_.origin[0], (float)config_.origin[1], (float)config_.origin[2]};
+  const float floor_height = (float)config_.floor_height;
+  const float min_depth = (float)config_.min_depth, max_depth = (float)config_.max_depth;
+  const int size_x = config_.size[0], size_y = config_.size[1], size_z = config_.size[2];
+  const int32_t layer = size_x * size_y;
+  const int32_t floor_cells = std::max(0, floorLayer()) * layer;
+
+  for (int row = 0; row < height; row += stride)
+  {
+    const T *line = (const T *)((const uint8_t *)data + row * step);
+    const float ray_y = (float)((row - cy) / fy);
+
+    for (int i = 0; i < columns; i++)
+      depth_[i] = (float)(line[i * stride] * scale);
+
+    // Camera to world and cell of every sample of the row, -1 outside
+    for (int i = 0; i < columns; i++)
+    {
+      float z = depth_[i];
+      float x = ray_x_[i] * z;
+      float y = ray_y * z;
+      float wx = rotation[0] * x + rotation[1] * y + rotation[2] * z + translation[0];
+      float wy = rotation[3] * x + rotation[4] * y + rotation[5] * z + translation[1];
+      float wz = rotation[6] * x + rotation[7] * y + rotation[8] * z + translation[2];
+      int ix = (int)floorf((wx - origin[0]) * inv_resolution);
+      int iy = (int)floorf((wy - origin[1]) * inv_resolution);
+      int iz = (int)floorf((wz - origin[2]) * inv_resolution);
+      bool is_valid = z >= min_depth && z <= max_depth && wz >= floor_height &&
+                      ix >= 0 && ix < size_x && iy >= 0 && iy < size_y && iz >= 0 && iz < size_z;
+      cell_[i] = is_valid ? (int32_t)((iz * size_y + iy) * size_x + ix) : -1;
+    }
+
+    // Down to the floor, once per frame: a camera over the table sees the
+    // tops of things, which are solid below
+    for (int i = 0; i < columns; i++)
+    {
+      for (int32_t cell = cell_[i]; cell >= floor_cells; cell -= layer)
+      {
+        if (seen_[cell] == frame_) break;
+        seen_[cell] = frame_;
+        int value = value_[cell] + config_.hit;
+        value_[cell] = value > config_.max_value ? config_.max_value : (uint8_t)value;
+      }
+    }
+  }
+}
+
+// 16UC1 and 32FC1 depth images
+template void VoxelGrid::insert<uint16_t>(const uint16_t *data, int width, int height, size_t step, double scale,
+                                          double fx, double fy, double cx, double cy,
+                                          const RigidTransform &camera_to_world, double stamp);
+template void VoxelGrid::insert<float>(const float *data, int width, int height, size_t step, double scale,
+                                       double fx, double fy, double cx, double cy,
+                                       const RigidTransform &camera_to_world, double stamp);
+
+}  // namespace open_manipulator_pick_and_place
@@ -0,0 +1,162 @@
+/*******************************************************************************
+* Copyright 2018 ROBOTIS CO., LTD.
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+*     http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*******************************************************************************/
+
+#include <gtest/gtest.h>
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+#include "open_manipulator_pick_and_place/depth_roi_sampler.h"
+
+using open_manipulator_pick_and_place::DepthRoiResult;
+using open_manipulator_pick_and_place::DepthRoiSampler;
+
+namespace
+{
+
+const int WIDTH = 640;
+const int HEIGHT = 480;
+const double FX = 600.0, FY = 600.0, CX = 320.0, CY = 240.0;
+
+// Camera looking straight down from CAMERA_HEIGHT above the table, so a
+// depth d is at world height CAMERA_HEIGHT - d
+const double CAMERA_HEIGHT = 0.500;  // [m]
+const double BOX_TOP = 0.450;        // depth of the box's top [m]
+const double BOX_HALF_SIZE = 0.030;  // [m]
+const double BOX_CENTER[3] = {0.010, -0.020, BOX_TOP};
+
+// 16UC1 frame in mm: the table, a box on it, holes (0) in both and a few
+// speckles on the box nearer than its top
+std::vector<uint16_t> makeFrame()
+{
+  std::vector<uint16_t> frame(WIDTH * HEIGHT);
+  for (int row = 0; row < HEIGHT; row++)
+  {
+    for (int col = 0; col < WIDTH; col++)
+    {
+      double x = (col - CX) / FX * BOX_TOP;
+      double y = (row - CY) / FY * BOX_TOP;
+      bool is_box = fabs(x - BOX_CENTER[0]) <= BOX_HALF_SIZE && fabs(y - BOX_CENTER[1]) <= BOX_HALF_SIZE;
+      uint16_t depth = is_box ? 450 : 500;
+      if ((row * WIDTH + col) % 7 == 0) depth = 0;                    // hole
+      else if (is_box && (row * WIDTH + col) % 31 == 0) depth = 300;  // speckle
+      frame[row * WIDTH + col] = depth;
+    }
+  }
+  return frame;
+}
+
+DepthRoiSampler makeSampler()
+{
+  DepthRoiSampler sampler;
+  sampler.setIntrinsics(FX, FY, CX, CY);
+  return sampler;
+}
+
+double worldHeight(double depth)
+{
+  return CAMERA_HEIGHT - depth;
+}
+
+}  // namespace
+
+TEST(DepthRoiSampler, ReadsBoxTopAndTable)
+{
+  std::vector<uint16_t> frame = makeFrame();
+  DepthRoiSampler sampler = makeSampler();
+
+  DepthRoiResult result;
+  ASSERT_TRUE(sampler.sample(&frame[0], WIDTH, HEIGHT, WIDTH * sizeof(uint16_t), 0.001,
+                             BOX_CENTER, BOX_HALF_SIZE, &result));
+  EXPECT_NEAR(0.450, result.top_depth, 1e-6);
+  EXPECT_NEAR(0.500, result.support_depth, 1e-6);
+
+  // Holes are left out
+  double half = FX * BOX_HALF_SIZE / BOX_TOP;
+  EXPECT_GT(result.top_pixels, 0);
+  EXPECT_LT(result.top_pixels, (int)(4.0 * (half + 1.0) * (half + 1.0)));
+  EXPECT_GT(result.support_pixels, 0);
+}
+
+TEST(DepthRoiSampler, ReadsFloatFrameWithNan)
+{
+  std::vector<uint16_t> frame = makeFrame();
+  std::vector<float> metres(frame.size());
+  for (size_t i = 0; i < frame.size(); i++)
+    metres[i] = frame[i] == 0 ? NAN : frame[i] * 0.001f;
+  DepthRoiSampler sampler = makeSampler();
+
+  DepthRoiResult result;
+  ASSERT_TRUE(sampler.sample(&metres[0], WIDTH, HEIGHT, WIDTH * sizeof(float), 1.0,
+                             BOX_CENTER, BOX_HALF_SIZE, &result));
+  EXPECT_NEAR(0.450, result.top_depth, 1e-6);
+  EXPECT_NEAR(0.500, result.support_depth, 1e-6);
+}
+
+TEST(DepthRoiSampler, FailsWithoutEnoughValidPixels)
+{
+  std::vector<uint16_t> frame(WIDTH * HEIGHT, 0);
+  DepthRoiSampler sampler = makeSampler();
+
+  DepthRoiResult result;
+  EXPECT_FALSE(sampler.sample(&frame[0], WIDTH, HEIGHT, WIDTH * sizeof(uint16_t), 0.001,
+                              BOX_CENTER, BOX_HALF_SIZE, &result));
+
+  // Footprint outside the image
+  frame = makeFrame();
+  const double outside[3] = {1.0, 0.0, BOX_TOP};
+  EXPECT_FALSE(sampler.sample(&frame[0], WIDTH, HEIGHT, WIDTH * sizeof(uint16_t), 0.001,
+                              outside, BOX_HALF_SIZE, &result));
+}
+
+TEST(DepthRoiSampler, PickAndPlaceHeights)
+{
+  std::vector<uint16_t> frame = makeFrame();
+  DepthRoiSampler sampler = makeSampler();
+
+  DepthRoiResult result;
+  ASSERT_TRUE(sampler.sample(&frame[0], WIDTH, HEIGHT, WIDTH * sizeof(uint16_t), 0.001,
+                             BOX_CENTER, BOX_HALF_SIZE, &result));
+  double top_z = worldHeight(result.top_depth);
+  double support_z = worldHeight(result.support_depth);
+  EXPECT_NEAR(0.050, top_z, 1e-6);
+  EXPECT_NEAR(0.000, support_z, 1e-6);
+
+  // 20 mm under the top of the 50 mm box
+  double held_height;
+  double pick_z = open_manipulator_pick_and_place::pickGraspHeight(top_z, support_z, 0.020, 0.010, &held_height);
+  EXPECT_NEAR(0.030, pick_z, 1e-6);
+  EXPECT_NEAR(0.030, held_height, 1e-6);
+
+  // On top of a 50 mm box: bottom of the held box 5 mm above it
+  EXPECT_NEAR(0.085, open_manipulator_pick_and_place::placeGraspHeight(top_z, held_height, 0.005), 1e-6);
+
+  // Never closer than grasp_min_height to the table
+  pick_z = open_manipulator_pick_and_place::pickGraspHeight(top_z, support_z, 0.045, 0.010, &held_height);
+  EXPECT_NEAR(0.010, pick_z, 1e-6);
+  EXPECT_NEAR(0.010, held_height, 1e-6);
+
+  // Table not seen: below the top, and the held height unknown
+  pick_z = open_manipulator_pick_and_place::pickGraspHeight(top_z, NAN, 0.020, 0.010, &held_height);
+  EXPECT_NEAR(0.030, pick_z, 1e-6);
+  EXPECT_LT(held_height, 0.0);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}